@@ -5,12 +5,13 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 
-static int createNonblocking()
+static int createNonblocking(sa_family_t family)
 {
-    // 第一步socket生成listenfd
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    // 第一步socket生成listenfd，协议族跟着监听地址走(IPv4/IPv6/Unix域)
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0)
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
@@ -25,13 +26,30 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
      * 是其他subLoop所不具有的，其他subLoop处理的是IO请求
      */
     : loop_(loop),
-      acceptSocket_(createNonblocking()),
+      acceptSocket_(createNonblocking(listenAddr.family())),
       // 只要是可能发生事件的东西都会被封装成channel，Acceptor会发生读事件，因为网络请求就是读写的过程，所以被封转成channel
       acceptChannel_(loop, acceptSocket_.fd()),
-      listenning_(false)
+      maxAcceptsPerWakeup_(kDefaultMaxAcceptsPerWakeup),
+      listenning_(false),
+      paused_(false),
+      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
     acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    // 只有调用方要求时才开启SO_REUSEPORT，否则同一个端口被别的进程重复绑定时不会报错，问题会被悄悄掩盖
+    acceptSocket_.setReusePort(reuseport);
+    /**
+     * Unix域socket绑定的是文件系统中的一个路径，上一次运行留下的socket文件会让bind失败(EADDRINUSE)，
+     * SO_REUSEADDR对它不起作用，所以bind之前先删掉，析构时再删掉自己创建的文件；抽象命名空间的地址没有文件
+     */
+    if (listenAddr.family() == AF_UNIX)
+    {
+        std::string path = listenAddr.toIp();
+        if (!path.empty() && path[0] != '@')
+        {
+            ::unlink(path.c_str());
+            unixPath_ = path;
+        }
+    }
     // 第二步bind绑定套接字与Socket对象
     acceptSocket_.bindAddress(listenAddr);
     /**
@@ -52,6 +70,14 @@ Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
+    if (!unixPath_.empty())
+    {
+        ::unlink(unixPath_.c_str());
+    }
 }
 
 void Acceptor::listen()
@@ -64,38 +90,109 @@ void Acceptor::listen()
      * 而这个handleRead的逻辑是第四步的accept产生connfd，执行newConnectionCallback_函数，
      * 这个newConnectionCallback_在TcpServer类中被设置为newConnection函数
      */
-    acceptChannel_.enableReading();
+    if (!paused_)
+    {
+        acceptChannel_.enableReading();
+    }
 }
 
-// listenfd有事件发生了，就是有新用户连接了
+void Acceptor::pause()
+{
+    paused_ = true;
+    if (acceptChannel_.isReading())
+    {
+        acceptChannel_.disableReading();
+    }
+}
+
+void Acceptor::resume()
+{
+    paused_ = false;
+    if (listenning_ && !acceptChannel_.isReading())
+    {
+        acceptChannel_.enableReading();
+    }
+}
+
+/**
+ * listenfd有事件发生了，就是有新用户连接了
+ *
+ * 一次唤醒中循环accept，直到全连接队列取空(EAGAIN)或者达到maxAcceptsPerWakeup_，
+ * 这样突发大量连接时不需要每个连接都经过一轮epoll_wait，达到上限时剩下的连接留给下一轮(LT模式会再次通知)
+ */
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr;
-    // 完成第四步也就是最后一个步骤accept产生connfd，只不过这是在listenfd发生了读事件时在回调函数handleRead中实现的
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if (connfd >= 0)
+    // 上次EMFILE之后没能重新占住预留的fd(那一瞬间fd又被别的线程用掉了)，每次accept之前重试，直到重新占住
+    if (idleFd_ < 0)
+    {
+        idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    for (int i = 0; i < maxAcceptsPerWakeup_; ++i)
     {
-        if (newConnectionCallback_)
+        InetAddress peerAddr;
+        // 完成第四步也就是最后一个步骤accept产生connfd，只不过这是在listenfd发生了读事件时在回调函数handleRead中实现的
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0)
         {
-            /**
-             * 这里的newConnectionCallback_(connfd, peerAddr)就相当于newConnection(connfd, peerAddr)
-             * newConnection(connfd, peerAddr)是在TcpServer中定义并且通过acceptor设置的
-             * 具体为在TcpServer的构造函数中调用acceptor_->setNewConnectionCallback(newConnection)
-             */
-            newConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
+            if (newConnectionBatchCallback_)
+            {
+                accepted_.push_back(AcceptedConnection(connfd, peerAddr));
+            }
+            else if (newConnectionCallback_)
+            {
+                /**
+                 * 这里的newConnectionCallback_(connfd, peerAddr)就相当于newConnection(connfd, peerAddr)
+                 * newConnection(connfd, peerAddr)是在TcpServer中定义并且通过acceptor设置的
+                 */
+                newConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
+            }
+            else
+            {
+                // 如果没有预先设置回调函数，则表示客户端无法处理新用户链接
+                ::close(connfd);
+            }
         }
         else
         {
-            // 如果没有预先设置回调函数，则表示客户端无法处理新用户链接
-            ::close(connfd);
+            // EAGAIN说明已经取空了，是正常的退出条件；握手完成前就被对端重置的连接直接跳过
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            if (errno == ECONNABORTED || errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+            if (errno == EMFILE && idleFd_ >= 0)
+            {
+                LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__, __FUNCTION__, __LINE__);
+                // 用预留的fd把这个连接接出来直接关闭，对端会立刻感知到连接被拒绝，而不是一直等在队列里
+                ::close(idleFd_);
+                int rejected = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+                if (rejected >= 0)
+                {
+                    ::close(rejected);
+                }
+                idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if (idleFd_ < 0)
+                {
+                    LOG_ERROR("%s:%s:%d reopen idle fd err:%d, retry on next accept \n", __FILE__, __FUNCTION__, __LINE__, errno);
+                }
+                // fd耗尽时即使队列已经空了accept也返回EMFILE，所以只有真的接出了连接才继续
+                if (rejected >= 0)
+                {
+                    continue;
+                }
+            }
+            break;
         }
     }
-    else
+
+    if (!accepted_.empty())
     {
-        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
-        if (errno == EMFILE)
-        {
-            LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__, __FUNCTION__, __LINE__);
-        }
+        // 把这一批连接交给TcpServer，轮询找到subLoop，每个subLoop唤醒一次
+        newConnectionBatchCallback_(accepted_);
+        accepted_.clear();
     }
 }
\ No newline at end of file
@@ -2,11 +2,14 @@
 #include "noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
+#include "InetAddress.h"
 
 #include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
 class EventLoop;
-class InetAddress;
 
 /**
  * acceptor运行在mainloop中的mainReactor中，其用封装了listenfd的acceptChannel处理accept请求，
@@ -27,6 +30,12 @@ class Acceptor : noncopyable
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress &)>;
+    // 一次accept得到的connfd和对端地址
+    using AcceptedConnection = std::pair<int, InetAddress>;
+    using NewConnectionBatchCallback = std::function<void(std::vector<AcceptedConnection> &)>;
+
+    // 每次listenfd可读时最多accept的连接数
+    static const int kDefaultMaxAcceptsPerWakeup = 128;
     // 有了loop才能访问其中的poller，才能把当前acceptor的channel扔给poller，让poller监听channel上面的fd和事件(有无新用户链接)
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
     ~Acceptor();
@@ -36,9 +45,27 @@ public:
         newConnectionCallback_ = cb;
     }
 
+    /**
+     * 设置之后一次唤醒中accept到的所有连接会攒成一批，只回调一次，newConnectionCallback_不再被调用
+     * TcpServer用它来按subLoop分组，一个subLoop一批连接只需要唤醒一次
+     */
+    void setNewConnectionBatchCallback(const NewConnectionBatchCallback &cb)
+    {
+        newConnectionBatchCallback_ = cb;
+    }
+
+    void setMaxAcceptsPerWakeup(int n) { maxAcceptsPerWakeup_ = n; }
+
     bool listenning() const { return listenning_; }
     void listen();
 
+    /**
+     * 暂停/恢复接受新连接，只是把listenfd从poller上摘下来，新连接会留在内核的全连接队列里
+     * 必须在loop_线程中调用，TcpServer在连接数达到上限时用它来做准入控制
+     */
+    void pause();
+    void resume();
+
 private:
     /**
      * poller监听的listenfd发生感兴趣的事件之后调用的回调函数
@@ -77,5 +104,19 @@ private:
      * 注意这里是NewConnectionCallback，不是TcpConnection中的ConnectionCallback，两者相差了一个New
      **/
     NewConnectionCallback newConnectionCallback_;
+    NewConnectionBatchCallback newConnectionBatchCallback_;
+    // 复用的批次缓冲区，只在loop_线程中访问
+    std::vector<AcceptedConnection> accepted_;
+    int maxAcceptsPerWakeup_;
     bool listenning_;
+    bool paused_;
+
+    /**
+     * 预留的空闲fd，进程的fd用完(EMFILE)时先关掉它腾出一个fd，把连接accept出来立刻关掉，再重新占住
+     * 否则连接一直留在全连接队列里，LT模式下listenfd会一直可读，mainLoop就会空转占满CPU
+     */
+    int idleFd_;
+
+    // 监听Unix域的路径时记下socket文件，析构时删除
+    std::string unixPath_;
 };
\ No newline at end of file
@@ -7,10 +7,14 @@
 /**
  * 从fd上读取数据  Poller工作在LT模式
  * Buffer缓冲区是有大小的！ 但是从fd上读数据的时候，却不知道tcp数据最终的大小
+ *
+ * maxBytes用来限制一个连接一轮循环最多读多少数据(见TcpConnection::setReadBudget)，
+ * 读不完的数据留在内核缓冲区里，LT模式下一轮poll会再次上报
  */
-ssize_t Buffer::readFd(int fd, int *saveErrno)
+ssize_t Buffer::readFd(int fd, int *saveErrno, size_t maxBytes)
 {
-    char extrabuf[65536] = {0}; // 栈上的内存空间  64K
+    // 栈上的内存空间  64K，readv只往里面写、只读出写入的部分，不需要每次都清零
+    char extrabuf[65536];
 
     struct iovec vec[2];
 
@@ -22,7 +26,20 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     vec[1].iov_base = extrabuf;
     vec[1].iov_len = sizeof extrabuf;
 
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    if (maxBytes != 0)
+    {
+        if (writable >= maxBytes)
+        {
+            vec[0].iov_len = maxBytes;
+            iovcnt = 1;
+        }
+        else if (iovcnt == 2 && writable + sizeof extrabuf > maxBytes)
+        {
+            vec[1].iov_len = maxBytes - writable;
+        }
+    }
+
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
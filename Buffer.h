@@ -4,6 +4,8 @@
 #include <string>
 #include <algorithm>
 
+#include "MemoryPool.h"
+
 /**
  * 网络库底层的缓冲器类型定义
  * 基于非阻塞IO的服务端编程中，一个缓冲区还是非常有必要的
@@ -61,6 +63,12 @@ public:
         return begin() + readerIndex_;
     }
 
+    // 可以原地修改的可读数据，比如WebSocket直接在inputBuffer_里去掉载荷的掩码
+    char *mutablePeek()
+    {
+        return begin() + readerIndex_;
+    }
+
     // onMessage string <- Buffer，retrieve函数的功能就是把目前缓冲区中能够读取的数据给处理了
     void retrieve(size_t len)
     {
@@ -129,8 +137,8 @@ public:
         return begin() + writerIndex_;
     }
 
-    // 从fd上读取数据
-    ssize_t readFd(int fd, int *saveErrno);
+    // 从fd上读取数据，maxBytes不为0时一次最多读maxBytes字节
+    ssize_t readFd(int fd, int *saveErrno, size_t maxBytes = 0);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int *saveErrno);
 
@@ -198,7 +206,8 @@ private:
         }
     }
 
-    std::vector<char> buffer_;
+    // 每个连接都有两个Buffer，底层数组从当前线程的MemoryPool中分配，连接关闭之后留给下一个连接复用
+    std::vector<char, PoolAllocator<char>> buffer_;
     size_t readerIndex_;
     size_t writerIndex_;
 };
\ No newline at end of file
@@ -4,12 +4,20 @@
 #include <functional>
 
 class Buffer;
+class EventLoop;
 class TcpConnection;
 class Timestamp;
+class UdpSocket;
+struct Datagram;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
 using MessageCallback = std::function<void(const TcpConnectionPtr &, Buffer *, Timestamp)>;
-using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+// 连接即将从当前loop迁移到参数中的loop，在当前loop线程中调用
+using MigrateCallback = std::function<void(const TcpConnectionPtr &, EventLoop *)>;
+
+// UdpSocket一次recvmmsg收到的一批数据报，datagrams只在回调执行期间有效
+using DatagramCallback = std::function<void(UdpSocket *, const Datagram *, size_t, Timestamp)>;
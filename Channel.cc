@@ -1,6 +1,7 @@
 #include "Channel.h"
 #include "EventLoop.h"
 #include "Logger.h"
+#include "LoopRefCounted.h"
 
 #include <sys/epoll.h>
 
@@ -15,7 +16,10 @@ Channel::Channel(EventLoop *loop, int fd)
       events_(0),
       revents_(0),
       index_(-1),
-      tied_(false)
+      tied_(false),
+      loopTie_(nullptr),
+      flushQueued_(false),
+      readyQueued_(false)
 {
 }
 
@@ -30,6 +34,11 @@ void Channel::tie(const std::shared_ptr<void> &obj)
     tied_ = true;
 }
 
+void Channel::tie(LoopRefCounted *obj)
+{
+    loopTie_ = obj;
+}
+
 /**
  * 当改变channel所表示fd的events事件后，update负责在poller里面更改fd相应的事件epoll_ctl
  * poller和channel是两个不同的模块，在channel中是无法访问到poller的，自然也无法调用poller中的方法，
@@ -48,13 +57,33 @@ void Channel::update()
 // 在channel所属的EventLoop中，把当前的channel删除掉
 void Channel::remove()
 {
+    // 从loop上摘下来之后就不能再被flush了，迁移到新loop的数据由新loop继续发送
+    if (flushQueued_)
+    {
+        flushQueued_ = false;
+        loop_->cancelFlush(this);
+    }
+    // ready同理，迁移之后由新loop重新登记
+    if (readyQueued_)
+    {
+        readyQueued_ = false;
+        loop_->cancelReady(this);
+    }
     loop_->removeChannel(this);
 }
 
 // fd得到poller通知以后处理事件
 void Channel::handleEvent(Timestamp receiveTime)
 {
-    if (tied_)
+    if (loopTie_)
+    {
+        // 回调里可能释放掉对象(以及这个channel)，先把指针取到局部变量里
+        LoopRefCounted *obj = loopTie_;
+        obj->retainInLoop();
+        handleEventWithGuard(receiveTime);
+        obj->releaseInLoop();
+    }
+    else if (tied_)
     {
         std::shared_ptr<void> guard = tie_.lock();
         if (guard)
@@ -68,10 +97,69 @@ void Channel::handleEvent(Timestamp receiveTime)
     }
 }
 
+void Channel::requestFlush()
+{
+    if (!flushQueued_)
+    {
+        flushQueued_ = true;
+        loop_->queueFlush(this);
+    }
+}
+
+void Channel::handleFlush()
+{
+    flushQueued_ = false;
+    if (!flushCallback_)
+    {
+        return;
+    }
+    if (loopTie_)
+    {
+        LoopRefCounted *obj = loopTie_;
+        obj->retainInLoop();
+        flushCallback_();
+        obj->releaseInLoop();
+    }
+    else
+    {
+        flushCallback_();
+    }
+}
+
+void Channel::requestReady()
+{
+    if (!readyQueued_)
+    {
+        readyQueued_ = true;
+        loop_->queueReady(this);
+    }
+}
+
+// 先清掉标志再回调，回调里可以再次requestReady，登记到再下一轮
+void Channel::handleReady(Timestamp receiveTime)
+{
+    readyQueued_ = false;
+    if (!readyCallback_)
+    {
+        return;
+    }
+    if (loopTie_)
+    {
+        LoopRefCounted *obj = loopTie_;
+        obj->retainInLoop();
+        readyCallback_(receiveTime);
+        obj->releaseInLoop();
+    }
+    else
+    {
+        readyCallback_(receiveTime);
+    }
+}
+
 // 根据poller通知的channel发生的具体事件， 由channel负责调用具体的回调操作
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO("channel handleEvent revents:%d\n", revents_);
+    LOG_DEBUG("channel handleEvent revents:%d\n", revents_);
 
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN))
     {
@@ -7,6 +7,7 @@
 #include <memory>
 
 class EventLoop;
+class LoopRefCounted;
 
 /**
  * 理清楚  EventLoop、Channel、Poller之间的关系   《= Reactor模型上对应 Demultiplex
@@ -36,9 +37,27 @@ public:
     void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
     void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
     void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+    void setFlushCallback(EventCallback cb) { flushCallback_ = std::move(cb); }
+    void setReadyCallback(ReadEventCallback cb) { readyCallback_ = std::move(cb); }
+
+    // 请求在本轮循环处理完所有活跃channel之后调用一次flush回调，见EventLoop::flushChannels
+    void requestFlush();
+    // 由EventLoop::flushChannels调用
+    void handleFlush();
+
+    /**
+     * 请求下一轮循环调用一次ready回调，不管fd上有没有事件，见EventLoop::queueReady
+     * 用于这一轮没处理完、主动让出的channel，登记之后到ready回调被调用之前isReadyQueued()为true
+     **/
+    void requestReady();
+    bool isReadyQueued() const { return readyQueued_; }
+    // 由EventLoop::runReadyChannels调用
+    void handleReady(Timestamp receiveTime);
 
     // 防止当channel被手动remove掉，channel还在执行回调操作
     void tie(const std::shared_ptr<void> &);
+    // 同样的保护，用对象上只在loop线程中修改的计数代替weak_ptr::lock，处理一次事件不需要原子操作
+    void tie(LoopRefCounted *obj);
 
     int fd() const { return fd_; }
     int events() const { return events_; }
@@ -102,6 +121,8 @@ public:
      * 这也是被称为多路复用的原因
      **/
     EventLoop *ownerLoop() { return loop_; }
+    // 只能在channel已经从原来loop的poller上remove之后调用，见TcpConnection::migrateTo
+    void setOwnerLoop(EventLoop *loop) { loop_ = loop; }
     void remove();
 
 private:
@@ -124,6 +145,9 @@ private:
 
     std::weak_ptr<void> tie_;
     bool tied_;
+    LoopRefCounted *loopTie_;
+    bool flushQueued_;
+    bool readyQueued_;
 
     /**
      * 因为channel通道里面能够获知fd最终发生的具体的事件revents，所以它负责调用具体事件的回调操作
@@ -134,4 +158,6 @@ private:
     EventCallback writeCallback_;
     EventCallback closeCallback_;
     EventCallback errorCallback_;
+    EventCallback flushCallback_;
+    ReadEventCallback readyCallback_;
 };
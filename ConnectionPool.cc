@@ -0,0 +1,220 @@
+#include "ConnectionPool.h"
+
+#include <future>
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+ConnectionPool::ConnectionPool(const std::vector<EventLoop *> &loops,
+                               const InetAddress &serverAddr,
+                               const std::string &nameArg,
+                               int connectionsPerLoop)
+    : serverAddr_(serverAddr),
+      name_(nameArg),
+      connectionsPerLoop_(connectionsPerLoop),
+      maxInFlight_(64),
+      initRetryDelayMs_(Connector::kDefaultInitRetryDelayMs),
+      maxRetryDelayMs_(Connector::kDefaultMaxRetryDelayMs),
+      healthCheckInterval_(0.0),
+      healthCheckTimeout_(0.0) {
+    for (EventLoop *loop : loops) {
+        std::unique_ptr<LoopPool> pool(new LoopPool);
+        pool->loop = loop;
+        pool->next = 0;
+        pools_[loop] = std::move(pool);
+    }
+}
+
+/**
+ * 和~TcpServer一样，每个loop上的连接投递到各自的loop中销毁，并且等它执行完
+ *
+ * TcpClient析构时连接的关闭是投递到loop中稍后执行的，关闭时还会回调onConnection，
+ * 所以先把连接上指向Member的回调换掉，之后Member就可以安全地删除了
+ */
+ConnectionPool::~ConnectionPool() {
+    for (auto &item : pools_) {
+        LoopPool *pool = item.second.get();
+        std::promise<void> done;
+        pool->loop->runInLoop([pool, &done]() {
+            pool->loop->cancel(pool->healthTimer);
+            for (std::unique_ptr<Member> &member : pool->members) {
+                if (member->conn) {
+                    member->conn->setConnectionCallback(
+                        [](const TcpConnectionPtr &) {});
+                    member->conn->setMessageCallback(
+                        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+                            buf->retrieveAll();
+                        });
+                }
+            }
+            pool->members.clear();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+void ConnectionPool::start() {
+    for (auto &item : pools_) {
+        LoopPool *pool = item.second.get();
+        pool->loop->runInLoop([this, pool]() { startInLoop(pool); });
+    }
+}
+
+void ConnectionPool::startInLoop(LoopPool *pool) {
+    for (int i = 0; i < connectionsPerLoop_; ++i) {
+        std::unique_ptr<Member> member(new Member);
+        member->client.reset(new TcpClient(
+            pool->loop, serverAddr_, name_ + "-" + std::to_string(i)));
+        member->inFlight = 0;
+        member->lastProgressUs = 0;
+        member->probeSentUs = 0;
+
+        // 每条连接的回调都带着自己的Member，收到数据时不需要再查找
+        Member *m = member.get();
+        member->client->setConnectionCallback(
+            [this, m](const TcpConnectionPtr &conn) { onConnection(m, conn); });
+        member->client->setMessageCallback(
+            [this, m](const TcpConnectionPtr &conn, Buffer *buf,
+                      Timestamp receiveTime) {
+                onMessage(m, conn, buf, receiveTime);
+            });
+        member->client->setRetryDelay(initRetryDelayMs_, maxRetryDelayMs_);
+        member->client->enableRetry();
+        member->client->connect();
+        pool->members.push_back(std::move(member));
+    }
+
+    if (healthCheckInterval_ > 0.0) {
+        pool->healthTimer = pool->loop->runEvery(
+            healthCheckInterval_, [this, pool]() { checkHealth(pool); });
+    }
+}
+
+/**
+ * 连接断开时还没有完成的请求不会再有响应了，计数直接清零，
+ * 用户的ConnectionCallback会收到断开的通知，由用户决定这些请求是重试还是报错
+ */
+void ConnectionPool::onConnection(Member *member,
+                                  const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        member->conn = conn;
+        member->lastProgressUs = Timestamp::now().microSecondsSinceEpoch();
+    } else {
+        member->conn.reset();
+    }
+    member->inFlight = 0;
+    member->probeSentUs = 0;
+    if (connectionCallback_) {
+        connectionCallback_(conn);
+    }
+}
+
+void ConnectionPool::onMessage(Member *member, const TcpConnectionPtr &conn,
+                               Buffer *buf, Timestamp receiveTime) {
+    // 收到任何数据都说明连接是活的
+    member->lastProgressUs = receiveTime.microSecondsSinceEpoch();
+    member->probeSentUs = 0;
+    if (messageCallback_) {
+        messageCallback_(conn, buf, receiveTime);
+    } else {
+        buf->retrieveAll();
+    }
+}
+
+TcpConnectionPtr ConnectionPool::acquire(EventLoop *loop) {
+    auto it = pools_.find(loop);
+    if (it == pools_.end()) {
+        LOG_ERROR("ConnectionPool::acquire [%s] - loop %p not in pool \n",
+                  name_.c_str(), loop);
+        return TcpConnectionPtr();
+    }
+    LoopPool *pool = it->second.get();
+
+    // 最少未完成请求：连接数很少(一般是个位数)，直接线性扫描
+    Member *best = nullptr;
+    size_t n = pool->members.size();
+    for (size_t i = 0; i < n; ++i) {
+        Member *member = pool->members[(pool->next + i) % n].get();
+        if (!member->conn || member->inFlight >= maxInFlight_) {
+            continue;
+        }
+        if (best == nullptr || member->inFlight < best->inFlight) {
+            best = member;
+        }
+    }
+    if (best == nullptr) {
+        return TcpConnectionPtr();
+    }
+    pool->next = (pool->next + 1) % n;
+    if (best->inFlight++ == 0) {
+        // 空闲的连接从现在开始等响应，超时从这里算起
+        best->lastProgressUs = Timestamp::now().microSecondsSinceEpoch();
+    }
+    return best->conn;
+}
+
+void ConnectionPool::release(const TcpConnectionPtr &conn) {
+    Member *member = findMember(conn);
+    if (member && member->inFlight > 0) {
+        --member->inFlight;
+    }
+}
+
+int ConnectionPool::connectedCount(EventLoop *loop) const {
+    auto it = pools_.find(loop);
+    if (it == pools_.end()) {
+        return 0;
+    }
+    int count = 0;
+    for (const std::unique_ptr<Member> &member : it->second->members) {
+        count += member->conn ? 1 : 0;
+    }
+    return count;
+}
+
+ConnectionPool::Member *ConnectionPool::findMember(
+    const TcpConnectionPtr &conn) const {
+    auto it = pools_.find(conn->getLoop());
+    if (it == pools_.end()) {
+        return nullptr;
+    }
+    for (const std::unique_ptr<Member> &member : it->second->members) {
+        if (member->conn == conn) {
+            return member.get();
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * 有请求在进行的连接如果一直收不到数据，说明上游卡住了，同样按超时处理；
+ * 完全空闲的连接靠探活回调产生一次往返，连接被中间设备悄悄丢弃时也能发现
+ */
+void ConnectionPool::checkHealth(LoopPool *pool) {
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    int64_t intervalUs = static_cast<int64_t>(
+        healthCheckInterval_ * Timestamp::kMicroSecondsPerSecond);
+    int64_t timeoutUs = static_cast<int64_t>(
+        healthCheckTimeout_ * Timestamp::kMicroSecondsPerSecond);
+
+    for (std::unique_ptr<Member> &member : pool->members) {
+        if (!member->conn) {
+            continue;
+        }
+        bool waiting = member->probeSentUs != 0 || member->inFlight > 0;
+        int64_t since = member->probeSentUs != 0 ? member->probeSentUs
+                                                 : member->lastProgressUs;
+        if (waiting && now - since >= timeoutUs) {
+            LOG_INFO("ConnectionPool::checkHealth [%s] - %s timed out \n",
+                     name_.c_str(), member->conn->name().c_str());
+            member->conn->forceClose();  // 断开之后TcpClient会重新连接
+        } else if (member->probeSentUs == 0 &&
+                   now - member->lastProgressUs >= intervalUs &&
+                   healthCheckCallback_) {
+            member->probeSentUs = now;
+            healthCheckCallback_(member->conn);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "TcpClient.h"
+#include "TimerId.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * 到同一个上游服务的连接池，每个loop各有一组常驻的连接
+ *
+ * 服务端处理请求时经常要再调用别的服务，每次临时建连接的握手延迟往往比请求本身还长。
+ * ConnectionPool在每个loop上预先建好connectionsPerLoop条连接(每条连接是一个开启了重连的TcpClient)，
+ * subLoop上的请求只使用本loop的连接，整个调用过程不跨线程，也不需要加锁
+ *
+ * 连接池不理解上层协议，只负责按"未完成的请求数"挑选连接：
+ * acquire挑出本loop上未完成请求最少、且没有达到maxInFlight的已连接连接，计数加一；
+ * 收到响应之后由用户在MessageCallback中调用release，计数减一
+ *
+ * 健康检查：每隔healthCheckInterval秒检查一次，空闲超过一个间隔的连接调用一次探活回调(比如发一个ping)，
+ * 探活之后超过healthCheckTimeout秒还没有收到任何数据的连接被强制关闭，由TcpClient重新连接
+ *
+ * 除了构造、析构和设置函数，其它操作都只能在对应的loop线程中调用
+ **/
+class ConnectionPool : noncopyable {
+   public:
+    using HealthCheckCallback = std::function<void(const TcpConnectionPtr &)>;
+
+    /**
+     * loops一般是TcpServer::threadPool()->getAllLoops()，必须在TcpServer::start之后获取，
+     * 这些loop在连接池析构之前必须一直运行
+     **/
+    ConnectionPool(const std::vector<EventLoop *> &loops,
+                   const InetAddress &serverAddr, const std::string &nameArg,
+                   int connectionsPerLoop = 4);
+    ~ConnectionPool();
+
+    // 以下设置必须在start之前调用
+    void setMaxInFlight(int maxInFlight) { maxInFlight_ = maxInFlight; }
+    void setHealthCheck(double interval, double timeout,
+                        const HealthCheckCallback &probe) {
+        healthCheckInterval_ = interval;
+        healthCheckTimeout_ = timeout;
+        healthCheckCallback_ = probe;
+    }
+    // 连接池中连接的回调，MessageCallback中收到完整的响应之后调用release
+    void setConnectionCallback(const ConnectionCallback &cb) {
+        connectionCallback_ = cb;
+    }
+    void setMessageCallback(const MessageCallback &cb) {
+        messageCallback_ = cb;
+    }
+    void setRetryDelay(int initDelayMs, int maxDelayMs) {
+        initRetryDelayMs_ = initDelayMs;
+        maxRetryDelayMs_ = maxDelayMs;
+    }
+
+    // 在每个loop上建立连接，可以在任意线程调用
+    void start();
+
+    /**
+     * 在loop线程中调用，loop必须是构造时传入的loop之一
+     * 返回本loop上未完成请求最少的可用连接，并把它的计数加一；所有连接都断开或者都满了时返回空
+     **/
+    TcpConnectionPtr acquire(EventLoop *loop);
+    // 在连接所在的loop线程中调用，一个acquire对应一个release
+    void release(const TcpConnectionPtr &conn);
+
+    // loop上当前已连接的连接数
+    int connectedCount(EventLoop *loop) const;
+
+   private:
+    // 连接池中的一条连接
+    struct Member {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn;   // 已连接时不为空
+        int inFlight;            // 已经acquire还没有release的请求数
+        int64_t lastProgressUs;  // 最近一次收到数据，或者从空闲变成有请求的时间
+        int64_t probeSentUs;     // 发出探活的时间，0表示没有在等探活的结果
+    };
+
+    // 一个loop上的所有连接，只在这个loop线程中访问
+    struct LoopPool {
+        EventLoop *loop;
+        std::vector<std::unique_ptr<Member>> members;
+        size_t next;  // 未完成请求数相同时轮流使用，避免总是压在第一条连接上
+        TimerId healthTimer;
+    };
+
+    void startInLoop(LoopPool *pool);
+    void checkHealth(LoopPool *pool);
+    void onConnection(Member *member, const TcpConnectionPtr &conn);
+    void onMessage(Member *member, const TcpConnectionPtr &conn, Buffer *buf,
+                   Timestamp receiveTime);
+    Member *findMember(const TcpConnectionPtr &conn) const;
+
+    const InetAddress serverAddr_;
+    const std::string name_;
+    const int connectionsPerLoop_;
+    int maxInFlight_;
+    int initRetryDelayMs_;
+    int maxRetryDelayMs_;
+    double healthCheckInterval_;
+    double healthCheckTimeout_;
+    HealthCheckCallback healthCheckCallback_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+
+    // 构造之后不再增删，任意loop线程都可以不加锁地查找自己的LoopPool
+    std::unordered_map<EventLoop *, std::unique_ptr<LoopPool>> pools_;
+};
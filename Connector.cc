@@ -0,0 +1,228 @@
+#include "Connector.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+static int createNonblocking(sa_family_t family) {
+    int sockfd =
+        ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        LOG_FATAL("%s:%s:%d connect socket create err:%d \n", __FILE__,
+                  __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd) {
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
+        return errno;
+    }
+    return optval;
+}
+
+/**
+ * 连接本机上一个没有监听的端口时，如果这个端口恰好就是内核分配给我们的临时端口，
+ * TCP的同时打开会让socket连上它自己，看起来连接成功了，实际上读到的都是自己写的数据
+ */
+static bool isSelfConnect(int sockfd) {
+    sockaddr_storage local;
+    sockaddr_storage peer;
+    socklen_t addrlen = sizeof local;
+    ::memset(&local, 0, sizeof local);
+    ::memset(&peer, 0, sizeof peer);
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0) {
+        return false;
+    }
+    addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr *)&peer, &addrlen) < 0) {
+        return false;
+    }
+    if (local.ss_family == AF_INET) {
+        const sockaddr_in *local4 = (const sockaddr_in *)&local;
+        const sockaddr_in *peer4 = (const sockaddr_in *)&peer;
+        return local4->sin_port == peer4->sin_port &&
+               local4->sin_addr.s_addr == peer4->sin_addr.s_addr;
+    }
+    if (local.ss_family == AF_INET6) {
+        const sockaddr_in6 *local6 = (const sockaddr_in6 *)&local;
+        const sockaddr_in6 *peer6 = (const sockaddr_in6 *)&peer;
+        return local6->sin6_port == peer6->sin6_port &&
+               ::memcmp(&local6->sin6_addr, &peer6->sin6_addr,
+                        sizeof local6->sin6_addr) == 0;
+    }
+    // Unix域socket没有临时端口，不会连上自己
+    return false;
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      connect_(false),
+      state_(kDisconnected),
+      initRetryDelayMs_(kDefaultInitRetryDelayMs),
+      maxRetryDelayMs_(kDefaultMaxRetryDelayMs),
+      retryDelayMs_(kDefaultInitRetryDelayMs),
+      random_(std::random_device()()) {
+    LOG_DEBUG("Connector ctor[%p] \n", this);
+}
+
+Connector::~Connector() {
+    LOG_DEBUG("Connector dtor[%p] \n", this);
+    if (channel_) {
+        LOG_ERROR("Connector dtor[%p] with a pending connect \n", this);
+    }
+}
+
+void Connector::setRetryDelay(int initDelayMs, int maxDelayMs) {
+    initRetryDelayMs_ = initDelayMs;
+    maxRetryDelayMs_ = std::max(initDelayMs, maxDelayMs);
+    retryDelayMs_ = initDelayMs;
+}
+
+void Connector::start() {
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop() {
+    if (connect_ && state_ == kDisconnected) {
+        connect();
+    } else {
+        LOG_DEBUG("Connector::startInLoop do not connect \n");
+    }
+}
+
+void Connector::stop() {
+    connect_ = false;
+    loop_->runInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+// 正在退避等待的重试取消掉，正在进行的connect直接关闭sockfd
+void Connector::stopInLoop() {
+    loop_->cancel(retryTimer_);
+    if (state_ == kConnecting) {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::restart() {
+    setState(kDisconnected);
+    retryDelayMs_ = initRetryDelayMs_;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::connect() {
+    int sockfd = createNonblocking(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(),
+                        serverAddr_.getSockLen());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno) {
+        case 0:
+        case EINPROGRESS:
+        case EINTR:
+        case EISCONN:
+            connecting(sockfd);
+            break;
+
+        // 对端暂时不可用或者本地端口暂时用光了，过一会再试
+        case EAGAIN:
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+        case ECONNREFUSED:
+        case ENETUNREACH:
+            retry(sockfd);
+            break;
+
+        // 地址、权限之类的错误，重试也不会成功
+        default:
+            LOG_ERROR("Connector::connect to %s error:%d \n",
+                      serverAddr_.toIpPort().c_str(), savedErrno);
+            ::close(sockfd);
+            break;
+    }
+}
+
+void Connector::connecting(int sockfd) {
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback([this]() { handleWrite(); });
+    channel_->setErrorCallback([this]() { handleError(); });
+    // 连接结果出来之前TcpClient可能已经放掉了Connector，处理事件期间要保证它还活着
+    channel_->tie(shared_from_this());
+    channel_->enableWriting();
+}
+
+int Connector::removeAndResetChannel() {
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 当前可能正处在这个channel的handleEvent里，不能在这里delete
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel() { channel_.reset(); }
+
+void Connector::handleWrite() {
+    if (state_ != kConnecting) {
+        return;
+    }
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err) {
+        LOG_ERROR("Connector::handleWrite - SO_ERROR = %d %s \n", err,
+                  strerror(err));
+        retry(sockfd);
+    } else if (isSelfConnect(sockfd)) {
+        LOG_ERROR("Connector::handleWrite - Self connect \n");
+        retry(sockfd);
+    } else {
+        setState(kConnected);
+        if (connect_) {
+            newConnectionCallback_(sockfd);
+        } else {
+            ::close(sockfd);
+        }
+    }
+}
+
+// connect失败时EPOLLERR和EPOLLOUT一般会一起上报，这里先处理掉，handleWrite看到状态已经变了就直接返回
+void Connector::handleError() {
+    if (state_ == kConnecting) {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_ERROR("Connector::handleError - SO_ERROR = %d %s \n", err,
+                  strerror(err));
+        retry(sockfd);
+    }
+}
+
+void Connector::retry(int sockfd) {
+    ::close(sockfd);
+    setState(kDisconnected);
+    if (!connect_) {
+        return;
+    }
+    // 在[retryDelayMs_/2, retryDelayMs_]之间随机
+    int half = retryDelayMs_ / 2;
+    int delayMs = half + static_cast<int>(random_() % (retryDelayMs_ - half + 1));
+    LOG_INFO("Connector::retry - retry connecting to %s in %d milliseconds. \n",
+             serverAddr_.toIpPort().c_str(), delayMs);
+    retryTimer_ = loop_->runAfter(
+        delayMs / 1000.0,
+        std::bind(&Connector::startInLoop, shared_from_this()));
+    retryDelayMs_ = std::min(retryDelayMs_ * 2, maxRetryDelayMs_);
+}
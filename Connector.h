@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+
+#include "InetAddress.h"
+#include "TimerId.h"
+#include "noncopyable.h"
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接，和Acceptor对应：Acceptor被动地accept出connfd，Connector主动地connect出sockfd，
+ * 两者拿到fd之后都交给上层(TcpServer/TcpClient)包装成TcpConnection
+ *
+ * 非阻塞connect一般不会立即完成，返回EINPROGRESS，这时把sockfd包装成channel关注EPOLLOUT，
+ * 可写时用getsockopt(SO_ERROR)取出connect的最终结果；连接失败时按指数退避重试：
+ * 第n次失败后等待 min(maxDelayMs, initDelayMs * 2^n) 的后一半区间内的随机时间，
+ * 避免大量客户端在服务端重启之后同一时刻一起重连
+ *
+ * start/stop可以在任意线程调用，其它操作都在loop线程中进行
+ **/
+class Connector : noncopyable,
+                  public std::enable_shared_from_this<Connector> {
+   public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    static const int kDefaultInitRetryDelayMs = 500;
+    static const int kDefaultMaxRetryDelayMs = 30 * 1000;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    // 连接成功之后sockfd的所有权交给回调
+    void setNewConnectionCallback(const NewConnectionCallback &cb) {
+        newConnectionCallback_ = cb;
+    }
+    // 必须在start之前调用
+    void setRetryDelay(int initDelayMs, int maxDelayMs);
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+    void start();    // 可以在任意线程调用
+    void restart();  // 只能在loop线程中调用，退避时间从头开始
+    void stop();     // 可以在任意线程调用
+
+   private:
+    enum States { kDisconnected, kConnecting, kConnected };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    // connect返回EINPROGRESS，等EPOLLOUT
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    // 关掉这次失败的sockfd，过一段退避时间之后再重新connect
+    void retry(int sockfd);
+    // 把channel从poller上摘下来，返回它的fd，channel本身等这一轮事件处理完再销毁
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;  // 用户是否希望连接，stop之后为false
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_;  // 只在connect进行中存在
+    NewConnectionCallback newConnectionCallback_;
+
+    int initRetryDelayMs_;
+    int maxRetryDelayMs_;
+    int retryDelayMs_;  // 下一次失败之后的退避上限
+    TimerId retryTimer_;
+    std::minstd_rand random_;  // 退避的随机抖动，只在loop线程中使用
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
@@ -36,8 +36,8 @@ EPollPoller::~EPollPoller() { ::close(epollfd_); }
  *
  **/
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
-    // 实际上应该用LOG_DEBUG输出日志更为合理
-    LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__,
+    // 每一轮循环都会执行，只在调试时输出
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__,
              channels_.size());
 
     /**
@@ -67,7 +67,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
     Timestamp now(Timestamp::now());
 
     if (numEvents > 0) {
-        LOG_INFO("%d events happened \n", numEvents);
+        LOG_DEBUG("%d events happened \n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
         // 监听的所有fd感兴趣的事件都发生了，则需要对events_扩容
         if (numEvents == events_.size()) {
@@ -95,7 +95,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
  */
 void EPollPoller::updateChannel(Channel *channel) {
     const int index = channel->index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__,
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__,
              channel->fd(), channel->events(), index);
 
     if (index == kNew || index == kDeleted) {
@@ -124,7 +124,7 @@ void EPollPoller::removeChannel(Channel *channel) {
     int fd = channel->fd();
     channels_.erase(fd);
 
-    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, fd);
 
     int index = channel->index();
     if (index == kAdded) {
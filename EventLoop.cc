@@ -5,11 +5,13 @@
 #include <sys/eventfd.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 
 #include "Channel.h"
 #include "Logger.h"
 #include "Poller.h"
+#include "TimerQueue.h"
 
 // 防止一个线程创建多个EventLoop   thread_local
 __thread EventLoop *t_loopInThisThread = nullptr;
@@ -17,6 +19,9 @@ __thread EventLoop *t_loopInThisThread = nullptr;
 // 定义默认的Poller IO复用接口的超时时间
 const int kPollTimeMs = 10000;
 
+// 统计loop忙碌比例的窗口长度
+const int64_t kBusyWindowUs = 100 * 1000;
+
 // 创建wakeupfd，用来notify唤醒subReactor处理新来的channel
 int createEventfd() {
     int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -33,11 +38,23 @@ int createEventfd() {
 EventLoop::EventLoop()
     : looping_(false),
       quit_(false),
-      callingPendingFunctors_(false),
       threadId_(CurrentThread::tid()),
       poller_(Poller::newDefaultPoller(this)),
       wakeupFd_(createEventfd()),
-      wakeupChannel_(new Channel(this, wakeupFd_)) {
+      wakeupChannel_(new Channel(this, wakeupFd_)),
+      timerQueue_(new TimerQueue(this)),
+      callingPendingFunctors_(false),
+      hasPendingFunctors_(false),
+      connectionCount_(0),
+      windowStartUs_(0),
+      windowBusyUs_(0),
+      busyPermille_(0),
+      pollStartUs_(0),
+      busyPollUs_(0),
+      avgIdleUs_(0),
+      spinUs_(0) {
+    splicePipe_[0] = -1;
+    splicePipe_[1] = -1;
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if (t_loopInThisThread) {
         LOG_FATAL("Another EventLoop %p exists in this thread %d \n",
@@ -76,9 +93,32 @@ EventLoop::~EventLoop() {
     wakeupChannel_->disableAll();
     wakeupChannel_->remove();
     ::close(wakeupFd_);
+    resetSplicePipe();
     t_loopInThisThread = nullptr;
 }
 
+bool EventLoop::splicePipe(int *readFd, int *writeFd) {
+    if (splicePipe_[0] < 0 &&
+        ::pipe2(splicePipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        LOG_ERROR("EventLoop::splicePipe pipe2 error:%d \n", errno);
+        splicePipe_[0] = -1;
+        splicePipe_[1] = -1;
+        return false;
+    }
+    *readFd = splicePipe_[0];
+    *writeFd = splicePipe_[1];
+    return true;
+}
+
+void EventLoop::resetSplicePipe() {
+    if (splicePipe_[0] >= 0) {
+        ::close(splicePipe_[0]);
+        ::close(splicePipe_[1]);
+        splicePipe_[0] = -1;
+        splicePipe_[1] = -1;
+    }
+}
+
 // 开启事件循环
 void EventLoop::loop() {
     looping_ = true;
@@ -86,8 +126,11 @@ void EventLoop::loop() {
 
     LOG_INFO("EventLoop %p start looping \n", this);
 
+    int64_t pollStartUs = Timestamp::now().microSecondsSinceEpoch();
+    windowStartUs_ = pollStartUs;
     while (!quit_) {
         activeChannels_.clear();
+        pollStartUs_.store(pollStartUs, std::memory_order_relaxed);
         /**
          * 监听两类fd   一种是client的connfd，一种wakeupfd
          * clientfd就是正常和客户端通信的socket链接，wakeupfd是mainloop和subloop之间通信的eventfd
@@ -95,7 +138,20 @@ void EventLoop::loop() {
          *
          * activeChannels_是所有被epoll监听所发生了相应事件的fd相对应封装成的channel所构成的集合
          **/
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        int busyPollUs = busyPollUs_.load(std::memory_order_relaxed);
+        // 循环之外(比如loop()之前)登记的flush也不能等到下一个事件才处理
+        if (!readyChannels_.empty() || !flushChannels_.empty()) {
+            pollReturnTime_ = poller_->poll(0, &activeChannels_);
+        } else if (busyPollUs > 0) {
+            pollReturnTime_ = busyPoll(pollStartUs, busyPollUs);
+        } else {
+            pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        }
+        pollStartUs_.store(0, std::memory_order_relaxed);
+
+        // 上一轮让出的channel排在本轮所有事件之前，处理期间再次让出的排到下一轮，每个channel每轮最多一次
+        runReadyChannels();
+
         for (Channel *channel : activeChannels_) {
             /**
              * Poller监听哪些channel发生事件了，然后上报给EventLoop，通知channel处理相应的事件
@@ -108,6 +164,9 @@ void EventLoop::loop() {
             channel->handleEvent(pollReturnTime_);
         }
 
+        // 批量写模式下，本轮处理事件时send的数据在这里一次性写出去
+        flushChannels();
+
         /**
          * 执行当前EventLoop事件循环需要处理的回调操作，channel有事件回调函数，EventLoop也有回调函数
          *
@@ -126,6 +185,12 @@ void EventLoop::loop() {
          * 把channel添加到channel列表、把channel去往subloop注册等操作，这些操作就是由回调函数去驱动的
          */
         doPendingFunctors();
+        flushChannels();
+
+        // 本轮循环结束的时刻同时也是下一轮poll开始的时刻
+        int64_t iterationEndUs = Timestamp::now().microSecondsSinceEpoch();
+        updateBusyRatio(iterationEndUs);
+        pollStartUs = iterationEndUs;
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
@@ -212,7 +277,7 @@ void EventLoop::runInLoop(Functor cb) {
         cb();
     } else  // 在非当前loop线程中执行cb , 就需要唤醒loop所在线程，执行cb
     {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 // 把cb放入队列中，唤醒loop所在的线程，执行cb
@@ -220,7 +285,8 @@ void EventLoop::queueInLoop(Functor cb) {
     // 因为pendingFunctors_可能被多个线程访问，所以需要设置锁
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
+        pendingFunctors_.emplace_back(std::move(cb));
+        hasPendingFunctors_.store(true, std::memory_order_release);
     }
 
     /**
@@ -255,6 +321,21 @@ void EventLoop::handleRead() {
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, Functor cb) {
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, Functor cb) {
+    return runAt(addTime(Timestamp::now(), delay), std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, Functor cb) {
+    return timerQueue_->addTimer(std::move(cb),
+                                 addTime(Timestamp::now(), interval), interval);
+}
+
+void EventLoop::cancel(TimerId timerId) { timerQueue_->cancel(timerId); }
+
 // 用来唤醒loop所在的线程的
 // 向wakeupfd_写一个数据，wakeupChannel就发生读事件，当前loop线程就会被唤醒
 void EventLoop::wakeup() {
@@ -278,23 +359,149 @@ void EventLoop::removeChannel(Channel *channel) {
     poller_->removeChannel(channel);
 }
 
+void EventLoop::queueFlush(Channel *channel) {
+    flushChannels_.push_back(channel);
+}
+
+void EventLoop::cancelFlush(Channel *channel) {
+    for (Channel *&queued : flushChannels_) {
+        if (queued == channel) {
+            queued = nullptr;
+        }
+    }
+}
+
+// flush回调中可能又有channel被登记或者被移除，所以按下标遍历，并且每次重新读取元素
+void EventLoop::flushChannels() {
+    for (size_t i = 0; i < flushChannels_.size(); ++i) {
+        Channel *channel = flushChannels_[i];
+        if (channel) {
+            channel->handleFlush();
+        }
+    }
+    flushChannels_.clear();
+}
+
+void EventLoop::queueReady(Channel *channel) {
+    readyChannels_.push_back(channel);
+}
+
+void EventLoop::cancelReady(Channel *channel) {
+    for (Channel *&queued : readyChannels_) {
+        if (queued == channel) {
+            queued = nullptr;
+        }
+    }
+    for (Channel *&queued : runningReadyChannels_) {
+        if (queued == channel) {
+            queued = nullptr;
+        }
+    }
+}
+
+// ready回调里可能把别的channel移除掉(cancelReady置空)，所以按下标遍历，并且每次重新读取元素
+void EventLoop::runReadyChannels() {
+    if (readyChannels_.empty()) {
+        return;
+    }
+    runningReadyChannels_.swap(readyChannels_);
+    for (size_t i = 0; i < runningReadyChannels_.size(); ++i) {
+        Channel *channel = runningReadyChannels_[i];
+        if (channel) {
+            channel->handleReady(pollReturnTime_);
+        }
+    }
+    runningReadyChannels_.clear();
+}
+
 bool EventLoop::hasChannel(Channel *channel) {
     return poller_->hasChannel(channel);
 }
 
 void EventLoop::doPendingFunctors()  // 执行回调
 {
-    std::vector<Functor> functors;
+    /**
+     * 大部分循环都没有回调要执行，先不加锁看一眼标志
+     * 别的线程在这之后才放进来的回调会wakeup，下一轮循环再执行；本线程放进来的回调在这之前就已经能看到了
+     */
+    if (!hasPendingFunctors_.load(std::memory_order_acquire)) {
+        return;
+    }
     callingPendingFunctors_ = true;
 
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);
+        callingFunctors_.swap(pendingFunctors_);
+        hasPendingFunctors_.store(false, std::memory_order_relaxed);
     }
 
-    for (const Functor &functor : functors) {
+    for (const Functor &functor : callingFunctors_) {
         functor();  // 执行当前loop需要执行的回调操作
     }
+    callingFunctors_.clear();
 
     callingPendingFunctors_ = false;
+}
+
+/**
+ * 空转期间每次poll都不阻塞，有事件(包括wakeup)就立即返回；空转窗口用完还没有事件才真正阻塞
+ *
+ * 每轮的空闲时间(从上一轮结束到poll返回)参与滑动平均，不管这一轮有没有空转，
+ * 这样流量变密之后平均值会降下来，重新开始空转。阻塞很久的那一轮按4倍maxSpinUs计算，
+ * 流量恢复之后几轮就能回到空转状态
+ */
+Timestamp EventLoop::busyPoll(int64_t pollStartUs, int maxSpinUs) {
+    Timestamp now;
+    bool gotEvents = false;
+    if (avgIdleUs_ <= maxSpinUs) {
+        int64_t windowUs = std::min<int64_t>(maxSpinUs, 2 * avgIdleUs_ + 1);
+        do {
+            now = poller_->poll(0, &activeChannels_);
+            gotEvents = !activeChannels_.empty();
+        } while (!gotEvents && !quit_ &&
+                 now.microSecondsSinceEpoch() - pollStartUs < windowUs);
+        spinUs_.store(spinUs_.load(std::memory_order_relaxed) +
+                          (now.microSecondsSinceEpoch() - pollStartUs),
+                      std::memory_order_relaxed);
+    }
+    if (!gotEvents && !quit_) {
+        now = poller_->poll(kPollTimeMs, &activeChannels_);
+    }
+
+    int64_t idleUs = now.microSecondsSinceEpoch() - pollStartUs;
+    idleUs = std::min<int64_t>(std::max<int64_t>(idleUs, 0), 4 * maxSpinUs);
+    avgIdleUs_ += (idleUs - avgIdleUs_) / 8;
+    return now;
+}
+
+/**
+ * 一轮循环 = 阻塞在poll上的空闲时间 + 处理活跃channel和pendingFunctors的忙碌时间
+ * 忙碌时间从poll返回开始算，到本轮doPendingFunctors结束为止
+ */
+void EventLoop::updateBusyRatio(int64_t iterationEndUs) {
+    int64_t busyUs =
+        iterationEndUs - pollReturnTime_.microSecondsSinceEpoch();
+    windowBusyUs_ += busyUs > 0 ? busyUs : 0;
+
+    int64_t windowUs = iterationEndUs - windowStartUs_;
+    if (windowUs >= kBusyWindowUs) {
+        int64_t permille = windowBusyUs_ * 1000 / windowUs;
+        busyPermille_.store(static_cast<int>(permille > 1000 ? 1000 : permille),
+                            std::memory_order_relaxed);
+        windowStartUs_ = iterationEndUs;
+        windowBusyUs_ = 0;
+    }
+}
+
+/**
+ * busyPermille_只在每轮循环结束时更新，一个之前很忙、现在已经阻塞在poll上很久的loop
+ * 会一直保留着旧的数值，所以阻塞时间超过一个统计窗口的loop直接认为是空闲的
+ */
+int EventLoop::busyPermille() const {
+    int64_t since = pollStartUs_.load(std::memory_order_relaxed);
+    if (since != 0 &&
+        Timestamp::now().microSecondsSinceEpoch() - since >= kBusyWindowUs) {
+        return 0;
+    }
+    return busyPermille_.load(std::memory_order_relaxed);
 }
\ No newline at end of file
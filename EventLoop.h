@@ -7,11 +7,13 @@
 #include <vector>
 
 #include "CurrentThread.h"
+#include "TimerId.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
 
 /**
  * 一个Eventloop相当于就是一个reactor，Eventloop类中有成员变量Poller，
@@ -55,6 +57,16 @@ class EventLoop : noncopyable {
     // 把cb放入队列中，唤醒loop所在的线程，执行cb
     void queueInLoop(Functor cb);
 
+    /**
+     * 定时器，都可以在任意线程调用，cb在loop线程中执行
+     * runAt：在time时刻执行；runAfter：delay秒之后执行；runEvery：每隔interval秒执行一次
+     * 返回的TimerId用来cancel，定时器已经执行完或者已经取消时cancel什么都不做
+     **/
+    TimerId runAt(Timestamp time, Functor cb);
+    TimerId runAfter(double delay, Functor cb);
+    TimerId runEvery(double interval, Functor cb);
+    void cancel(TimerId timerId);
+
     // 用来唤醒loop所在的线程的
     void wakeup();
 
@@ -63,12 +75,65 @@ class EventLoop : noncopyable {
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    /**
+     * 本轮所有活跃channel处理完之后，调用channel的flush回调，只能在loop线程中调用
+     * 在doPendingFunctors中登记的channel，在这些回调执行完之后再flush一次
+     * 由Channel::requestFlush/cancelFlush调用，同一个channel一轮只会登记一次
+     **/
+    void queueFlush(Channel *channel);
+    void cancelFlush(Channel *channel);
+
+    /**
+     * ready列表：上一轮没处理完、主动让出的channel，下一轮循环在处理poller上报的事件之前先调用它们的ready回调，
+     * 不需要等新的epoll事件；ready列表不为空时poll不阻塞。只能在loop线程中调用
+     * 由Channel::requestReady/remove调用，同一个channel只会登记一次，本轮处理期间登记的留到下一轮
+     **/
+    void queueReady(Channel *channel);
+    void cancelReady(Channel *channel);
+
+    /**
+     * loop内共用的一对非阻塞管道，供TcpConnection::relayTo用splice(2)在两个socket之间搬运数据，只能在loop线程中调用
+     * 第一次使用时创建，创建失败返回false。管道是共用的，使用者每次用完都必须把管道读空
+     * 管道里残留了读不出来的数据时调用resetSplicePipe丢掉这对管道，下次使用时重新创建
+     **/
+    bool splicePipe(int *readFd, int *writeFd);
+    void resetSplicePipe();
+
     // 判断EventLoop对象是否在自己的线程里面
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
+    /**
+     * 负载信息，供EventLoopThreadPool按负载选择subLoop，可以在任意线程读取
+     * connectionCount：当前归属于这个loop的TcpConnection个数，由TcpConnection构造和析构时维护
+     * busyPermille：最近一个统计窗口内loop处理事件和回调所占的时间比例(千分比)，不包含阻塞在poll上的时间
+     **/
+    int connectionCount() const { return connectionCount_; }
+    void adjustConnectionCount(int delta) { connectionCount_ += delta; }
+    int busyPermille() const;
+
+    /**
+     * 忙轮询：没有事件的时候先用超时为0的epoll_wait空转一段时间再阻塞，省掉线程睡眠/唤醒的延迟，代价是空转的CPU
+     * maxSpinUs为0表示关闭(默认)。空转多久根据最近的事件间隔自适应：事件间隔的滑动平均是avg，
+     * 每次空转min(maxSpinUs, 2*avg)，avg超过maxSpinUs说明事件太稀疏，空转大多落空，直接阻塞
+     * 可以在任意线程设置，下一轮循环生效
+     **/
+    void setBusyPoll(int maxSpinUs) {
+        busyPollUs_.store(maxSpinUs, std::memory_order_relaxed);
+    }
+    // 累计空转的时间(微秒)，即忙轮询额外消耗的CPU时间，可以在任意线程读取
+    int64_t busyPollSpinUs() const {
+        return spinUs_.load(std::memory_order_relaxed);
+    }
+
    private:
     void handleRead();         // wake up
     void doPendingFunctors();  // 执行回调
+    void flushChannels();
+    void runReadyChannels();
+    // 先空转再阻塞的poll，见setBusyPoll
+    Timestamp busyPoll(int64_t pollStartUs, int maxSpinUs);
+    // 每轮循环结束时累计忙碌时间，窗口满了就更新一次busyPermille_
+    void updateBusyRatio(int64_t iterationEndUs);
 
     using ChannelList = std::vector<Channel *>;
 
@@ -120,11 +185,40 @@ class EventLoop : noncopyable {
     // wakeupChannel_应该包含wakeupFd_和其感兴趣的事件
     std::unique_ptr<Channel> wakeupChannel_;
 
+    // 定时器用timerfd注册在poller上，所以放在poller_之后构造、之前析构
+    std::unique_ptr<TimerQueue> timerQueue_;
+
+    // 见splicePipe，没有创建时为-1
+    int splicePipe_[2];
+
     // 一个EventLoop包含一个Poller，一个Poller包含多个Channel，所以一个EventLoop包含多个channel
     ChannelList activeChannels_;
 
-    std::atomic_bool
-        callingPendingFunctors_;  // 标识当前loop是否有需要执行的回调操作
+    // 标识当前loop是否正在执行回调，只在loop线程中读写(queueInLoop先判断了isInLoopThread)
+    bool callingPendingFunctors_;
+    // pendingFunctors_不为空，没有回调的时候doPendingFunctors不用加锁
+    std::atomic_bool hasPendingFunctors_;
     std::vector<Functor> pendingFunctors_;  // 存储loop需要执行的所有的回调操作
+    // doPendingFunctors换出来的回调，执行完清空但保留容量，两个vector来回交换，稳定之后不再分配
+    std::vector<Functor> callingFunctors_;
     std::mutex mutex_;  // 互斥锁，用来保护上面vector容器的线程安全操作
+
+    // 等待本轮结束时flush的channel，只在loop线程中访问，cancelFlush会把对应的元素置空
+    std::vector<Channel *> flushChannels_;
+    // readyChannels_是下一轮要处理的，runningReadyChannels_是本轮正在处理的，两者来回交换，cancelReady两个都要找
+    std::vector<Channel *> readyChannels_;
+    std::vector<Channel *> runningReadyChannels_;
+
+    std::atomic_int connectionCount_;
+    // 忙碌时间的统计窗口，只在loop线程中读写
+    int64_t windowStartUs_;
+    int64_t windowBusyUs_;
+    std::atomic_int busyPermille_;
+    // loop阻塞在poll上的起始时间，不在poll中时为0，用来识别长时间空闲的loop
+    std::atomic<int64_t> pollStartUs_;
+
+    // 忙轮询，见setBusyPoll；avgIdleUs_只在loop线程中读写
+    std::atomic_int busyPollUs_;
+    int64_t avgIdleUs_;
+    std::atomic<int64_t> spinUs_;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "EventLoopThread.h"
 
 #include "EventLoop.h"
+#include "ThreadPlacement.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
                                  const std::string &name)
@@ -12,7 +13,8 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
       mutex_(),
       cond_(),
       // threadFunc是线程函数，callback_是线程被创建时的回调函数，两者不是一个概念
-      callback_(cb) {}
+      callback_(cb),
+      numaNode_(-1) {}
 
 EventLoopThread::~EventLoopThread() {
     exiting_ = true;
@@ -67,6 +69,14 @@ EventLoop *EventLoopThread::startLoop() {
  * 所以我们应该自然而然想到在线程函数中调用 loop.loop();
  */
 void EventLoopThread::threadFunc() {
+    /**
+     * 绑定cpu和设置内存策略必须在构造EventLoop之前完成，
+     * 这样EventLoop、Poller以及之后这个线程里分配的连接对象都落在本地节点上
+     **/
+    if (!cpus_.empty() || numaNode_ >= 0) {
+        ThreadPlacement::apply(cpus_, numaNode_);
+    }
+
     /**
      * 创建一个独立的eventloop，和上面的线程是一一对应的，one loop per thread
      *
@@ -4,6 +4,7 @@
 #include <functional>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "Thread.h"
 #include "noncopyable.h"
@@ -21,6 +22,15 @@ class EventLoopThread : noncopyable {
 
     EventLoop *startLoop();
 
+    /**
+     * 设置线程绑定的cpu集合以及内存优先分配的NUMA节点，必须在startLoop之前调用
+     * 具体的取值由ThreadPlacement根据线程池中的编号计算得出
+     **/
+    void setPlacement(const std::vector<int> &cpus, int numaNode) {
+        cpus_ = cpus;
+        numaNode_ = numaNode;
+    }
+
    private:
     void threadFunc();
 
@@ -30,4 +40,7 @@ class EventLoopThread : noncopyable {
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallback callback_;
+
+    std::vector<int> cpus_;
+    int numaNode_;
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <memory>
 
+#include "EventLoop.h"
 #include "EventLoopThread.h"
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop,
@@ -10,7 +11,10 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop,
       name_(nameArg),
       started_(false),
       numThreads_(0),
-      next_(0) {}
+      next_(0),
+      busyPollUs_(0),
+      loadBalance_(kRoundRobin),
+      random_(std::random_device()()) {}
 
 EventLoopThreadPool::~EventLoopThreadPool() {}
 
@@ -51,6 +55,10 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb) {
          * 并且把初始化成功的loop放入vector中
          */
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        std::vector<int> cpus;
+        int node = -1;
+        placement_.resolve(i, &cpus, &node);
+        t->setPlacement(cpus, node);
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(
             t->startLoop());  // 底层创建线程，绑定一个新的EventLoop，并返回该loop的地址
@@ -60,6 +68,22 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb) {
     if (numThreads_ == 0 && cb) {
         cb(baseLoop_);
     }
+
+    if (busyPollUs_ != 0) {
+        for (EventLoop *loop : getAllLoops()) {
+            loop->setBusyPoll(busyPollUs_);
+        }
+    }
+}
+
+// start之前只记下来，start时再设置到具体的loop上，那时才知道有没有subLoop
+void EventLoopThreadPool::setBusyPoll(int maxSpinUs) {
+    busyPollUs_ = maxSpinUs;
+    if (started_) {
+        for (EventLoop *loop : getAllLoops()) {
+            loop->setBusyPoll(maxSpinUs);
+        }
+    }
 }
 
 /**
@@ -67,21 +91,82 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb) {
  *
  * 为什么要提供这个接口呢？因为当server接收到http请求之后会将生成的connfd封装成channel发送给各个subLoop
  * 而这个过程中其实就是挑选Loop并且发送的过程，挑选Loop之前则需要获取到Loop，那么getNextLoop就提供了这个功能
+ *
  */
-EventLoop *EventLoopThreadPool::getNextLoop() {
+EventLoop *EventLoopThreadPool::getNextLoop() { return selectLoop(nullptr); }
+
+EventLoop *EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr) {
+    return selectLoop(&peerAddr);
+}
+
+EventLoop *EventLoopThreadPool::selectLoop(const InetAddress *peerAddr) {
     EventLoop *loop = baseLoop_;
+    if (loops_.empty()) {
+        return loop;
+    }
+    if (selector_) {
+        return selector_(loops_, peerAddr ? *peerAddr : InetAddress());
+    }
 
-    /**
-     * 通过轮询获取下一个处理事件的loop
-     * IO线程运行的是baseloop，工作线程运行的就是新创建的loop，
-     * IO线程一般都只处理连接时间，工作线程处理已连接用户的读写事件
-     **/
-    if (!loops_.empty()) {
-        loop = loops_[next_];
-        ++next_;
-        if (next_ >= loops_.size()) {
-            next_ = 0;
+    switch (loadBalance_) {
+        case kLeastConnections:
+            loop = loops_[0];
+            for (EventLoop *candidate : loops_) {
+                if (candidate->connectionCount() < loop->connectionCount()) {
+                    loop = candidate;
+                }
+            }
+            break;
+        case kLeastBusy: {
+            // 忙碌比例相同(比如都很空闲)的时候再比较连接数
+            loop = loops_[0];
+            int busy = loop->busyPermille();
+            for (size_t i = 1; i < loops_.size(); ++i) {
+                int candidateBusy = loops_[i]->busyPermille();
+                if (candidateBusy < busy ||
+                    (candidateBusy == busy && loops_[i]->connectionCount() <
+                                                  loop->connectionCount())) {
+                    loop = loops_[i];
+                    busy = candidateBusy;
+                }
+            }
+            break;
         }
+        case kPowerOfTwoChoices: {
+            size_t first = random_() % loops_.size();
+            size_t second = random_() % loops_.size();
+            if (loops_.size() > 1 && second == first) {
+                second = (first + 1) % loops_.size();
+            }
+            loop = loops_[second]->connectionCount() <
+                           loops_[first]->connectionCount()
+                       ? loops_[second]
+                       : loops_[first];
+            break;
+        }
+        case kHashByPeer:
+            // 只对ip做哈希，同一台主机上来的多条连接共享同一个loop
+            // Unix域的对端一般没有地址，哈希会把所有连接都放到一个loop上，也按轮询处理
+            if (peerAddr != nullptr && peerAddr->family() != AF_UNIX) {
+                uint32_t ip = peerAddr->ipHash();
+                loop = loops_[(ip * 2654435761u) % loops_.size()];
+                break;
+            }
+            // 不知道对端地址的时候退化成轮询
+            // fall through
+        case kRoundRobin:
+        default:
+            /**
+             * 通过轮询获取下一个处理事件的loop
+             * IO线程运行的是baseloop，工作线程运行的就是新创建的loop，
+             * IO线程一般都只处理连接时间，工作线程处理已连接用户的读写事件
+             **/
+            loop = loops_[next_];
+            ++next_;
+            if (next_ >= loops_.size()) {
+                next_ = 0;
+            }
+            break;
     }
 
     return loop;
@@ -93,4 +178,12 @@ std::vector<EventLoop *> EventLoopThreadPool::getAllLoops() {
     } else {
         return loops_;
     }
+}
+
+std::vector<int> EventLoopThreadPool::connectionCounts() {
+    std::vector<int> counts;
+    for (EventLoop *loop : getAllLoops()) {
+        counts.push_back(loop->connectionCount());
+    }
+    return counts;
 }
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
 #include <functional>
 #include <memory>
+#include <random>
 #include <string>
 #include <vector>
 
+#include "InetAddress.h"
+#include "ThreadPlacement.h"
 #include "noncopyable.h"
 
 class EventLoop;
@@ -12,17 +15,52 @@ class EventLoopThread;
 class EventLoopThreadPool : noncopyable {
    public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
+    // 自定义的subLoop选择策略，参数为所有的subLoop以及新连接的对端地址
+    using LoopSelector = std::function<EventLoop *(
+        const std::vector<EventLoop *> &, const InetAddress &)>;
+
+    /**
+     * 内置的subLoop选择策略
+     * kRoundRobin：轮询，muduo的默认做法
+     * kLeastConnections：选择当前连接数最少的loop
+     * kLeastBusy：选择最近一个统计窗口内忙碌比例最低的loop，忙碌比例由EventLoop::loop统计
+     * kPowerOfTwoChoices：随机挑两个loop，选连接数少的那个，避免所有新连接同时涌向同一个"最空闲"的loop
+     * kHashByPeer：按对端ip哈希，同一个客户端主机的连接总是落在同一个loop上
+     **/
+    enum LoadBalance {
+        kRoundRobin,
+        kLeastConnections,
+        kLeastBusy,
+        kPowerOfTwoChoices,
+        kHashByPeer,
+    };
 
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    // 设置subLoop线程在cpu/NUMA节点上的摆放策略，必须在start之前调用
+    void setThreadPlacement(const ThreadPlacement &placement) {
+        placement_ = placement;
+    }
+
+    // 所有subLoop的忙轮询时长，见EventLoop::setBusyPoll；没有subLoop时作用于baseLoop，start前后都可以调用
+    void setBusyPoll(int maxSpinUs);
 
     // 开启线程池中的所有线程
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
+    void setLoadBalance(LoadBalance loadBalance) { loadBalance_ = loadBalance; }
+    // 设置了自定义策略之后，setLoadBalance设置的内置策略就不再生效
+    void setLoopSelector(const LoopSelector &selector) { selector_ = selector; }
+
     // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
     EventLoop *getNextLoop();
+    // 按照当前的选择策略为来自peerAddr的新连接挑选一个subloop
+    EventLoop *getNextLoop(const InetAddress &peerAddr);
+
+    // 与getAllLoops()一一对应的各个loop当前的连接个数，用来观察负载是否均衡
+    std::vector<int> connectionCounts();
 
     std::vector<EventLoop *> getAllLoops();
 
@@ -30,6 +68,9 @@ class EventLoopThreadPool : noncopyable {
     const std::string name() const { return name_; }
 
    private:
+    // peerAddr为nullptr表示不知道对端地址
+    EventLoop *selectLoop(const InetAddress *peerAddr);
+
     /**
      * EventLoop loop;
      * 如果不通过TcpServer的setThreadNumber函数设置底层线程数量的话，那么muduo库就采用的是单线程模型
@@ -40,6 +81,12 @@ class EventLoopThreadPool : noncopyable {
     bool started_;
     int numThreads_;
     int next_;
+    ThreadPlacement placement_;
+    int busyPollUs_;
+    LoadBalance loadBalance_;
+    LoopSelector selector_;
+    // 只在baseLoop线程中被getNextLoop使用
+    std::minstd_rand random_;
     // 通过调用EventLoopThread的startloop函数就能获得EventLoop类型的指针变量，并且存放在loops_数组中
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
 
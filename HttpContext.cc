@@ -0,0 +1,399 @@
+#include "HttpContext.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Buffer.h"
+
+// 块大小那一行(十六进制长度加上扩展)的最大长度
+static const size_t kMaxChunkSizeLine = 1024;
+
+/**
+ * 返回[begin, end)中第一个c的位置，没有时返回nullptr
+ * SSE2是x86-64的基线指令集，不需要额外的编译选项：一次比较16个字节，movemask得到每个字节是否相等的位图，
+ * 最低的置位就是第一个匹配。请求行和头部一行一般几十个字节，比调用memchr省掉了函数调用和对齐处理的开销
+ */
+static const char *findByte(const char *begin, const char *end, char c) {
+#ifdef __SSE2__
+    const __m128i target = _mm_set1_epi8(c);
+    while (end - begin >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, target));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 16;
+    }
+#endif
+    for (; begin < end; ++begin) {
+        if (*begin == c) {
+            return begin;
+        }
+    }
+    return nullptr;
+}
+
+static bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+static bool equalsIgnoreCase(const char *begin, const char *end, const char *literal, size_t len) {
+    return static_cast<size_t>(end - begin) == len && ::strncasecmp(begin, literal, len) == 0;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 方法名区分大小写(RFC 9110 9.1)，先按长度分开，每个方法最多一次memcmp
+static HttpRequest::Method parseMethod(const char *begin, const char *end) {
+    switch (end - begin) {
+        case 3:
+            if (::memcmp(begin, "GET", 3) == 0) return HttpRequest::kGet;
+            if (::memcmp(begin, "PUT", 3) == 0) return HttpRequest::kPut;
+            break;
+        case 4:
+            if (::memcmp(begin, "POST", 4) == 0) return HttpRequest::kPost;
+            if (::memcmp(begin, "HEAD", 4) == 0) return HttpRequest::kHead;
+            break;
+        case 5:
+            if (::memcmp(begin, "PATCH", 5) == 0) return HttpRequest::kPatch;
+            break;
+        case 6:
+            if (::memcmp(begin, "DELETE", 6) == 0) return HttpRequest::kDelete;
+            break;
+        case 7:
+            if (::memcmp(begin, "OPTIONS", 7) == 0) return HttpRequest::kOptions;
+            break;
+    }
+    return HttpRequest::kInvalid;
+}
+
+HttpContext::HttpContext(size_t maxHeaderBytes, size_t maxBodyBytes)
+    : maxHeaderBytes_(maxHeaderBytes),
+      maxBodyBytes_(maxBodyBytes),
+      state_(kExpectRequestLine),
+      pos_(0),
+      scanned_(0),
+      chunkRemaining_(0),
+      trailerBytes_(0),
+      hasContentLength_(false),
+      errorStatus_(0),
+      continuePending_(false),
+      closing_(false) {}
+
+void HttpContext::finishRequest(Buffer *buf) {
+    buf->retrieve(pos_);
+    state_ = kExpectRequestLine;
+    pos_ = 0;
+    scanned_ = 0;
+    chunkRemaining_ = 0;
+    trailerBytes_ = 0;
+    hasContentLength_ = false;
+    continuePending_ = false;
+    request_.reset();
+}
+
+HttpContext::ParseResult HttpContext::fail(int status) {
+    errorStatus_ = status;
+    return kError;
+}
+
+/**
+ * Buffer的内容在两次调用之间可能被挪动过，所以每次都从peek()重新计算base，状态里只保存偏移
+ */
+HttpContext::ParseResult HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime) {
+    const char *base = buf->peek();
+    const char *end = base + buf->readableBytes();
+    while (true) {
+        switch (state_) {
+            case kExpectRequestLine:
+            case kExpectHeader:
+            case kExpectChunkSize:
+            case kExpectTrailer: {
+                const char *lineBegin = base + pos_;
+                const char *newline = findByte(base + scanned_, end, '\n');
+                if (newline == nullptr) {
+                    scanned_ = end - base;
+                    if (state_ == kExpectChunkSize) {
+                        if (static_cast<size_t>(end - lineBegin) > kMaxChunkSizeLine) {
+                            return fail(400);
+                        }
+                    } else if (state_ == kExpectTrailer) {
+                        if (trailerBytes_ + (end - lineBegin) > maxHeaderBytes_) {
+                            return fail(431);
+                        }
+                    } else if (scanned_ > maxHeaderBytes_) {
+                        return fail(431);
+                    }
+                    return kNeedMore;
+                }
+                pos_ = scanned_ = newline - base + 1;
+                // 行尾应该是"\r\n"，只有'\n'的也接受(RFC 9112 2.2)
+                const char *lineEnd = newline;
+                if (lineEnd > lineBegin && lineEnd[-1] == '\r') {
+                    --lineEnd;
+                }
+
+                if (state_ == kExpectRequestLine) {
+                    // 请求行之前的空行忽略掉，有的客户端会在上一个请求体之后多发一个"\r\n"
+                    if (lineEnd == lineBegin) {
+                        break;
+                    }
+                    request_.receiveTime_ = receiveTime;
+                    if (!parseRequestLine(base, lineBegin, lineEnd)) {
+                        return fail(errorStatus_);
+                    }
+                    state_ = kExpectHeader;
+                } else if (state_ == kExpectHeader) {
+                    if (pos_ > maxHeaderBytes_) {
+                        return fail(431);
+                    }
+                    bool ok = lineEnd == lineBegin ? endOfHead()
+                                                   : parseHeaderLine(base, lineBegin, lineEnd);
+                    if (!ok) {
+                        return fail(errorStatus_);
+                    }
+                } else if (state_ == kExpectChunkSize) {
+                    if (!parseChunkSize(lineBegin, lineEnd)) {
+                        return fail(errorStatus_);
+                    }
+                } else {
+                    // 尾部字段不支持，直接跳过，空行表示请求结束
+                    trailerBytes_ += pos_ - (lineBegin - base);
+                    if (trailerBytes_ > maxHeaderBytes_) {
+                        return fail(431);
+                    }
+                    if (lineEnd == lineBegin) {
+                        state_ = kGotAll;
+                    }
+                }
+                break;
+            }
+            case kExpectBody: {
+                // 请求体不拷贝，等它全部到达之后直接指向inputBuffer_
+                if (static_cast<size_t>(end - base) - pos_ < request_.contentLength_) {
+                    return kNeedMore;
+                }
+                request_.body_ = HttpRequest::Slice(static_cast<uint32_t>(pos_),
+                                                    static_cast<uint32_t>(request_.contentLength_));
+                pos_ += request_.contentLength_;
+                state_ = kGotAll;
+                break;
+            }
+            case kExpectChunkData: {
+                size_t n = std::min(chunkRemaining_, static_cast<size_t>(end - base) - pos_);
+                request_.decodedBody_.append(base + pos_, n);
+                pos_ += n;
+                chunkRemaining_ -= n;
+                if (chunkRemaining_ > 0) {
+                    return kNeedMore;
+                }
+                state_ = kExpectChunkDataEnd;
+                break;
+            }
+            case kExpectChunkDataEnd: {
+                if (static_cast<size_t>(end - base) - pos_ < 2) {
+                    return kNeedMore;
+                }
+                if (base[pos_] != '\r' || base[pos_ + 1] != '\n') {
+                    return fail(400);
+                }
+                pos_ += 2;
+                scanned_ = pos_;
+                state_ = kExpectChunkSize;
+                break;
+            }
+            case kGotAll:
+                request_.base_ = base;
+                return kGotRequest;
+        }
+    }
+}
+
+bool HttpContext::endOfHead() {
+    errorStatus_ = 400;
+    // 同时带Transfer-Encoding和Content-Length的请求可能被用来做请求走私，直接拒绝
+    if (request_.chunked_ && hasContentLength_) {
+        return false;
+    }
+    if (request_.chunked_) {
+        state_ = kExpectChunkSize;
+    } else if (request_.contentLength_ > 0) {
+        if (request_.contentLength_ > maxBodyBytes_) {
+            errorStatus_ = 413;
+            return false;
+        }
+        state_ = kExpectBody;
+    } else {
+        state_ = kGotAll;
+        return true;
+    }
+    continuePending_ = request_.expectContinue_;
+    return true;
+}
+
+// method SP request-target SP HTTP-version
+bool HttpContext::parseRequestLine(const char *base, const char *begin, const char *end) {
+    errorStatus_ = 400;
+    const char *space = findByte(begin, end, ' ');
+    if (space == nullptr) {
+        return false;
+    }
+    request_.method_ = parseMethod(begin, space);
+    if (request_.method_ == HttpRequest::kInvalid) {
+        errorStatus_ = 501;
+        return false;
+    }
+
+    const char *targetBegin = space + 1;
+    const char *targetEnd = findByte(targetBegin, end, ' ');
+    if (targetEnd == nullptr || targetEnd == targetBegin) {
+        return false;
+    }
+    const char *question = findByte(targetBegin, targetEnd, '?');
+    const char *pathEnd = question ? question : targetEnd;
+    request_.path_ = HttpRequest::Slice(static_cast<uint32_t>(targetBegin - base),
+                                        static_cast<uint32_t>(pathEnd - targetBegin));
+    if (question != nullptr) {
+        request_.query_ = HttpRequest::Slice(static_cast<uint32_t>(question + 1 - base),
+                                             static_cast<uint32_t>(targetEnd - question - 1));
+    }
+
+    const char *versionBegin = targetEnd + 1;
+    if (end - versionBegin != 8 || ::memcmp(versionBegin, "HTTP/1.", 7) != 0) {
+        if (end - versionBegin >= 5 && ::memcmp(versionBegin, "HTTP/", 5) == 0) {
+            errorStatus_ = 505;
+        }
+        return false;
+    }
+    if (versionBegin[7] == '1') {
+        request_.version_ = HttpRequest::kHttp11;
+    } else if (versionBegin[7] == '0') {
+        request_.version_ = HttpRequest::kHttp10;
+    } else {
+        errorStatus_ = 505;
+        return false;
+    }
+    return true;
+}
+
+// field-name ":" OWS field-value OWS
+bool HttpContext::parseHeaderLine(const char *base, const char *begin, const char *end) {
+    errorStatus_ = 400;
+    if (request_.numHeaders_ == HttpRequest::kMaxHeaders) {
+        errorStatus_ = 431;
+        return false;
+    }
+    const char *colon = findByte(begin, end, ':');
+    // 字段名里不能有空白，以空白开头的是已经废弃的折行写法，都不接受
+    if (colon == nullptr || colon == begin || std::find_if(begin, colon, isSpace) != colon) {
+        return false;
+    }
+    const char *valueBegin = colon + 1;
+    const char *valueEnd = end;
+    while (valueBegin < valueEnd && isSpace(*valueBegin)) {
+        ++valueBegin;
+    }
+    while (valueEnd > valueBegin && isSpace(valueEnd[-1])) {
+        --valueEnd;
+    }
+
+    // 先按字段名的长度过滤，大部分头部一次比较都不用做
+    switch (colon - begin) {
+        case 14:
+            if (equalsIgnoreCase(begin, colon, "Content-Length", 14)) {
+                if (valueBegin == valueEnd) {
+                    return false;
+                }
+                if (valueEnd - valueBegin > 18) {
+                    errorStatus_ = 413;
+                    return false;
+                }
+                size_t length = 0;
+                for (const char *p = valueBegin; p < valueEnd; ++p) {
+                    if (*p < '0' || *p > '9') {
+                        return false;
+                    }
+                    length = length * 10 + (*p - '0');
+                }
+                // 重复的Content-Length只有值都相同时才接受
+                if (hasContentLength_ && length != request_.contentLength_) {
+                    return false;
+                }
+                hasContentLength_ = true;
+                request_.contentLength_ = length;
+            }
+            break;
+        case 17:
+            if (equalsIgnoreCase(begin, colon, "Transfer-Encoding", 17)) {
+                // 只支持chunked，gzip之类的传输编码回复501
+                if (!equalsIgnoreCase(valueBegin, valueEnd, "chunked", 7)) {
+                    errorStatus_ = 501;
+                    return false;
+                }
+                request_.chunked_ = true;
+            }
+            break;
+        case 10:
+            if (equalsIgnoreCase(begin, colon, "Connection", 10)) {
+                StringPiece value(valueBegin, valueEnd - valueBegin);
+                request_.connectionClose_ = HttpRequest::containsToken(value, "close");
+                request_.connectionKeepAlive_ = HttpRequest::containsToken(value, "keep-alive");
+            }
+            break;
+        case 6:
+            if (equalsIgnoreCase(begin, colon, "Expect", 6)) {
+                request_.expectContinue_ = equalsIgnoreCase(valueBegin, valueEnd, "100-continue", 12);
+            }
+            break;
+    }
+
+    HttpRequest::Header &header = request_.headers_[request_.numHeaders_++];
+    header.name = HttpRequest::Slice(static_cast<uint32_t>(begin - base),
+                                     static_cast<uint32_t>(colon - begin));
+    header.value = HttpRequest::Slice(static_cast<uint32_t>(valueBegin - base),
+                                      static_cast<uint32_t>(valueEnd - valueBegin));
+    return true;
+}
+
+// 十六进制的块长度，后面可以跟块扩展(";name=value")，直接忽略
+bool HttpContext::parseChunkSize(const char *begin, const char *end) {
+    errorStatus_ = 400;
+    // 原始数据在请求处理完之前都留在inputBuffer_里，大量很小的块或者很长的块扩展会让它远大于解码后的请求体
+    if (pos_ > maxHeaderBytes_ + 2 * maxBodyBytes_) {
+        errorStatus_ = 413;
+        return false;
+    }
+    size_t size = 0;
+    const char *p = begin;
+    for (; p < end && hexValue(*p) >= 0; ++p) {
+        // 提前判断，防止溢出
+        if (size > (maxBodyBytes_ >> 4)) {
+            errorStatus_ = 413;
+            return false;
+        }
+        size = size * 16 + hexValue(*p);
+    }
+    if (p == begin || (p < end && *p != ';' && !isSpace(*p))) {
+        return false;
+    }
+    if (size == 0) {
+        state_ = kExpectTrailer;
+        return true;
+    }
+    if (request_.decodedBody_.size() + size > maxBodyBytes_) {
+        errorStatus_ = 413;
+        return false;
+    }
+    chunkRemaining_ = size;
+    state_ = kExpectChunkData;
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Timestamp.h"
+
+class Buffer;
+
+/**
+ * 一个HTTP连接的解析状态，HttpServer通过TcpConnection::setContext挂在连接上
+ *
+ * parseRequest直接在连接的inputBuffer_上按行增量解析：每收到一段数据，只从上次找过的位置接着用SIMD找'\n'，
+ * 找到一整行就立刻解析掉，不完整的行留到下次，已经解析过的行不会再扫描；解析出来的各个部分只记偏移，见HttpRequest
+ * 一个请求的字节在回调处理完、调用finishRequest之后才从inputBuffer_中取走，流水线上后面的请求留在Buffer里
+ * 稳定之后解析一个请求没有任何内存分配(chunked请求体的解码缓冲区第一次扩容除外)
+ **/
+class HttpContext {
+   public:
+    enum ParseResult {
+        kNeedMore,    // 数据不够一个完整的请求，等下次数据到达
+        kGotRequest,  // request()里是一个完整的请求，处理完之后调用finishRequest
+        kError,       // 请求不合法，errorStatus()是应该回复的状态码，之后应该关闭连接
+    };
+
+    HttpContext(size_t maxHeaderBytes, size_t maxBodyBytes);
+
+    ParseResult parseRequest(Buffer *buf, Timestamp receiveTime);
+
+    const HttpRequest &request() const { return request_; }
+    HttpResponse *response() { return &response_; }
+    int errorStatus() const { return errorStatus_; }
+
+    // 当前请求带了Expect: 100-continue并且正在等请求体时返回true，每个请求只返回一次
+    bool takeContinue() {
+        bool pending = continuePending_;
+        continuePending_ = false;
+        return pending;
+    }
+
+    // 从buf中取走刚处理完的请求，准备解析下一个；request()返回的StringPiece从此失效
+    void finishRequest(Buffer *buf);
+
+    // 连接已经决定关闭(Connection: close或者请求出错)，之后收到的数据都丢弃
+    void setClosing() { closing_ = true; }
+    bool closing() const { return closing_; }
+
+   private:
+    enum State {
+        kExpectRequestLine,
+        kExpectHeader,
+        kExpectBody,
+        kExpectChunkSize,
+        kExpectChunkData,
+        kExpectChunkDataEnd,  // 块数据之后的"\r\n"
+        kExpectTrailer,
+        kGotAll,
+    };
+
+    // 以下函数解析一整行[begin, end)，不含行尾的"\r\n"；base是请求的开头，用来计算偏移
+    bool parseRequestLine(const char *base, const char *begin, const char *end);
+    bool parseHeaderLine(const char *base, const char *begin, const char *end);
+    bool parseChunkSize(const char *begin, const char *end);
+    // 头部结束，根据Content-Length/Transfer-Encoding决定怎么读请求体
+    bool endOfHead();
+    ParseResult fail(int status);
+
+    const size_t maxHeaderBytes_;
+    const size_t maxBodyBytes_;
+    State state_;
+    size_t pos_;             // 下一个要解析的字节相对于请求开头的偏移，也就是当前行的开头
+    size_t scanned_;         // 当前行已经找过'\n'的位置
+    size_t chunkRemaining_;  // kExpectChunkData时当前块还差的字节数
+    size_t trailerBytes_;
+    bool hasContentLength_;
+    int errorStatus_;
+    bool continuePending_;
+    bool closing_;
+    HttpRequest request_;
+    HttpResponse response_;  // 每个连接复用一个，见HttpServer::onMessage
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+/**
+ * 一个HTTP请求，由HttpContext解析填充
+ *
+ * 方法之外的各个部分(路径、查询串、头部的名字和值、Content-Length格式的请求体)都不拷贝，
+ * 只记下它们在连接inputBuffer_中相对于请求开头的偏移和长度，访问时拼成指向inputBuffer_的StringPiece；
+ * 头部存在固定大小的数组里，超过kMaxHeaders个的请求回复431。这样解析一个请求不需要任何内存分配
+ * 只有chunked编码的请求体需要解码，拷贝进decodedBody_，它的容量留给下一个请求用
+ *
+ * 记偏移而不是指针，是因为请求收全之前inputBuffer_可能扩容或者把数据挪到开头，偏移不受影响；
+ * 收全之后HttpContext把base_指向请求的开头再交给回调，回调返回之后请求占用的字节才从inputBuffer_中取走
+ * 所以这些StringPiece只在HttpCallback执行期间有效，需要保留的要toString拷贝出来
+ **/
+class HttpRequest {
+   public:
+    enum Method { kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions, kPatch };
+    enum Version { kUnknown, kHttp10, kHttp11 };
+
+    static const int kMaxHeaders = 64;
+
+    HttpRequest() : base_(nullptr) { reset(); }
+
+    Method method() const { return method_; }
+    const char *methodString() const {
+        switch (method_) {
+            case kGet: return "GET";
+            case kPost: return "POST";
+            case kHead: return "HEAD";
+            case kPut: return "PUT";
+            case kDelete: return "DELETE";
+            case kOptions: return "OPTIONS";
+            case kPatch: return "PATCH";
+            default: return "UNKNOWN";
+        }
+    }
+    Version version() const { return version_; }
+    // 请求目标中'?'之前的部分
+    StringPiece path() const { return piece(path_); }
+    // '?'之后的部分，不含'?'
+    StringPiece query() const { return piece(query_); }
+    Timestamp receiveTime() const { return receiveTime_; }
+
+    // 字段名不区分大小写，同名字段只返回第一个，没有时返回空的StringPiece
+    StringPiece getHeader(const StringPiece &field) const {
+        for (int i = 0; i < numHeaders_; ++i) {
+            if (headerName(i).equalsIgnoreCase(field)) {
+                return headerValue(i);
+            }
+        }
+        return StringPiece();
+    }
+    int headerCount() const { return numHeaders_; }
+    // 逗号分隔的字段值(比如Connection、Upgrade)里有没有token，不区分大小写
+    bool headerHasToken(const StringPiece &field, const StringPiece &token) const {
+        return containsToken(getHeader(field), token);
+    }
+    StringPiece headerName(int i) const { return piece(headers_[i].name); }
+    StringPiece headerValue(int i) const { return piece(headers_[i].value); }
+
+    // Content-Length格式时指向inputBuffer_，chunked时是解码之后的完整请求体
+    StringPiece body() const {
+        return chunked_ ? StringPiece(decodedBody_) : piece(body_);
+    }
+
+    /**
+     * HTTP/1.1默认保持连接，除非带了Connection: close；
+     * HTTP/1.0默认关闭，除非带了Connection: keep-alive
+     **/
+    bool keepAlive() const {
+        if (version_ == kHttp11) {
+            return !connectionClose_;
+        }
+        return connectionKeepAlive_;
+    }
+
+    void reset() {
+        method_ = kInvalid;
+        version_ = kUnknown;
+        path_ = Slice();
+        query_ = Slice();
+        numHeaders_ = 0;
+        body_ = Slice();
+        decodedBody_.clear();
+        contentLength_ = 0;
+        chunked_ = false;
+        connectionClose_ = false;
+        connectionKeepAlive_ = false;
+        expectContinue_ = false;
+    }
+
+    static bool containsToken(const StringPiece &list, const StringPiece &token) {
+        const char *begin = list.begin();
+        while (begin < list.end()) {
+            const char *comma = static_cast<const char *>(::memchr(begin, ',', list.end() - begin));
+            const char *tokenEnd = comma ? comma : list.end();
+            const char *tokenBegin = begin;
+            while (tokenBegin < tokenEnd && (*tokenBegin == ' ' || *tokenBegin == '\t')) {
+                ++tokenBegin;
+            }
+            while (tokenEnd > tokenBegin && (tokenEnd[-1] == ' ' || tokenEnd[-1] == '\t')) {
+                --tokenEnd;
+            }
+            if (StringPiece(tokenBegin, tokenEnd - tokenBegin).equalsIgnoreCase(token)) {
+                return true;
+            }
+            begin = comma ? comma + 1 : list.end();
+        }
+        return false;
+    }
+
+   private:
+    friend class HttpContext;
+
+    // 相对于请求开头的一段
+    struct Slice {
+        Slice() : offset(0), len(0) {}
+        Slice(uint32_t o, uint32_t l) : offset(o), len(l) {}
+        uint32_t offset;
+        uint32_t len;
+    };
+    struct Header {
+        Slice name;
+        Slice value;
+    };
+
+    StringPiece piece(const Slice &slice) const {
+        return StringPiece(base_ + slice.offset, slice.len);
+    }
+
+    const char *base_;  // 请求在inputBuffer_中的开头，只在交给回调期间有效
+    Method method_;
+    Version version_;
+    Slice path_;
+    Slice query_;
+    Timestamp receiveTime_;
+    Header headers_[kMaxHeaders];
+    int numHeaders_;
+    Slice body_;
+    std::string decodedBody_;
+
+    // 解析头部时顺便记下的，决定了怎么读请求体以及是否保持连接
+    size_t contentLength_;
+    bool chunked_;
+    bool connectionClose_;
+    bool connectionKeepAlive_;
+    bool expectContinue_;
+};
@@ -0,0 +1,91 @@
+#include "HttpResponse.h"
+
+#include <stdio.h>
+
+#include "Buffer.h"
+
+static const char *reasonPhrase(int code) {
+    switch (code) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 411: return "Length Required";
+        case 413: return "Content Too Large";
+        case 414: return "URI Too Long";
+        case 426: return "Upgrade Required";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+void HttpResponse::setStatusCode(int code) {
+    statusCode_ = code;
+    statusMessage_ = reasonPhrase(code);
+}
+
+void HttpResponse::appendChunk(const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    char size[32];
+    int n = snprintf(size, sizeof size, "%zx\r\n", len);
+    body_.append(size, n);
+    body_.append(data, len);
+    body_.append("\r\n", 2);
+}
+
+void HttpResponse::appendToBuffer(Buffer *output, bool headOnly) const {
+    char buf[64];
+    int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
+    output->append(buf, n);
+    output->append(statusMessage_.data(), statusMessage_.size());
+    output->append("\r\n", 2);
+
+    // 1xx、204、304没有响应体，也不写Content-Length
+    bool noBody = statusCode_ < 200 || statusCode_ == 204 || statusCode_ == 304;
+    if (noBody) {
+        headOnly = true;
+    } else if (chunked_) {
+        output->append("Transfer-Encoding: chunked\r\n", 28);
+    } else {
+        n = snprintf(buf, sizeof buf, "Content-Length: %zu\r\n", body_.size());
+        output->append(buf, n);
+    }
+    if (closeConnection_) {
+        output->append("Connection: close\r\n", 19);
+    }
+    output->append(headers_.data(), headers_.size());
+    output->append("\r\n", 2);
+
+    if (headOnly) {
+        return;
+    }
+    output->append(body_.data(), body_.size());
+    if (chunked_) {
+        output->append("0\r\n\r\n", 5);
+    }
+}
+
+void HttpResponse::reset() {
+    statusCode_ = 200;
+    statusMessage_ = "OK";
+    closeConnection_ = false;
+    chunked_ = false;
+    headers_.clear();
+    body_.clear();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+
+#include "StringPiece.h"
+
+class Buffer;
+
+/**
+ * HTTP响应，由HttpServer的回调填充，再由appendToBuffer直接序列化进连接的outputBuffer_
+ *
+ * 和HttpContext一样每个连接一个，每个请求reset一次，字符串的容量留着给下一个响应用
+ * 头部在addHeader时就序列化成"name: value\r\n"追加到一个字符串里，稳定之后填充一个响应也没有内存分配
+ * 默认是200 OK；不是chunked时按body的长度自动加上Content-Length
+ *
+ * chunked：setChunked(true)之后用appendChunk追加数据，每次追加是一个块，块的帧头在追加时就写好了，
+ * 序列化时带上Transfer-Encoding: chunked和结尾的0长度块。适合边生成边拼接、事先不好算总长度的响应
+ **/
+class HttpResponse {
+   public:
+    HttpResponse() { reset(); }
+
+    // 状态码对应的原因短语按RFC 9110自动填写，需要别的文字时再调用setStatusMessage
+    void setStatusCode(int code);
+    int statusCode() const { return statusCode_; }
+    void setStatusMessage(const StringPiece &message) {
+        statusMessage_.assign(message.data(), message.size());
+    }
+
+    // 发送完这个响应之后关闭连接，会带上Connection: close
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+
+    void setContentType(const StringPiece &contentType) {
+        addHeader("Content-Type", contentType);
+    }
+    void addHeader(const StringPiece &field, const StringPiece &value) {
+        headers_.append(field.data(), field.size());
+        headers_.append(": ", 2);
+        headers_.append(value.data(), value.size());
+        headers_.append("\r\n", 2);
+    }
+
+    void setBody(const StringPiece &body) { body_.assign(body.data(), body.size()); }
+    void appendBody(const char *data, size_t len) { body_.append(data, len); }
+    const std::string &body() const { return body_; }
+
+    void setChunked(bool on) { chunked_ = on; }
+    bool chunked() const { return chunked_; }
+    // 追加一个块，空数据忽略(0长度的块表示结束，由appendToBuffer写)
+    void appendChunk(const char *data, size_t len);
+
+    /**
+     * 把状态行、头部和响应体追加到output
+     * headOnly为true时(HEAD请求)只写状态行和头部，Content-Length仍然是响应体的长度
+     **/
+    void appendToBuffer(Buffer *output, bool headOnly = false) const;
+
+    void reset();
+
+   private:
+    int statusCode_;
+    std::string statusMessage_;
+    bool closeConnection_;
+    bool chunked_;
+    std::string headers_;  // 已经序列化好的头部
+    std::string body_;  // chunked时是已经带了块帧头的数据
+};
@@ -0,0 +1,97 @@
+#include "HttpServer.h"
+
+#include <memory>
+
+#include "HttpContext.h"
+#include "TcpConnection.h"
+
+static void defaultHttpCallback(const HttpRequest &, HttpResponse *response) {
+    response->setStatusCode(404);
+    response->setCloseConnection(true);
+}
+
+HttpServer::HttpServer(EventLoop *loop, const InetAddress &listenAddr,
+                       const std::string &name, TcpServer::Option option)
+    : loop_(loop),
+      server_(loop, listenAddr, name, option),
+      httpCallback_(defaultHttpCallback),
+      maxHeaderBytes_(kDefaultMaxHeaderBytes),
+      maxBodyBytes_(kDefaultMaxBodyBytes),
+      maxRequestsPerRead_(kDefaultMaxRequestsPerRead) {
+    server_.setConnectionCallback(
+        std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(
+        std::bind(&HttpServer::onMessage, this, std::placeholders::_1,
+                  std::placeholders::_2, std::placeholders::_3));
+    // 一轮循环中所有请求的响应攒在outputBuffer_里，结束时一次write
+    server_.setWriteBatching(true);
+}
+
+void HttpServer::start() { server_.start(); }
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        conn->setTcpNoDelay(true);
+        conn->setContext(std::make_shared<HttpContext>(maxHeaderBytes_, maxBodyBytes_));
+    }
+}
+
+/**
+ * 逐个解析inputBuffer_中的请求，每个请求的响应直接追加到outputBuffer_，最后统一发送
+ * 响应的顺序就是请求的顺序；需要关闭连接的响应之后的请求不再处理
+ */
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf,
+                           Timestamp receiveTime) {
+    HttpContext *context = static_cast<HttpContext *>(conn->getContext().get());
+    if (context == nullptr || context->closing()) {
+        buf->retrieveAll();
+        return;
+    }
+
+    Buffer *output = conn->outputBuffer();
+    for (int handled = 0;; ++handled) {
+        if (handled >= maxRequestsPerRead_ && buf->readableBytes() > 0) {
+            // 这一轮处理得够多了，剩下的请求下一轮接着处理
+            conn->yieldRead();
+            break;
+        }
+
+        HttpContext::ParseResult result = context->parseRequest(buf, receiveTime);
+        if (result == HttpContext::kNeedMore) {
+            // 客户端带了Expect: 100-continue，收到这个临时响应之后才会发请求体
+            if (context->takeContinue()) {
+                output->append("HTTP/1.1 100 Continue\r\n\r\n", 25);
+            }
+            break;
+        }
+
+        HttpResponse *response = context->response();
+        response->reset();
+        if (result == HttpContext::kError) {
+            response->setStatusCode(context->errorStatus());
+            response->setCloseConnection(true);
+            response->appendToBuffer(output);
+            context->setClosing();
+            buf->retrieveAll();
+            break;
+        }
+
+        const HttpRequest &request = context->request();
+        response->setCloseConnection(!request.keepAlive());
+        httpCallback_(request, response);
+        response->appendToBuffer(output, request.method() == HttpRequest::kHead);
+        bool close = response->closeConnection();
+        context->finishRequest(buf);
+        if (close) {
+            context->setClosing();
+            buf->retrieveAll();
+            break;
+        }
+    }
+
+    conn->sendOutputBuffer();
+    if (context->closing()) {
+        // 批量写模式下shutdown会等outputBuffer_写完再关闭写端
+        conn->shutdown();
+    }
+}
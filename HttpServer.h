@@ -0,0 +1,59 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "TcpServer.h"
+#include "noncopyable.h"
+
+/**
+ * 基于TcpServer的HTTP/1.1服务器
+ *
+ * 长连接：HTTP/1.1默认保持连接，请求带Connection: close(或者HTTP/1.0没有带keep-alive)时回复之后关闭写端
+ * 流水线：一次读到的多个请求在同一个MessageCallback里按顺序逐个解析、调用HttpCallback，
+ * 响应按请求的顺序直接序列化进连接的outputBuffer_；连接开启了批量写，一批流水线请求的响应只需要一次write
+ * 一次回调最多处理maxRequestsPerRead个请求，剩下的用TcpConnection::yieldRead留到下一轮，不让一个连接占住loop
+ *
+ * HttpCallback在连接所在的loop线程中同步调用，返回时response必须已经填好；
+ * 请求和响应对象每个连接各一个，回调返回之后就被下一个请求复用，不能把它们的引用留到回调之外；
+ * HttpRequest返回的StringPiece直接指向inputBuffer_，回调返回之后也会失效，需要保留的要拷贝出来
+ **/
+class HttpServer : noncopyable {
+   public:
+    using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+
+    static const size_t kDefaultMaxHeaderBytes = 64 * 1024;
+    static const size_t kDefaultMaxBodyBytes = 8 * 1024 * 1024;
+    static const int kDefaultMaxRequestsPerRead = 64;
+
+    HttpServer(EventLoop *loop, const InetAddress &listenAddr,
+               const std::string &name,
+               TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop *getLoop() const { return loop_; }
+
+    // 默认的回调对所有请求回复404
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    // 请求行加头部的最大长度，超过回复431；请求体的最大长度，超过回复413；必须在start之前设置
+    void setMaxHeaderBytes(size_t bytes) { maxHeaderBytes_ = bytes; }
+    void setMaxBodyBytes(size_t bytes) { maxBodyBytes_ = bytes; }
+    void setMaxRequestsPerRead(int n) { maxRequestsPerRead_ = n; }
+    // 需要连接数上限、负载均衡等设置时直接操作底层的TcpServer
+    TcpServer *tcpServer() { return &server_; }
+
+    void start();
+
+   private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    HttpCallback httpCallback_;
+    size_t maxHeaderBytes_;
+    size_t maxBodyBytes_;
+    int maxRequestsPerRead_;
+};
@@ -1,33 +1,130 @@
 #include "InetAddress.h"
 
+#include <stddef.h>
 #include <string.h>
 #include <strings.h>
 
+#include <algorithm>
+
 InetAddress::InetAddress(uint16_t port, std::string ip) {
     bzero(&addr_, sizeof addr_);
-    addr_.sin_family = AF_INET;
-    addr_.sin_port = htons(port);
-    addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    if (ip.find(':') != std::string::npos) {
+        sockaddr_in6 *addr6 = reinterpret_cast<sockaddr_in6 *>(&addr_);
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        ::inet_pton(AF_INET6, ip.c_str(), &addr6->sin6_addr);
+        len_ = sizeof(sockaddr_in6);
+    } else {
+        sockaddr_in *addr4 = reinterpret_cast<sockaddr_in *>(&addr_);
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        addr4->sin_addr.s_addr = inet_addr(ip.c_str());
+        len_ = sizeof(sockaddr_in);
+    }
+}
+
+InetAddress::InetAddress(const sockaddr_in &addr) {
+    setSockAddr(reinterpret_cast<const sockaddr *>(&addr), sizeof addr);
+}
+
+InetAddress::InetAddress(const sockaddr_in6 &addr) {
+    setSockAddr(reinterpret_cast<const sockaddr *>(&addr), sizeof addr);
+}
+
+InetAddress::InetAddress(const sockaddr *addr, socklen_t len) {
+    setSockAddr(addr, len);
+}
+
+InetAddress InetAddress::unixDomain(const std::string &path) {
+    InetAddress result;
+    bzero(&result.addr_, sizeof result.addr_);
+    sockaddr_un *addrUn = reinterpret_cast<sockaddr_un *>(&result.addr_);
+    addrUn->sun_family = AF_UNIX;
+    // 超长的路径截断，bind/connect时会找不到或者绑到截断后的路径上
+    size_t n = std::min(path.size(), sizeof(addrUn->sun_path) - 1);
+    ::memcpy(addrUn->sun_path, path.data(), n);
+    if (n > 0 && path[0] == '@') {
+        // 抽象命名空间：sun_path[0]是'\0'，长度不包含结尾的'\0'
+        addrUn->sun_path[0] = '\0';
+        result.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n);
+    } else {
+        result.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n + 1);
+    }
+    return result;
+}
+
+// 只拷贝有效长度，接收数据报时每个数据报都要调用一次，不去清零剩下的部分
+void InetAddress::setSockAddr(const sockaddr *addr, socklen_t len) {
+    if (len > sizeof addr_) {
+        len = sizeof addr_;
+    }
+    ::memcpy(&addr_, addr, len);
+    if (len < sizeof(sa_family_t)) {
+        addr_.ss_family = AF_UNSPEC;
+    }
+    len_ = len;
 }
 
 std::string InetAddress::toIp() const {
     // addr_
     char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
+    if (family() == AF_INET) {
+        const sockaddr_in *addr4 = reinterpret_cast<const sockaddr_in *>(&addr_);
+        ::inet_ntop(AF_INET, &addr4->sin_addr, buf, sizeof buf);
+    } else if (family() == AF_INET6) {
+        const sockaddr_in6 *addr6 = reinterpret_cast<const sockaddr_in6 *>(&addr_);
+        ::inet_ntop(AF_INET6, &addr6->sin6_addr, buf, sizeof buf);
+    } else if (family() == AF_UNIX) {
+        const sockaddr_un *addrUn = reinterpret_cast<const sockaddr_un *>(&addr_);
+        size_t offset = offsetof(sockaddr_un, sun_path);
+        if (len_ <= offset) {
+            return std::string();  // 没有绑定路径
+        }
+        size_t n = len_ - offset;
+        if (addrUn->sun_path[0] == '\0') {
+            return "@" + std::string(addrUn->sun_path + 1, n - 1);
+        }
+        return std::string(addrUn->sun_path, strnlen(addrUn->sun_path, n));
+    }
     return buf;
 }
 
 std::string InetAddress::toIpPort() const {
     // ip:port
+    if (family() == AF_UNIX) {
+        return toIp();
+    }
     char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
-    size_t end = strlen(buf);
-    uint16_t port = ntohs(addr_.sin_port);
-    sprintf(buf + end, ":%u", port);
+    if (family() == AF_INET6) {
+        snprintf(buf, sizeof buf, "[%s]:%u", toIp().c_str(), toPort());
+    } else {
+        snprintf(buf, sizeof buf, "%s:%u", toIp().c_str(), toPort());
+    }
     return buf;
 }
 
-uint16_t InetAddress::toPort() const { return ntohs(addr_.sin_port); }
+uint16_t InetAddress::toPort() const {
+    if (family() == AF_INET) {
+        return ntohs(reinterpret_cast<const sockaddr_in *>(&addr_)->sin_port);
+    }
+    if (family() == AF_INET6) {
+        return ntohs(reinterpret_cast<const sockaddr_in6 *>(&addr_)->sin6_port);
+    }
+    return 0;
+}
+
+uint32_t InetAddress::ipHash() const {
+    if (family() == AF_INET) {
+        return reinterpret_cast<const sockaddr_in *>(&addr_)->sin_addr.s_addr;
+    }
+    if (family() == AF_INET6) {
+        const sockaddr_in6 *addr6 = reinterpret_cast<const sockaddr_in6 *>(&addr_);
+        uint32_t words[4];
+        ::memcpy(words, &addr6->sin6_addr, sizeof words);
+        return words[0] ^ words[1] ^ words[2] ^ words[3];
+    }
+    return 0;
+}
 
 // #include <iostream>
 // int main()
@@ -2,22 +2,46 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <string>
 
-// 封装socket地址类型
+/**
+ * 封装socket地址类型，内部是sockaddr_storage，可以是IPv4、IPv6或者Unix域地址
+ *
+ * Unix域地址用unixDomain构造，路径以'@'开头时表示Linux的抽象命名空间(不在文件系统中创建文件)
+ * Unix域的流式socket完全不经过TCP协议栈，同一台机器上的进程之间(比如sidecar)通信比走回环地址快
+ **/
 class InetAddress {
    public:
+    // ip中含有':'时按IPv6解析，比如InetAddress(8080, "::")监听所有IPv6(以及映射过来的IPv4)地址
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
-    explicit InetAddress(const sockaddr_in &addr) : addr_(addr) {}
+    explicit InetAddress(const sockaddr_in &addr);
+    explicit InetAddress(const sockaddr_in6 &addr);
+    // 从accept、getsockname、recvmmsg等填好的地址构造，len是内核返回的地址长度
+    InetAddress(const sockaddr *addr, socklen_t len);
 
+    static InetAddress unixDomain(const std::string &path);
+
+    sa_family_t family() const { return addr_.ss_family; }
+
+    // Unix域地址返回路径，抽象地址是"@name"，没有绑定路径的一端(比如客户端)是空串
     std::string toIp() const;
+    // IPv6的格式是"[ip]:port"，Unix域地址和toIp一样
     std::string toIpPort() const;
+    // Unix域地址返回0
     uint16_t toPort() const;
+    // 只对ip部分求一个32位的哈希，Unix域地址返回0
+    uint32_t ipHash() const;
 
-    const sockaddr_in *getSockAddr() const { return &addr_; }
-    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; }
+    const sockaddr *getSockAddr() const {
+        return reinterpret_cast<const sockaddr *>(&addr_);
+    }
+    socklen_t getSockLen() const { return len_; }
+    void setSockAddr(const sockaddr *addr, socklen_t len);
 
    private:
-    sockaddr_in addr_;
-};
\ No newline at end of file
+    sockaddr_storage addr_;
+    socklen_t len_;  // 地址的有效长度，bind/connect/sendto时传给内核
+};
@@ -10,6 +10,14 @@ Logger &Logger::instance() {
     return logger;
 }
 
+Logger::Logger() : logLevel_(INFO), binaryMode_(false), binaryFile_(nullptr) {}
+
+Logger::~Logger() {
+    if (binaryFile_ != nullptr) {
+        ::fclose(binaryFile_);
+    }
+}
+
 // 设置日志级别
 void Logger::setLogLevel(int level) { logLevel_ = level; }
 
@@ -34,4 +42,82 @@ void Logger::log(std::string msg) {
 
     // 打印时间和msg
     std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
-}
\ No newline at end of file
+}
+
+bool Logger::setBinaryLogFile(const std::string &path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    binaryMode_ = false;
+    if (binaryFile_ != nullptr) {
+        ::fclose(binaryFile_);
+        binaryFile_ = nullptr;
+    }
+    if (path.empty()) {
+        return true;
+    }
+
+    binaryFile_ = ::fopen(path.c_str(), "wb");
+    if (binaryFile_ == nullptr) {
+        return false;
+    }
+    ::fwrite(BinaryLog::kFileMagic, 1, sizeof BinaryLog::kFileMagic,
+             binaryFile_);
+    /**
+     * 格式串的id保存在各个调用点的静态变量里，只会注册一次
+     * 所以重新打开文件时要把之前注册过的格式串全部补写一遍，否则解码工具无法识别这些id
+     **/
+    for (size_t i = 0; i < formats_.size(); ++i) {
+        writeFormatRecord(static_cast<uint32_t>(i), formats_[i]);
+    }
+    binaryMode_ = true;
+    return true;
+}
+
+uint32_t Logger::registerFormat(const char *format) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint32_t id = static_cast<uint32_t>(formats_.size());
+    formats_.push_back(format);
+    if (binaryFile_ != nullptr) {
+        writeFormatRecord(id, formats_.back());
+    }
+    return id;
+}
+
+void Logger::writeFormatRecord(uint32_t id, const std::string &format) {
+    uint16_t len = static_cast<uint16_t>(
+        format.size() < UINT16_MAX ? format.size() : UINT16_MAX);
+    ::fputc(BinaryLog::kFormatRecord, binaryFile_);
+    ::fwrite(&id, sizeof id, 1, binaryFile_);
+    ::fwrite(&len, sizeof len, 1, binaryFile_);
+    ::fwrite(format.data(), 1, len, binaryFile_);
+}
+
+void Logger::writeLogRecord(char *record, size_t len, int level,
+                            uint32_t formatId, uint8_t argCount) {
+    // 头部在参数写完之后再回填，bodyLen不包含'L'和bodyLen本身
+    uint16_t bodyLen = static_cast<uint16_t>(len - 1 - 2);
+    int64_t micros = Timestamp::now().microSecondsSinceEpoch();
+    char *p = record;
+    *p++ = BinaryLog::kLogRecord;
+    memcpy(p, &bodyLen, sizeof bodyLen);
+    p += sizeof bodyLen;
+    *p++ = static_cast<char>(level);
+    memcpy(p, &micros, sizeof micros);
+    p += sizeof micros;
+    memcpy(p, &formatId, sizeof formatId);
+    p += sizeof formatId;
+    *p++ = static_cast<char>(argCount);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (binaryFile_ != nullptr) {
+        ::fwrite_unlocked(record, 1, len, binaryFile_);
+    }
+}
+
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (binaryFile_ != nullptr) {
+        ::fflush(binaryFile_);
+    } else {
+        std::cout.flush();
+    }
+}
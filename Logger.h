@@ -1,6 +1,15 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include "noncopyable.h"
 
@@ -8,46 +17,148 @@
  * 日志对于一个软件来说还是非常重要的，很多时候当软件正式应用以后使用gdb进行调试是不便的
  * 则日志是我们来处理问题最直接的途径
  *
+ * 日志有两种输出模式：
+ * 1. 文本模式(默认)：在调用线程里snprintf格式化，然后输出到标准输出
+ * 2. 二进制模式：调用Logger::setBinaryLogFile打开之后，调用线程不再做任何格式化，
+ *    只把 格式串id + 参数的原始字节 + 时间戳 拼成一条紧凑的记录写入文件，
+ *    格式串在每个LOG_*调用点第一次执行时注册一次，离线再用tools/logdecoder还原成文本
+ *
+ * 两种模式共用同一组LOG_*宏，调用点不需要做任何修改
  **/
 
-// LOG_INFO("%s %d", arg1, arg2)
-#define LOG_INFO(logmsgFormat, ...)                       \
-    do {                                                  \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(INFO);                         \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
-    } while (0)
+// 二进制日志的文件格式，Logger和离线解码工具共用
+namespace BinaryLog {
+// 文件头，用来识别二进制日志文件以及格式版本
+const char kFileMagic[8] = {'M', 'D', 'B', 'L', 'O', 'G', '0', '1'};
+
+/**
+ * 格式串注册记录：[u8 'F'][u32 id][u16 len][len字节的格式串]
+ * 日志记录：[u8 'L'][u16 bodyLen][u8 level][i64 微秒时间戳][u32 id][u8 参数个数][参数...]
+ * 参数：[u8 类型][数据]，整数、浮点数、指针都是8字节，字符串是[u16 len][len字节]
+ * 所有整数都按本机字节序写入，日志在哪台机器上产生就在同类机器上解码
+ **/
+const char kFormatRecord = 'F';
+const char kLogRecord = 'L';
+
+const char kArgInt = 'i';
+const char kArgUint = 'u';
+const char kArgDouble = 'd';
+const char kArgPointer = 'p';
+const char kArgString = 's';
+
+// 一条日志记录的最大长度，与文本模式的1024字节缓冲区保持一致，放不下的参数连同之后的参数都被丢弃
+const size_t kMaxRecordSize = 1024;
+// 日志记录头：'L' + bodyLen + level + 时间戳 + id + 参数个数
+const size_t kLogHeaderSize = 1 + 2 + 1 + 8 + 4 + 1;
+
+// 在栈上的记录缓冲区中依次追加参数，只做memcpy，不做任何格式化
+class RecordWriter {
+   public:
+    RecordWriter(char *buf, size_t size)
+        : cur_(buf + kLogHeaderSize), end_(buf + size), count_(0), full_(false) {}
+
+    // 整数、bool、枚举：统一按8字节存储，解码时再按格式串里的转换符输出
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value ||
+                            std::is_enum<T>::value>::type
+    append(T v) {
+        if (std::is_signed<T>::value) {
+            appendFixed(kArgInt, static_cast<int64_t>(v));
+        } else {
+            appendFixed(kArgUint, static_cast<uint64_t>(v));
+        }
+    }
+
+    void append(double v) { appendFixed(kArgDouble, v); }
+
+    // 字符串在记录生成之后就可能失效，所以必须把内容拷贝下来
+    void append(const char *s) {
+        if (full_ || cur_ + 1 + 2 > end_) {
+            full_ = true;
+            return;
+        }
+        size_t len = s == nullptr ? 0 : strlen(s);
+        size_t room = end_ - cur_ - 1 - 2;
+        if (len > room) {
+            len = room;
+        }
+        uint16_t len16 = static_cast<uint16_t>(len);
+        *cur_++ = kArgString;
+        memcpy(cur_, &len16, sizeof len16);
+        cur_ += sizeof len16;
+        if (len > 0) {
+            memcpy(cur_, s, len);
+            cur_ += len;
+        }
+        ++count_;
+    }
+    void append(char *s) { append(static_cast<const char *>(s)); }
+
+    // 其余指针只记录地址本身，对应格式串中的%p
+    template <typename T>
+    void append(T *p) {
+        appendFixed(kArgPointer,
+                    static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)));
+    }
+
+    size_t size(const char *buf) const { return cur_ - buf; }
+    uint8_t count() const { return count_; }
 
-#define LOG_ERROR(logmsgFormat, ...)                      \
-    do {                                                  \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(ERROR);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
+   private:
+    template <typename T>
+    void appendFixed(char tag, T v) {
+        static_assert(sizeof(T) == 8, "fixed argument must be 8 bytes");
+        if (full_ || cur_ + 1 + sizeof v > end_) {
+            full_ = true;
+            return;
+        }
+        *cur_++ = tag;
+        memcpy(cur_, &v, sizeof v);
+        cur_ += sizeof v;
+        ++count_;
+    }
+
+    char *cur_;
+    char *end_;
+    uint8_t count_;
+    // 丢弃过一个参数之后不再追加，否则解码时后面的参数会和前面的转换符错位
+    bool full_;
+};
+}  // namespace BinaryLog
+
+// 二进制模式下格式串只在每个调用点第一次执行时注册一次，之后只写id
+#define LOG_IMPL(level, logmsgFormat, ...)                                  \
+    do {                                                                    \
+        Logger &logger = Logger::instance();                                \
+        if (logger.binaryMode()) {                                          \
+            static const uint32_t logFormatId =                             \
+                logger.registerFormat(logmsgFormat);                        \
+            logger.logBinary(level, logFormatId, ##__VA_ARGS__);            \
+        } else {                                                            \
+            logger.setLogLevel(level);                                      \
+            char buf[1024] = {0};                                           \
+            snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);               \
+            logger.log(buf);                                                \
+        }                                                                   \
     } while (0)
 
-#define LOG_FATAL(logmsgFormat, ...)                      \
-    do {                                                  \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(FATAL);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
-        exit(-1);                                         \
+// LOG_INFO("%s %d", arg1, arg2)
+#define LOG_INFO(logmsgFormat, ...) \
+    LOG_IMPL(INFO, logmsgFormat, ##__VA_ARGS__)
+
+#define LOG_ERROR(logmsgFormat, ...) \
+    LOG_IMPL(ERROR, logmsgFormat, ##__VA_ARGS__)
+
+#define LOG_FATAL(logmsgFormat, ...)                   \
+    do {                                               \
+        LOG_IMPL(FATAL, logmsgFormat, ##__VA_ARGS__);  \
+        Logger::instance().flush();                    \
+        exit(-1);                                      \
     } while (0)
 
 #ifdef MUDEBUG
-#define LOG_DEBUG(logmsgFormat, ...)                      \
-    do {                                                  \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(DEBUG);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
-    } while (0)
+#define LOG_DEBUG(logmsgFormat, ...) \
+    LOG_IMPL(DEBUG, logmsgFormat, ##__VA_ARGS__)
 #else
 #define LOG_DEBUG(logmsgFormat, ...)
 #endif
@@ -78,6 +189,45 @@ class Logger : noncopyable {
     // 写日志
     void log(std::string msg);
 
+    /**
+     * 切换到二进制模式，之后的日志都以二进制记录写入path，path为空则切回文本模式
+     * 应该在程序启动、各个loop线程开始打日志之前调用
+     **/
+    bool setBinaryLogFile(const std::string &path);
+    bool binaryMode() const { return binaryMode_; }
+
+    // 注册一个格式串，返回它的id，同时把注册记录写入二进制日志文件
+    uint32_t registerFormat(const char *format);
+
+    // 二进制模式下写一条日志：只拷贝参数的原始字节，格式化留给离线解码工具
+    template <typename... Args>
+    void logBinary(int level, uint32_t formatId, Args... args) {
+        char record[BinaryLog::kMaxRecordSize];
+        BinaryLog::RecordWriter writer(record, sizeof record);
+        int expand[] = {0, (writer.append(args), 0)...};
+        (void)expand;
+        writeLogRecord(record, writer.size(record), level, formatId,
+                       writer.count());
+    }
+
+    // 把二进制日志文件的用户态缓冲刷到内核，LOG_FATAL退出之前会调用
+    void flush();
+
    private:
+    Logger();
+    ~Logger();
+
+    // 填写记录头并写入文件，record中从kLogHeaderSize开始已经是参数数据
+    void writeLogRecord(char *record, size_t len, int level, uint32_t formatId,
+                        uint8_t argCount);
+    void writeFormatRecord(uint32_t id, const std::string &format);
+
     int logLevel_;
-};
\ No newline at end of file
+
+    std::atomic_bool binaryMode_;
+    FILE *binaryFile_;
+    // 保护binaryFile_以及formats_，同一条记录必须完整地写入文件
+    std::mutex mutex_;
+    // 已注册的格式串，下标即id，重新打开文件时需要把它们重新写一遍
+    std::vector<std::string> formats_;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+
+/**
+ * 只在所属loop线程中增减的侵入式引用计数
+ *
+ * shared_ptr的引用计数是原子的，每次拷贝/析构都是一次带lock前缀的read-modify-write，
+ * 而一个连接的绝大部分引用(channel处理事件期间的保护、回调里的临时引用)都只存在于连接所在的loop线程中，
+ * 根本不会被别的线程看到。LoopRefCounted把这部分引用计数放在对象自己身上，用普通的int计数：
+ * 只有计数从0变成1时才通过firstLoopRefAcquired拿一个真正的shared_ptr，从1变成0时再通过lastLoopRefReleased放掉，
+ * 中间任意多次的加减都不需要原子操作
+ *
+ * 计数只能在对象所属的loop线程中修改；要把对象交给别的线程，必须先转换成shared_ptr(见LoopRef::shared)
+ * 对象在loop之间迁移时，计数随对象一起转移，由迁移过程中queueInLoop的互斥锁保证可见性
+ */
+class LoopRefCounted {
+   public:
+    void retainInLoop() {
+        if (loopRefs_++ == 0) {
+            firstLoopRefAcquired();
+        }
+    }
+    // 计数归零时对象可能在lastLoopRefReleased里被销毁，调用之后不能再访问this
+    void releaseInLoop() {
+        if (--loopRefs_ == 0) {
+            lastLoopRefReleased();
+        }
+    }
+
+   protected:
+    LoopRefCounted() : loopRefs_(0) {}
+    virtual ~LoopRefCounted() = default;
+
+    virtual void firstLoopRefAcquired() = 0;
+    virtual void lastLoopRefReleased() = 0;
+
+   private:
+    int loopRefs_;
+};
+
+/**
+ * 指向LoopRefCounted对象的句柄，用法和shared_ptr类似，但是拷贝和析构只修改对象上的普通计数
+ * 只能在对象所属的loop线程中创建、拷贝和析构
+ */
+template <typename T>
+class LoopRef {
+   public:
+    LoopRef() : ptr_(nullptr) {}
+    explicit LoopRef(T *ptr) : ptr_(ptr) {
+        if (ptr_) {
+            ptr_->retainInLoop();
+        }
+    }
+    LoopRef(const LoopRef &other) : LoopRef(other.ptr_) {}
+    LoopRef(LoopRef &&other) : ptr_(other.ptr_) { other.ptr_ = nullptr; }
+    ~LoopRef() { reset(); }
+
+    LoopRef &operator=(LoopRef other) {
+        std::swap(ptr_, other.ptr_);
+        return *this;
+    }
+
+    void reset() {
+        T *ptr = ptr_;
+        ptr_ = nullptr;
+        if (ptr) {
+            ptr->releaseInLoop();
+        }
+    }
+
+    T *get() const { return ptr_; }
+    T *operator->() const { return ptr_; }
+    T &operator*() const { return *ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+    // 跨线程的出口：转换成shared_ptr之后就可以交给任意线程了，这一步是原子操作
+    std::shared_ptr<T> shared() const {
+        return ptr_ ? ptr_->shared_from_this() : std::shared_ptr<T>();
+    }
+
+   private:
+    T *ptr_;
+};
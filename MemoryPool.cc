@@ -0,0 +1,75 @@
+#include "MemoryPool.h"
+
+#include <new>
+
+namespace {
+// 没有析构函数的thread_local，线程退出时内存池析构之后仍然可以安全地读取
+thread_local bool t_poolDestroyed = false;
+}  // namespace
+
+MemoryPool::MemoryPool() {
+    for (FreeList &list : lists_) {
+        list.head = nullptr;
+        list.count = 0;
+    }
+}
+
+MemoryPool::~MemoryPool() {
+    for (FreeList &list : lists_) {
+        while (list.head != nullptr) {
+            FreeBlock *block = list.head;
+            list.head = block->next;
+            ::operator delete(block);
+        }
+    }
+    t_poolDestroyed = true;
+}
+
+MemoryPool *MemoryPool::local() {
+    if (t_poolDestroyed) {
+        return nullptr;
+    }
+    static thread_local MemoryPool pool;
+    return &pool;
+}
+
+void *MemoryPool::allocate(size_t bytes) {
+    if (bytes == 0 || bytes > kMaxBlockSize) {
+        return ::operator new(bytes);
+    }
+    size_t index = (bytes - 1) / kBlockGranularity;
+    MemoryPool *pool = local();
+    if (pool != nullptr) {
+        FreeList &list = pool->lists_[index];
+        if (list.head != nullptr) {
+            FreeBlock *block = list.head;
+            list.head = block->next;
+            --list.count;
+            return block;
+        }
+    }
+    // 按尺寸的上限分配，这样这个块释放之后能被同一尺寸的任何请求复用
+    return ::operator new((index + 1) * kBlockGranularity);
+}
+
+void MemoryPool::deallocate(void *p, size_t bytes) {
+    if (p == nullptr) {
+        return;
+    }
+    if (bytes == 0 || bytes > kMaxBlockSize) {
+        ::operator delete(p);
+        return;
+    }
+    MemoryPool *pool = local();
+    if (pool != nullptr) {
+        FreeList &list = pool->lists_[(bytes - 1) / kBlockGranularity];
+        if (list.count < kMaxCachedBlocks) {
+            FreeBlock *block = static_cast<FreeBlock *>(p);
+            block->next = list.head;
+            list.head = block;
+            ++list.count;
+            return;
+        }
+    }
+    ::operator delete(p);
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+/**
+ * 线程局部的小块内存缓存
+ *
+ * 短连接场景下每个连接都要分配TcpConnection(连同shared_ptr的控制块)、两个Buffer以及连接表的节点，
+ * 连接关闭时又全部释放，而且大小每次都一样。MemoryPool把不超过kMaxBlockSize的请求按kBlockGranularity
+ * 向上取整分成若干个尺寸，每个线程每个尺寸维护一个空闲链表，释放的块挂回链表，下次同样尺寸的分配直接复用
+ *
+ * 连接在哪个loop线程中创建，通常也就在哪个loop线程中析构，所以不需要加锁；
+ * 在别的线程释放的块会挂到那个线程的链表上，只是不能被原来的线程复用而已
+ */
+class MemoryPool : noncopyable {
+   public:
+    static const size_t kBlockGranularity = 64;
+    static const size_t kMaxBlockSize = 4096;
+    // 每个尺寸最多缓存的空闲块数，超过的直接还给系统
+    static const size_t kMaxCachedBlocks = 256;
+
+    static void *allocate(size_t bytes);
+    static void deallocate(void *p, size_t bytes);
+
+   private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    struct FreeList {
+        FreeBlock *head;
+        size_t count;
+    };
+
+    MemoryPool();
+    ~MemoryPool();
+
+    // 当前线程的内存池，线程退出过程中内存池已经析构之后返回nullptr
+    static MemoryPool *local();
+
+    FreeList lists_[kMaxBlockSize / kBlockGranularity];
+};
+
+// 使用MemoryPool的标准分配器，给std::allocate_shared以及标准容器使用
+template <typename T>
+class PoolAllocator {
+   public:
+    using value_type = T;
+
+    PoolAllocator() {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(MemoryPool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T *p, size_t n) { MemoryPool::deallocate(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) {
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "RpcClient.h"
+
+#include <future>
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+const size_t RpcClient::kMaxPendingCalls;
+constexpr double RpcClient::kDeadlineTickSeconds;
+
+// 响应帧不会比这个更大，防止一个错误的长度让inputBuffer_无限增长
+static const size_t kMaxResponseFrameBytes = 64 * 1024 * 1024;
+
+RpcClient::RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &name)
+    : loop_(loop),
+      freeHead_(kMaxPendingCalls),
+      numPending_(0),
+      ticking_(false),
+      client_(loop, serverAddr, name) {
+    client_.setConnectionCallback(
+        std::bind(&RpcClient::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(
+        std::bind(&RpcClient::onMessage, this, std::placeholders::_1,
+                  std::placeholders::_2, std::placeholders::_3));
+}
+
+/**
+ * 和ConnectionPool一样，TcpClient析构时连接的关闭是投递到loop中稍后执行的，关闭时还会回调onConnection，
+ * 所以先在loop线程中停止重连、换掉连接上指向this的回调，再让TcpClient析构
+ */
+RpcClient::~RpcClient() {
+    std::promise<void> done;
+    loop_->runInLoop([this, &done]() {
+        client_.stop();
+        loop_->cancel(tickTimer_);
+        ticking_ = false;
+        if (conn_) {
+            conn_->setConnectionCallback([](const TcpConnectionPtr &) {});
+            conn_->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+                buf->retrieveAll();
+            });
+            conn_.reset();
+        }
+        failAll(kRpcUnavailable);
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+void RpcClient::call(uint16_t method, const StringPiece &request, double timeoutSeconds,
+                     ResponseCallback cb) {
+    callWith(method, [&request](RpcWriter *writer) {
+        writer->writeRaw(request);
+    }, timeoutSeconds, std::move(cb));
+}
+
+void RpcClient::callEncoded(uint16_t method, const EncodeFunction &encode, double timeoutSeconds,
+                            ResponseCallback &&cb) {
+    if (!loop_->isInLoopThread()) {
+        // 请求在调用方的线程里编码好，loop线程中再原样发出去
+        Buffer payload;
+        RpcWriter writer(&payload);
+        encode(&writer);
+        std::string request = payload.retrieveAllAsString();
+        // C++11的lambda不能移动捕获，回调先拷贝一份
+        ResponseCallback callback(std::move(cb));
+        loop_->queueInLoop([this, method, request, timeoutSeconds, callback]() {
+            call(method, request, timeoutSeconds, callback);
+        });
+        return;
+    }
+
+    if (!conn_) {
+        if (cb) {
+            cb(kRpcUnavailable, StringPiece());
+        }
+        return;
+    }
+    uint32_t slot = allocateSlot();
+    if (slot == kMaxPendingCalls) {
+        if (cb) {
+            cb(kRpcOverloaded, StringPiece());
+        }
+        return;
+    }
+
+    uint32_t timeoutMs = 0;
+    PendingCall &pending = calls_[slot];
+    pending.callback = std::move(cb);
+    if (timeoutSeconds > 0) {
+        // 向上取整到毫秒，不会因为取整变成0(没有期限)
+        double ms = timeoutSeconds * 1000 + 0.999;
+        timeoutMs = ms >= 4294967295.0 ? 4294967295u : static_cast<uint32_t>(ms);
+        pending.deadlineUs = Timestamp::now().microSecondsSinceEpoch() +
+                             static_cast<int64_t>(timeoutSeconds * Timestamp::kMicroSecondsPerSecond);
+        heapPush(slot);
+        if (!ticking_) {
+            ticking_ = true;
+            tickTimer_ = loop_->runEvery(kDeadlineTickSeconds, [this]() { onDeadlineTick(); });
+        }
+    }
+
+    uint32_t requestId = (static_cast<uint32_t>(pending.generation) << 16) | slot;
+    Buffer *output = conn_->outputBuffer();
+    size_t start = RpcCodec::beginFrame(output);
+    RpcWriter writer(output);
+    encode(&writer);
+    RpcCodec::finishFrame(output, start, RpcCodec::kRequest, kRpcOk, method, requestId, timeoutMs);
+    conn_->sendOutputBuffer();
+}
+
+void RpcClient::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        conn->setTcpNoDelay(true);
+        // 一轮循环中发起的调用攒在outputBuffer_里一次write
+        conn->setWriteBatching(true);
+        conn_ = conn;
+    } else {
+        conn_.reset();
+        // 已经发出去的请求不会再有响应了
+        failAll(kRpcUnavailable);
+    }
+    if (connectionCallback_) {
+        connectionCallback_(conn);
+    }
+}
+
+void RpcClient::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+    for (;;) {
+        RpcCodec::Header header;
+        bool error;
+        if (!RpcCodec::parseHeader(buf, kMaxResponseFrameBytes, &header, &error)) {
+            if (error) {
+                LOG_ERROR("RpcClient: bad frame from %s, closing", conn->peerAddress().toIpPort().c_str());
+                buf->retrieveAll();
+                conn->forceClose();
+            }
+            return;
+        }
+        size_t frameBytes = RpcCodec::frameBytes(header);
+        uint32_t slot = header.requestId & 0xFFFF;
+        uint16_t generation = static_cast<uint16_t>(header.requestId >> 16);
+        // 槽位已经被超时释放(迟到的响应)或者已经换了代数时丢弃
+        if (header.type != RpcCodec::kResponse || slot >= calls_.size() || !calls_[slot].inUse ||
+            calls_[slot].generation != generation) {
+            buf->retrieve(frameBytes);
+            continue;
+        }
+
+        ResponseCallback callback(releaseSlot(slot));
+        if (callback) {
+            callback(header.status,
+                     StringPiece(buf->peek() + RpcCodec::kHeaderBytes, frameBytes - RpcCodec::kHeaderBytes));
+        }
+        buf->retrieve(frameBytes);
+    }
+}
+
+/**
+ * 弹出所有已经到期的调用；回调里可能又发起新的调用，所以每次都重新看堆顶
+ * 堆空了就停掉定时器，没有带期限的调用时loop不会被定时器唤醒
+ */
+void RpcClient::onDeadlineTick() {
+    int64_t nowUs = Timestamp::now().microSecondsSinceEpoch();
+    while (!deadlines_.empty() && calls_[deadlines_[0]].deadlineUs <= nowUs) {
+        ResponseCallback callback(releaseSlot(deadlines_[0]));
+        if (callback) {
+            callback(kRpcDeadlineExceeded, StringPiece());
+        }
+    }
+    if (deadlines_.empty() && ticking_) {
+        ticking_ = false;
+        loop_->cancel(tickTimer_);
+    }
+}
+
+uint32_t RpcClient::allocateSlot() {
+    uint32_t slot;
+    if (freeHead_ != kMaxPendingCalls) {
+        slot = freeHead_;
+        freeHead_ = calls_[slot].nextFree;
+    } else if (calls_.size() < kMaxPendingCalls) {
+        slot = static_cast<uint32_t>(calls_.size());
+        calls_.emplace_back();
+    } else {
+        return kMaxPendingCalls;
+    }
+    calls_[slot].inUse = true;
+    ++numPending_;
+    return slot;
+}
+
+RpcClient::ResponseCallback RpcClient::releaseSlot(uint32_t slot) {
+    PendingCall &pending = calls_[slot];
+    if (pending.heapIndex >= 0) {
+        heapRemove(slot);
+    }
+    ResponseCallback callback(std::move(pending.callback));
+    pending.callback = nullptr;
+    pending.inUse = false;
+    ++pending.generation;
+    pending.nextFree = freeHead_;
+    freeHead_ = slot;
+    --numPending_;
+    return callback;
+}
+
+void RpcClient::failAll(RpcStatus status) {
+    for (uint32_t slot = 0; slot < calls_.size() && numPending_ > 0; ++slot) {
+        if (calls_[slot].inUse) {
+            ResponseCallback callback(releaseSlot(slot));
+            if (callback) {
+                callback(status, StringPiece());
+            }
+        }
+    }
+}
+
+void RpcClient::heapPush(uint32_t slot) {
+    deadlines_.push_back(slot);
+    heapSet(deadlines_.size() - 1, slot);
+    heapSiftUp(deadlines_.size() - 1);
+}
+
+void RpcClient::heapRemove(uint32_t slot) {
+    size_t index = static_cast<size_t>(calls_[slot].heapIndex);
+    calls_[slot].heapIndex = -1;
+    uint32_t last = deadlines_.back();
+    deadlines_.pop_back();
+    if (index < deadlines_.size()) {
+        // 把最后一个元素挪到空出来的位置，它可能比父节点小，也可能比子节点大
+        heapSet(index, last);
+        heapSiftUp(index);
+        heapSiftDown(static_cast<size_t>(calls_[last].heapIndex));
+    }
+}
+
+void RpcClient::heapSiftUp(size_t index) {
+    uint32_t slot = deadlines_[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (calls_[deadlines_[parent]].deadlineUs <= calls_[slot].deadlineUs) {
+            break;
+        }
+        heapSet(index, deadlines_[parent]);
+        index = parent;
+    }
+    heapSet(index, slot);
+}
+
+void RpcClient::heapSiftDown(size_t index) {
+    uint32_t slot = deadlines_[index];
+    size_t size = deadlines_.size();
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size &&
+            calls_[deadlines_[child + 1]].deadlineUs < calls_[deadlines_[child]].deadlineUs) {
+            ++child;
+        }
+        if (calls_[slot].deadlineUs <= calls_[deadlines_[child]].deadlineUs) {
+            break;
+        }
+        heapSet(index, deadlines_[child]);
+        index = child;
+    }
+    heapSet(index, slot);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Callbacks.h"
+#include "RpcCodec.h"
+#include "StringPiece.h"
+#include "TcpClient.h"
+#include "TimerId.h"
+#include "noncopyable.h"
+
+/**
+ * 基于TcpClient的二进制RPC客户端，和RpcServer配对使用，帧格式见RpcCodec.h
+ *
+ * 所有调用复用同一条连接，每个调用占一个槽位，请求id = (槽位的代数 << 16) | 槽位下标：
+ * 响应到达时直接按下标找到槽位，不需要查表；槽位复用时代数加一，迟到的响应(已经超时的调用)对不上代数，直接丢弃
+ * 同时在途的调用最多kMaxPendingCalls个，超过时回调kRpcOverloaded
+ *
+ * 期限：有期限的调用按到期时间放进一个最小堆，loop上一个每kDeadlineTickSeconds执行一次的定时器弹出到期的调用，
+ * 回调kRpcDeadlineExceeded。精度是一个tick；堆空了之后定时器在下一个tick停掉，再有调用时重新启动
+ * 剩余的时间预算随请求发给服务端，服务端轮到处理时已经过期的请求直接丢弃
+ * 连接断开时所有在途的调用回调kRpcUnavailable；没有连接时发起的调用立即回调kRpcUnavailable
+ *
+ * 在loop线程中调用时，请求直接编码进连接的outputBuffer_(批量写，一轮循环中的调用只需要一次write)，
+ * 回调移动进预先分配好的槽位，响应的载荷是指向inputBuffer_的StringPiece。预热之后整个调用过程不分配内存，
+ * 前提是回调放得进std::function自己的空间(libstdc++中是16字节、可以平凡拷贝的lambda，比如只捕获一两个指针)
+ * 在其它线程中调用时请求先编码成std::string再投递到loop线程，会有几次内存分配
+ *
+ * ResponseCallback都在loop线程中调用，载荷只在回调期间有效
+ * 析构时还没有完成的调用回调kRpcUnavailable；析构和其它线程中的call不能同时进行
+ **/
+class RpcClient : noncopyable {
+   public:
+    using ResponseCallback = std::function<void(RpcStatus, const StringPiece &payload)>;
+
+    static const size_t kMaxPendingCalls = 65536;
+    static constexpr double kDeadlineTickSeconds = 0.005;
+
+    RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &name);
+    ~RpcClient();
+
+    EventLoop *getLoop() const { return loop_; }
+
+    // 连接建立和断开时在loop线程中调用，必须在connect之前设置
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void enableRetry() { client_.enableRetry(); }
+    void connect() { client_.connect(); }
+    void disconnect() { client_.disconnect(); }
+
+    // 只能在loop线程中调用
+    bool connected() const { return static_cast<bool>(conn_); }
+    size_t pendingCalls() const { return numPending_; }
+
+    /**
+     * 以method调用服务端，request原样作为请求的载荷，timeoutSeconds秒内没有收到响应就回调kRpcDeadlineExceeded，
+     * timeoutSeconds不大于0表示没有期限。可以在任意线程调用，cb总是在loop线程中调用
+     **/
+    void call(uint16_t method, const StringPiece &request, double timeoutSeconds, ResponseCallback cb);
+    // 用RpcSerializer<T>编码请求
+    template <typename T>
+    void callValue(uint16_t method, const T &request, double timeoutSeconds, ResponseCallback cb) {
+        callWith(method, [&request](RpcWriter *writer) { RpcSerializer<T>::encode(request, writer); },
+                 timeoutSeconds, std::move(cb));
+    }
+    // 由encode把请求的载荷写进RpcWriter
+    template <typename Encoder>
+    void callWith(uint16_t method, const Encoder &encode, double timeoutSeconds, ResponseCallback cb) {
+        callEncoded(method, [&encode](RpcWriter *writer) { encode(writer); }, timeoutSeconds,
+                    std::move(cb));
+    }
+
+   private:
+    using EncodeFunction = std::function<void(RpcWriter *)>;
+
+    // 一个在途的调用
+    struct PendingCall {
+        PendingCall() : inUse(false), generation(0), heapIndex(-1), nextFree(0), deadlineUs(0) {}
+        ResponseCallback callback;
+        bool inUse;
+        uint16_t generation;
+        int heapIndex;       // 在deadlines_中的下标，没有期限时为-1
+        uint32_t nextFree;   // 空闲链表的下一个槽位
+        int64_t deadlineUs;
+    };
+
+    void callEncoded(uint16_t method, const EncodeFunction &encode, double timeoutSeconds,
+                     ResponseCallback &&cb);
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void onDeadlineTick();
+
+    // 找一个空闲的槽位，满了返回kMaxPendingCalls
+    uint32_t allocateSlot();
+    // 槽位结束时调用：移出期限堆、代数加一、放回空闲链表，返回它的回调
+    ResponseCallback releaseSlot(uint32_t slot);
+    void failAll(RpcStatus status);
+
+    // deadlines_是按deadlineUs排列的最小堆，元素是槽位下标
+    void heapPush(uint32_t slot);
+    void heapRemove(uint32_t slot);
+    void heapSiftUp(size_t index);
+    void heapSiftDown(size_t index);
+    void heapSet(size_t index, uint32_t slot) {
+        deadlines_[index] = slot;
+        calls_[slot].heapIndex = static_cast<int>(index);
+    }
+
+    EventLoop *loop_;
+    ConnectionCallback connectionCallback_;
+    TcpConnectionPtr conn_;  // 只在loop线程中访问，没有连接时为空
+
+    // 以下都只在loop线程中访问
+    std::vector<PendingCall> calls_;
+    uint32_t freeHead_;  // 空闲链表的头，kMaxPendingCalls表示空
+    size_t numPending_;
+    std::vector<uint32_t> deadlines_;
+    TimerId tickTimer_;
+    bool ticking_;
+
+    TcpClient client_;
+};
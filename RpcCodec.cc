@@ -0,0 +1,86 @@
+#include "RpcCodec.h"
+
+namespace {
+
+uint32_t peekUint32(const char *p) {
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    return (static_cast<uint32_t>(u[0]) << 24) | (static_cast<uint32_t>(u[1]) << 16) |
+           (static_cast<uint32_t>(u[2]) << 8) | static_cast<uint32_t>(u[3]);
+}
+
+void pokeUint32(char *p, uint32_t v) {
+    p[0] = static_cast<char>(v >> 24);
+    p[1] = static_cast<char>(v >> 16);
+    p[2] = static_cast<char>(v >> 8);
+    p[3] = static_cast<char>(v);
+}
+
+}  // namespace
+
+const char *rpcStatusString(RpcStatus status) {
+    switch (status) {
+        case kRpcOk:
+            return "ok";
+        case kRpcNoSuchMethod:
+            return "no such method";
+        case kRpcBadRequest:
+            return "bad request";
+        case kRpcApplicationError:
+            return "application error";
+        case kRpcDeadlineExceeded:
+            return "deadline exceeded";
+        case kRpcUnavailable:
+            return "unavailable";
+        case kRpcOverloaded:
+            return "overloaded";
+    }
+    return "unknown";
+}
+
+const size_t RpcCodec::kHeaderBytes;
+
+bool RpcCodec::parseHeader(const Buffer *buf, size_t maxFrameBytes, Header *header, bool *error) {
+    *error = false;
+    if (buf->readableBytes() < kHeaderBytes) {
+        return false;
+    }
+    const char *p = buf->peek();
+    header->length = peekUint32(p);
+    if (header->length < kHeaderBytes - 4 || header->length > maxFrameBytes - 4) {
+        *error = true;
+        return false;
+    }
+    uint8_t type = static_cast<uint8_t>(p[4]);
+    if (type != kRequest && type != kResponse) {
+        *error = true;
+        return false;
+    }
+    if (buf->readableBytes() < frameBytes(*header)) {
+        return false;
+    }
+    header->type = static_cast<FrameType>(type);
+    header->status = static_cast<RpcStatus>(static_cast<uint8_t>(p[5]));
+    header->method = static_cast<uint16_t>((static_cast<uint8_t>(p[6]) << 8) | static_cast<uint8_t>(p[7]));
+    header->requestId = peekUint32(p + 8);
+    header->timeoutMs = peekUint32(p + 12);
+    return true;
+}
+
+size_t RpcCodec::beginFrame(Buffer *output) {
+    size_t start = output->readableBytes();
+    char placeholder[kHeaderBytes] = {0};
+    output->append(placeholder, kHeaderBytes);
+    return start;
+}
+
+void RpcCodec::finishFrame(Buffer *output, size_t start, FrameType type, RpcStatus status,
+                           uint16_t method, uint32_t requestId, uint32_t timeoutMs) {
+    char *p = output->mutablePeek() + start;
+    pokeUint32(p, static_cast<uint32_t>(output->readableBytes() - start - 4));
+    p[4] = static_cast<char>(type);
+    p[5] = static_cast<char>(status);
+    p[6] = static_cast<char>(method >> 8);
+    p[7] = static_cast<char>(method);
+    pokeUint32(p + 8, requestId);
+    pokeUint32(p + 12, timeoutMs);
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Buffer.h"
+#include "StringPiece.h"
+
+/**
+ * RpcServer/RpcClient之间的二进制协议
+ *
+ * 一条连接上可以同时有很多个调用，每个帧带着请求id，响应按处理完成的顺序发回，不需要和请求的顺序一致
+ * 帧头16字节，整数都是网络字节序：
+ *
+ *  0        4      5        6        8             12           16
+ * +--------+------+--------+--------+-------------+------------+----------------
+ * | length | type | status | method |  requestId  | timeoutMs  | payload ...
+ * +--------+------+--------+--------+-------------+------------+----------------
+ *
+ * length：length字段之后的字节数，也就是12 + 载荷长度
+ * type：kRequest/kResponse；status：响应的RpcStatus，请求中为0
+ * method：方法编号，响应中原样带回；timeoutMs：请求剩余的时间预算，0表示没有期限，响应中为0
+ *
+ * 载荷的编码由使用方决定，框架只搬运字节；内置的RpcWriter/RpcReader是一种简单的二进制编码，
+ * RpcSerializer<T>把类型和编码方式对应起来，特化它就可以换成别的序列化方式
+ **/
+enum RpcStatus {
+    kRpcOk = 0,
+    kRpcNoSuchMethod = 1,     // 服务端没有注册这个方法
+    kRpcBadRequest = 2,       // 请求的载荷解码失败
+    kRpcApplicationError = 3, // 方法自己返回的错误，载荷里可以带错误信息
+    kRpcDeadlineExceeded = 4, // 客户端：期限之前没有收到响应
+    kRpcUnavailable = 5,      // 客户端：没有连接，或者等待响应期间连接断开了
+    kRpcOverloaded = 6,       // 客户端：在途的调用太多
+};
+
+const char *rpcStatusString(RpcStatus status);
+
+class RpcCodec {
+   public:
+    enum FrameType { kRequest = 1, kResponse = 2 };
+
+    static const size_t kHeaderBytes = 16;
+
+    struct Header {
+        uint32_t length;
+        FrameType type;
+        RpcStatus status;
+        uint16_t method;
+        uint32_t requestId;
+        uint32_t timeoutMs;
+    };
+
+    /**
+     * buf开头有一个完整的帧时解析帧头并返回true，载荷是[peek() + kHeaderBytes, peek() + frameBytes(header))
+     * 数据不够时返回false；帧不合法(长度不够帧头、超过maxFrameBytes、类型不对)时返回false并置*error为true
+     **/
+    static bool parseHeader(const Buffer *buf, size_t maxFrameBytes, Header *header, bool *error);
+    static size_t frameBytes(const Header &header) { return 4 + header.length; }
+
+    /**
+     * 在output的末尾开始一个帧：先写一个帧头占位，调用方接着直接往output里追加载荷，
+     * 最后用finishFrame回填长度，载荷不需要先编码到别的地方再拷贝一次。返回帧在output可读区域中的偏移
+     **/
+    static size_t beginFrame(Buffer *output);
+    static void finishFrame(Buffer *output, size_t start, FrameType type, RpcStatus status,
+                            uint16_t method, uint32_t requestId, uint32_t timeoutMs);
+};
+
+/**
+ * 内置的二进制编码：定长整数是网络字节序，varint是LEB128，字符串/字节串是varint长度加内容
+ * 直接追加到Buffer末尾(比如连接的outputBuffer_)，不经过中间的std::string
+ **/
+class RpcWriter {
+   public:
+    explicit RpcWriter(Buffer *buf) : buf_(buf) {}
+
+    void writeUint8(uint8_t v) { buf_->append(reinterpret_cast<const char *>(&v), 1); }
+    void writeUint16(uint16_t v) {
+        char bytes[2] = {static_cast<char>(v >> 8), static_cast<char>(v)};
+        buf_->append(bytes, 2);
+    }
+    void writeUint32(uint32_t v) {
+        char bytes[4];
+        for (int i = 0; i < 4; ++i) {
+            bytes[i] = static_cast<char>(v >> (24 - 8 * i));
+        }
+        buf_->append(bytes, 4);
+    }
+    void writeUint64(uint64_t v) {
+        char bytes[8];
+        for (int i = 0; i < 8; ++i) {
+            bytes[i] = static_cast<char>(v >> (56 - 8 * i));
+        }
+        buf_->append(bytes, 8);
+    }
+    void writeVarint(uint64_t v) {
+        char bytes[10];
+        size_t n = 0;
+        while (v >= 0x80) {
+            bytes[n++] = static_cast<char>(v | 0x80);
+            v >>= 7;
+        }
+        bytes[n++] = static_cast<char>(v);
+        buf_->append(bytes, n);
+    }
+    void writeDouble(double v) {
+        uint64_t bits;
+        ::memcpy(&bits, &v, sizeof bits);
+        writeUint64(bits);
+    }
+    void writeBytes(const StringPiece &bytes) {
+        writeVarint(bytes.size());
+        buf_->append(bytes.data(), bytes.size());
+    }
+    // 不带长度，原样追加
+    void writeRaw(const StringPiece &bytes) { buf_->append(bytes.data(), bytes.size()); }
+
+    Buffer *buffer() { return buf_; }
+
+   private:
+    Buffer *buf_;
+};
+
+/**
+ * 从一段载荷中按RpcWriter的编码读出来，越界或者格式不对之后ok()为false，之后的读取都返回0/空
+ * readBytes返回的StringPiece指向载荷本身，不拷贝
+ **/
+class RpcReader {
+   public:
+    explicit RpcReader(const StringPiece &data) : p_(data.begin()), end_(data.end()), ok_(true) {}
+
+    bool ok() const { return ok_; }
+    // 所有数据都读完了并且没有出错
+    bool done() const { return ok_ && p_ == end_; }
+
+    uint8_t readUint8() { return static_cast<uint8_t>(readFixed(1)); }
+    uint16_t readUint16() { return static_cast<uint16_t>(readFixed(2)); }
+    uint32_t readUint32() { return static_cast<uint32_t>(readFixed(4)); }
+    uint64_t readUint64() { return readFixed(8); }
+    uint64_t readVarint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64 && p_ < end_; shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(*p_++);
+            v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return v;
+            }
+        }
+        ok_ = false;
+        return 0;
+    }
+    double readDouble() {
+        uint64_t bits = readUint64();
+        double v;
+        ::memcpy(&v, &bits, sizeof v);
+        return v;
+    }
+    StringPiece readBytes() {
+        uint64_t len = readVarint();
+        if (!ok_ || len > static_cast<uint64_t>(end_ - p_)) {
+            ok_ = false;
+            return StringPiece();
+        }
+        StringPiece bytes(p_, static_cast<size_t>(len));
+        p_ += len;
+        return bytes;
+    }
+
+   private:
+    uint64_t readFixed(int n) {
+        if (!ok_ || end_ - p_ < n) {
+            ok_ = false;
+            return 0;
+        }
+        uint64_t v = 0;
+        for (int i = 0; i < n; ++i) {
+            v = (v << 8) | static_cast<uint8_t>(p_[i]);
+        }
+        p_ += n;
+        return v;
+    }
+
+    const char *p_;
+    const char *end_;
+    bool ok_;
+};
+
+/**
+ * 类型T怎么编码成载荷：默认调用T的成员函数
+ *     void encode(RpcWriter *writer) const;
+ *     bool decode(RpcReader *reader);
+ * 整数(varint)、double、std::string有内置的特化；换用protobuf等其它序列化方式时，特化这个模板即可
+ **/
+template <typename T, typename Enable = void>
+struct RpcSerializer {
+    static void encode(const T &value, RpcWriter *writer) { value.encode(writer); }
+    static bool decode(RpcReader *reader, T *value) { return value->decode(reader); }
+};
+
+template <typename T>
+struct RpcSerializer<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    // 有符号数用zigzag，绝对值小的负数也只占很少的字节
+    static void encode(const T &value, RpcWriter *writer) {
+        writer->writeVarint(std::is_signed<T>::value
+                                ? (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63)
+                                : static_cast<uint64_t>(value));
+    }
+    static bool decode(RpcReader *reader, T *value) {
+        uint64_t v = reader->readVarint();
+        *value = static_cast<T>(std::is_signed<T>::value ? (v >> 1) ^ (~(v & 1) + 1) : v);
+        return reader->ok();
+    }
+};
+
+template <>
+struct RpcSerializer<double> {
+    static void encode(const double &value, RpcWriter *writer) { writer->writeDouble(value); }
+    static bool decode(RpcReader *reader, double *value) {
+        *value = reader->readDouble();
+        return reader->ok();
+    }
+};
+
+template <>
+struct RpcSerializer<std::string> {
+    static void encode(const std::string &value, RpcWriter *writer) { writer->writeBytes(value); }
+    static bool decode(RpcReader *reader, std::string *value) {
+        StringPiece bytes = reader->readBytes();
+        value->assign(bytes.data(), bytes.size());
+        return reader->ok();
+    }
+};
+
+// 编码不需要拷贝；解码时只能得到指向载荷的StringPiece
+template <>
+struct RpcSerializer<StringPiece> {
+    static void encode(const StringPiece &value, RpcWriter *writer) { writer->writeBytes(value); }
+    static bool decode(RpcReader *reader, StringPiece *value) {
+        *value = reader->readBytes();
+        return reader->ok();
+    }
+};
+
+template <typename T>
+struct RpcSerializer<std::vector<T>> {
+    static void encode(const std::vector<T> &value, RpcWriter *writer) {
+        writer->writeVarint(value.size());
+        for (const T &item : value) {
+            RpcSerializer<T>::encode(item, writer);
+        }
+    }
+    static bool decode(RpcReader *reader, std::vector<T> *value) {
+        uint64_t n = reader->readVarint();
+        value->clear();
+        for (uint64_t i = 0; i < n && reader->ok(); ++i) {
+            value->emplace_back();
+            RpcSerializer<T>::decode(reader, &value->back());
+        }
+        return reader->ok();
+    }
+};
+
+// 把整个载荷解码成一个T，载荷有多余的字节也算失败
+template <typename T>
+bool rpcDecode(const StringPiece &payload, T *value) {
+    RpcReader reader(payload);
+    return RpcSerializer<T>::decode(&reader, value) && reader.done();
+}
@@ -0,0 +1,155 @@
+#include "RpcServer.h"
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+const size_t RpcServer::kDefaultMaxFrameBytes;
+const int RpcServer::kDefaultMaxRequestsPerRead;
+
+static bool expired(Timestamp deadline, Timestamp now) {
+    return deadline.microSecondsSinceEpoch() != 0 && deadline < now;
+}
+
+TcpConnectionPtr RpcResponder::target() const {
+    TcpConnectionPtr conn = conn_.lock();
+    if (!conn || !conn->connected() || expired(deadline_, Timestamp::now())) {
+        return TcpConnectionPtr();
+    }
+    return conn;
+}
+
+void RpcResponder::respond(RpcStatus status, const StringPiece &payload) const {
+    respondWith(status, [&payload](RpcWriter *writer) {
+        writer->writeRaw(payload);
+    });
+}
+
+void RpcResponder::respondEncoded(RpcStatus status, const EncodeFunction &encode) const {
+    TcpConnectionPtr conn = target();
+    if (!conn) {
+        return;
+    }
+    if (conn->getLoop()->isInLoopThread()) {
+        Buffer *output = conn->outputBuffer();
+        size_t start = RpcCodec::beginFrame(output);
+        RpcWriter writer(output);
+        encode(&writer);
+        RpcCodec::finishFrame(output, start, RpcCodec::kResponse, status, method_, requestId_, 0);
+        conn->sendOutputBuffer();
+        return;
+    }
+    // 不在连接的线程中，outputBuffer_不能碰，只能编码成一个完整的帧交给send投递过去
+    Buffer frame;
+    size_t start = RpcCodec::beginFrame(&frame);
+    RpcWriter writer(&frame);
+    encode(&writer);
+    RpcCodec::finishFrame(&frame, start, RpcCodec::kResponse, status, method_, requestId_, 0);
+    conn->send(frame.retrieveAllAsString());
+}
+
+RpcServer::RpcServer(EventLoop *loop, const InetAddress &listenAddr,
+                     const std::string &name, TcpServer::Option option)
+    : loop_(loop),
+      maxFrameBytes_(kDefaultMaxFrameBytes),
+      maxRequestsPerRead_(kDefaultMaxRequestsPerRead),
+      server_(loop, listenAddr, name, option) {
+    server_.setConnectionCallback(
+        std::bind(&RpcServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(
+        std::bind(&RpcServer::onMessage, this, std::placeholders::_1,
+                  std::placeholders::_2, std::placeholders::_3));
+    // 一次读到的所有请求的响应攒在outputBuffer_里，本轮循环结束时一次write
+    server_.setWriteBatching(true);
+}
+
+void RpcServer::registerMethod(uint16_t method, const Handler &handler) {
+    if (method >= methods_.size()) {
+        methods_.resize(method + 1);
+    }
+    methods_[method].handler = handler;
+    methods_[method].asyncHandler = nullptr;
+}
+
+void RpcServer::registerAsyncMethod(uint16_t method, const AsyncHandler &handler) {
+    if (method >= methods_.size()) {
+        methods_.resize(method + 1);
+    }
+    methods_[method].handler = nullptr;
+    methods_[method].asyncHandler = handler;
+}
+
+void RpcServer::start() { server_.start(); }
+
+void RpcServer::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        conn->setTcpNoDelay(true);
+    }
+}
+
+/**
+ * 逐个取出inputBuffer_中完整的请求帧分发，响应都追加在outputBuffer_里，最后统一发送
+ * 帧不合法时后面的数据已经没法找到帧的边界，只能关闭连接
+ */
+void RpcServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+    for (int handled = 0;; ++handled) {
+        if (handled >= maxRequestsPerRead_ && buf->readableBytes() > 0) {
+            conn->yieldRead();
+            break;
+        }
+
+        RpcCodec::Header header;
+        bool error;
+        if (!RpcCodec::parseHeader(buf, maxFrameBytes_, &header, &error)) {
+            if (error) {
+                LOG_ERROR("RpcServer: bad frame from %s, closing", conn->peerAddress().toIpPort().c_str());
+                buf->retrieveAll();
+                conn->forceClose();
+            }
+            break;
+        }
+        if (header.type != RpcCodec::kRequest) {
+            LOG_ERROR("RpcServer: unexpected response frame from %s, closing",
+                      conn->peerAddress().toIpPort().c_str());
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+
+        StringPiece payload(buf->peek() + RpcCodec::kHeaderBytes,
+                            RpcCodec::frameBytes(header) - RpcCodec::kHeaderBytes);
+        dispatch(conn, header, payload, receiveTime);
+        buf->retrieve(RpcCodec::frameBytes(header));
+    }
+    conn->sendOutputBuffer();
+}
+
+void RpcServer::dispatch(const TcpConnectionPtr &conn, const RpcCodec::Header &header,
+                         const StringPiece &payload, Timestamp receiveTime) {
+    Timestamp deadline;
+    if (header.timeoutMs != 0) {
+        deadline = Timestamp(receiveTime.microSecondsSinceEpoch() +
+                             static_cast<int64_t>(header.timeoutMs) * 1000);
+        // 在inputBuffer_里排队(yieldRead)期间已经过期，客户端已经放弃了，不必再处理
+        if (expired(deadline, Timestamp::now())) {
+            return;
+        }
+    }
+
+    RpcRequest request(conn, header.method, header.requestId, payload, receiveTime, deadline);
+    const Method *method = header.method < methods_.size() ? &methods_[header.method] : nullptr;
+    if (method != nullptr && method->asyncHandler) {
+        method->asyncHandler(request, RpcResponder(conn, header.method, header.requestId, deadline));
+        return;
+    }
+
+    Buffer *output = conn->outputBuffer();
+    size_t start = RpcCodec::beginFrame(output);
+    RpcStatus status = kRpcNoSuchMethod;
+    if (method != nullptr && method->handler) {
+        RpcWriter writer(output);
+        status = method->handler(request, &writer);
+    }
+    RpcCodec::finishFrame(output, start, RpcCodec::kResponse, status, header.method,
+                          header.requestId, 0);
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "RpcCodec.h"
+#include "StringPiece.h"
+#include "TcpServer.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+/**
+ * 一个请求，只在处理函数执行期间有效：payload直接指向连接的inputBuffer_，需要保留的要拷贝出来
+ **/
+class RpcRequest {
+   public:
+    RpcRequest(const TcpConnectionPtr &conn, uint16_t method, uint32_t requestId,
+               const StringPiece &payload, Timestamp receiveTime, Timestamp deadline)
+        : conn_(conn), method_(method), requestId_(requestId), payload_(payload),
+          receiveTime_(receiveTime), deadline_(deadline) {}
+
+    const TcpConnectionPtr &connection() const { return conn_; }
+    uint16_t method() const { return method_; }
+    uint32_t requestId() const { return requestId_; }
+    const StringPiece &payload() const { return payload_; }
+    Timestamp receiveTime() const { return receiveTime_; }
+    // 客户端不再等待响应的时间点(按收到请求的时间加上客户端剩余的预算计算)，没有期限时为0
+    Timestamp deadline() const { return deadline_; }
+    bool hasDeadline() const { return deadline_.microSecondsSinceEpoch() != 0; }
+
+    template <typename T>
+    bool decode(T *value) const { return rpcDecode(payload_, value); }
+
+   private:
+    const TcpConnectionPtr &conn_;
+    uint16_t method_;
+    uint32_t requestId_;
+    StringPiece payload_;
+    Timestamp receiveTime_;
+    Timestamp deadline_;
+};
+
+/**
+ * 异步处理函数用来在之后回复一个请求，可以拷贝、可以在任意线程调用，只能回复一次
+ * 只持有连接的weak_ptr，连接已经断开、或者已经过了请求的期限时，回复直接丢弃
+ * 在连接所在的loop线程中调用时响应直接编码进outputBuffer_；在其它线程中调用时先编码成一个std::string再投递过去
+ * 不要在同一个连接的同步处理函数里调用(那时outputBuffer_里有一个还没写完的帧)
+ **/
+class RpcResponder {
+   public:
+    RpcResponder() : requestId_(0), method_(0) {}
+    RpcResponder(const TcpConnectionPtr &conn, uint16_t method, uint32_t requestId, Timestamp deadline)
+        : conn_(conn), requestId_(requestId), method_(method), deadline_(deadline) {}
+
+    // payload原样作为响应的载荷
+    void respond(RpcStatus status, const StringPiece &payload = StringPiece()) const;
+    // 用RpcSerializer<T>编码value作为载荷
+    template <typename T>
+    void respondValue(RpcStatus status, const T &value) const {
+        respondWith(status, [&value](RpcWriter *writer) { RpcSerializer<T>::encode(value, writer); });
+    }
+    // 由encode把载荷写进RpcWriter
+    template <typename Encoder>
+    void respondWith(RpcStatus status, const Encoder &encode) const {
+        respondEncoded(status, [&encode](RpcWriter *writer) { encode(writer); });
+    }
+
+   private:
+    using EncodeFunction = std::function<void(RpcWriter *)>;
+    // 传进来的lambda只捕获一个引用，存放在std::function自己的空间里，不会分配内存
+    void respondEncoded(RpcStatus status, const EncodeFunction &encode) const;
+    // 连接已经断开或者过了期限时返回空
+    TcpConnectionPtr target() const;
+
+    std::weak_ptr<TcpConnection> conn_;
+    uint32_t requestId_;
+    uint16_t method_;
+    Timestamp deadline_;
+};
+
+/**
+ * 基于TcpServer的二进制RPC服务端，帧格式见RpcCodec.h
+ *
+ * 多路复用：一个连接上可以同时有很多个在途的请求，响应带着请求id，按处理完成的顺序发回
+ * 分发：方法编号直接作为下标查分发表
+ * 同步处理函数在连接所在的loop线程中调用，响应直接序列化进outputBuffer_里预留好帧头的位置，返回之后回填帧头；
+ * 连接开启了批量写，一次读到的所有请求的响应只需要一次write。整个过程不分配内存
+ * 异步处理函数拿到一个RpcResponder，处理完之后(可以在别的线程)再回复，后到的请求可以先回复
+ * 期限：请求带着客户端剩余的时间预算，轮到处理时已经过期的请求直接丢弃，过期之后的回复也丢弃
+ * 帧长度超过maxFrameBytes或者格式错误时关闭连接
+ **/
+class RpcServer : noncopyable {
+   public:
+    // 同步处理：把响应载荷写进response并返回状态，返回非kRpcOk时写入的内容仍然作为载荷发回(比如错误信息)
+    using Handler = std::function<RpcStatus(const RpcRequest &, RpcWriter *response)>;
+    using AsyncHandler = std::function<void(const RpcRequest &, const RpcResponder &)>;
+
+    static const size_t kDefaultMaxFrameBytes = 16 * 1024 * 1024;
+    static const int kDefaultMaxRequestsPerRead = 64;
+
+    RpcServer(EventLoop *loop, const InetAddress &listenAddr,
+              const std::string &name,
+              TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop *getLoop() const { return loop_; }
+
+    // 以下都必须在start之前调用，同一个方法编号后注册的覆盖先注册的
+    void registerMethod(uint16_t method, const Handler &handler);
+    void registerAsyncMethod(uint16_t method, const AsyncHandler &handler);
+    /**
+     * 按类型注册：请求解码成Request，handler填好Response，编码的方式由RpcSerializer决定
+     * 请求解码失败时回复kRpcBadRequest；Request/Response含有std::string等成员时每次调用都会构造它们
+     **/
+    template <typename Request, typename Response>
+    void registerMethod(uint16_t method,
+                        const std::function<RpcStatus(const Request &, Response *)> &handler) {
+        registerMethod(method, [handler](const RpcRequest &request, RpcWriter *writer) {
+            Request value;
+            if (!request.decode(&value)) {
+                return kRpcBadRequest;
+            }
+            Response response;
+            RpcStatus status = handler(value, &response);
+            RpcSerializer<Response>::encode(response, writer);
+            return status;
+        });
+    }
+
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    void setMaxFrameBytes(size_t bytes) { maxFrameBytes_ = bytes; }
+    void setMaxRequestsPerRead(int n) { maxRequestsPerRead_ = n; }
+    TcpServer *tcpServer() { return &server_; }
+
+    void start();
+
+   private:
+    struct Method {
+        Handler handler;
+        AsyncHandler asyncHandler;
+    };
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void dispatch(const TcpConnectionPtr &conn, const RpcCodec::Header &header,
+                  const StringPiece &payload, Timestamp receiveTime);
+
+    EventLoop *loop_;
+    // 下标是方法编号，start之后只读，各个loop线程可以同时查
+    std::vector<Method> methods_;
+    size_t maxFrameBytes_;
+    int maxRequestsPerRead_;
+    TcpServer server_;
+};
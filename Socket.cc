@@ -12,8 +12,8 @@
 Socket::~Socket() { close(sockfd_); }
 
 void Socket::bindAddress(const InetAddress &localaddr) {
-    if (0 != ::bind(sockfd_, (sockaddr *)localaddr.getSockAddr(),
-                    sizeof(sockaddr_in))) {
+    if (0 != ::bind(sockfd_, localaddr.getSockAddr(),
+                    localaddr.getSockLen())) {
         LOG_FATAL("bind sockfd:%d fail \n", sockfd_);
     }
 }
@@ -31,13 +31,14 @@ int Socket::accept(InetAddress *peeraddr) {
      * Reactor模型 one loop per thread
      * poller + non-blocking IO
      */
-    sockaddr_in addr;
+    // IPv4、IPv6、Unix域的对端地址都放得下
+    sockaddr_storage addr;
     socklen_t len = sizeof addr;
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr *)&addr, &len,
                            SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0) {
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr *)&addr, len);
     }
     return connfd;
 }
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+
+/**
+ * 指向别人内存的一段字符串(C++17 std::string_view的简化版)，不拥有数据，也不以'\0'结尾
+ * HttpRequest用它把方法、路径、头部直接指向连接的inputBuffer_，解析请求时不拷贝、不分配内存
+ * 被指向的内存释放或者移动之后StringPiece就失效了，使用方负责保证生命周期
+ **/
+class StringPiece {
+   public:
+    StringPiece() : data_(nullptr), size_(0) {}
+    StringPiece(const char *data, size_t size) : data_(data), size_(size) {}
+    StringPiece(const char *str) : data_(str), size_(::strlen(str)) {}
+    StringPiece(const std::string &str) : data_(str.data()), size_(str.size()) {}
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + size_; }
+    char operator[](size_t i) const { return data_[i]; }
+
+    std::string toString() const { return std::string(data_, size_); }
+
+    bool equalsIgnoreCase(const StringPiece &other) const {
+        return size_ == other.size_ &&
+               (size_ == 0 || ::strncasecmp(data_, other.data_, size_) == 0);
+    }
+
+   private:
+    const char *data_;
+    size_t size_;
+};
+
+inline bool operator==(const StringPiece &lhs, const StringPiece &rhs) {
+    return lhs.size() == rhs.size() &&
+           (lhs.size() == 0 || ::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0);
+}
+
+inline bool operator!=(const StringPiece &lhs, const StringPiece &rhs) {
+    return !(lhs == rhs);
+}
@@ -0,0 +1,139 @@
+#include "TcpClient.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include <future>
+
+#include "Logger.h"
+#include "MemoryPool.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop) {
+    if (loop == nullptr) {
+        LOG_FATAL("%s:%s:%d loop is null! \n", __FILE__, __FUNCTION__,
+                  __LINE__);
+    }
+    return loop;
+}
+
+/**
+ * TcpClient析构时连接还没有关闭完(forceClose是投递到loop中执行的)，
+ * 连接的closeCallback换成这个函数，关闭时不会再访问已经析构的TcpClient
+ */
+static void removeDetachedConnection(const TcpConnectionPtr &conn) {
+    conn->connectDestroyed();
+}
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr,
+                     const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop)),
+      connector_(std::make_shared<Connector>(loop, serverAddr)),
+      name_(nameArg),
+      connNamePrefix_(std::make_shared<const std::string>(
+          name_ + ":" + serverAddr.toIpPort() + "#")),
+      retry_(false),
+      connect_(false),
+      nextConnId_(1) {
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_DEBUG("TcpClient::TcpClient[%s] - connector %p \n", name_.c_str(),
+              connector_.get());
+}
+
+/**
+ * connector_和connection_都只能在loop线程中操作，和~TcpServer一样投递到loop中执行并且等它完成，
+ * 之后就不会再有回调访问到这个TcpClient了
+ */
+TcpClient::~TcpClient() {
+    LOG_DEBUG("TcpClient::~TcpClient[%s] - connector %p \n", name_.c_str(),
+              connector_.get());
+    connect_ = false;
+    std::promise<void> done;
+    loop_->runInLoop([this, &done]() {
+        connector_->stop();
+        TcpConnectionPtr conn;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            conn.swap(connection_);
+        }
+        if (conn) {
+            // 用户手里可能还持有这个连接，关闭之后它看到的就是一个已经断开的连接
+            conn->setCloseCallback(removeDetachedConnection);
+            conn->forceClose();
+        }
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+void TcpClient::connect() {
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s \n", name_.c_str(),
+             connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect() {
+    connect_ = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (connection_) {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop() {
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd) {
+    sockaddr_storage peer;
+    sockaddr_storage local;
+    socklen_t peerlen = sizeof peer;
+    socklen_t locallen = sizeof local;
+    ::memset(&peer, 0, sizeof peer);
+    ::memset(&local, 0, sizeof local);
+    if (::getpeername(sockfd, (sockaddr *)&peer, &peerlen) < 0) {
+        LOG_ERROR("sockets::getPeerAddr");
+    }
+    if (::getsockname(sockfd, (sockaddr *)&local, &locallen) < 0) {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+
+    // 和TcpServer::createConnection一样从loop线程的内存池中分配
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+        PoolAllocator<TcpConnection>(), loop_, nextConnId_++, connNamePrefix_,
+        sockfd, InetAddress((sockaddr *)&local, locallen),
+        InetAddress((sockaddr *)&peer, peerlen));
+
+    // 一个TcpClient同时只有一个连接，每次建立连接时构造一份回调集合就够了
+    ConnectionCallbacksPtr callbacks = std::make_shared<ConnectionCallbacks>();
+    callbacks->connectionCallback = connectionCallback_;
+    callbacks->messageCallback = messageCallback_;
+    callbacks->writeCompleteCallback = writeCompleteCallback_;
+    callbacks->closeCallback =
+        std::bind(&TcpClient::removeConnection, this, std::placeholders::_1);
+    conn->setCallbacks(callbacks);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (connection_ == conn) {
+            connection_.reset();
+        }
+    }
+
+    // 当前处在连接自己的handleClose中，和TcpServer::removeConnection一样直接销毁
+    conn->connectDestroyed();
+    if (retry_ && connect_) {
+        LOG_INFO("TcpClient::removeConnection[%s] - reconnecting to %s \n",
+                 name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Callbacks.h"
+#include "Connector.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "TcpConnection.h"
+#include "noncopyable.h"
+
+/**
+ * 对外的客户端编程使用的类，和TcpServer对应
+ *
+ * TcpServer通过Acceptor拿到connfd，TcpClient通过Connector拿到sockfd，之后都包装成TcpConnection，
+ * 回调类型、收发数据、关闭连接的方式完全一样，所以一个服务调用其它服务时可以直接在自己的subLoop上发起连接，
+ * 不需要额外的线程和阻塞socket
+ *
+ * 一个TcpClient同一时刻最多有一个连接，连接建立之后的所有回调都在loop线程中执行
+ * 开启enableRetry之后，连接断开时会用Connector重新发起连接(退避时间从头开始)
+ *
+ * 析构时会关闭当前的连接，并且等loop线程处理完这个TcpClient的清理工作，所以loop必须还在运行，或者在loop线程中析构
+ **/
+class TcpClient : noncopyable {
+   public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr,
+              const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();     // 可以在任意线程调用
+    void disconnect();  // 关闭当前连接的写端，不再重连
+    void stop();        // 停止正在进行的连接尝试
+
+    // 当前的连接，没有连上时为空
+    TcpConnectionPtr connection() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    bool retry() const { return retry_; }
+    void enableRetry() { retry_ = true; }
+    // connect失败之后的退避时间，见Connector::setRetryDelay，必须在connect之前调用
+    void setRetryDelay(int initDelayMs, int maxDelayMs) {
+        connector_->setRetryDelay(initDelayMs, maxDelayMs);
+    }
+
+    const std::string &name() const { return name_; }
+
+    // 以下回调必须在connect之前设置，每次建立连接时一起交给TcpConnection
+    void setConnectionCallback(const ConnectionCallback &cb) {
+        connectionCallback_ = cb;
+    }
+    void setMessageCallback(const MessageCallback &cb) {
+        messageCallback_ = cb;
+    }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) {
+        writeCompleteCallback_ = cb;
+    }
+
+   private:
+    // Connector连接成功之后在loop线程中调用
+    void newConnection(int sockfd);
+    // 连接关闭时由TcpConnection::handleClose在loop线程中调用
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    const std::shared_ptr<const std::string> connNamePrefix_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    uint64_t nextConnId_;  // 只在loop线程中使用
+
+    mutable std::mutex mutex_;  // 保护connection_，connection()可以在任意线程调用
+    TcpConnectionPtr connection_;
+};
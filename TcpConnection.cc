@@ -1,11 +1,13 @@
 #include "TcpConnection.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
 #include <strings.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <functional>
 #include <string>
 
@@ -22,23 +24,35 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop) {
     return loop;
 }
 
-TcpConnection::TcpConnection(EventLoop *loop, const std::string &nameArg,
-                             int sockfd, const InetAddress &localAddr,
-                             const InetAddress &peerAddr)
+// 还没有设置任何回调的连接共享这一份空的回调集合
+static const ConnectionCallbacksPtr &emptyCallbacks() {
+    static const ConnectionCallbacksPtr callbacks =
+        std::make_shared<ConnectionCallbacks>();
+    return callbacks;
+}
+
+TcpConnection::TcpConnection(
+    EventLoop *loop, uint64_t id,
+    const std::shared_ptr<const std::string> &namePrefix, int sockfd,
+    const InetAddress &localAddr, const InetAddress &peerAddr)
     : loop_(CheckLoopNotNull(loop)),
-      name_(nameArg),
+      id_(id),
+      namePrefix_(namePrefix),
       state_(kConnecting),
       reading_(true),
-      socket_(new Socket(
-          sockfd)),  // 这里的sockfd就是acceptor接受新的用户连接之后生成的connfd
-      channel_(new Channel(
-          loop,
-          sockfd)),  // 使用channel封装connfd，TcpConnection的作用就是对包装channel并且传递给subloop
+      writeBatching_(false),
+      readBudget_(0),
+      trafficBytes_(0),
+      socket_(sockfd),  // 这里的sockfd就是acceptor接受新的用户连接之后生成的connfd
+      channel_(loop,
+               sockfd),  // 使用channel封装connfd，TcpConnection的作用就是对包装channel并且传递给subloop
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 *
-                     1024)  // 一个TcpConnection接收64M数据就到水位线了
-{
+      callbacks_(emptyCallbacks()),
+      backpressureMark_(0),
+      backpressureActive_(false),
+      relaying_(false),
+      relaySplice_(false) {
     /**
      * 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
      *
@@ -53,25 +67,48 @@ TcpConnection::TcpConnection(EventLoop *loop, const std::string &nameArg,
      * 这里需要确认一点，系统默认设置的函数和用户自定义的函数是不冲突的，这个想法基于系统和用户是互斥的逻辑
      * 但是以下的逻辑完全可以成立：系统设置默认函数，这个函数的逻辑是执行用户自定义的函数
      **/
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    // 只捕获this的lambda可以放进std::function内部的小缓冲区，不像std::bind(成员函数指针, this)那样需要堆分配
+    channel_.setReadCallback(
+        [this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+    channel_.setCloseCallback([this]() { handleClose(); });
+    channel_.setErrorCallback([this]() { handleError(); });
+    channel_.setFlushCallback([this]() { handleFlush(); });
+    channel_.setReadyCallback(
+        [this](Timestamp receiveTime) { handleReady(receiveTime); });
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_DEBUG("TcpConnection::ctor[%s%llu] at fd=%d\n", namePrefix_->c_str(),
+              (unsigned long long)id_, sockfd);
+    socket_.setKeepAlive(true);
+    // 供EventLoopThreadPool按连接数选择subLoop
+    getLoop()->adjustConnectionCount(1);
 }
 
 TcpConnection::~TcpConnection() {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", name_.c_str(),
-             channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::dtor[%s%llu] at fd=%d state=%d \n",
+              namePrefix_->c_str(), (unsigned long long)id_, channel_.fd(),
+              (int)state_);
+    getLoop()->adjustConnectionCount(-1);
+}
+
+ConnectionCallbacks &TcpConnection::mutableCallbacks() {
+    if (!callbacks_.unique()) {
+        callbacks_ = std::make_shared<ConnectionCallbacks>(*callbacks_);
+    }
+    return *callbacks_;
+}
+
+// 用户可能在任意线程中第一次调用name()，所以用call_once保证只生成一次
+const std::string &TcpConnection::name() const {
+    std::call_once(nameOnce_,
+                   [this]() { name_ = *namePrefix_ + std::to_string(id_); });
+    return name_;
 }
 
 /**
  * 用户会给TcpServer注册一个onMessage方法，表示已连接用户有读写事件的时候执行onMessage方法
- * 这个onMessage函数会被TcpServer.setMessageCallback以及TcpConnection.setMessageCallback的形式
- * 注册成messageCallback_,而这个messageCallback_成员函数最终会在TcpConnection中的handleRead回调函数中被调用，
+ * 这个onMessage函数先由TcpServer.setMessageCallback保存下来，再以TcpServer::buildCallbacks和TcpConnection.setCallbacks的形式
+ * 最终成为所有连接共享的回调集合callbacks_中的messageCallback,而这个回调函数最终会在TcpConnection中的handleRead回调函数中被调用，
  * 也就是说当connfd发生读事件时会调用handleRead回调函数并且执行逻辑为用户自定义的onMessage函数，而这个onMessage函数中就调用了send函数
  * 我们在onMessage方法中处理完一些业务代码会send给客户端返回数据
  **/
@@ -87,15 +124,36 @@ void TcpConnection::send(const std::string &buf) {
          * 而该调用方属于main线程，所以CurThread为mainThread，一个线程是subThread，一个线程是mainThread
          * 因此loop_->isInLoopThread()的调用结果为false，最后会把sendInLoop函数放入loop_对应的pendingFunctors队列中等待被该subLoop执行
          */
-        if (loop_->isInLoopThread()) {
+        EventLoop *loop = getLoop();
+        if (loop->isInLoopThread()) {
             sendInLoop(buf.c_str(), buf.size());
         } else {
-            loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this,
-                                       buf.c_str(), buf.size()));
+            /**
+             * 跨线程发送时buf在sendInLoop真正执行之前就可能被调用方释放了，
+             * 所以必须把数据拷贝一份交给loop线程
+             */
+            void (TcpConnection::*fp)(const std::string &) =
+                &TcpConnection::sendInLoop;
+            loop->runInLoop(std::bind(fp, shared_from_this(), buf));
         }
     }
 }
 
+/**
+ * 跨线程的send最终在这里执行，排队期间连接可能已经被migrateTo迁移到了别的loop上，
+ * 这时候要把数据继续转交给连接现在所在的loop
+ */
+void TcpConnection::sendInLoop(const std::string &message) {
+    EventLoop *loop = getLoop();
+    if (!loop->isInLoopThread()) {
+        void (TcpConnection::*fp)(const std::string &) =
+            &TcpConnection::sendInLoop;
+        loop->queueInLoop(std::bind(fp, shared_from_this(), message));
+        return;
+    }
+    sendInLoop(message.data(), message.size());
+}
+
 /**
  * 发送数据
  * 应用写的快，而内核发送数据慢，需要把待发送数据写入缓冲区，而且设置了水位回调
@@ -130,23 +188,25 @@ void TcpConnection::sendInLoop(const void *data, size_t len) {
      * 所以第一次写数据就只写nwrote大小的数据，如果有剩余数据则全部通过触发EPOLLOUT事件，在回调函数hanldeWrite中处理
      * 注意：前面说的缓冲区是sockfd的内核缓冲区，不是我们定义的Buffer缓冲区
      */
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
-        // 这里的channel_->fd()指的是connfd
-        nwrote = ::write(channel_->fd(), data, len);
+    if (!writeBatching_ && !channel_.isWriting() &&
+        outputBuffer_.readableBytes() == 0) {
+        // 这里的channel_.fd()指的是connfd
+        nwrote = ::write(channel_.fd(), data, len);
         if (nwrote >= 0) {
+            addTraffic(nwrote);
             remaining = len - nwrote;
             // remaining==0表示一次性发送完数据，不需要缓冲区暂存
-            if (remaining == 0 && writeCompleteCallback_) {
+            if (remaining == 0 && callbacks_->writeCompleteCallback) {
                 /**
                  * 既然在这里数据全部发送完成，就不用再给channel设置epollout事件
                  * 从而去执行handleWrite回调函数
                  *
                  * 其实我们在send函数中就已经分析过
                  * 此处的threadId_和CurThread是两个不同的线程，因此既然是不同的两个线程那就需要执行queueInLoop
-                 * 把writeCompleteCallback_回调函数放入subThread对应的pendingFunctors队列等待subThread去执行
+                 * 把writeCompleteCallback回调函数放入subThread对应的pendingFunctors队列等待subThread去执行
                  **/
-                loop_->queueInLoop(
-                    std::bind(writeCompleteCallback_, shared_from_this()));
+                getLoop()->queueInLoop(
+                    std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
             }
         } else  // nwrote < 0
         {
@@ -172,24 +232,30 @@ void TcpConnection::sendInLoop(const void *data, size_t len) {
          * 如果此时OutputBuffer中的旧数据的个数和未写完字节个数之和大于highWaterMark
          * 则将highWaterMarkCallback放入待执行队列中
          */
-        if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ &&
-            highWaterMarkCallback_) {
+        if (oldLen + remaining >= callbacks_->highWaterMark && oldLen < callbacks_->highWaterMark &&
+            callbacks_->highWaterMarkCallback) {
             /**
              * 其实我们在send函数中就已经分析过
              * 此处的threadId_和CurThread是两个不同的线程，因此既然是不同的两个线程那就需要执行queueInLoop
-             * 把highWaterMarkCallback_回调函数放入subThread对应的pendingFunctors队列等待subThread去执行
+             * 把highWaterMarkCallback回调函数放入subThread对应的pendingFunctors队列等待subThread去执行
              **/
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_,
+            getLoop()->queueInLoop(std::bind(callbacks_->highWaterMarkCallback,
                                          shared_from_this(),
                                          oldLen + remaining));
         }
         outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting()) {
+        applyBackpressure();
+        if (writeBatching_) {
+            // 批量写模式下先攒着，本轮循环结束时由handleFlush写出去；已经在等EPOLLOUT的话交给handleWrite
+            if (!channel_.isWriting()) {
+                channel_.requestFlush();
+            }
+        } else if (!channel_.isWriting()) {
             /**
              * 这里一定要将对应socket的可写事件注册到EventLoop中，否则poller不会给channel通知epollout
              * 缓冲区从满到不满，会触发EPOLLOUT事件
              */
-            channel_->enableWriting();
+            channel_.enableWriting();
         }
     }
 }
@@ -203,41 +269,75 @@ void TcpConnection::shutdown() {
          * CurThread为shutdown函数调用方所在线程，而shutdown在testserver.c中的onMessage回调函数中被调用，即在main线程中被调用
          * 因此threadId_!=CurThread，所以loop_->runInLoop最终会把shutdownInLoop函数放入loop_对应的pendingFunctors队列中
          */
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        getLoop()->runInLoop(
+            std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
     }
 }
 
 void TcpConnection::shutdownInLoop() {
-    if (!channel_->isWriting())  // 说明outputBuffer中的数据已经全部发送完成
+    EventLoop *loop = getLoop();
+    if (!loop->isInLoopThread()) {
+        // 排队期间连接被迁移走了，交给新的loop去关闭
+        loop->queueInLoop(
+            std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
+        return;
+    }
+    // 说明outputBuffer中的数据已经全部发送完成，批量写模式下还没flush的数据也在outputBuffer中
+    if (!channel_.isWriting() && outputBuffer_.readableBytes() == 0)
     {
         // 关闭写端
         // poller就通知channel出发了关闭事件，就回调TcpConnection的handleclose方法
-        socket_->shutdownWrite();
+        socket_.shutdownWrite();
+    }
+}
+
+void TcpConnection::forceClose() {
+    if (state_ == kConnected || state_ == kDisconnecting) {
+        setState(kDisconnecting);
+        getLoop()->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop() {
+    EventLoop *loop = getLoop();
+    if (!loop->isInLoopThread()) {
+        // 排队期间连接被迁移走了，交给新的loop去关闭
+        loop->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+        return;
+    }
+    // 排队期间对端已经先关闭了
+    if (state_ == kConnected || state_ == kDisconnecting) {
+        handleClose();
     }
 }
 
 // 连接建立
 void TcpConnection::connectEstablished() {
     setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading();  // 向poller注册channel的epollin事件
+    registration_ = TcpConnectionRef(this);
+    channel_.tie(this);
+    channel_.enableReading();  // 向poller注册channel的epollin事件
 
     // 新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+    callbacks_->connectionCallback(self_);
 }
 
 // 连接销毁
 void TcpConnection::connectDestroyed() {
+    TcpConnectionRef guard(this);
     if (state_ == kConnected) {
         setState(kDisconnected);
-        channel_->disableAll();  // 把channel的所有感兴趣的事件，从poller中del掉
-        connectionCallback_(shared_from_this());
+        channel_.disableAll();  // 把channel的所有感兴趣的事件，从poller中del掉
+        callbacks_->connectionCallback(self_);
     }
-    channel_->remove();  // 把channel从poller中删除掉
+    channel_.remove();  // 把channel从poller中删除掉
+    registration_.reset();
 }
 
 /**
- * TcpConnection封装了一个connfd对应的channel，通过执行channel_->setReadCallback(handleRead)
+ * TcpConnection封装了一个connfd对应的channel，通过执行channel_.setReadCallback(handleRead)
  * 以便当这个connfd注册的读事件发生之后回调这个handleRead函数
  *
  * 这个handleRead函数的代码隐含着一个先后关系就是只有触发了connfd的读事件才会执行handleRead回调函数，然后才会调用readFd从connfd中读取数据，
@@ -256,28 +356,41 @@ void TcpConnection::connectDestroyed() {
  * 对于写事件而言，write操作处于写事件被触发从而调用回调函数handleWrite之前
  */
 void TcpConnection::handleRead(Timestamp receiveTime) {
+    /**
+     * 用户调用了yieldRead，inputBuffer_里的消息还没处理完，由下一轮的handleReady接着处理，这里不再读新数据
+     * LT模式下只要数据还在内核缓冲区里，每一轮都会再上报，处理完之后自然会读到；对端的关闭也要等处理完才能读到
+     */
+    if (channel_.isReadyQueued()) {
+        return;
+    }
+    if (relaying_) {
+        handleRelayRead(receiveTime);
+        return;
+    }
     int savedErrno = 0;
-    // 这里的channel_->fd()为connfd
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    // 这里的channel_.fd()为connfd，readBudget_为0时不限制
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno, readBudget_);
     /**
-     * 如果从connfd中正常读取数据，则调用messageCallback_回调函数
-     * 而这个messageCallback_由用户通过onMessage函数自定义设置，从test_server中的相关代码来看，
-     * messageCallback_的逻辑是获取Buffer中可读区域中的数据，并且调用TcpConnection的send方法来处理这些数据
+     * 如果从connfd中正常读取数据，则调用messageCallback回调函数
+     * 而这个messageCallback由用户通过onMessage函数自定义设置，从test_server中的相关代码来看，
+     * messageCallback的逻辑是获取Buffer中可读区域中的数据，并且调用TcpConnection的send方法来处理这些数据
      */
     if (n > 0) {
+        addTraffic(n);
         /**
          * 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
-         * shared_from_this：获取当前TcpConnection的智能指针
+         * self_：当前TcpConnection的智能指针，channel处理事件期间一定有效，直接传引用，不用shared_from_this
          *
-         * messageCallback_为用户自定义的回调函数，不是系统默认设置的，具体案例可以参考test_server.c
+         * messageCallback为用户自定义的回调函数，不是系统默认设置的，具体案例可以参考test_server.c
          * 下面的一行代码可以等价于onMessage(shared_from_this(), &inputBuffer_,
          * receiveTime), 这里的onMessage是由用户在调用客户端设置的回调函数
          *
          * 还是那个原理，在主程序中调用TcpServer的setMessageCallback函数，设置TcpServer对象的messageCallback_变量，
-         * 然后在TcpServer的newConnection函数中调用TcpConnection对象的setMessageCallback函数，
-         * 并且以TcpServer对象的messageCallback_为赋值参数，这样就把一个用户定义的回调函数设置到了TcpConnection对象中
+         * TcpServer::start中buildCallbacks把messageCallback_等回调拷贝进一个所有连接共享的ConnectionCallbacks，
+         * 然后在TcpServer的newConnection函数中调用TcpConnection对象的setCallbacks函数，
+         * 让TcpConnection的callbacks_指向这个共享的回调集合，这样就把一个用户定义的回调函数设置到了TcpConnection对象中
          */
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        callbacks_->messageCallback(self_, &inputBuffer_, receiveTime);
     } else if (n == 0) {
         handleClose();
     } else {
@@ -287,19 +400,28 @@ void TcpConnection::handleRead(Timestamp receiveTime) {
     }
 }
 
+// 上一轮MessageCallback调用了yieldRead，用inputBuffer_里剩下的数据接着调用，不读socket
+void TcpConnection::handleReady(Timestamp receiveTime) {
+    if ((state_ == kConnected || state_ == kDisconnecting) &&
+        inputBuffer_.readableBytes() > 0) {
+        callbacks_->messageCallback(self_, &inputBuffer_, receiveTime);
+    }
+}
+
 /**
  * 同理handleRead，handleWrite会在confd触发写事件时被调用，主要功能是把在sendInLoop函数中未能一次性发送完的数据全部发送给connfd
  *
  * socket内核缓冲区每次从满到不满都会触发一次EPOLLOUT事件，每次触发EPOLLOUT事件都会调用回调函数handleWrite，
- * 在handleWrite函数中实现了从outputBuffer_用户写缓冲区往channel_->fd()内核缓冲区写数据的操作，然后内核缓冲区内的数据
+ * 在handleWrite函数中实现了从outputBuffer_用户写缓冲区往channel_.fd()内核缓冲区写数据的操作，然后内核缓冲区内的数据
  * 又会被用户所读取，从而导致缓冲区不满，然后触发EPOLLOUT事件，以此类推，周而复始，直至无数据可写
  */
 void TcpConnection::handleWrite() {
-    if (channel_->isWriting()) {
+    if (channel_.isWriting()) {
         int savedErrno = 0;
         // 把发送缓冲区可读区域的数据全部发送到connfd中
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
         if (n > 0) {
+            addTraffic(n);
             /**
              * retrieve的作用就是使readIndex_增大，不断缩小readableBytes，扩大可写入区域大小
              * 因为outputBuffer_.writeFd读取了写缓冲区可读区域中的数据，并且发送到connfd，所以readableBytes变少，即readIndex_增大
@@ -321,18 +443,19 @@ void TcpConnection::handleWrite() {
              * 此外，highWaterMarkCallback和writeCompleteCallback一般配合使用，起到限流的作用
              */
             if (outputBuffer_.readableBytes() == 0) {
-                channel_->disableWriting();
-                // 与handleRead函数中的messageCallback_赋值原理是相同的
-                if (writeCompleteCallback_) {
+                channel_.disableWriting();
+                releaseBackpressure();
+                // 与handleRead函数中的messageCallback赋值原理是相同的
+                if (callbacks_->writeCompleteCallback) {
                     /**
                      * 唤醒loop_对应的thread线程，执行回调
                      *
                      * 其实我们在send函数中就已经分析过
                      * 此处的threadId_和CurThread是两个不同的线程，因此既然是不同的两个线程那就需要执行queueInLoop
-                     * 把writeCompleteCallback_回调函数放入subThread对应的pendingFunctors队列等待subThread去执行
+                     * 把writeCompleteCallback回调函数放入subThread对应的pendingFunctors队列等待subThread去执行
                      **/
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this()));
+                    getLoop()->queueInLoop(
+                        std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
                 }
                 if (state_ == kDisconnecting) {
                     shutdownInLoop();
@@ -343,7 +466,7 @@ void TcpConnection::handleWrite() {
         }
     } else {
         LOG_ERROR("TcpConnection fd=%d is down, no more writing \n",
-                  channel_->fd());
+                  channel_.fd());
     }
 }
 
@@ -366,28 +489,374 @@ void TcpConnection::handleWrite() {
  * close对应的fd。此步骤是在析构函数中自动触发的，当TcpConnection对象被移除后，引用计数为0，对象析构时会调用close。
  */
 void TcpConnection::handleClose() {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(),
-             (int)state_);
+    LOG_DEBUG("TcpConnection::handleClose fd=%d state=%d \n", channel_.fd(),
+              (int)state_);
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
+
+    // 保证下面的回调执行期间self_一直有效，即使closeCallback把连接从连接表中移除了
+    TcpConnectionRef guard(this);
+    releaseBackpressure();  // 积压的数据再也发不出去了，不能让source一直停着
+    if (relaying_) {
+        // 转发的一端关闭了，另一端发完积压的数据之后也关闭写端
+        TcpConnectionPtr sink = relaySink_.lock();
+        if (sink) {
+            sink->shutdown();
+        }
+    }
+    // 与handleRead函数中的messageCallback赋值原理是相同的
+    callbacks_->connectionCallback(self_);  // 执行连接关闭的回调
+    callbacks_->closeCallback(
+        self_);  // 关闭连接的回调 执行的是TcpServer::removeConnection回调方法
+}
+
+void TcpConnection::startRead() {
+    if (getLoop()->isInLoopThread()) {
+        startReadInLoop();
+    } else {
+        getLoop()->queueInLoop(
+            std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::stopRead() {
+    if (getLoop()->isInLoopThread()) {
+        stopReadInLoop();
+    } else {
+        getLoop()->queueInLoop(
+            std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+    }
+}
+
+/**
+ * 和shutdownInLoop一样，排队期间连接可能被迁移走了，交给新的loop去执行
+ * 连接已经关闭的时候channel已经从poller上移除了，只记录reading_，不能再去注册channel
+ */
+void TcpConnection::startReadInLoop() {
+    EventLoop *loop = getLoop();
+    if (!loop->isInLoopThread()) {
+        loop->queueInLoop(
+            std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+        return;
+    }
+    reading_ = true;
+    if ((state_ == kConnected || state_ == kDisconnecting) &&
+        !channel_.isReading()) {
+        channel_.enableReading();
+    }
+}
+
+void TcpConnection::stopReadInLoop() {
+    EventLoop *loop = getLoop();
+    if (!loop->isInLoopThread()) {
+        loop->queueInLoop(
+            std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+        return;
+    }
+    reading_ = false;
+    if ((state_ == kConnected || state_ == kDisconnecting) &&
+        channel_.isReading()) {
+        channel_.disableReading();
+    }
+}
+
+void TcpConnection::setBackpressureSource(const TcpConnectionPtr &source,
+                                          size_t highWaterMark) {
+    if (backpressureSource_.lock() != source) {
+        releaseBackpressure();  // 换了source，原来被暂停的source要恢复
+    }
+    backpressureSource_ = source;
+    backpressureMark_ = source ? highWaterMark : 0;
+    applyBackpressure();
+}
+
+// source在别的loop上时stopRead/startRead会投递到它自己的loop中执行
+void TcpConnection::applyBackpressure() {
+    if (backpressureActive_ || backpressureMark_ == 0 ||
+        outputBuffer_.readableBytes() < backpressureMark_) {
+        return;
+    }
+    TcpConnectionPtr source = backpressureSource_.lock();
+    if (source) {
+        source->stopRead();
+        backpressureActive_ = true;
+    }
+}
+
+void TcpConnection::releaseBackpressure() {
+    if (!backpressureActive_) {
+        return;
+    }
+    backpressureActive_ = false;
+    TcpConnectionPtr source = backpressureSource_.lock();
+    if (source) {
+        source->startRead();
+    }
+}
+
+void TcpConnection::relayTo(const TcpConnectionPtr &sink, bool useSplice) {
+    relaySink_ = sink;
+    relaying_ = static_cast<bool>(sink);
+    relaySplice_ = useSplice;
+    // 进入转发模式之前已经读进来、还没被处理的数据先发出去
+    if (sink && inputBuffer_.readableBytes() > 0) {
+        relayInput(sink);
+    }
+}
+
+// 每次最多splice这么多字节，正好是管道的默认容量
+static const size_t kSpliceChunk = 64 * 1024;
+
+/**
+ * splice只能保证this => 管道 => sink这一段不经过用户空间，数据的顺序还要靠outputBuffer_保证：
+ * sink有积压的时候新数据必须排在积压的后面，只能走拷贝；
+ * 配合setBackpressureSource，sink一有积压this就停止读，所以绝大部分数据都走splice
+ */
+void TcpConnection::handleRelayRead(Timestamp receiveTime) {
+    TcpConnectionPtr sink = relaySink_.lock();
+    if (!sink) {
+        // sink已经销毁，数据没有地方转发了，退出转发模式交给MessageCallback
+        relaying_ = false;
+        handleRead(receiveTime);
+        return;
+    }
+
+    int pipeReadFd = -1;
+    int pipeWriteFd = -1;
+    // sink和this在同一个loop上时，sink的状态只会在当前线程中被修改
+    if (relaySplice_ && sink->getLoop() == getLoop() &&
+        sink->state_ == kConnected && !sink->channel_.isWriting() &&
+        sink->outputBuffer_.readableBytes() == 0 &&
+        getLoop()->splicePipe(&pipeReadFd, &pipeWriteFd)) {
+        size_t chunk = readBudget_ > 0 ? std::min(readBudget_, kSpliceChunk)
+                                       : kSpliceChunk;
+        ssize_t n = ::splice(channel_.fd(), nullptr, pipeWriteFd, nullptr,
+                             chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            addTraffic(n);
+            sink->writeFromPipe(pipeReadFd, static_cast<size_t>(n));
+            return;
+        } else if (n == 0) {
+            handleClose();
+            return;
+        } else if (errno == EAGAIN) {
+            return;
+        } else if (errno != EINVAL && errno != ENOSYS) {
+            LOG_ERROR("TcpConnection::handleRelayRead");
+            handleError();
+            return;
+        }
+        // 内核不支持对这种socket做splice，以后都走拷贝
+        relaySplice_ = false;
+    }
 
-    TcpConnectionPtr connPtr(shared_from_this());
-    // 与handleRead函数中的messageCallback_赋值原理是相同的
-    connectionCallback_(connPtr);  // 执行连接关闭的回调
-    closeCallback_(
-        connPtr);  // 关闭连接的回调 执行的是TcpServer::removeConnection回调方法
+    int savedErrno = 0;
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno, readBudget_);
+    if (n > 0) {
+        addTraffic(n);
+        relayInput(sink);
+    } else if (n == 0) {
+        handleClose();
+    } else {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleRelayRead");
+        handleError();
+    }
+}
+
+void TcpConnection::relayInput(const TcpConnectionPtr &sink) {
+    if (sink->getLoop()->isInLoopThread()) {
+        if (sink->state_ == kConnected) {
+            sink->sendInLoop(inputBuffer_.peek(), inputBuffer_.readableBytes());
+        }
+        inputBuffer_.retrieveAll();
+    } else {
+        sink->send(inputBuffer_.retrieveAllAsString());
+    }
+}
+
+/**
+ * 管道是loop内所有连接共用的，不管socket写不写得进去，返回之前都要把管道读空：
+ * 写不下的部分读进outputBuffer_，注册EPOLLOUT由handleWrite接着发送，同时触发背压让source停下来
+ */
+void TcpConnection::writeFromPipe(int pipeReadFd, size_t len) {
+    bool faultError = false;
+    while (len > 0) {
+        ssize_t n = ::splice(pipeReadFd, nullptr, channel_.fd(), nullptr, len,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            addTraffic(n);
+            len -= n;
+        } else {
+            if (n < 0 && errno != EAGAIN) {
+                LOG_ERROR("TcpConnection::writeFromPipe");
+                faultError = (errno == EPIPE || errno == ECONNRESET);
+            }
+            break;
+        }
+    }
+
+    while (len > 0) {
+        int savedErrno = 0;
+        ssize_t n = outputBuffer_.readFd(pipeReadFd, &savedErrno, len);
+        if (n <= 0) {
+            // 不应该发生：管道里的数据读不出来，丢掉这对管道，免得残留的数据混进别的连接
+            LOG_ERROR("TcpConnection::writeFromPipe drain pipe error:%d \n",
+                      savedErrno);
+            getLoop()->resetSplicePipe();
+            break;
+        }
+        len -= n;
+    }
+
+    if (outputBuffer_.readableBytes() == 0) {
+        return;
+    }
+    if (faultError) {
+        // 对端已经关闭，和sendInLoop一样不再保存，后续由handleRead/handleClose处理
+        outputBuffer_.retrieveAll();
+        return;
+    }
+    channel_.enableWriting();
+    applyBackpressure();
+}
+
+/**
+ * 调用方已经把数据直接追加到了outputBuffer_，这里只负责发出去：
+ * 正在等EPOLLOUT时交给handleWrite；批量写模式下登记flush；否则立即用handleFlush写一次
+ */
+void TcpConnection::sendOutputBuffer() {
+    if (state_ == kDisconnected) {
+        outputBuffer_.retrieveAll();
+        return;
+    }
+    if (outputBuffer_.readableBytes() == 0) {
+        return;
+    }
+    applyBackpressure();
+    if (channel_.isWriting()) {
+        return;
+    }
+    if (writeBatching_) {
+        channel_.requestFlush();
+    } else {
+        handleFlush();
+    }
+}
+
+/**
+ * 批量写模式下，本轮循环中所有send追加到outputBuffer_的数据在这里用一次write发出去
+ * 数据在outputBuffer_中是连续的，一次write就够了；写不完的部分注册EPOLLOUT交给handleWrite
+ */
+void TcpConnection::handleFlush() {
+    if (channel_.isWriting() || outputBuffer_.readableBytes() == 0) {
+        return;
+    }
+    int savedErrno = 0;
+    ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
+    if (n > 0) {
+        addTraffic(n);
+        outputBuffer_.retrieve(n);
+    } else if (savedErrno != EWOULDBLOCK) {
+        LOG_ERROR("TcpConnection::handleFlush");
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET) {
+            return;  // 对端已经关闭，后续由handleRead/handleClose处理
+        }
+    }
+
+    if (outputBuffer_.readableBytes() > 0) {
+        channel_.enableWriting();
+        return;
+    }
+    releaseBackpressure();
+    if (callbacks_->writeCompleteCallback) {
+        getLoop()->queueInLoop(
+            std::bind(callbacks_->writeCompleteCallback, self_));
+    }
+    if (state_ == kDisconnecting) {
+        shutdownInLoop();
+    }
 }
 
 void TcpConnection::handleError() {
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) <
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) <
         0) {
         err = errno;
     } else {
         err = optval;
     }
     LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n",
-              name_.c_str(), err);
+              name().c_str(), err);
+}
+
+/**
+ * 把连接迁移到另一个loop上，可以在任意线程调用
+ *
+ * 迁移分成两步，都不会丢失inputBuffer_/outputBuffer_中的数据：
+ * 1. detachInLoop：在原来的loop线程中把channel从原来的poller上摘下来，然后把连接交给新的loop
+ * 2. attachInLoop：在新的loop线程中按照连接当前的状态重新向新的poller注册channel
+ *
+ * 第一步总是放在pendingFunctors里执行，因为调用方可能正处在这个连接自己的handleEvent里
+ * (比如在onMessage回调中调用migrateTo)，这时候不能把channel交给别的线程
+ */
+void TcpConnection::migrateTo(EventLoop *newLoop) {
+    getLoop()->queueInLoop(
+        std::bind(&TcpConnection::detachInLoop, shared_from_this(), newLoop));
+}
+
+void TcpConnection::detachInLoop(EventLoop *newLoop) {
+    EventLoop *oldLoop = getLoop();
+    if (!oldLoop->isInLoopThread()) {
+        // 排队期间已经被之前的一次迁移带走了，从连接现在所在的loop重新发起
+        oldLoop->queueInLoop(std::bind(&TcpConnection::detachInLoop,
+                                       shared_from_this(), newLoop));
+        return;
+    }
+    if (state_ != kConnected || newLoop == oldLoop) {
+        return;
+    }
+
+    channel_.disableAll();
+    channel_.remove();  // 之后原来的poller就不会再上报这个fd上的事件了
+    oldLoop->adjustConnectionCount(-1);
+    if (callbacks_->migrateCallback) {
+        callbacks_->migrateCallback(shared_from_this(), newLoop);
+    }
+
+    channel_.setOwnerLoop(newLoop);
+    loop_ = newLoop;
+    newLoop->adjustConnectionCount(1);
+
+    /**
+     * queueInLoop的互斥锁保证了这里对连接的所有修改在新的loop线程中都是可见的，
+     * 在attachInLoop执行之前，没有任何一个线程会去读写这个连接的channel和缓冲区
+     */
+    newLoop->queueInLoop(
+        std::bind(&TcpConnection::attachInLoop, shared_from_this()));
+}
+
+void TcpConnection::attachInLoop() {
+    if (state_ != kConnected && state_ != kDisconnecting) {
+        return;
+    }
+    if (reading_) {
+        channel_.enableReading();
+    }
+    /**
+     * 原来loop上的ready登记在channel_.remove()时已经取消了，不知道用户是否让出过，
+     * inputBuffer_里有数据就再调用一次MessageCallback，剩下的是半条消息也没关系，回调什么都不会做
+     */
+    if (inputBuffer_.readableBytes() > 0) {
+        channel_.requestReady();
+    }
+    if (outputBuffer_.readableBytes() > 0) {
+        // 迁移之前没有发送完的数据由新的loop继续发送
+        channel_.enableWriting();
+    } else if (state_ == kDisconnecting) {
+        // 迁移期间用户调用了shutdown
+        shutdownInLoop();
+    }
 }
\ No newline at end of file
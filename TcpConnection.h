@@ -2,17 +2,45 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "Buffer.h"
 #include "Callbacks.h"
+#include "Channel.h"
 #include "InetAddress.h"
+#include "LoopRefCounted.h"
+#include "Socket.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
 
-class Channel;
 class EventLoop;
-class Socket;
+
+/**
+ * 一个TcpConnection用到的全部回调
+ *
+ * 同一个TcpServer建立的连接回调都是一样的，所以由TcpServer创建一份，所有连接通过shared_ptr共享，
+ * 每个连接只需要一次引用计数的加一，而不是拷贝六个std::function。
+ * 如果单独对某个连接调用了setXXXCallback，这个连接会先拷贝出一份自己的再修改(写时复制)
+ **/
+struct ConnectionCallbacks {
+    ConnectionCallbacks() : highWaterMark(64 * 1024 * 1024) {}
+
+    ConnectionCallback connectionCallback;  // 有新连接时的回调
+    MessageCallback messageCallback;        // 有读写消息时的回调
+    WriteCompleteCallback writeCompleteCallback;  // 消息发送完成以后的回调
+    /**
+     * 到达水位回时候地调函数
+     * 顾名思义：越过了水位线就会出问题，需要控制在水位线以下
+     * 发送数据的时候对端接受数据的速率慢，但是发送地很快，那么数据就会丢失并出错
+     * 比如到达水位线了，则可以通过回调函数暂停发送数据
+     **/
+    HighWaterMarkCallback highWaterMarkCallback;
+    CloseCallback closeCallback;
+    MigrateCallback migrateCallback;  // 让TcpServer把连接从原来loop的连接表挪到新loop的连接表中
+    size_t highWaterMark;             // 默认接收64M数据就到水位线了
+};
+using ConnectionCallbacksPtr = std::shared_ptr<ConnectionCallbacks>;
 
 /**
  * TcpConnection主要负责连接，一个连接说的就是服务器和客户端之间建立的一条连接
@@ -29,14 +57,23 @@ class Socket;
  *
  */
 class TcpConnection : noncopyable,
+                      public LoopRefCounted,
                       public std::enable_shared_from_this<TcpConnection> {
    public:
-    TcpConnection(EventLoop *loop, const std::string &name, int sockfd,
-                  const InetAddress &localAddr, const InetAddress &peerAddr);
+    /**
+     * id由创建者(TcpServer)分配，在同一个TcpServer内唯一
+     * 连接的名字是 namePrefix + id，在第一次调用name()时才生成，
+     * 大部分短连接从建立到关闭都没有人关心它的名字，这样就省掉了每个连接一次格式化和字符串分配
+     **/
+    TcpConnection(EventLoop *loop, uint64_t id,
+                  const std::shared_ptr<const std::string> &namePrefix,
+                  int sockfd, const InetAddress &localAddr,
+                  const InetAddress &peerAddr);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    uint64_t id() const { return id_; }
+    const std::string &name() const;
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
@@ -44,8 +81,90 @@ class TcpConnection : noncopyable,
 
     // 发送数据
     void send(const std::string &buf);
+
+    /**
+     * 批量写模式(类似TCP_CORK)：loop线程中的send不再立即write，只追加到outputBuffer_，
+     * 等本轮循环所有活跃channel都处理完之后一次性写出去，一个回调里分几次send的响应、
+     * 一次读到的多个流水线请求的响应，都只需要一次write系统调用，对端也只收到一个报文段
+     * 默认关闭；只能在连接所在的loop线程中，或者连接建立之前设置
+     **/
+    void setWriteBatching(bool on) { writeBatching_ = on; }
+    /**
+     * 只能在连接所在的loop线程中调用：把响应直接序列化进outputBuffer_，省掉先拼成std::string再拷贝一次，
+     * 追加完之后调用sendOutputBuffer发出去，和send一样，批量写模式下等到本轮循环结束时才写
+     **/
+    Buffer *outputBuffer() { return &outputBuffer_; }
+    void sendOutputBuffer();
+
+    // 连接上的用户数据，比如HttpServer每个连接的解析状态；只能在连接所在的loop线程中访问
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+
+    // 关闭Nagle算法，小报文立即发出，不等之前报文的ACK
+    void setTcpNoDelay(bool on) { socket_.setTcpNoDelay(on); }
     // 关闭连接
     void shutdown();
+    // 不等outputBuffer_发送完，直接关闭连接，和对端关闭一样走handleClose，可以在任意线程调用
+    void forceClose();
+
+    /**
+     * 每轮循环最多从socket读多少字节，0表示不限制(默认)
+     * 一个狂发数据的连接一轮最多只能带进来bytes字节，MessageCallback每次要处理的数据量也就有了上限，
+     * 同一个loop上其它连接等待的时间不会被它拉长；剩下的数据留在内核缓冲区里，下一轮再读
+     * 只能在连接所在的loop线程中，或者连接建立之前设置
+     **/
+    void setReadBudget(size_t bytes) { readBudget_ = bytes; }
+
+    /**
+     * 只能在MessageCallback中调用：inputBuffer_里还有没处理的消息，但是这一轮已经处理得够多了
+     * 下一轮循环不等新数据到达、也不等epoll事件，直接用inputBuffer_里剩下的数据再调用一次MessageCallback，
+     * 让出期间不会再从socket读数据。MessageCallback每次只处理N条消息然后让出，就是每轮N条消息的预算
+     **/
+    void yieldRead() { channel_.requestReady(); }
+
+    /**
+     * 开始/停止从连接上读数据，可以在任意线程调用
+     * 停止读之后不再关注EPOLLIN，对端继续发送的数据留在内核的接收缓冲区里，
+     * 缓冲区满了之后TCP的滑动窗口会让对端停下来，这样背压就一路传到了对端
+     **/
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    /**
+     * 自动背压：this的outputBuffer_越过highWaterMark时暂停source的读，this的数据全部发送完成时恢复
+     *
+     * 典型的场景是代理：从客户端连接读到的数据转发给后端连接，后端处理得慢，后端连接的outputBuffer_就会无限增长。
+     * 在后端连接上调用setBackpressureSource(客户端连接)，后端连接积压的数据就不会超过highWaterMark太多，反方向同理
+     * 传入空指针取消。只持有source的weak_ptr，只能在this所在的loop线程中设置
+     * source最好和this在同一个loop上；在别的loop上时暂停要投递过去才生效，这期间source读出来并转发过来的数据
+     * 仍然会进入outputBuffer_，积压的上限取决于两个loop之间的延迟
+     **/
+    void setBackpressureSource(const TcpConnectionPtr &source,
+                               size_t highWaterMark = 4 * 1024 * 1024);
+
+    /**
+     * 转发模式(四层代理)：从this读到的数据不再交给MessageCallback，而是原样发给sink；
+     * this关闭时，sink在发送完积压的数据之后关闭写端
+     *
+     * this和sink在同一个loop上、sink没有积压的数据时，用splice(2)经过loop共用的管道(见EventLoop::splicePipe)
+     * 把数据从this的socket直接搬到sink的socket，数据不进入用户空间，只有sink的内核发送缓冲区写不下的部分才拷贝进outputBuffer_；
+     * 不在同一个loop上、sink还有积压、useSplice为false或者内核不支持时，退回到readFd + send，每个字节拷贝两次
+     * 背压仍然由setBackpressureSource负责，见TcpRelay
+     * 传入空指针退出转发模式。只持有sink的weak_ptr，只能在this所在的loop线程中设置
+     **/
+    void relayTo(const TcpConnectionPtr &sink, bool useSplice = true);
+
+    /**
+     * 把连接连同它的缓冲区一起迁移到另一个loop上，可以在任意线程调用
+     * 迁移完成之后连接的所有回调都会在newLoop线程中执行
+     **/
+    void migrateTo(EventLoop *newLoop);
+
+    // 连接累计收发的字节数，供TcpServer判断哪些连接是热点连接
+    uint64_t trafficBytes() const {
+        return trafficBytes_.load(std::memory_order_relaxed);
+    }
 
     /**
      * 以下的几种函数最终都会被作为Channel中handleEventWithGuard的callback函数
@@ -53,25 +172,36 @@ class TcpConnection : noncopyable,
      * 用户把函数给了TcpServer，TcpServer再把函数给了TcpConnection，TcpConnection再把函数封装到Channel中
      * Channel随后就加入poller，poller监听到事件发生随之channel就调用相应的回调函数
      **/
+    // 整体替换回调集合，TcpServer用它让所有连接共享同一份回调
+    void setCallbacks(const ConnectionCallbacksPtr &callbacks) {
+        callbacks_ = callbacks;
+    }
+
     void setConnectionCallback(const ConnectionCallback &cb) {
-        connectionCallback_ = cb;
+        mutableCallbacks().connectionCallback = cb;
     }
 
     void setMessageCallback(const MessageCallback &cb) {
-        messageCallback_ = cb;
+        mutableCallbacks().messageCallback = cb;
     }
 
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) {
-        writeCompleteCallback_ = cb;
+        mutableCallbacks().writeCompleteCallback = cb;
     }
 
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb,
                                   size_t highWaterMark) {
-        highWaterMarkCallback_ = cb;
-        highWaterMark_ = highWaterMark;
+        ConnectionCallbacks &callbacks = mutableCallbacks();
+        callbacks.highWaterMarkCallback = cb;
+        callbacks.highWaterMark = highWaterMark;
     }
 
-    void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
+    void setCloseCallback(const CloseCallback &cb) {
+        mutableCallbacks().closeCallback = cb;
+    }
+    void setMigrateCallback(const MigrateCallback &cb) {
+        mutableCallbacks().migrateCallback = cb;
+    }
 
     // 连接建立
     void connectEstablished();
@@ -88,22 +218,65 @@ class TcpConnection : noncopyable,
     void handleWrite();
     void handleClose();
     void handleError();
+    void handleFlush();
+    void handleReady(Timestamp receiveTime);
+    // 转发模式下代替handleRead，见relayTo
+    void handleRelayRead(Timestamp receiveTime);
+    // 把inputBuffer_中的数据全部发给sink
+    void relayInput(const TcpConnectionPtr &sink);
+    // 把管道里的len字节写到socket，写不下的部分读进outputBuffer_，返回时管道一定已经读空
+    void writeFromPipe(int pipeReadFd, size_t len);
 
     void sendInLoop(const void *message, size_t len);
+    void sendInLoop(const std::string &message);
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    // outputBuffer_的积压越过/回落时暂停/恢复背压源的读
+    void applyBackpressure();
+    void releaseBackpressure();
+
+    // 回调集合被其它连接共享时先拷贝一份，再修改自己的这一份
+    ConnectionCallbacks &mutableCallbacks();
 
-    EventLoop *loop_;  // 这里绝对不是baseLoop，
-                       // 因为TcpConnection都是在subLoop里面管理的
-    const std::string name_;
+    // loop线程内的引用从无到有时才持有一个真正的shared_ptr，见LoopRefCounted
+    void firstLoopRefAcquired() override { self_ = shared_from_this(); }
+    void lastLoopRefReleased() override {
+        TcpConnectionPtr self;
+        self.swap(self_);  // 可能是最后一个引用，析构放在函数最后
+    }
+
+    void detachInLoop(EventLoop *newLoop);
+    void attachInLoop();
+
+    // 只有连接所在的loop线程会写，其它线程只读，所以不需要原子的read-modify-write
+    void addTraffic(size_t n) {
+        trafficBytes_.store(
+            trafficBytes_.load(std::memory_order_relaxed) + n,
+            std::memory_order_relaxed);
+    }
+
+    // 这里绝对不是baseLoop，因为TcpConnection都是在subLoop里面管理的
+    // 连接可以通过migrateTo在loop之间迁移，其它线程会读取这个指针，所以是原子的
+    std::atomic<EventLoop *> loop_;
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_;
+    mutable std::once_flag nameOnce_;
+    mutable std::string name_;  // 延迟生成，见name()
     std::atomic_int state_;
-    bool reading_;
+    bool reading_;  // 用户是否希望读数据，见startRead/stopRead，迁移之后据此决定是否重新关注EPOLLIN
+    bool writeBatching_;
+    size_t readBudget_;  // 见setReadBudget
+    std::atomic<uint64_t> trafficBytes_;
 
     /**
      * 这里和Acceptor类似   Acceptor=》mainLoop    TcpConenction=》subLoop
      * Acceptor和TcpConenction都需要把底层的fd封装成channel，并且在相应loop的poller中监听事件
      */
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    // 直接作为成员，跟TcpConnection在同一次分配中，不再单独new
+    Socket socket_;
+    Channel channel_;
 
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
@@ -112,20 +285,34 @@ class TcpConnection : noncopyable,
      * 下面的几个函数都被执行于handleXXX函数中，而handleXXX函数都会被注册在channel中，
      * 最终会在channel对应的fd发生感兴趣的事件时被调用，而这几个函数都是用户所自定义的，详情参考test_server.c
      */
-    ConnectionCallback connectionCallback_;  // 有新连接时的回调
-    MessageCallback messageCallback_;        // 有读写消息时的回调
-    WriteCompleteCallback writeCompleteCallback_;  // 消息发送完成以后的回调
+    ConnectionCallbacksPtr callbacks_;
+
     /**
-     * 到达水位回时候地调函数
-     * 顾名思义：越过了水位线就会出问题，需要控制在水位线以下
-     * 发送数据的时候对端接受数据的速率慢，但是发送地很快，那么数据就会丢失并出错
-     * 比如到达水位线了，则可以通过回调函数暂停发送数据
+     * 连接所在loop线程中的引用计数大于0时，self_持有连接自己，
+     * 回调需要的const TcpConnectionPtr&直接传self_，不用每次shared_from_this
+     *
+     * registration_是从connectEstablished到connectDestroyed之间一直存在的那个引用，
+     * 所以连接建立期间loop线程内的引用只修改普通的计数，不会碰到shared_ptr的原子计数
      **/
-    HighWaterMarkCallback highWaterMarkCallback_;
-    CloseCallback closeCallback_;
-    size_t highWaterMark_;
+    TcpConnectionPtr self_;
+    LoopRef<TcpConnection> registration_;
+
+    // 自动背压，见setBackpressureSource
+    std::weak_ptr<TcpConnection> backpressureSource_;
+    size_t backpressureMark_;
+    bool backpressureActive_;  // 已经暂停了source的读
+
+    // 转发模式，见relayTo
+    std::weak_ptr<TcpConnection> relaySink_;
+    bool relaying_;
+    bool relaySplice_;  // 内核不支持对这个socket用splice时置为false，之后只走拷贝
+
+    std::shared_ptr<void> context_;  // 见setContext
 
     // 接收缓冲区中的read区域数据是从fd中获取的，发送缓冲区中的read区域数据是要往fd中发送的
     Buffer inputBuffer_;   // 接收数据的缓冲区
     Buffer outputBuffer_;  // 发送数据的缓冲区
-};
\ No newline at end of file
+};
+
+// 只能在连接所在的loop线程中使用的连接句柄，跨线程时用shared()转换成TcpConnectionPtr
+using TcpConnectionRef = LoopRef<TcpConnection>;
\ No newline at end of file
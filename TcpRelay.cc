@@ -0,0 +1,91 @@
+#include "TcpRelay.h"
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+TcpRelay::TcpRelay(const TcpConnectionPtr &downstream,
+                   const InetAddress &upstreamAddr)
+    : loop_(downstream->getLoop()),
+      upstreamAddr_(upstreamAddr),
+      downstream_(downstream),
+      splice_(true),
+      connectTimeout_(5.0),
+      finished_(false) {}
+
+TcpRelay::~TcpRelay() {
+    LOG_DEBUG("TcpRelay::~TcpRelay - %s \n", upstreamAddr_.toIpPort().c_str());
+}
+
+void TcpRelay::start() {
+    self_ = shared_from_this();
+    // 上游连上之前不读，客户端的数据留在内核缓冲区里
+    downstream_->stopRead();
+
+    client_.reset(new TcpClient(loop_, upstreamAddr_, "relay"));
+    client_->setConnectionCallback(
+        [this](const TcpConnectionPtr &conn) { onUpstreamConnection(conn); });
+    // 转发模式下不会调用MessageCallback，只有downstream先销毁时剩下的数据会走到这里
+    client_->setMessageCallback(
+        [](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+            buf->retrieveAll();
+        });
+    client_->connect();
+    if (connectTimeout_ > 0.0) {
+        connectTimer_ =
+            loop_->runAfter(connectTimeout_, [this]() { onConnectTimeout(); });
+    }
+}
+
+/**
+ * 背压的水位是1字节：接收端有积压，说明它的内核发送缓冲区已经满了，
+ * 这时候再读进来的数据只能拷贝进outputBuffer_，不如让发送端停下来，等积压的数据发完之后继续splice
+ */
+void TcpRelay::onUpstreamConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        loop_->cancel(connectTimer_);
+        if (!downstream_->connected()) {
+            // 等上游的时候客户端已经断开了
+            conn->shutdown();
+            return;
+        }
+        upstream_ = conn;
+        upstream_->setBackpressureSource(downstream_, 1);
+        downstream_->setBackpressureSource(upstream_, 1);
+        upstream_->relayTo(downstream_, splice_);
+        downstream_->relayTo(upstream_, splice_);
+        downstream_->startRead();
+    } else {
+        // 转发期间任意一端关闭，relayTo都会关闭另一端的写端；还没开始转发时downstream没有在读，只能直接关闭
+        if (!upstream_) {
+            downstream_->forceClose();
+        }
+        finish();
+    }
+}
+
+void TcpRelay::onConnectTimeout() {
+    if (upstream_ || finished_) {
+        return;
+    }
+    LOG_ERROR("TcpRelay::onConnectTimeout - %s \n",
+              upstreamAddr_.toIpPort().c_str());
+    client_->stop();
+    downstream_->forceClose();
+    finish();
+}
+
+void TcpRelay::finish() {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+    loop_->cancel(connectTimer_);
+    std::shared_ptr<TcpRelay> self;
+    self.swap(self_);
+    loop_->queueInLoop([self]() {
+        self->client_.reset();
+        self->downstream_.reset();
+        self->upstream_.reset();
+    });
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "TcpClient.h"
+#include "TimerId.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * 四层转发：把一个已经建立的连接(downstream，一般是TcpServer接受的客户端连接)和一个到上游的新连接(upstream)双向接起来
+ *
+ * upstream由TcpClient在downstream所在的loop上发起，两个连接在同一个loop上，
+ * 两个方向都用TcpConnection::relayTo转发，数据通过splice在内核中直接搬运，不经过Buffer
+ * 背压：一个方向的接收端有积压时就暂停发送端的读(关闭EPOLLIN)，积压的数据发送完之后恢复，内核的socket缓冲区就是转发的缓冲区
+ *
+ * 用法：在TcpServer的ConnectionCallback中
+ *     std::make_shared<TcpRelay>(conn, upstreamAddr)->start();
+ * start之后relay持有自己，不需要保存返回的指针，upstream连接关闭之后自动销毁
+ *
+ * upstream连接建立之前downstream不读数据，客户端发来的数据留在内核缓冲区里；
+ * connectTimeout秒之内连不上上游就关闭downstream
+ * 转发期间downstream不能被迁移到别的loop(不要和TcpServer::enableRebalance一起使用)，迁移之后转发仍然正确，但只能走拷贝
+ **/
+class TcpRelay : noncopyable, public std::enable_shared_from_this<TcpRelay> {
+   public:
+    TcpRelay(const TcpConnectionPtr &downstream,
+             const InetAddress &upstreamAddr);
+    ~TcpRelay();
+
+    // 以下设置必须在start之前调用
+    void setSplice(bool on) { splice_ = on; }
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+
+    // 在downstream所在的loop线程中调用，this必须由shared_ptr管理
+    void start();
+
+   private:
+    void onUpstreamConnection(const TcpConnectionPtr &conn);
+    void onConnectTimeout();
+    // 投递到loop中销毁TcpClient并释放自己，当前可能正处在TcpClient的回调中
+    void finish();
+
+    EventLoop *loop_;
+    const InetAddress upstreamAddr_;
+    TcpConnectionPtr downstream_;
+    TcpConnectionPtr upstream_;  // upstream连接建立之后才不为空
+    std::unique_ptr<TcpClient> client_;
+    std::shared_ptr<TcpRelay> self_;  // start到finish之间持有自己
+    TimerId connectTimer_;
+    bool splice_;
+    double connectTimeout_;
+    bool finished_;
+};
+
+using TcpRelayPtr = std::shared_ptr<TcpRelay>;
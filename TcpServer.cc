@@ -1,10 +1,13 @@
 #include "TcpServer.h"
 
 #include <strings.h>
+#include <unistd.h>
 
 #include <functional>
+#include <future>
 
 #include "Logger.h"
+#include "MemoryPool.h"
 #include "TcpConnection.h"
 
 // 不允许用户给loop传递一个空指针，如果这样的话就意味着连mainloop都没有了
@@ -16,19 +19,49 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop) {
     return loop;
 }
 
+/**
+ * Unix域socket不支持SO_REUSEPORT，同一个路径只能bind一次，kReusePortPerLoop退化成一个Acceptor
+ */
+static TcpServer::Option CheckOption(const InetAddress &listenAddr,
+                                     TcpServer::Option option) {
+    if (listenAddr.family() == AF_UNIX && option == TcpServer::kReusePortPerLoop) {
+        LOG_INFO("TcpServer: %s is a Unix domain socket, kReusePortPerLoop falls back to kNoReusePort \n",
+                 listenAddr.toIpPort().c_str());
+        return TcpServer::kNoReusePort;
+    }
+    return option;
+}
+
 // 这里的loop指的是mainloop，也就是设置了acceptor的loop
 TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr,
                      const std::string &nameArg, Option option)
     : loop_(CheckLoopNotNull(loop)),
       ipPort_(listenAddr.toIpPort()),
       name_(nameArg),
+      listenAddr_(listenAddr),
+      option_(CheckOption(listenAddr, option)),
       // acceptor_处于mainloop线程中，监听listenfd，在这个构造函数中已经完成了第一步socket和第二步bind操作
-      acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+      acceptor_(option_ == kReusePortPerLoop
+                    ? nullptr
+                    : new Acceptor(loop, listenAddr, option_ == kReusePort)),
       threadPool_(new EventLoopThreadPool(loop, name_)),
       connectionCallback_(),
       messageCallback_(),
+      started_(0),
+      maxAcceptsPerWakeup_(Acceptor::kDefaultMaxAcceptsPerWakeup),
+      writeBatching_(false),
+      readBudget_(0),
+      maxConnections_(0),
+      overloadPolicy_(kRejectNewConnections),
+      numConnections_(0),
+      acceptPaused_(std::make_shared<std::atomic_bool>(false)),
+      closing_(false),
       nextConnId_(1),
-      started_(0) {
+      connNamePrefix_(
+          std::make_shared<const std::string>(name_ + "-" + ipPort_ + "#")),
+      rebalanceIntervalMs_(0),
+      rebalanceThresholdPermille_(0),
+      rebalanceStopping_(false) {
     /**
      * 当有先用户连接时，会执行TcpServer::newConnection回调
      * 注意这里是setNewConnectionCallback不是TcpConnection中的setConnectionCallback，两者相差了一个New，
@@ -37,36 +70,86 @@ TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr,
      * 是由用户指定的，可以理解为NewConnectionCallback是用户连接建立时候系统设置的缺省回调函数，是必须要执行的，
      * 而TcpConnection中的ConnectionCallback设置的选择权在用户手中，设置与不设置都是可以的
      */
-    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection,
-                                                  this, std::placeholders::_1,
-                                                  std::placeholders::_2));
+    if (acceptor_) {
+        acceptor_->setNewConnectionBatchCallback(
+            std::bind(&TcpServer::newConnection, this, std::placeholders::_1));
+    }
 }
 
 TcpServer::~TcpServer() {
-    for (auto &item : connections_) {
-        // 这个局部的shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象资源了
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
+    if (rebalanceThread_) {
+        {
+            std::unique_lock<std::mutex> lock(rebalanceMutex_);
+            rebalanceStopping_ = true;
+        }
+        rebalanceCond_.notify_one();
+        rebalanceThread_->join();
+    }
 
-        /**
-         * 销毁连接
-         *
-         * 因为conn->getLoop()获得的是TcpConnection的Loop，因此这里的loop对应的线程threadId_为sub线程
-         * 而~TcpServer函数的调用方TcpServer处于main线程中，因此runInLoop函数的isInLoopThread判断为false
-         * 因此需要把connectDestroyed函数存入pendingFunctors队列中来让ioLoop去执行
-         *
-         * 其实也是比较好理解的，针对每个不同的TcpConnection都需要在对应的loop线程中去执行销毁conn的操作
-         */
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn));
+    /**
+     * 别的loop上的removeConnection/admitConnection可能正在syncAccepting里读loopAcceptors_，
+     * 先置上closing_，之后开始的syncAccepting直接返回
+     *
+     * 每个loop上的Acceptor和连接表都只能在它自己的loop线程里访问，所以分两轮投递到各个loop中并且等它执行完：
+     * 第一轮停掉这个loop的Acceptor、销毁连接表中的连接；第一轮在所有loop上都执行完之后，
+     * 在closing_置上之前开始的syncAccepting都已经返回，它们投递的syncAcceptorInLoop都排在第二轮前面，
+     * 第二轮再销毁各个loop的Acceptor，之后就不会再有新连接回调到正在析构的TcpServer了
+     **/
+    closing_ = true;
+    *acceptPaused_ = true;
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    for (size_t i = 0; i < loops.size(); ++i) {
+        ShardPtr shard = shardOf(loops[i]);
+        if (!shard) {
+            continue;  // 没有start过
+        }
+        Acceptor *acceptor =
+            i < loopAcceptors_.size() ? loopAcceptors_[i].get() : nullptr;
+        std::promise<void> done;
+        loops[i]->runInLoop([acceptor, shard, &done]() {
+            if (acceptor) {
+                acceptor->pause();
+            }
+            shard->closed = true;
+            ConnectionMap connections;
+            connections.swap(shard->connections);
+            for (auto &item : connections) {
+                /**
+                 * 销毁连接
+                 *
+                 * 当前就处在连接所在的loop线程中，直接执行connectDestroyed，
+                 * 针对每个不同的TcpConnection都需要在对应的loop线程中去执行销毁conn的操作
+                 */
+                item.second->connectDestroyed();
+            }
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+    for (size_t i = 0; i < loopAcceptors_.size(); ++i) {
+        std::shared_ptr<Acceptor> &acceptor = loopAcceptors_[i];
+        std::promise<void> done;
+        loops[i]->runInLoop([&acceptor, &done]() {
+            acceptor.reset();
+            done.set_value();
+        });
+        done.get_future().wait();
     }
 }
 
-// 设置底层subloop的个数
 void TcpServer::setThreadNum(int numThreads) {
     threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::enableRebalance(int intervalMs, int thresholdPermille) {
+    rebalanceIntervalMs_ = intervalMs;
+    rebalanceThresholdPermille_ = thresholdPermille;
+}
+
+void TcpServer::setThreadPlacement(const ThreadPlacement &placement) {
+    threadPool_->setThreadPlacement(placement);
+}
+
 /**
  * 开启服务器监听
  *
@@ -97,6 +180,10 @@ void TcpServer::start() {
          * 其跟ConnectionCallback、MessageCallback、WriteCompleteCallback同样都是由用户自定义的
          */
         threadPool_->start(threadInitCallback_);  // 启动底层的loop线程池
+        buildCallbacks();
+        for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+            shards_[ioLoop] = std::make_shared<ConnectionShard>();
+        }
         /**
          * listen&enableReading，把acceptChannel注册到mainloop的poller上
          *
@@ -112,65 +199,88 @@ void TcpServer::start() {
          * 又因为该runInLoop函数处于start函数中，而调用start函数的地方在testserver.c中，即main线程中调用
          * 所以isInLoopThread()为true，即直接执行cb()
          **/
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        if (acceptor_) {
+            acceptor_->setMaxAcceptsPerWakeup(maxAcceptsPerWakeup_);
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        } else {
+            /**
+             * 每个loop都在同一个地址上bind一个SO_REUSEPORT的listenfd，各自在自己的线程中listen
+             * Acceptor在这里构造(socket+bind)，listen以及注册channel交给对应的loop线程
+             **/
+            for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+                std::shared_ptr<Acceptor> acceptor =
+                    std::make_shared<Acceptor>(ioLoop, listenAddr_, true);
+                acceptor->setMaxAcceptsPerWakeup(maxAcceptsPerWakeup_);
+                acceptor->setNewConnectionCallback(std::bind(
+                    &TcpServer::newConnectionInLoop, this, ioLoop,
+                    std::placeholders::_1, std::placeholders::_2));
+                loopAcceptors_.push_back(acceptor);
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor.get()));
+            }
+        }
+
+        if (rebalanceIntervalMs_ > 0) {
+            rebalanceThread_.reset(new Thread(
+                std::bind(&TcpServer::rebalanceThreadFunc, this),
+                name_ + "-rebalance"));
+            rebalanceThread_->start();
+        }
     }
 }
 
-// 有一个新的客户端的连接，acceptor会执行这个回调操作
-void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
-    /**
-     * 轮询算法，选择一个subLoop，来管理channel
-     * 如果没有设置setThreadNumber，则返回的就是baseloop
-     **/
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
-
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
-             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+/**
+ * 这里的setConnectionCallback跟setNewConnectionCallback是不同的，这里的回调函数connectionCallback_完全是由用户所指定的，
+ * 系统没有提供类似于newConnection函数来充当默认回调函数，具体运用案例可以参考testserver.c
+ *
+ * 设置了如何关闭连接的回调 conn->shutDown()
+ * 可以看到这里的closeCallback提供了一个系统默认提供的removeConnection，类似于newConnection回调函数
+ **/
+void TcpServer::buildCallbacks() {
+    ConnectionCallbacksPtr callbacks = std::make_shared<ConnectionCallbacks>();
+    callbacks->connectionCallback = connectionCallback_;
+    callbacks->messageCallback = messageCallback_;
+    callbacks->writeCompleteCallback = writeCompleteCallback_;
+    callbacks->closeCallback =
+        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1);
+    callbacks->migrateCallback =
+        std::bind(&TcpServer::migrateConnection, this, std::placeholders::_1,
+                  std::placeholders::_2);
+    callbacks_ = callbacks;
+}
 
-    // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0) {
-        LOG_ERROR("sockets::getLocalAddr");
+/**
+ * acceptor一次唤醒中accept到的所有新连接，会执行这个回调操作
+ *
+ * 先给每个连接选好subLoop并创建TcpConnection，再按subLoop分组，
+ * 每个subLoop只投递一次任务(一次唤醒)去建立这一批连接，而不是每个连接唤醒一次
+ **/
+void TcpServer::newConnection(
+    std::vector<Acceptor::AcceptedConnection> &accepted) {
+    std::unordered_map<EventLoop *, std::vector<Acceptor::AcceptedConnection>>
+        batches;
+    for (auto &item : accepted) {
+        if (!admitConnection(item.first, item.second)) {
+            continue;
+        }
+        /**
+         * 按照setLoadBalance设置的策略(默认轮询)，选择一个subLoop，来管理channel
+         * 如果没有设置setThreadNumber，则返回的就是baseloop
+         *
+         * TcpConnection要到ioLoop中才创建，先给ioLoop的连接数占一个位置，
+         * 这样kLeastConnections策略在同一批连接里也能看到前面已经分出去的连接
+         **/
+        EventLoop *ioLoop = threadPool_->getNextLoop(item.second);
+        ioLoop->adjustConnectionCount(1);
+        batches[ioLoop].push_back(item);
     }
-    InetAddress localAddr(local);
-
-    // 根据连接成功的sockfd，创建TcpConnection连接对象
-    TcpConnectionPtr conn(new TcpConnection(ioLoop, connName,
-                                            sockfd,  // Socket Channel
-                                            localAddr, peerAddr));
-    connections_[connName] = conn;
-    /**
-     * 下面的回调都是用户设置给TcpServer=>设置给TcpConnection=>设置给Channel=>注册Poller=>notify
-     * channel调用回调
-     *
-     * 这里的setConnectionCallback跟setNewConnectionCallback是不同的，这里的回调函数connectionCallback_完全是由用户所指定的，
-     * 可以看到这里的connectionCallback_完全是由用户通过TcpConnection提供的接口自定义设置的，
-     * 系统没有提供类似于上面的newConnection函数来充当默认回调函数，具体运用案例可以参考testserver.c
-     */
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-
-    /**
-     * 设置了如何关闭连接的回调   conn->shutDown()
-     * 可以看到这里的setCloseCallback提供了一个系统默认提供的removeConnection，类似于上面的newConnectionn回调函数
-     */
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
 
     /**
-     * 直接调用TcpConnection::connectEstablished
+     * 调用TcpConnection::connectEstablished
      *
      * ioLoop对象的threadId是对应subThread的ID
      * 但是当前的线程是main线程，所以当前所执行的回调并不在loop所在线程
      * 随机执行queueInloop函数，通过往对应sub线程写一个数据从而唤醒该线程，
-     * 并且把TcpConnection注册到subloop中
+     * 并且把这一批TcpConnection注册到subloop中
      *
      * runInLoop函数中isInLoopThread()判断的代码=>threadId_ ==
      *CurrentThread::tid();
@@ -185,33 +295,326 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
      * 但是runInLoop()函数的调用方是TcpServer::newConnection()，newConnection调用了ioLoop对象里的runInLoop函数
      * 又因为TcpServer在testserver.cc中的main函数中以子类形式被调用，因此TcpServer所在的线程为main线程
      *
-     * 因此由于mainLoop不等于subLoop，于是该connectEstablished函数将会被放入该ioLoop的pendingFunctors_集合中
+     * 因此由于mainLoop不等于subLoop，于是establishConnections函数将会被放入该ioLoop的pendingFunctors_集合中
      * 这里需要注意的是pendingFunctors_是某个EventLoop对象特有的，不同的mainLoop或者subLoop所拥有的pendingFunctors_是不同的
      * pendingFunctors_集合最终会在该ioLoop的loop循环体中被doPendingFunctors函数所调用
      **/
+    for (auto &batch : batches) {
+        batch.first->runInLoop(std::bind(&TcpServer::establishConnections,
+                                         this, batch.first,
+                                         std::move(batch.second)));
+    }
+}
+
+/**
+ * 在ioLoop中执行：创建TcpConnection，登记到这个loop的连接表里，再建立连接
+ *
+ * 连接对象在它所属的loop线程中分配，之后也在这个线程中释放，这样每个loop线程的内存池都能循环复用。
+ * TcpServer析构时投递给各个loop的销毁任务排在这个任务后面，所以这里的this一定还有效
+ **/
+void TcpServer::establishConnections(
+    EventLoop *ioLoop,
+    const std::vector<Acceptor::AcceptedConnection> &accepted) {
+    const ShardPtr &shard = shards_.find(ioLoop)->second;
+    for (const auto &item : accepted) {
+        TcpConnectionPtr conn =
+            createConnection(ioLoop, item.first, item.second);
+        ioLoop->adjustConnectionCount(-1);  // TcpConnection构造时已经计入
+        shard->connections[conn->id()] = conn;
+        conn->connectEstablished();
+    }
+}
+
+/**
+ * kReusePortPerLoop模式下在ioLoop自己的线程中被调用，下面的runInLoop会直接执行connectEstablished
+ **/
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int sockfd,
+                                    const InetAddress &peerAddr) {
+    if (!admitConnection(sockfd, peerAddr)) {
+        return;
+    }
+    TcpConnectionPtr conn = createConnection(ioLoop, sockfd, peerAddr);
+    shardOf(ioLoop)->connections[conn->id()] = conn;
+
+    /**
+     * 直接调用TcpConnection::connectEstablished
+     *
+     * 默认模式下连接是在mainLoop中创建的，而ioLoop是subLoop，这时runInLoop会把connectEstablished放入
+     * ioLoop的pendingFunctors_集合中并唤醒ioLoop；而在kReusePortPerLoop模式下当前线程就是ioLoop所在的线程，
+     * isInLoopThread()为true，connectEstablished被直接执行
+     **/
     ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
+// 为accept到的sockfd创建TcpConnection并设置好回调，登记到连接表以及注册到ioLoop的poller上都在ioLoop中完成
+TcpConnectionPtr TcpServer::createConnection(EventLoop *ioLoop, int sockfd,
+                                             const InetAddress &peerAddr) {
+    uint64_t connId = nextConnId_++;
+
+    LOG_DEBUG("TcpServer::newConnection [%s] - new connection [%s%llu] from %s \n",
+              name_.c_str(), connNamePrefix_->c_str(),
+              (unsigned long long)connId, peerAddr.toIpPort().c_str());
+
+    // 通过sockfd获取其绑定的本机的ip地址和端口信息
+    sockaddr_storage local;
+    ::bzero(&local, sizeof local);
+    socklen_t addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0) {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    InetAddress localAddr((sockaddr *)&local, addrlen);
+
+    // 根据连接成功的sockfd，创建TcpConnection连接对象
+    /**
+     * TcpConnection对象和shared_ptr的控制块由allocate_shared一次分配，
+     * 并且从当前线程(ioLoop线程)的内存池中取，连接关闭之后再还给这个池
+     **/
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+        PoolAllocator<TcpConnection>(), ioLoop, connId, connNamePrefix_,
+        sockfd,  // Socket Channel
+        localAddr, peerAddr);
     /**
-     * loop_对象在TcpServer中被定义，而TcpServer又在testserver.c中被声明，即该loop_是baseLoop，对应的线程为main线程
-     * 又因为removeConnection在TcpServer对象中被声明，因此CurThread为TcpServer对象所在线程，即main线程
-     * 所以threadId_=CurThread，因此isInLoopThread为true，调用runInLoop直接执行cb()，并不需要存入pendingFunctors队列中
+     * 下面的回调都是用户设置给TcpServer=>设置给TcpConnection=>设置给Channel=>注册Poller=>notify
+     * channel调用回调
+     *
+     * 所有连接共享start时构造好的同一份回调集合，建立一个连接不再需要逐个拷贝std::function，
+     * 其中connectionCallback等完全由用户指定，closeCallback(removeConnection)和migrateCallback由系统提供
      */
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    conn->setCallbacks(callbacks_);
+    conn->setWriteBatching(writeBatching_);
+    conn->setReadBudget(readBudget_);
+    return conn;
+}
+
+/**
+ * 先占名额再判断，kReusePortPerLoop模式下多个loop同时accept也不会超过上限
+ **/
+bool TcpServer::admitConnection(int sockfd, const InetAddress &peerAddr) {
+    int count = ++numConnections_;
+    if (maxConnections_ <= 0 || count < maxConnections_) {
+        return true;
+    }
+    if (count == maxConnections_) {
+        // 刚好占满最后一个名额，暂停模式下不再从队列里取新的连接
+        if (overloadPolicy_ == kPauseAccepting) {
+            pauseAccepting();
+        }
+        return true;
+    }
+
+    --numConnections_;
+    LOG_ERROR("TcpServer::admitConnection [%s] - reach max connections %d, "
+              "reject %s \n",
+              name_.c_str(), maxConnections_, peerAddr.toIpPort().c_str());
+    ::close(sockfd);
+    if (overloadPolicy_ == kPauseAccepting) {
+        pauseAccepting();
+    }
+    return false;
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn) {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n",
-             name_.c_str(), conn->name().c_str());
+void TcpServer::pauseAccepting() {
+    if (!closing_ && !acceptPaused_->exchange(true)) {
+        syncAccepting();
+    }
+}
 
-    connections_.erase(conn->name());
+void TcpServer::resumeAccepting() {
+    if (!closing_ && acceptPaused_->exchange(false)) {
+        syncAccepting();
+    }
+}
+
+/**
+ * 暂停和恢复可能由不同的loop线程同时触发，投递到同一个loop的任务先后顺序不一定和状态变化一致，
+ * 所以任务里不直接pause/resume，而是按执行时acceptPaused_的最新值来设置，最后一个任务总能得到正确的状态
+ **/
+void TcpServer::syncAccepting() {
+    if (acceptor_) {
+        loop_->runInLoop(std::bind(&TcpServer::syncAcceptorInLoop,
+                                   std::weak_ptr<Acceptor>(acceptor_),
+                                   acceptPaused_));
+    }
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    for (size_t i = 0; i < loopAcceptors_.size(); ++i) {
+        loops[i]->runInLoop(std::bind(&TcpServer::syncAcceptorInLoop,
+                                      std::weak_ptr<Acceptor>(loopAcceptors_[i]),
+                                      acceptPaused_));
+    }
+}
+
+// acceptor_在TcpServer析构时销毁，各个loop的Acceptor在析构的第二轮中于自己的loop线程里销毁，weak_ptr失效之后什么都不做
+void TcpServer::syncAcceptorInLoop(const std::weak_ptr<Acceptor> &acceptor,
+                                   const std::shared_ptr<std::atomic_bool> &paused) {
+    std::shared_ptr<Acceptor> guard = acceptor.lock();
+    if (!guard) {
+        return;
+    }
+    if (*paused) {
+        guard->pause();
+    } else {
+        guard->resume();
+    }
+}
+
+void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
+    LOG_DEBUG("TcpServer::removeConnection [%s] - connection %s\n",
+              name_.c_str(), conn->name().c_str());
+
+    /**
+     * closeCallback_是在连接自己的handleClose中被调用的，当前线程就是ioLoop所在的线程，
+     * 连接也只登记在这个loop的连接表中，所以直接移除，不需要先回到mainLoop再回到ioLoop
+     */
     EventLoop *ioLoop = conn->getLoop();
+    ShardPtr shard = shardOf(ioLoop);
+    // 已经被~TcpServer取走的连接由析构函数负责销毁
+    if (!shard || shard->connections.erase(conn->id()) == 0) {
+        return;
+    }
+    shard->lastTraffic.erase(conn->id());
+    if (--numConnections_ < maxConnections_ && *acceptPaused_) {
+        resumeAccepting();
+    }
 
     /**
-     * 因为conn->getLoop()获得的是TcpConnection的Loop，因此这里的ioLoop对应的线程threadId_为sub线程
-     * 而removeConnectionInLoop函数的调用方TcpServer处于main线程中
-     * 因此需要把connectDestroyed函数存入pendingFunctors队列中来让ioLoop去执行
+     * 直接在当前的ioLoop中销毁，不再经过pendingFunctors队列(省掉一次加锁、一次std::function分配和shared_ptr拷贝)
+     *
+     * 当前虽然正处在这个连接channel的handleEvent中，但是Channel::handleEvent通过loopTie_在连接上retainInLoop，
+     * 这份loop内的引用计数不为0时连接自己持有一个shared_ptr(见LoopRefCounted)；channel_->remove()只是把channel
+     * 从poller的map中删除，要等handleEvent返回时releaseInLoop让计数归零，TcpConnection以及它的Channel才会析构
      */
-    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    conn->connectDestroyed();
+}
+
+void TcpServer::migrateConnection(const TcpConnectionPtr &conn,
+                                  EventLoop *newLoop) {
+    ShardPtr shard = shardOf(conn->getLoop());
+    if (shard) {
+        shard->connections.erase(conn->id());
+        shard->lastTraffic.erase(conn->id());
+    }
+    // 先于连接自己的attachInLoop排进newLoop的队列，连接在新loop上恢复事件之前就已经登记好了
+    ShardPtr newShard = shardOf(newLoop);
+    if (newShard) {
+        newLoop->queueInLoop(
+            std::bind(&TcpServer::adoptConnection, newShard, conn));
+    } else {
+        LOG_ERROR("TcpServer::migrateConnection [%s] - loop %p not in server\n",
+                  name_.c_str(), newLoop);
+    }
+}
+
+void TcpServer::adoptConnection(const ShardPtr &shard,
+                                const TcpConnectionPtr &conn) {
+    if (shard->closed) {
+        // 迁移途中TcpServer已经析构了，跟其它连接一样销毁
+        conn->connectDestroyed();
+        return;
+    }
+    shard->connections[conn->id()] = conn;
+}
+
+TcpServer::ShardPtr TcpServer::shardOf(EventLoop *loop) const {
+    auto it = shards_.find(loop);
+    return it == shards_.end() ? ShardPtr() : it->second;
+}
+
+void TcpServer::rebalanceThreadFunc() {
+    std::unique_lock<std::mutex> lock(rebalanceMutex_);
+    while (!rebalanceStopping_) {
+        rebalanceCond_.wait_for(
+            lock, std::chrono::milliseconds(rebalanceIntervalMs_));
+        if (!rebalanceStopping_) {
+            rebalance();
+        }
+    }
+}
+
+void TcpServer::rebalance() {
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    if (loops.size() < 2) {
+        return;
+    }
+
+    EventLoop *busiest = loops[0];
+    EventLoop *idlest = loops[0];
+    int maxBusy = busiest->busyPermille();
+    int minBusy = maxBusy;
+    for (size_t i = 1; i < loops.size(); ++i) {
+        int busy = loops[i]->busyPermille();
+        if (busy > maxBusy) {
+            maxBusy = busy;
+            busiest = loops[i];
+        }
+        if (busy < minBusy) {
+            minBusy = busy;
+            idlest = loops[i];
+        }
+    }
+
+    // 每个loop每个周期都要更新一次流量快照，只有最忙的loop需要挑选连接迁移出去
+    bool migrate =
+        maxBusy > 0 && maxBusy - minBusy >= rebalanceThresholdPermille_;
+    for (EventLoop *loop : loops) {
+        EventLoop *target = migrate && loop == busiest ? idlest : nullptr;
+        loop->queueInLoop(std::bind(&TcpServer::rebalanceShardInLoop, this,
+                                    loop, target, maxBusy, minBusy));
+    }
+}
+
+/**
+ * 一次再均衡最多迁移一条连接，避免多个周期之间来回搬动
+ *
+ * 不直接迁移最热的那条连接：如果它本身就占了最忙loop的大部分流量，搬过去只是把热点换了个地方，
+ * 所以挑选本周期流量最接近 忙碌差值的一半 所对应流量的那条连接
+ */
+void TcpServer::rebalanceShardInLoop(EventLoop *loop, EventLoop *target,
+                                     int maxBusy, int minBusy) {
+    ShardPtr shard = shardOf(loop);
+    if (!shard || shard->closed) {
+        return;
+    }
+
+    std::unordered_map<uint64_t, uint64_t> traffic;
+    std::vector<std::pair<TcpConnectionPtr, uint64_t>> candidates;
+    uint64_t totalTraffic = 0;
+    for (auto &item : shard->connections) {
+        const TcpConnectionPtr &conn = item.second;
+        uint64_t bytes = conn->trafficBytes();
+        traffic[item.first] = bytes;
+
+        auto it = shard->lastTraffic.find(item.first);
+        if (it == shard->lastTraffic.end()) {
+            continue;
+        }
+        uint64_t delta = bytes - it->second;
+        if (delta > 0) {
+            candidates.push_back(std::make_pair(conn, delta));
+            totalTraffic += delta;
+        }
+    }
+    shard->lastTraffic.swap(traffic);
+
+    if (target == nullptr || candidates.size() < 2) {
+        return;
+    }
+
+    uint64_t targetBytes =
+        totalTraffic * (maxBusy - minBusy) / (2 * static_cast<uint64_t>(maxBusy));
+    TcpConnectionPtr chosen;
+    uint64_t bestDistance = UINT64_MAX;
+    for (auto &candidate : candidates) {
+        uint64_t distance = candidate.second > targetBytes
+                                ? candidate.second - targetBytes
+                                : targetBytes - candidate.second;
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            chosen = candidate.first;
+        }
+    }
+
+    LOG_INFO("TcpServer::rebalance [%s] - move %s from loop %p(%d) to %p(%d)\n",
+             name_.c_str(), chosen->name().c_str(), loop, maxBusy, target,
+             minBusy);
+    chosen->migrateTo(target);
 }
\ No newline at end of file
@@ -4,10 +4,13 @@
  * 用户使用muduo编写服务器程序
  */
 #include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "Acceptor.h"
 #include "Buffer.h"
@@ -16,6 +19,7 @@
 #include "EventLoopThreadPool.h"
 #include "InetAddress.h"
 #include "TcpConnection.h"
+#include "Thread.h"
 #include "noncopyable.h"
 
 /**
@@ -65,9 +69,16 @@ class TcpServer : noncopyable {
      **/
     using ThreadInitCallback = std::function<void(EventLoop *)>;
 
+    /**
+     * kReusePortPerLoop：每个loop(有subLoop时只用subLoop)各自持有一个开启了SO_REUSEPORT的Acceptor，
+     * 由内核按四元组把新连接分散到各个listenfd上，连接在哪个loop上被accept就直接在哪个loop上建立，
+     * 不再经过mainLoop中转，也就没有每个连接一次的跨线程runInLoop。这种模式下setLoadBalance不起作用
+     * 监听地址是Unix域地址(InetAddress::unixDomain)时没有SO_REUSEPORT，退化成kNoReusePort
+     **/
     enum Option {
         kNoReusePort,
         kReusePort,
+        kReusePortPerLoop,
     };
 
     TcpServer(EventLoop *loop, const InetAddress &listenAddr,
@@ -100,17 +111,111 @@ class TcpServer : noncopyable {
 
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
+    /**
+     * 连接数达到上限之后的处理方式
+     * kRejectNewConnections：继续accept，新连接直接关闭，对端立刻收到FIN
+     * kPauseAccepting：把所有Acceptor从poller上摘下来，新连接留在内核的全连接队列里，
+     *                  连接数降到上限以下时恢复；已经accept出来的超额连接仍然直接关闭
+     **/
+    enum OverloadPolicy {
+        kRejectNewConnections,
+        kPauseAccepting,
+    };
+    // 设置同时存在的最大连接数，0表示不限制，必须在start之前调用
+    void setMaxConnections(int maxConnections,
+                           OverloadPolicy policy = kRejectNewConnections) {
+        maxConnections_ = maxConnections;
+        overloadPolicy_ = policy;
+    }
+    int numConnections() const { return numConnections_; }
+
+    // 每次listenfd可读时最多accept多少个连接，必须在start之前调用
+    void setMaxAcceptsPerWakeup(int n) { maxAcceptsPerWakeup_ = n; }
+    // 设置subloop线程绑定cpu/NUMA节点的策略，比如ThreadPlacement::onePerCore()
+    void setThreadPlacement(const ThreadPlacement &placement);
+    // 设置新连接分配给subloop的策略，默认轮询
+    void setLoadBalance(EventLoopThreadPool::LoadBalance loadBalance) {
+        threadPool_->setLoadBalance(loadBalance);
+    }
+
+    // 可以通过线程池观察各个subloop的连接数，或者设置自定义的subloop选择策略
+    std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
+
+    /**
+     * 开启后台再均衡，必须在start之前调用
+     * 每隔intervalMs检查一次各个subloop的忙碌比例，最忙和最闲的loop相差超过thresholdPermille(千分比)时，
+     * 从最忙的loop上挑一条本周期流量合适的热点连接，通过TcpConnection::migrateTo迁移到最闲的loop上
+     **/
+    void enableRebalance(int intervalMs = 1000, int thresholdPermille = 300);
+
+    // 处理连接的loop先空转maxSpinUs微秒再阻塞，见EventLoop::setBusyPoll
+    void setBusyPoll(int maxSpinUs) { threadPool_->setBusyPoll(maxSpinUs); }
+
+    // 新建立的连接是否开启批量写模式，见TcpConnection::setWriteBatching，必须在start之前调用
+    void setWriteBatching(bool on) { writeBatching_ = on; }
+    // 新建立的连接每轮循环最多读多少字节，见TcpConnection::setReadBudget，必须在start之前调用
+    void setReadBudget(size_t bytes) { readBudget_ = bytes; }
 
     // 开启服务器监听
     void start();
 
    private:
     // 封装TcpConnection对象
-    void newConnection(int sockfd, const InetAddress &peerAddr);
+    // acceptor一次唤醒accept到的所有新连接
+    void newConnection(std::vector<Acceptor::AcceptedConnection> &accepted);
+    TcpConnectionPtr createConnection(EventLoop *ioLoop, int sockfd,
+                                      const InetAddress &peerAddr);
+    // start时把用户回调和系统回调合成一份，所有TcpConnection共享
+    void buildCallbacks();
+
+    // 准入控制：连接数未超过上限时占用一个名额并返回true，否则关闭sockfd并返回false
+    bool admitConnection(int sockfd, const InetAddress &peerAddr);
+    // 在各个Acceptor自己的loop中暂停/恢复accept
+    void pauseAccepting();
+    void resumeAccepting();
+    void syncAccepting();
+    // 投递到loop中执行时TcpServer可能已经析构，所以只通过weak_ptr和共享的标志访问
+    static void syncAcceptorInLoop(const std::weak_ptr<Acceptor> &acceptor,
+                                   const std::shared_ptr<std::atomic_bool> &paused);
+    // 在ioLoop上建立连接，kReusePortPerLoop模式下由各个loop自己的Acceptor直接调用
+    void newConnectionInLoop(EventLoop *ioLoop, int sockfd,
+                             const InetAddress &peerAddr);
+    // 在连接所在的ioLoop中被调用，直接从这个loop的连接表中移除，不需要回到mainLoop
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // 在连接原来所在的loop中被调用，把连接表中的记录挪到newLoop的连接表中
+    void migrateConnection(const TcpConnectionPtr &conn, EventLoop *newLoop);
+
+    /**
+     * 再均衡线程只负责定时以及比较各个loop的忙碌比例(都是原子变量)，
+     * 统计连接流量以及挑选迁移的连接都在各个loop自己的线程中执行，因为连接表只在所属的loop中访问
+     **/
+    void rebalanceThreadFunc();
+    void rebalance();
+    void rebalanceShardInLoop(EventLoop *loop, EventLoop *target, int maxBusy,
+                              int minBusy);
+
+    using ConnectionMap = std::unordered_map<uint64_t, TcpConnectionPtr>;
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    /**
+     * 每个loop一个连接表，只在这个loop的线程中访问，不需要加锁，连接的建立和关闭都不用再经过mainLoop
+     * shared_ptr是因为迁移中的连接可能在TcpServer析构之后才到达新的loop，见adoptConnection
+     **/
+    struct ConnectionShard {
+        ConnectionShard() : closed(false) {}
+        ConnectionMap connections;
+        // 上一个再均衡周期各个连接的累计流量，用来计算本周期的流量
+        std::unordered_map<uint64_t, uint64_t> lastTraffic;
+        bool closed;  // TcpServer已经析构，连接表中的连接都已经销毁
+    };
+    using ShardPtr = std::shared_ptr<ConnectionShard>;
+
+    // 找到loop对应的连接表，loop不属于这个TcpServer时返回空
+    ShardPtr shardOf(EventLoop *loop) const;
+    void establishConnections(
+        EventLoop *ioLoop,
+        const std::vector<Acceptor::AcceptedConnection> &accepted);
+    static void adoptConnection(const ShardPtr &shard,
+                                const TcpConnectionPtr &conn);
 
     /**
      * TcpServer作为用户和服务器的直接桥梁，拥有很多重要的参数
@@ -129,8 +234,13 @@ class TcpServer : noncopyable {
     const std::string ipPort_;
     const std::string name_;
 
-    std::unique_ptr<Acceptor>
-        acceptor_;  // 运行在mainLoop，任务就是监听新连接事件
+    const InetAddress listenAddr_;
+    const Option option_;
+
+    std::shared_ptr<Acceptor>
+        acceptor_;  // 运行在mainLoop，任务就是监听新连接事件，kReusePortPerLoop模式下为空
+    // kReusePortPerLoop模式下每个loop上的Acceptor，下标与threadPool_->getAllLoops()一致
+    std::vector<std::shared_ptr<Acceptor>> loopAcceptors_;
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;  // one loop per thread
 
@@ -140,9 +250,30 @@ class TcpServer : noncopyable {
     WriteCompleteCallback writeCompleteCallback_;  // 消息发送完成以后的回调
 
     ThreadInitCallback threadInitCallback_;  // loop线程初始化的回调
+    ConnectionCallbacksPtr callbacks_;  // 所有连接共享的回调集合，start之后只读
 
     std::atomic_int started_;
+    int maxAcceptsPerWakeup_;
+    bool writeBatching_;
+    size_t readBudget_;
+    int maxConnections_;
+    OverloadPolicy overloadPolicy_;
+    std::atomic_int numConnections_;  // 当前的连接数，包括已经accept还没有建立完成的
+    // syncAcceptorInLoop持有一份，TcpServer析构之后执行的任务也能安全地读
+    const std::shared_ptr<std::atomic_bool> acceptPaused_;
+    // 析构开始之后不再暂停/恢复acceptor，也不再读loopAcceptors_
+    std::atomic_bool closing_;
+
+    std::atomic<uint64_t> nextConnId_;
+    // 连接名字的公共前缀 name-ip:port#，所有连接共享一份
+    const std::shared_ptr<const std::string> connNamePrefix_;
+    // 保存所有的连接，按loop分片，start之后只读
+    std::unordered_map<EventLoop *, ShardPtr> shards_;
 
-    int nextConnId_;
-    ConnectionMap connections_;  // 保存所有的连接
+    int rebalanceIntervalMs_;  // 0表示不开启再均衡
+    int rebalanceThresholdPermille_;
+    std::unique_ptr<Thread> rebalanceThread_;
+    std::mutex rebalanceMutex_;
+    std::condition_variable rebalanceCond_;
+    bool rebalanceStopping_;
 };
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "ThreadPlacement.h"
+
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "Logger.h"
+
+// 读取sysfs中的一个小文件，去掉末尾的换行
+static std::string readSysFile(const std::string &path) {
+    std::string content;
+    FILE *fp = ::fopen(path.c_str(), "r");
+    if (fp != nullptr) {
+        char buf[4096] = {0};
+        if (::fgets(buf, sizeof buf, fp) != nullptr) {
+            content = buf;
+        }
+        ::fclose(fp);
+    }
+    while (!content.empty() &&
+           (content.back() == '\n' || content.back() == ' ')) {
+        content.pop_back();
+    }
+    return content;
+}
+
+// 解析"0-3,8-11"这种格式的cpu/node列表
+static std::vector<int> parseList(const std::string &list) {
+    std::vector<int> ids;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        std::string range = list.substr(pos, comma - pos);
+        size_t dash = range.find('-');
+        if (!range.empty()) {
+            int first = atoi(range.c_str());
+            int last = dash == std::string::npos
+                           ? first
+                           : atoi(range.c_str() + dash + 1);
+            for (int id = first; id <= last; ++id) {
+                ids.push_back(id);
+            }
+        }
+        pos = comma + 1;
+    }
+    return ids;
+}
+
+static std::vector<int> onlineCpus() {
+    std::vector<int> cpus =
+        parseList(readSysFile("/sys/devices/system/cpu/online"));
+    if (cpus.empty()) {
+        long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < n; ++i) {
+            cpus.push_back(static_cast<int>(i));
+        }
+    }
+    return cpus;
+}
+
+static std::vector<int> onlineNodes() {
+    return parseList(readSysFile("/sys/devices/system/node/online"));
+}
+
+static std::vector<int> cpusOfNode(int node) {
+    return parseList(readSysFile("/sys/devices/system/node/node" +
+                                 std::to_string(node) + "/cpulist"));
+}
+
+// 单节点的机器上设置内存策略没有意义，直接返回-1
+static int nodeOfCpu(int cpu) {
+    std::vector<int> nodes = onlineNodes();
+    if (nodes.size() <= 1) {
+        return -1;
+    }
+    for (int node : nodes) {
+        std::vector<int> cpus = cpusOfNode(node);
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+            return node;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 按物理核分组：同一个物理核上的超线程共享thread_siblings_list
+ * 返回的每个元素是一个物理核上的所有逻辑cpu，按第一个cpu编号排序
+ **/
+static std::vector<std::vector<int>> physicalCores() {
+    std::vector<std::vector<int>> cores;
+    for (int cpu : onlineCpus()) {
+        std::vector<int> siblings = parseList(
+            readSysFile("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                        "/topology/thread_siblings_list"));
+        if (siblings.empty()) {
+            siblings.push_back(cpu);
+        }
+        if (std::find(cores.begin(), cores.end(), siblings) == cores.end()) {
+            cores.push_back(siblings);
+        }
+    }
+    return cores;
+}
+
+ThreadPlacement::ThreadPlacement() : policy_(kNone), node_(-1) {}
+
+ThreadPlacement ThreadPlacement::cpuList(const std::vector<int> &cpus) {
+    ThreadPlacement placement;
+    placement.policy_ = kCpuList;
+    placement.cpus_ = cpus;
+    return placement;
+}
+
+ThreadPlacement ThreadPlacement::onePerCore() {
+    ThreadPlacement placement;
+    placement.policy_ = kOnePerCore;
+    return placement;
+}
+
+ThreadPlacement ThreadPlacement::numaLocal(int node) {
+    ThreadPlacement placement;
+    placement.policy_ = kNumaLocal;
+    placement.node_ = node;
+    return placement;
+}
+
+void ThreadPlacement::resolve(int index, std::vector<int> *cpus,
+                              int *node) const {
+    cpus->clear();
+    *node = -1;
+
+    switch (policy_) {
+        case kCpuList:
+            if (!cpus_.empty()) {
+                cpus->push_back(cpus_[index % cpus_.size()]);
+            }
+            break;
+        case kOnePerCore: {
+            std::vector<std::vector<int>> cores = physicalCores();
+            if (!cores.empty()) {
+                *cpus = cores[index % cores.size()];
+            }
+            break;
+        }
+        case kNumaLocal: {
+            std::vector<int> nodes = onlineNodes();
+            if (node_ >= 0) {
+                *node = node_;
+            } else if (!nodes.empty()) {
+                *node = nodes[index % nodes.size()];
+            }
+            if (*node >= 0) {
+                *cpus = cpusOfNode(*node);
+            }
+            // 只有一个节点的时候不需要再设置内存策略
+            if (nodes.size() <= 1) {
+                *node = -1;
+            }
+            return;
+        }
+        default:
+            return;
+    }
+
+    // 绑定到具体cpu的策略，内存也跟着cpu放在它所在的节点上
+    if (!cpus->empty()) {
+        *node = nodeOfCpu(cpus->front());
+    }
+}
+
+bool ThreadPlacement::apply(const std::vector<int> &cpus, int node) {
+    bool ok = true;
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        int err = ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set);
+        if (err != 0) {
+            LOG_ERROR("%s:%s:%d pthread_setaffinity_np err:%d \n", __FILE__,
+                      __FUNCTION__, __LINE__, err);
+            ok = false;
+        }
+    }
+
+    /**
+     * MPOL_PREFERRED：本线程之后分配的内存优先从node上分配，node内存不够时允许退到其它节点
+     * 直接走系统调用，不依赖libnuma
+     **/
+    if (node >= 0) {
+        const int kMaskBits = 8 * sizeof(unsigned long) * 16;
+        unsigned long mask[16] = {0};
+        if (node < kMaskBits) {
+            mask[node / (8 * sizeof(unsigned long))] |=
+                1UL << (node % (8 * sizeof(unsigned long)));
+            if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask,
+                          kMaskBits + 1) != 0) {
+                LOG_ERROR("%s:%s:%d set_mempolicy node:%d err:%d \n", __FILE__,
+                          __FUNCTION__, __LINE__, node, errno);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
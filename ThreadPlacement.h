@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * loop线程在CPU和NUMA节点上的摆放策略
+ *
+ * EventLoopThreadPool默认不对subLoop线程做任何绑定，调度器会把它们在各个核、甚至各个socket之间迁移，
+ * 一个连接的Buffer、Channel等数据刚在某个核的L2/L3里热起来，线程就被换到了别的核上，
+ * 在多socket的机器上还会变成跨节点的内存访问
+ *
+ * ThreadPlacement描述第几个loop线程应该绑定到哪些cpu、内存优先从哪个NUMA节点分配，
+ * 由EventLoopThread在threadFunc中、构造EventLoop之前应用到线程上，
+ * 这样EventLoop、Poller以及之后在这个线程里创建的连接对象都是在本地节点上第一次被访问(first-touch)的
+ **/
+class ThreadPlacement {
+   public:
+    enum Policy {
+        kNone,        // 不做任何绑定，交给调度器
+        kCpuList,     // 按用户给出的cpu列表，第i个loop线程绑定到第i个cpu
+        kOnePerCore,  // 每个loop线程独占一个物理核(包括它的超线程兄弟)
+        kNumaLocal,   // 绑定到某个NUMA节点上的所有cpu
+    };
+
+    ThreadPlacement();
+
+    static ThreadPlacement cpuList(const std::vector<int> &cpus);
+    static ThreadPlacement onePerCore();
+    // node为-1表示把各个loop线程轮流分布到所有的NUMA节点上
+    static ThreadPlacement numaLocal(int node = -1);
+
+    Policy policy() const { return policy_; }
+
+    /**
+     * 计算第index个loop线程应该绑定的cpu集合以及内存所在的NUMA节点
+     * cpus为空表示不绑定cpu，node为-1表示不设置内存策略
+     **/
+    void resolve(int index, std::vector<int> *cpus, int *node) const;
+
+    // 把cpu绑定和内存策略应用到调用线程上，失败只打印日志，不影响线程继续运行
+    static bool apply(const std::vector<int> &cpus, int node);
+
+   private:
+    Policy policy_;
+    std::vector<int> cpus_;
+    int node_;
+};
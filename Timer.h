@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+/**
+ * 一个定时任务：到期时间、回调，以及重复执行的间隔(interval为0表示只执行一次)
+ * 只由TimerQueue创建和销毁，只在所属loop线程中访问
+ **/
+class Timer : noncopyable {
+   public:
+    using TimerCallback = std::function<void()>;
+
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb)),
+          expiration_(when),
+          interval_(interval),
+          repeat_(interval > 0.0),
+          sequence_(++numCreated_) {}
+
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复的定时器执行完之后从now开始重新计时
+    void restart(Timestamp now);
+
+   private:
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_;  // 秒
+    const bool repeat_;
+    /**
+     * 全局唯一的序号，TimerId用(Timer*, sequence)来标识一个定时器，
+     * 定时器被删除之后同一块内存可能分配给新的定时器，光凭地址区分不出来
+     **/
+    const int64_t sequence_;
+
+    static std::atomic<int64_t> numCreated_;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+/**
+ * EventLoop::runAt/runAfter/runEvery返回的定时器句柄，只用来调用EventLoop::cancel
+ * 可以拷贝，可以在任意线程保存和传递；定时器已经执行完或者已经取消之后再cancel什么都不会发生
+ **/
+class TimerId {
+   public:
+    TimerId() : timer_(nullptr), sequence_(0) {}
+    TimerId(Timer *timer, int64_t sequence)
+        : timer_(timer), sequence_(sequence) {}
+
+    friend class TimerQueue;
+
+   private:
+    Timer *timer_;
+    int64_t sequence_;
+};
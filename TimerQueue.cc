@@ -0,0 +1,173 @@
+#include "TimerQueue.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+/**
+ * CLOCK_MONOTONIC不受系统时间调整的影响
+ * Timestamp用的是墙上时间，所以每次都按"距离现在还有多久"设置相对的超时时间
+ */
+static int createTimerfd() {
+    int timerfd =
+        ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0) {
+        LOG_FATAL("timerfd_create error:%d \n", errno);
+    }
+    return timerfd;
+}
+
+// 已经过期的定时器也至少等100微秒，timerfd的超时时间为0表示停止计时
+static timespec howMuchTimeFromNow(Timestamp when) {
+    int64_t microseconds = when.microSecondsSinceEpoch() -
+                           Timestamp::now().microSecondsSinceEpoch();
+    if (microseconds < 100) {
+        microseconds = 100;
+    }
+    timespec ts;
+    ts.tv_sec =
+        static_cast<time_t>(microseconds / Timestamp::kMicroSecondsPerSecond);
+    ts.tv_nsec = static_cast<long>(
+        (microseconds % Timestamp::kMicroSecondsPerSecond) * 1000);
+    return ts;
+}
+
+static void readTimerfd(int timerfd) {
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
+    if (n != sizeof howmany) {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8 \n",
+                  (long)n);
+    }
+}
+
+static void resetTimerfd(int timerfd, Timestamp expiration) {
+    itimerspec newValue;
+    itimerspec oldValue;
+    ::memset(&newValue, 0, sizeof newValue);
+    ::memset(&oldValue, 0, sizeof oldValue);
+    newValue.it_value = howMuchTimeFromNow(expiration);
+    if (::timerfd_settime(timerfd, 0, &newValue, &oldValue) < 0) {
+        LOG_ERROR("timerfd_settime error:%d \n", errno);
+    }
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop),
+      timerfd_(createTimerfd()),
+      timerfdChannel_(loop, timerfd_),
+      callingExpiredTimers_(false) {
+    timerfdChannel_.setReadCallback([this](Timestamp) { handleRead(); });
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue() {
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+    for (const Entry &timer : timers_) {
+        delete timer.second;
+    }
+}
+
+/**
+ * Timer在调用方线程中创建，插入timers_的操作放到loop线程中执行，
+ * 这样timers_和activeTimers_只会被loop线程访问，不需要加锁
+ */
+TimerId TimerQueue::addTimer(Timer::TimerCallback cb, Timestamp when,
+                             double interval) {
+    Timer *timer = new Timer(std::move(cb), when, interval);
+    loop_->runInLoop([this, timer]() { addTimerInLoop(timer); });
+    return TimerId(timer, timer->sequence());
+}
+
+void TimerQueue::cancel(TimerId timerId) {
+    loop_->runInLoop([this, timerId]() { cancelInLoop(timerId); });
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer) {
+    bool earliestChanged = insert(timer);
+    if (earliestChanged) {
+        resetTimerfd(timerfd_, timer->expiration());
+    }
+}
+
+/**
+ * timerId里的指针只用来查找，不会被解引用：定时器可能早就执行完被删除了，
+ * 这时(地址, 序号)在activeTimers_里找不到，什么都不做
+ */
+void TimerQueue::cancelInLoop(TimerId timerId) {
+    ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    ActiveTimerSet::iterator it = activeTimers_.find(timer);
+    if (it != activeTimers_.end()) {
+        timers_.erase(Entry(it->first->expiration(), it->first));
+        delete it->first;
+        activeTimers_.erase(it);
+    } else if (callingExpiredTimers_) {
+        // 正在执行的定时器取消自己
+        cancelingTimers_.insert(timer);
+    }
+    // timerfd不用重新设置，最多空醒一次
+}
+
+void TimerQueue::handleRead() {
+    Timestamp now(Timestamp::now());
+    readTimerfd(timerfd_);
+
+    std::vector<Entry> expired = getExpired(now);
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for (const Entry &it : expired) {
+        it.second->run();
+    }
+    callingExpiredTimers_ = false;
+
+    reset(expired, now);
+}
+
+std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now) {
+    // 到期时间不晚于now的都算到期，地址取最大值，保证同一时刻到期的都被包含进来
+    Entry sentry(now, reinterpret_cast<Timer *>(UINTPTR_MAX));
+    TimerList::iterator end = timers_.lower_bound(sentry);
+    std::vector<Entry> expired(timers_.begin(), end);
+    timers_.erase(timers_.begin(), end);
+
+    for (const Entry &it : expired) {
+        activeTimers_.erase(ActiveTimer(it.second, it.second->sequence()));
+    }
+    return expired;
+}
+
+void TimerQueue::reset(const std::vector<Entry> &expired, Timestamp now) {
+    for (const Entry &it : expired) {
+        ActiveTimer timer(it.second, it.second->sequence());
+        if (it.second->repeat() &&
+            cancelingTimers_.find(timer) == cancelingTimers_.end()) {
+            it.second->restart(now);
+            insert(it.second);
+        } else {
+            delete it.second;
+        }
+    }
+
+    if (!timers_.empty()) {
+        resetTimerfd(timerfd_, timers_.begin()->second->expiration());
+    }
+}
+
+bool TimerQueue::insert(Timer *timer) {
+    bool earliestChanged = false;
+    Timestamp when = timer->expiration();
+    TimerList::iterator it = timers_.begin();
+    if (it == timers_.end() || when < it->first) {
+        earliestChanged = true;
+    }
+    timers_.insert(Entry(when, timer));
+    activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
+    return earliestChanged;
+}
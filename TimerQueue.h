@@ -0,0 +1,67 @@
+#pragma once
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "Channel.h"
+#include "Timer.h"
+#include "TimerId.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * 一个loop上的所有定时器，用一个timerfd统一交给poller监听
+ *
+ * 跟wakeupfd一样是"统一事件源"的思路：timerfd总是设置成最早到期的那个定时器的时间，
+ * 到期之后timerfd可读，loop在处理这个channel的读事件时执行所有已经到期的定时器，
+ * 定时器和网络IO都在同一个epoll_wait里等待，不需要额外的线程，回调都在loop线程中执行
+ *
+ * 定时器按到期时间排序存放在std::set中，插入、删除、取出最早的一个都是O(logN)
+ **/
+class TimerQueue : noncopyable {
+   public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 可以在任意线程调用，interval大于0表示每隔interval秒重复执行
+    TimerId addTimer(Timer::TimerCallback cb, Timestamp when, double interval);
+    // 可以在任意线程调用
+    void cancel(TimerId timerId);
+
+   private:
+    // 同一时刻到期的定时器用地址区分
+    using Entry = std::pair<Timestamp, Timer *>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer *, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读，执行所有到期的定时器
+    void handleRead();
+
+    // 从timers_中取出所有到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    // 重复的定时器重新放回去，其它的删除，然后按最早到期的时间重新设置timerfd
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+    // 返回插入的定时器是不是最早到期的那个
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    // timers_按到期时间排序，activeTimers_按(地址, 序号)排序，两者保存的是同一批定时器
+    TimerList timers_;
+    ActiveTimerSet activeTimers_;
+
+    /**
+     * 定时器的回调里可能取消定时器自己(典型的是重复的定时器)，这时它已经不在timers_里了，
+     * 记到cancelingTimers_中，reset时就不会再把它放回去
+     **/
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_;
+};
@@ -11,6 +11,25 @@ class Timestamp {
     static Timestamp now();
     std::string toString() const;
 
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
+
    private:
     int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs) {
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs) {
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// timestamp之后seconds秒的时间点，定时器用它计算到期时间
+inline Timestamp addTime(Timestamp timestamp, double seconds) {
+    int64_t delta =
+        static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
@@ -0,0 +1,80 @@
+#include "UdpServer.h"
+
+#include <future>
+
+#include "Logger.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop) {
+    if (loop == nullptr) {
+        LOG_FATAL("%s:%s:%d mainLoop is null! \n", __FILE__, __FUNCTION__,
+                  __LINE__);
+    }
+    return loop;
+}
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr,
+                     const std::string &nameArg, Option option)
+    : loop_(CheckLoopNotNull(loop)),
+      name_(nameArg),
+      listenAddr_(listenAddr),
+      option_(option),
+      threadPool_(new EventLoopThreadPool(loop, name_)),
+      batchSize_(64),
+      maxDatagramSize_(2048),
+      gro_(false),
+      gso_(false),
+      receiveBufferSize_(0),
+      started_(0) {}
+
+// 和~TcpServer一样，每个socket投递到自己的loop中销毁，并且等它执行完
+UdpServer::~UdpServer() {
+    for (std::unique_ptr<UdpSocket> &socket : sockets_) {
+        UdpSocket *s = socket.release();
+        std::promise<void> done;
+        s->getLoop()->runInLoop([s, &done]() {
+            delete s;
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+/**
+ * 和TcpServer的kReusePortPerLoop一样，socket在这里构造(socket+bind)，
+ * 分配接收缓冲区以及注册channel交给对应的loop线程，之后这个socket只在那个线程中使用
+ */
+void UdpServer::start() {
+    if (started_++ != 0) {
+        return;
+    }
+    threadPool_->start(threadInitCallback_);
+
+    std::vector<EventLoop *> loops;
+    if (option_ == kReusePortPerLoop) {
+        loops = threadPool_->getAllLoops();
+    } else {
+        loops.push_back(loop_);
+    }
+    for (EventLoop *ioLoop : loops) {
+        UdpSocket *socket =
+            new UdpSocket(ioLoop, listenAddr_, option_ == kReusePortPerLoop);
+        socket->setDatagramCallback(datagramCallback_);
+        socket->setBatchSize(batchSize_);
+        socket->setMaxDatagramSize(maxDatagramSize_);
+        socket->enableGro(gro_);
+        socket->enableGso(gso_);
+        socket->setReceiveBufferSize(receiveBufferSize_);
+        sockets_.push_back(std::unique_ptr<UdpSocket>(socket));
+        ioLoop->runInLoop(std::bind(&UdpSocket::start, socket));
+    }
+    LOG_INFO("UdpServer[%s] started on %s with %zu socket(s) \n", name_.c_str(),
+             listenAddr_.toIpPort().c_str(), sockets_.size());
+}
+
+uint64_t UdpServer::droppedDatagrams() const {
+    uint64_t dropped = 0;
+    for (const std::unique_ptr<UdpSocket> &socket : sockets_) {
+        dropped += socket->droppedDatagrams();
+    }
+    return dropped;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Callbacks.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "UdpSocket.h"
+#include "noncopyable.h"
+
+/**
+ * 对外的UDP服务器编程使用的类，和TcpServer对应
+ *
+ * UDP没有连接，也就没有Acceptor和TcpConnection，服务器就是注册在loop上的UdpSocket：
+ * kSingleSocket：只在baseLoop上有一个socket，所有数据报都由baseLoop处理，setThreadNum不起作用
+ * kReusePortPerLoop：每个loop(有subLoop时只用subLoop)各自bind一个开启了SO_REUSEPORT的socket，
+ *                    内核按四元组把数据报分散到各个socket上，同一个对端的数据报总是落在同一个loop上
+ *
+ * DatagramCallback在收到数据报的socket所在的loop线程中调用，回复直接调用参数中UdpSocket的sendTo，
+ * 一批数据报的回复在本轮循环结束时用一次sendmmsg发出
+ **/
+class UdpServer : noncopyable {
+   public:
+    using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    enum Option {
+        kSingleSocket,
+        kReusePortPerLoop,
+    };
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr,
+              const std::string &nameArg, Option option = kSingleSocket);
+    ~UdpServer();
+
+    // 以下设置必须在start之前调用，socket的设置含义见UdpSocket
+    void setThreadInitCallback(const ThreadInitCallback &cb) {
+        threadInitCallback_ = cb;
+    }
+    void setThreadNum(int numThreads) { threadPool_->setThreadNum(numThreads); }
+    void setDatagramCallback(const DatagramCallback &cb) {
+        datagramCallback_ = cb;
+    }
+    void setBatchSize(int batchSize) { batchSize_ = batchSize; }
+    void setMaxDatagramSize(size_t bytes) { maxDatagramSize_ = bytes; }
+    void enableGro(bool on) { gro_ = on; }
+    void enableGso(bool on) { gso_ = on; }
+    void setReceiveBufferSize(int bytes) { receiveBufferSize_ = bytes; }
+
+    // 开始接收数据报，只能调用一次
+    void start();
+
+    std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
+    const std::string &name() const { return name_; }
+
+    // 所有socket丢弃的数据报个数之和，start之后可以在任意线程调用
+    uint64_t droppedDatagrams() const;
+
+   private:
+    EventLoop *loop_;
+    const std::string name_;
+    const InetAddress listenAddr_;
+    const Option option_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+
+    ThreadInitCallback threadInitCallback_;
+    DatagramCallback datagramCallback_;
+    int batchSize_;
+    size_t maxDatagramSize_;
+    bool gro_;
+    bool gso_;
+    int receiveBufferSize_;
+
+    std::atomic_int started_;
+    // start之后不再增删，每个socket只在自己的loop线程中使用
+    std::vector<std::unique_ptr<UdpSocket>> sockets_;
+};
@@ -0,0 +1,354 @@
+#include "UdpSocket.h"
+
+#include <errno.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+// sendmmsg一次最多发送的消息数(UIO_MAXIOV)
+static const int kMaxSendMessages = 1024;
+// GSO一个报文最多的段数和最大的负载
+static const size_t kMaxGsoSegments = 64;
+static const size_t kMaxGsoBytes = 65507;
+// 开启GRO时合并后的报文最大64K
+static const size_t kGroBufferSize = 65536;
+
+static int createUdpSocket(sa_family_t family) {
+    // 对端地址按sockaddr_in6保存，Unix域的路径会被截断，见UdpSocket::PendingDatagram
+    if (family != AF_INET && family != AF_INET6) {
+        LOG_FATAL("%s:%s:%d udp socket only supports AF_INET/AF_INET6, got family:%d \n",
+                  __FILE__, __FUNCTION__, __LINE__, family);
+    }
+    int sockfd =
+        ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        LOG_FATAL("%s:%s:%d udp socket create err:%d \n", __FILE__,
+                  __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+UdpSocket::UdpSocket(EventLoop *loop, const InetAddress &bindAddr,
+                     bool reusePort)
+    : loop_(loop),
+      self_(std::make_shared<UdpSocket *>(this)),
+      socket_(createUdpSocket(bindAddr.family())),
+      channel_(loop, socket_.fd()),
+      localAddr_(bindAddr),
+      batchSize_(64),
+      maxDatagramSize_(2048),
+      gro_(false),
+      gso_(false),
+      receiveBufferSize_(0),
+      dropped_(0) {
+    socket_.setReuseAddr(true);
+    socket_.setReusePort(reusePort);
+    socket_.bindAddress(bindAddr);
+    // 绑定的端口是0时由内核分配，取回实际的地址
+    sockaddr_storage local;
+    socklen_t addrlen = sizeof local;
+    if (::getsockname(socket_.fd(), (sockaddr *)&local, &addrlen) == 0) {
+        localAddr_.setSockAddr((sockaddr *)&local, addrlen);
+    }
+
+    channel_.setReadCallback(
+        [this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+    channel_.setErrorCallback([this]() { handleError(); });
+    channel_.setFlushCallback([this]() { flushSends(); });
+}
+
+UdpSocket::~UdpSocket() {
+    channel_.disableAll();
+    channel_.remove();
+}
+
+void UdpSocket::start() {
+    if (receiveBufferSize_ > 0 &&
+        ::setsockopt(socket_.fd(), SOL_SOCKET, SO_RCVBUF, &receiveBufferSize_,
+                     sizeof receiveBufferSize_) < 0) {
+        LOG_ERROR("UdpSocket::start SO_RCVBUF error:%d \n", errno);
+    }
+    if (gro_) {
+        int on = 1;
+        if (::setsockopt(socket_.fd(), SOL_UDP, UDP_GRO, &on, sizeof on) < 0) {
+            LOG_ERROR("UdpSocket::start UDP_GRO not supported, errno:%d \n",
+                      errno);
+            gro_ = false;
+        } else {
+            maxDatagramSize_ = std::max(maxDatagramSize_, kGroBufferSize);
+        }
+    }
+
+    /**
+     * 所有接收缓冲区、地址、iovec、mmsghdr都在这里一次分配好并且互相指好，
+     * 之后每次recvmmsg只需要重置msg_namelen和msg_controllen
+     **/
+    size_t n = static_cast<size_t>(batchSize_);
+    size_t controlSize = CMSG_SPACE(sizeof(int));
+    recvBuffer_.resize(n * maxDatagramSize_);
+    recvMessages_.resize(n);
+    recvIovecs_.resize(n);
+    recvAddrs_.resize(n);
+    recvControl_.resize(gro_ ? n * controlSize : 0);
+    datagrams_.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        recvIovecs_[i].iov_base = &recvBuffer_[i * maxDatagramSize_];
+        recvIovecs_[i].iov_len = maxDatagramSize_;
+        msghdr &hdr = recvMessages_[i].msg_hdr;
+        ::memset(&hdr, 0, sizeof hdr);
+        hdr.msg_name = &recvAddrs_[i];
+        hdr.msg_iov = &recvIovecs_[i];
+        hdr.msg_iovlen = 1;
+        if (gro_) {
+            hdr.msg_control = &recvControl_[i * controlSize];
+        }
+    }
+
+    channel_.enableReading();
+}
+
+/**
+ * LT模式下这一批没收完，下一轮还会上报，所以连续收满kMaxBatchesPerRead批之后就让出loop
+ * 被截断的数据报(比maxDatagramSize大)直接丢弃，不交给回调
+ */
+void UdpSocket::handleRead(Timestamp receiveTime) {
+    const size_t controlSize = CMSG_SPACE(sizeof(int));
+    for (int batch = 0; batch < kMaxBatchesPerRead; ++batch) {
+        for (int i = 0; i < batchSize_; ++i) {
+            recvMessages_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in6);
+            recvMessages_[i].msg_hdr.msg_controllen = gro_ ? controlSize : 0;
+        }
+        int n = ::recvmmsg(socket_.fd(), recvMessages_.data(), batchSize_,
+                           MSG_DONTWAIT, nullptr);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                LOG_ERROR("UdpSocket::handleRead recvmmsg error:%d \n", errno);
+            }
+            return;
+        }
+
+        datagrams_.clear();
+        uint64_t dropped = 0;
+        for (int i = 0; i < n; ++i) {
+            msghdr &hdr = recvMessages_[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC) {
+                ++dropped;
+                continue;
+            }
+            const char *data = static_cast<const char *>(recvIovecs_[i].iov_base);
+            size_t len = recvMessages_[i].msg_len;
+            size_t segment = len;
+            if (gro_) {
+                // 合并过的报文带着段长，除了最后一段，每段都是这么长
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+                     cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+                    if (cmsg->cmsg_level == SOL_UDP &&
+                        cmsg->cmsg_type == UDP_GRO) {
+                        int size;
+                        ::memcpy(&size, CMSG_DATA(cmsg), sizeof size);
+                        segment = size > 0 ? static_cast<size_t>(size) : len;
+                    }
+                }
+            }
+            // 空的数据报也要交给回调，所以用do-while
+            size_t offset = 0;
+            do {
+                Datagram datagram;
+                datagram.data = data + offset;
+                datagram.len = std::min(segment, len - offset);
+                datagram.peer.setSockAddr((sockaddr *)&recvAddrs_[i],
+                                          recvMessages_[i].msg_hdr.msg_namelen);
+                datagrams_.push_back(datagram);
+                offset += segment;
+            } while (offset < len);
+        }
+        if (dropped > 0) {
+            addDropped(dropped);
+        }
+        if (!datagrams_.empty() && datagramCallback_) {
+            datagramCallback_(this, datagrams_.data(), datagrams_.size(),
+                              receiveTime);
+        }
+        if (n < batchSize_) {
+            return;  // 内核的接收队列已经收空了
+        }
+    }
+}
+
+void UdpSocket::sendTo(const void *data, size_t len, const InetAddress &peer) {
+    if (!loop_->isInLoopThread()) {
+        loop_->runInLoop(std::bind(&UdpSocket::sendInLoop,
+                                   std::weak_ptr<UdpSocket *>(self_),
+                                   std::string(static_cast<const char *>(data), len),
+                                   peer));
+        return;
+    }
+    if (pending_.size() >= kMaxPendingDatagrams) {
+        addDropped(1);
+        return;
+    }
+    PendingDatagram datagram;
+    datagram.offset = sendBuffer_.readableBytes();
+    datagram.len = len;
+    datagram.peerLen = std::min<socklen_t>(peer.getSockLen(), sizeof datagram.peer);
+    ::memcpy(&datagram.peer, peer.getSockAddr(), datagram.peerLen);
+    sendBuffer_.append(static_cast<const char *>(data), len);
+    pending_.push_back(datagram);
+    // 已经在等EPOLLOUT的话交给handleWrite
+    if (!channel_.isWriting()) {
+        channel_.requestFlush();
+    }
+}
+
+// 和析构一样在loop线程中执行，lock成功时UdpSocket一定还没有析构
+void UdpSocket::sendInLoop(const std::weak_ptr<UdpSocket *> &socket,
+                           const std::string &message, const InetAddress &peer) {
+    std::shared_ptr<UdpSocket *> self = socket.lock();
+    if (self) {
+        (*self)->sendTo(message.data(), message.size(), peer);
+    }
+}
+
+/**
+ * 每个消息是一个数据报；开启GSO时，发往同一个对端的连续数据报如果长度都等于第一个(最后一个可以短一些)，
+ * 它们在sendBuffer_中本来就是连续的，直接用一个iovec合并成一个消息，用UDP_SEGMENT告诉内核段长
+ */
+int UdpSocket::buildSendMessages(size_t first) {
+    const size_t controlSize = CMSG_SPACE(sizeof(uint16_t));
+    if (sendMessages_.size() < static_cast<size_t>(kMaxSendMessages)) {
+        sendMessages_.resize(kMaxSendMessages);
+        sendIovecs_.resize(kMaxSendMessages);
+        sendCounts_.resize(kMaxSendMessages);
+    }
+    if (gso_ && sendControl_.size() < kMaxSendMessages * controlSize) {
+        sendControl_.resize(kMaxSendMessages * controlSize);
+    }
+
+    const char *base = sendBuffer_.peek();
+    int numMessages = 0;
+    size_t i = first;
+    while (i < pending_.size() && numMessages < kMaxSendMessages) {
+        const PendingDatagram &head = pending_[i];
+        size_t count = 1;
+        size_t total = head.len;
+        if (gso_ && head.len > 0) {
+            while (i + count < pending_.size() && count < kMaxGsoSegments) {
+                const PendingDatagram &next = pending_[i + count];
+                if (next.len == 0 || next.len > head.len ||
+                    total + next.len > kMaxGsoBytes ||
+                    next.peerLen != head.peerLen ||
+                    ::memcmp(&next.peer, &head.peer, head.peerLen) != 0) {
+                    break;
+                }
+                total += next.len;
+                ++count;
+                if (next.len < head.len) {
+                    break;  // 短的一段只能是最后一段
+                }
+            }
+        }
+
+        iovec &iov = sendIovecs_[numMessages];
+        iov.iov_base = const_cast<char *>(base + head.offset);
+        iov.iov_len = total;
+        msghdr &hdr = sendMessages_[numMessages].msg_hdr;
+        ::memset(&hdr, 0, sizeof hdr);
+        hdr.msg_name = const_cast<sockaddr_in6 *>(&head.peer);
+        hdr.msg_namelen = head.peerLen;
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        if (count > 1) {
+            hdr.msg_control = &sendControl_[numMessages * controlSize];
+            hdr.msg_controllen = controlSize;
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = static_cast<uint16_t>(head.len);
+            ::memcpy(CMSG_DATA(cmsg), &segment, sizeof segment);
+        }
+        sendCounts_[numMessages] = count;
+        ++numMessages;
+        i += count;
+    }
+    return numMessages;
+}
+
+/**
+ * 发送失败的处理：
+ * EAGAIN：内核发送缓冲区满了，剩下的留在队列里，注册EPOLLOUT等handleWrite
+ * 开启了GSO时的EIO/EINVAL：内核或者网卡不支持，关闭GSO重新组装
+ * 其它错误(比如EMSGSIZE)只和第一个消息有关，丢掉它继续发后面的
+ */
+void UdpSocket::flushSends() {
+    size_t sent = 0;
+    bool blocked = false;
+    while (sent < pending_.size()) {
+        int numMessages = buildSendMessages(sent);
+        int n = ::sendmmsg(socket_.fd(), sendMessages_.data(), numMessages, 0);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                blocked = true;
+                break;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (gso_ && (errno == EIO || errno == EINVAL)) {
+                LOG_ERROR("UdpSocket::flushSends GSO not supported, errno:%d \n",
+                          errno);
+                gso_ = false;
+                continue;
+            }
+            LOG_ERROR("UdpSocket::flushSends sendmmsg error:%d \n", errno);
+            addDropped(sendCounts_[0]);
+            sent += sendCounts_[0];
+            continue;
+        }
+        for (int i = 0; i < n; ++i) {
+            sent += sendCounts_[i];
+        }
+    }
+
+    if (sent == pending_.size()) {
+        pending_.clear();
+        sendBuffer_.retrieveAll();
+        if (channel_.isWriting()) {
+            channel_.disableWriting();
+        }
+        return;
+    }
+    // 把发出去的部分从队列前面去掉，剩下的偏移相应前移
+    size_t bytes = pending_[sent].offset;
+    sendBuffer_.retrieve(bytes);
+    pending_.erase(pending_.begin(), pending_.begin() + sent);
+    for (PendingDatagram &datagram : pending_) {
+        datagram.offset -= bytes;
+    }
+    if (blocked && !channel_.isWriting()) {
+        channel_.enableWriting();
+    }
+}
+
+void UdpSocket::handleWrite() {
+    flushSends();
+}
+
+void UdpSocket::handleError() {
+    int optval;
+    socklen_t optlen = sizeof optval;
+    int err = 0;
+    if (::getsockopt(socket_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) <
+        0) {
+        err = errno;
+    } else {
+        err = optval;
+    }
+    LOG_ERROR("UdpSocket::handleError fd:%d - SO_ERROR:%d \n", socket_.fd(),
+              err);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Buffer.h"
+#include "Callbacks.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Socket.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+class EventLoop;
+
+// 收到的一个数据报，data指向UdpSocket预先分配好的接收缓冲区，只在DatagramCallback执行期间有效
+struct Datagram {
+    const char *data;
+    size_t len;
+    InetAddress peer;
+};
+
+/**
+ * 注册在一个EventLoop上的UDP socket，由UdpServer创建，也可以单独使用；只支持IPv4和IPv6地址
+ *
+ * 接收：一次recvmmsg最多收batchSize个数据报，全部放在start时一次分配好的缓冲区里，收到的一批数据报一起交给DatagramCallback，
+ * 每个数据报不需要一次系统调用，也没有任何内存分配；一次可读事件最多连续收kMaxBatchesPerRead批，不让一个socket占住loop
+ *
+ * 发送：loop线程中的sendTo只把数据报追加到发送队列，本轮循环结束时(见Channel::requestFlush)用sendmmsg一次发出去，
+ * DatagramCallback里对一批请求逐个sendTo回复，整批回复也只需要一次系统调用
+ *
+ * GRO/GSO(Linux 5.0以上)：
+ * enableGro之后内核把同一个对端连续到达的数据报合并成一个大的报文交上来，这里再按段长切开，DatagramCallback看到的仍然是一个个数据报；
+ * 开启GRO时每个接收缓冲区都是64K，内存是batchSize * 64K
+ * enableGso之后发送队列中发往同一个对端、长度相同的连续数据报合并成一个报文，由内核(或网卡)切分，
+ * 不支持的内核上sendmmsg会失败，之后自动关闭GSO
+ *
+ * 除了构造函数和设置函数，其它函数都只能在loop线程中调用(sendTo除外，可以在任意线程调用)；必须在loop线程中析构，
+ * 析构时还没执行的跨线程sendTo被丢弃
+ **/
+class UdpSocket : noncopyable {
+   public:
+    // 一次可读事件最多连续recvmmsg的批数
+    static const int kMaxBatchesPerRead = 8;
+
+    UdpSocket(EventLoop *loop, const InetAddress &bindAddr, bool reusePort);
+    ~UdpSocket();
+
+    EventLoop *getLoop() const { return loop_; }
+    int fd() const { return socket_.fd(); }
+    const InetAddress &localAddress() const { return localAddr_; }
+
+    // 以下设置必须在start之前调用
+    void setDatagramCallback(const DatagramCallback &cb) {
+        datagramCallback_ = cb;
+    }
+    // 每次recvmmsg最多收多少个数据报，默认64
+    void setBatchSize(int batchSize) { batchSize_ = batchSize; }
+    // 每个数据报的接收缓冲区大小，超过的数据报被丢弃(计入droppedDatagrams)，默认2048
+    void setMaxDatagramSize(size_t bytes) { maxDatagramSize_ = bytes; }
+    void enableGro(bool on) { gro_ = on; }
+    void enableGso(bool on) { gso_ = on; }
+    // SO_RCVBUF，0表示使用系统默认值；突发流量下内核接收队列满了就会丢包
+    void setReceiveBufferSize(int bytes) { receiveBufferSize_ = bytes; }
+
+    // 分配接收缓冲区，注册到poller上开始接收，在loop线程中调用
+    void start();
+
+    /**
+     * 发送一个数据报，可以在任意线程调用
+     * 在loop线程中只是追加到发送队列，本轮循环结束时统一发送；其它线程中会先拷贝一份投递到loop线程
+     * 内核发送缓冲区满了时保留在队列里等EPOLLOUT，队列超过kMaxPendingDatagrams个之后新的数据报直接丢弃
+     **/
+    void sendTo(const void *data, size_t len, const InetAddress &peer);
+    void sendTo(const std::string &message, const InetAddress &peer) {
+        sendTo(message.data(), message.size(), peer);
+    }
+
+    // 截断或者发送队列满了而被丢弃的数据报个数，可以在任意线程读取
+    uint64_t droppedDatagrams() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    static const size_t kMaxPendingDatagrams = 65536;
+
+    /**
+     * 发送队列中的一个数据报，数据在sendBuffer_中，offset是相对于sendBuffer_.peek()的偏移
+     * UDP的对端只会是IPv4或IPv6地址，sockaddr_in6放得下两者，不用sockaddr_storage(128字节)
+     * 所以不支持Unix域的数据报socket，构造时传入Unix域地址直接LOG_FATAL
+     */
+    struct PendingDatagram {
+        size_t offset;
+        size_t len;
+        sockaddr_in6 peer;
+        socklen_t peerLen;
+    };
+
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    void handleError();
+    // 跨线程sendTo投递的任务，执行时UdpSocket可能已经析构，只通过weak_ptr访问
+    static void sendInLoop(const std::weak_ptr<UdpSocket *> &socket,
+                           const std::string &message, const InetAddress &peer);
+    // 用sendmmsg发送队列中的数据报，写不完时注册EPOLLOUT
+    void flushSends();
+    // 从发送队列的第first个数据报开始组装sendMessages_，返回消息个数，每个消息包含的数据报个数记在sendCounts_中
+    int buildSendMessages(size_t first);
+    // 只在loop线程中修改，多个线程读取
+    void addDropped(uint64_t n) {
+        dropped_.store(dropped_.load(std::memory_order_relaxed) + n,
+                       std::memory_order_relaxed);
+    }
+
+    EventLoop *loop_;
+    // 指向this，只用来给投递出去的任务提供weak_ptr，析构之后它们就拿不到this了
+    const std::shared_ptr<UdpSocket *> self_;
+    Socket socket_;
+    Channel channel_;
+    InetAddress localAddr_;
+    DatagramCallback datagramCallback_;
+
+    int batchSize_;
+    size_t maxDatagramSize_;
+    bool gro_;
+    bool gso_;
+    int receiveBufferSize_;
+    std::atomic<uint64_t> dropped_;
+
+    // 接收用的数组，start时按batchSize_一次分配好，之后每次recvmmsg重复使用
+    std::vector<char> recvBuffer_;
+    std::vector<mmsghdr> recvMessages_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_in6> recvAddrs_;  // 同PendingDatagram::peer
+    std::vector<char> recvControl_;  // 开启GRO时每个消息一块，存放段长
+    std::vector<Datagram> datagrams_;
+
+    // 发送队列以及sendmmsg用的数组，清空时保留容量，稳定之后不再分配
+    Buffer sendBuffer_;
+    std::vector<PendingDatagram> pending_;
+    std::vector<mmsghdr> sendMessages_;
+    std::vector<iovec> sendIovecs_;
+    std::vector<char> sendControl_;  // GSO时每个消息一块，存放段长
+    std::vector<size_t> sendCounts_;
+};
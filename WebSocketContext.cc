@@ -0,0 +1,118 @@
+#include "WebSocketContext.h"
+
+#include "Buffer.h"
+
+// 拼接分片消息的缓冲区超过这个容量时，消息处理完就释放掉，不让偶尔一条大消息的内存一直留在连接上
+static const size_t kMaxRetainedFragmentCapacity = 64 * 1024;
+
+WebSocketContext::WebSocketContext(size_t maxHandshakeBytes, size_t maxMessageBytes)
+    : maxMessageBytes_(maxMessageBytes),
+      state_(kHandshake),
+      handshake_(new HttpContext(maxHandshakeBytes, 0)),
+      frameBytes_(0),
+      opcode_(WebSocketFrame::kContinuation),
+      fragmented_(false),
+      messageOpcode_(WebSocketFrame::kContinuation),
+      errorCode_(0),
+      shardIndex_(0) {}
+
+WebSocketContext::ParseResult WebSocketContext::fail(uint16_t code) {
+    errorCode_ = code;
+    return kError;
+}
+
+WebSocketContext::ParseResult WebSocketContext::parseFrame(Buffer *buf) {
+    while (true) {
+        size_t readable = buf->readableBytes();
+        if (readable < 2) {
+            return kNeedMore;
+        }
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(buf->peek());
+        bool fin = (p[0] & 0x80) != 0;
+        int opcode = p[0] & 0x0F;
+        // 没有协商任何扩展，RSV位必须是0；客户端发来的帧必须带掩码(RFC 6455 5.1)
+        if ((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0) {
+            return fail(1002);
+        }
+
+        uint64_t len = p[1] & 0x7F;
+        size_t headerLen = 2;
+        if (len == 126) {
+            if (readable < 4) {
+                return kNeedMore;
+            }
+            len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+            headerLen = 4;
+        } else if (len == 127) {
+            if (readable < 10) {
+                return kNeedMore;
+            }
+            len = 0;
+            for (int i = 0; i < 8; ++i) {
+                len = (len << 8) | p[2 + i];
+            }
+            headerLen = 10;
+        }
+        headerLen += 4;  // 掩码
+
+        bool control = WebSocketFrame::isControl(opcode);
+        if (control) {
+            if (opcode > WebSocketFrame::kPong || !fin || len > WebSocketFrame::kMaxControlPayload) {
+                return fail(1002);
+            }
+        } else if (opcode > WebSocketFrame::kBinary) {
+            return fail(1002);
+        } else if ((opcode == WebSocketFrame::kContinuation) != fragmented_) {
+            // 续帧只能出现在分片消息中间，分片消息没结束之前也不能开始新的消息
+            return fail(1002);
+        } else if (len > maxMessageBytes_ || fragments_.size() + len > maxMessageBytes_) {
+            return fail(1009);
+        }
+        if (readable < headerLen || readable - headerLen < len) {
+            return kNeedMore;
+        }
+
+        char *payload = buf->mutablePeek() + headerLen;
+        WebSocketFrame::unmask(payload, len, buf->peek() + headerLen - 4);
+        frameBytes_ = headerLen + len;
+
+        if (control) {
+            opcode_ = static_cast<WebSocketFrame::Opcode>(opcode);
+            payload_ = StringPiece(payload, len);
+            return kGotControl;
+        }
+        if (opcode != WebSocketFrame::kContinuation) {
+            messageOpcode_ = static_cast<WebSocketFrame::Opcode>(opcode);
+            if (fin) {
+                message_ = StringPiece(payload, len);
+                return kGotMessage;
+            }
+            fragmented_ = true;
+            fragments_.assign(payload, len);
+        } else {
+            fragments_.append(payload, len);
+            if (fin) {
+                fragmented_ = false;
+                message_ = StringPiece(fragments_);
+                return kGotMessage;
+            }
+        }
+        // 中间的分片已经拼进fragments_，接着解析下一个帧
+        buf->retrieve(frameBytes_);
+        frameBytes_ = 0;
+    }
+}
+
+void WebSocketContext::finishFrame(Buffer *buf) {
+    buf->retrieve(frameBytes_);
+    frameBytes_ = 0;
+    payload_ = StringPiece();
+    message_ = StringPiece();
+    if (!fragmented_ && !fragments_.empty()) {
+        if (fragments_.capacity() > kMaxRetainedFragmentCapacity) {
+            std::string().swap(fragments_);
+        } else {
+            fragments_.clear();
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "HttpContext.h"
+#include "StringPiece.h"
+#include "WebSocketFrame.h"
+
+class Buffer;
+
+/**
+ * 一个WebSocket连接的状态，WebSocketServer通过TcpConnection::setContext挂在连接上
+ *
+ * 握手阶段借用HttpContext解析升级请求，握手完成之后立即释放，一个打开的连接只剩下帧解析的几个字段，
+ * 单机几十万个连接时每个连接省下一千多字节
+ *
+ * parseFrame等一个帧完整到达之后，直接在inputBuffer_里去掉载荷的掩码：
+ * 没有分片的消息(绝大多数)交给回调的就是指向inputBuffer_的StringPiece，不拷贝；
+ * 分片的消息才把各个分片拼进message_
+ **/
+class WebSocketContext {
+   public:
+    enum State {
+        kHandshake,  // 等待升级请求
+        kOpen,
+        kClosing,    // 服务端已经发出了close帧，等对端的close帧
+        kClosed,     // 已经交换过close帧或者出错，之后收到的数据都丢弃
+    };
+
+    enum ParseResult {
+        kNeedMore,
+        kGotMessage,  // 一条完整的文本/二进制消息，见messageOpcode()、message()
+        kGotControl,  // 一个控制帧，见opcode()、payload()
+        kError,       // 协议错误，errorCode()是应该在close帧里带上的状态码
+    };
+
+    WebSocketContext(size_t maxHandshakeBytes, size_t maxMessageBytes);
+
+    State state() const { return state_; }
+    void setState(State state) { state_ = state; }
+
+    // 握手阶段的HTTP解析状态，握手结束之后调用finishHandshake释放
+    HttpContext *handshake() { return handshake_.get(); }
+    // 握手成功过(之后可能已经关闭)
+    bool upgraded() const { return !handshake_; }
+    void finishHandshake() {
+        handshake_.reset();
+        state_ = kOpen;
+    }
+
+    /**
+     * 解析inputBuffer_开头的帧，中间的分片直接拼进message_并取走
+     * 返回kGotMessage/kGotControl时处理完之后调用finishFrame，message()/payload()从此失效
+     **/
+    ParseResult parseFrame(Buffer *buf);
+    void finishFrame(Buffer *buf);
+
+    WebSocketFrame::Opcode messageOpcode() const { return messageOpcode_; }
+    StringPiece message() const { return message_; }
+    WebSocketFrame::Opcode opcode() const { return opcode_; }
+    StringPiece payload() const { return payload_; }
+    uint16_t errorCode() const { return errorCode_; }
+
+    // 在WebSocketServer中各个loop连接列表里的下标，用来O(1)移除
+    size_t shardIndex() const { return shardIndex_; }
+    void setShardIndex(size_t index) { shardIndex_ = index; }
+
+   private:
+    ParseResult fail(uint16_t code);
+
+    const size_t maxMessageBytes_;
+    State state_;
+    std::unique_ptr<HttpContext> handshake_;
+
+    size_t frameBytes_;  // 当前帧(帧头加载荷)的长度，finishFrame时从Buffer中取走
+    WebSocketFrame::Opcode opcode_;
+    StringPiece payload_;
+
+    // 正在拼接的分片消息
+    bool fragmented_;
+    WebSocketFrame::Opcode messageOpcode_;
+    std::string fragments_;
+    StringPiece message_;  // 不分片时指向inputBuffer_，分片时指向fragments_
+
+    uint16_t errorCode_;
+    size_t shardIndex_;
+};
@@ -0,0 +1,85 @@
+#include "WebSocketFrame.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+// 帧头最长10字节：2字节固定部分 + 8字节扩展长度(服务端的帧没有掩码)
+static const size_t kMaxServerHeaderBytes = 10;
+
+// 把帧头写进header，返回帧头的长度
+static size_t encodeHeader(char *header, WebSocketFrame::Opcode opcode, size_t len, bool fin) {
+    header[0] = static_cast<char>((fin ? 0x80 : 0) | opcode);
+    if (len < 126) {
+        header[1] = static_cast<char>(len);
+        return 2;
+    }
+    if (len <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = static_cast<char>(len >> 8);
+        header[3] = static_cast<char>(len);
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; ++i) {
+        header[2 + i] = static_cast<char>(static_cast<uint64_t>(len) >> (56 - 8 * i));
+    }
+    return 10;
+}
+
+void WebSocketFrame::encode(Buffer *output, Opcode opcode, const StringPiece &payload, bool fin) {
+    char header[kMaxServerHeaderBytes];
+    size_t headerLen = encodeHeader(header, opcode, payload.size(), fin);
+    output->ensureWriteableBytes(headerLen + payload.size());
+    output->append(header, headerLen);
+    output->append(payload.data(), payload.size());
+}
+
+WebSocketFramePtr WebSocketFrame::make(Opcode opcode, const StringPiece &payload) {
+    char header[kMaxServerHeaderBytes];
+    size_t headerLen = encodeHeader(header, opcode, payload.size(), true);
+    std::shared_ptr<std::string> frame = std::make_shared<std::string>();
+    frame->reserve(headerLen + payload.size());
+    frame->append(header, headerLen);
+    frame->append(payload.data(), payload.size());
+    return frame;
+}
+
+void WebSocketFrame::send(const TcpConnectionPtr &conn, Opcode opcode, const StringPiece &payload) {
+    if (conn->getLoop()->isInLoopThread()) {
+        encode(conn->outputBuffer(), opcode, payload);
+        conn->sendOutputBuffer();
+    } else {
+        conn->send(*make(opcode, payload));
+    }
+}
+
+void WebSocketFrame::unmask(char *data, size_t len, const char key[4]) {
+    size_t i = 0;
+    // 载荷的第i个字节用key[i % 4]，从下标0开始，所以把4字节的key重复排开就是对齐的
+    uint32_t key32;
+    ::memcpy(&key32, key, 4);
+#ifdef __SSE2__
+    const __m128i key128 = _mm_set1_epi32(static_cast<int>(key32));
+    for (; i + 16 <= len; i += 16) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+    }
+#endif
+    const uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        ::memcpy(&chunk, data + i, 8);
+        chunk ^= key64;
+        ::memcpy(data + i, &chunk, 8);
+    }
+    for (; i < len; ++i) {
+        data[i] ^= key[i & 3];
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "Callbacks.h"
+#include "StringPiece.h"
+
+class Buffer;
+
+// 编码好的一个完整的帧，可以在多个连接、多个线程之间共享
+using WebSocketFramePtr = std::shared_ptr<const std::string>;
+
+/**
+ * WebSocket(RFC 6455)帧的编码和去掩码
+ *
+ *  0                   1                   2                   3
+ * +-+-+-+-+-------+-+-------------+-------------------------------+
+ * |F|R|R|R| opcode|M| Payload len |    Extended payload length    |
+ * |I|S|S|S|  (4)  |A|     (7)     |            (16/64)            |
+ * |N|V|V|V|       |S|             |                               |
+ * +-+-+-+-+-------+-+-------------+-------------------------------+
+ * |  Masking-key (客户端发出的帧才有，32位)   |    Payload Data ...
+ *
+ * 服务端发出的帧不带掩码，同一条消息发给任意多个连接时字节完全相同：
+ * make()编码一次，广播时每个连接直接从这段共享的字节write，不用每个连接各自编码、各自拷贝，见WebSocketServer::broadcast
+ **/
+class WebSocketFrame {
+   public:
+    enum Opcode {
+        kContinuation = 0x0,
+        kText = 0x1,
+        kBinary = 0x2,
+        kClose = 0x8,
+        kPing = 0x9,
+        kPong = 0xA,
+    };
+
+    // 控制帧(close/ping/pong)的载荷最多125字节，并且不能分片
+    static const size_t kMaxControlPayload = 125;
+
+    static bool isControl(int opcode) { return (opcode & 0x8) != 0; }
+
+    // 把一个不带掩码的帧追加到output
+    static void encode(Buffer *output, Opcode opcode, const StringPiece &payload, bool fin = true);
+    static WebSocketFramePtr make(Opcode opcode, const StringPiece &payload);
+
+    /**
+     * 给一个连接发一个帧，可以在任意线程调用
+     * 在连接所在的loop线程中直接编码进outputBuffer_；其它线程先编码成std::string再交给TcpConnection::send
+     **/
+    static void send(const TcpConnectionPtr &conn, Opcode opcode, const StringPiece &payload);
+
+    /**
+     * 原地去掩码：data[i] ^= key[i % 4]
+     * 客户端发来的每个帧都带掩码，载荷在inputBuffer_里直接异或回来，不拷贝。
+     * SSE2(x86-64的基线指令集)一次异或16字节，没有SSE2的平台每次异或8字节
+     **/
+    static void unmask(char *data, size_t len, const char key[4]);
+};
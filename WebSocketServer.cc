@@ -0,0 +1,401 @@
+#include "WebSocketServer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "EventLoop.h"
+#include "HttpContext.h"
+#include "HttpResponse.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+#include "WebSocketContext.h"
+
+// Sec-WebSocket-Accept = base64(SHA-1(Sec-WebSocket-Key + kWebSocketGuid))
+static const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+// SHA-1(RFC 3174)，只用来计算握手的应答，输入不超过几十字节，不追求速度
+static void sha1(const StringPiece &input, unsigned char digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    // 补齐：0x80，若干个0，最后8字节是按位计算的长度(大端)
+    std::string message(input.data(), input.size());
+    uint64_t bits = static_cast<uint64_t>(input.size()) * 8;
+    message.push_back(static_cast<char>(0x80));
+    while (message.size() % 64 != 56) {
+        message.push_back('\0');
+    }
+    for (int i = 7; i >= 0; --i) {
+        message.push_back(static_cast<char>(bits >> (i * 8)));
+    }
+
+    for (size_t block = 0; block < message.size(); block += 64) {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(message.data() + block);
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (static_cast<uint32_t>(p[4 * i]) << 24) | (p[4 * i + 1] << 16) |
+                   (p[4 * i + 2] << 8) | p[4 * i + 3];
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 5; ++i) {
+        digest[4 * i] = static_cast<unsigned char>(h[i] >> 24);
+        digest[4 * i + 1] = static_cast<unsigned char>(h[i] >> 16);
+        digest[4 * i + 2] = static_cast<unsigned char>(h[i] >> 8);
+        digest[4 * i + 3] = static_cast<unsigned char>(h[i]);
+    }
+}
+
+static std::string base64(const unsigned char *data, size_t len) {
+    static const char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t n = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < len) n |= data[i + 1] << 8;
+        if (i + 2 < len) n |= data[i + 2];
+        result.push_back(kAlphabet[(n >> 18) & 63]);
+        result.push_back(kAlphabet[(n >> 12) & 63]);
+        result.push_back(i + 1 < len ? kAlphabet[(n >> 6) & 63] : '=');
+        result.push_back(i + 2 < len ? kAlphabet[n & 63] : '=');
+    }
+    return result;
+}
+
+const size_t WebSocketServer::kDefaultMaxHandshakeBytes;
+const size_t WebSocketServer::kDefaultMaxMessageBytes;
+const int WebSocketServer::kDefaultMaxFramesPerRead;
+constexpr double WebSocketServer::kCloseTimeoutSeconds;
+
+// 可以出现在close帧里的状态码(RFC 6455 7.4)：1004/1005/1006/1015是保留的，3000-4999留给库和应用
+static bool isValidCloseCode(uint16_t code) {
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) ||
+           (code >= 3000 && code <= 4999);
+}
+
+static bool defaultHandshakeCallback(const TcpConnectionPtr &, const HttpRequest &) {
+    return true;
+}
+
+WebSocketServer::WebSocketServer(EventLoop *loop, const InetAddress &listenAddr,
+                                 const std::string &name, TcpServer::Option option)
+    : loop_(loop),
+      handshakeCallback_(defaultHandshakeCallback),
+      maxMessageBytes_(kDefaultMaxMessageBytes),
+      maxFramesPerRead_(kDefaultMaxFramesPerRead),
+      server_(loop, listenAddr, name, option) {
+    server_.setConnectionCallback(
+        std::bind(&WebSocketServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(
+        std::bind(&WebSocketServer::onMessage, this, std::placeholders::_1,
+                  std::placeholders::_2, std::placeholders::_3));
+    server_.setThreadInitcallback(
+        std::bind(&WebSocketServer::onThreadInit, this, std::placeholders::_1));
+}
+
+WebSocketServer::~WebSocketServer() = default;
+
+void WebSocketServer::start() { server_.start(); }
+
+/**
+ * TcpServer::start中每个loop线程依次调用(没有subLoop时在当前线程中对baseLoop调用)，
+ * 上一个loop的回调返回之后才会启动下一个线程，全部完成之后才开始listen(kReusePortPerLoop也一样)，
+ * 所以shards_的push_back不会和任何读者并发
+ */
+void WebSocketServer::onThreadInit(EventLoop *loop) {
+    shards_.push_back(std::make_pair(loop, std::make_shared<Shard>()));
+    if (threadInitCallback_) {
+        threadInitCallback_(loop);
+    }
+}
+
+WebSocketServer::Shard *WebSocketServer::shardOf(EventLoop *loop) const {
+    for (const auto &item : shards_) {
+        if (item.first == loop) {
+            return item.second.get();
+        }
+    }
+    return nullptr;
+}
+
+void WebSocketServer::addToShard(const TcpConnectionPtr &conn, WebSocketContext *context) {
+    Shard *shard = shardOf(conn->getLoop());
+    if (shard == nullptr) {
+        LOG_ERROR("WebSocketServer: connection on a loop not owned by this server");
+        return;
+    }
+    context->setShardIndex(shard->connections.size());
+    shard->connections.push_back(conn);
+    shard->size.store(shard->connections.size(), std::memory_order_relaxed);
+}
+
+void WebSocketServer::removeFromShard(const TcpConnectionPtr &conn, WebSocketContext *context) {
+    Shard *shard = shardOf(conn->getLoop());
+    size_t index = context->shardIndex();
+    if (shard == nullptr || index >= shard->connections.size() ||
+        shard->connections[index] != conn) {
+        return;  // 不在连接列表中(已经移除过)
+    }
+    if (index + 1 != shard->connections.size()) {
+        // 最后一个连接挪到空出来的位置，更新它记下的下标
+        shard->connections[index].swap(shard->connections.back());
+        static_cast<WebSocketContext *>(shard->connections[index]->getContext().get())
+            ->setShardIndex(index);
+    }
+    shard->connections.pop_back();
+    shard->size.store(shard->connections.size(), std::memory_order_relaxed);
+}
+
+size_t WebSocketServer::numConnections() const {
+    size_t n = 0;
+    for (const auto &item : shards_) {
+        n += item.second->size.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void WebSocketServer::onConnection(const TcpConnectionPtr &conn) {
+    if (conn->connected()) {
+        conn->setTcpNoDelay(true);
+        conn->setContext(std::make_shared<WebSocketContext>(kDefaultMaxHandshakeBytes, maxMessageBytes_));
+        return;
+    }
+    WebSocketContext *context = static_cast<WebSocketContext *>(conn->getContext().get());
+    if (context == nullptr || !context->upgraded()) {
+        return;  // 没有握手成功的连接，使用方从来没见过它
+    }
+    removeFromShard(conn, context);
+    context->setState(WebSocketContext::kClosed);
+    if (connectionCallback_) {
+        connectionCallback_(conn);
+    }
+}
+
+bool WebSocketServer::handleHandshake(const TcpConnectionPtr &conn, WebSocketContext *context,
+                                      Buffer *buf, Timestamp receiveTime) {
+    HttpContext *http = context->handshake();
+    HttpContext::ParseResult result = http->parseRequest(buf, receiveTime);
+    if (result == HttpContext::kNeedMore) {
+        return false;
+    }
+
+    HttpResponse *response = http->response();
+    response->reset();
+    const HttpRequest &request = http->request();
+    if (result == HttpContext::kError) {
+        response->setStatusCode(http->errorStatus());
+    } else if (request.method() != HttpRequest::kGet || request.version() != HttpRequest::kHttp11 ||
+               !request.headerHasToken("Upgrade", "websocket") ||
+               !request.headerHasToken("Connection", "Upgrade") ||
+               request.getHeader("Sec-WebSocket-Key").size() != 24) {
+        response->setStatusCode(400);
+    } else if (request.getHeader("Sec-WebSocket-Version") != "13") {
+        // 只支持RFC 6455的版本13，426带上支持的版本让客户端重试(RFC 6455 4.4)
+        response->setStatusCode(426);
+        response->addHeader("Sec-WebSocket-Version", "13");
+    } else if (!handshakeCallback_(conn, request)) {
+        response->setStatusCode(403);
+    } else {
+        std::string key = request.getHeader("Sec-WebSocket-Key").toString() + kWebSocketGuid;
+        unsigned char digest[20];
+        sha1(key, digest);
+        response->setStatusCode(101);
+        response->addHeader("Upgrade", "websocket");
+        response->addHeader("Connection", "Upgrade");
+        response->addHeader("Sec-WebSocket-Accept", base64(digest, sizeof digest));
+        response->appendToBuffer(conn->outputBuffer());
+        // 请求之后的数据已经是帧了
+        http->finishRequest(buf);
+        context->finishHandshake();
+        addToShard(conn, context);
+        if (connectionCallback_) {
+            connectionCallback_(conn);
+        }
+        return true;
+    }
+
+    response->setCloseConnection(true);
+    response->appendToBuffer(conn->outputBuffer());
+    context->setState(WebSocketContext::kClosed);
+    buf->retrieveAll();
+    conn->sendOutputBuffer();
+    conn->shutdown();
+    forceCloseAfterTimeout(conn);
+    return false;
+}
+
+/**
+ * 逐个解析inputBuffer_中的帧，pong、close等回复直接编码进outputBuffer_，最后统一发送
+ */
+void WebSocketServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+    WebSocketContext *context = static_cast<WebSocketContext *>(conn->getContext().get());
+    if (context == nullptr || context->state() == WebSocketContext::kClosed) {
+        buf->retrieveAll();
+        return;
+    }
+    if (context->state() == WebSocketContext::kHandshake &&
+        !handleHandshake(conn, context, buf, receiveTime)) {
+        return;
+    }
+
+    for (int handled = 0;; ++handled) {
+        if (handled >= maxFramesPerRead_ && buf->readableBytes() > 0) {
+            conn->yieldRead();
+            break;
+        }
+        WebSocketContext::ParseResult result = context->parseFrame(buf);
+        if (result == WebSocketContext::kNeedMore) {
+            break;
+        }
+        if (result == WebSocketContext::kError) {
+            sendClose(conn, context, context->errorCode(), StringPiece());
+            context->setState(WebSocketContext::kClosed);
+            buf->retrieveAll();
+            conn->shutdown();
+            forceCloseAfterTimeout(conn);
+            break;
+        }
+        if (result == WebSocketContext::kGotControl) {
+            handleControl(conn, context);
+        } else if (context->state() == WebSocketContext::kOpen && messageCallback_) {
+            // 服务端已经发出close帧之后，对端在收到它之前发来的消息丢弃
+            messageCallback_(conn, context->messageOpcode(), context->message(), receiveTime);
+        }
+        context->finishFrame(buf);
+        if (context->state() == WebSocketContext::kClosed) {
+            buf->retrieveAll();
+            break;
+        }
+    }
+    conn->sendOutputBuffer();
+}
+
+void WebSocketServer::handleControl(const TcpConnectionPtr &conn, WebSocketContext *context) {
+    StringPiece payload = context->payload();
+    switch (context->opcode()) {
+        case WebSocketFrame::kPing:
+            if (context->state() == WebSocketContext::kOpen) {
+                WebSocketFrame::encode(conn->outputBuffer(), WebSocketFrame::kPong, payload);
+            }
+            break;
+        case WebSocketFrame::kPong:
+            break;
+        case WebSocketFrame::kClose: {
+            // 对端主动关闭时原样回复它的状态码(不合法的回复1002)；我们先发的close帧，这就是对端的回复，直接关闭
+            if (context->state() == WebSocketContext::kOpen) {
+                uint16_t code = 1000;
+                if (payload.size() >= 2) {
+                    code = static_cast<uint16_t>((static_cast<unsigned char>(payload[0]) << 8) |
+                                                 static_cast<unsigned char>(payload[1]));
+                    if (!isValidCloseCode(code)) {
+                        code = 1002;
+                    }
+                } else if (payload.size() == 1) {
+                    code = 1002;
+                }
+                sendClose(conn, context, code, StringPiece());
+            }
+            context->setState(WebSocketContext::kClosed);
+            conn->shutdown();
+            forceCloseAfterTimeout(conn);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void WebSocketServer::sendClose(const TcpConnectionPtr &conn, WebSocketContext *context,
+                                uint16_t code, const StringPiece &reason) {
+    if (context->state() != WebSocketContext::kOpen) {
+        return;
+    }
+    char payload[WebSocketFrame::kMaxControlPayload];
+    payload[0] = static_cast<char>(code >> 8);
+    payload[1] = static_cast<char>(code);
+    size_t reasonLen = std::min(reason.size(), sizeof payload - 2);
+    ::memcpy(payload + 2, reason.data(), reasonLen);
+    WebSocketFrame::encode(conn->outputBuffer(), WebSocketFrame::kClose,
+                           StringPiece(payload, 2 + reasonLen));
+    conn->sendOutputBuffer();
+    // 发出close帧之后就不再是广播的对象了
+    removeFromShard(conn, context);
+    context->setState(WebSocketContext::kClosing);
+}
+
+void WebSocketServer::close(const TcpConnectionPtr &conn, uint16_t code, const StringPiece &reason) {
+    conn->getLoop()->runInLoop(
+        std::bind(&WebSocketServer::closeInLoop, this, conn, code, reason.toString()));
+}
+
+void WebSocketServer::closeInLoop(const TcpConnectionPtr &conn, uint16_t code, const std::string &reason) {
+    WebSocketContext *context = static_cast<WebSocketContext *>(conn->getContext().get());
+    if (context == nullptr || context->state() != WebSocketContext::kOpen) {
+        return;
+    }
+    sendClose(conn, context, code, reason);
+    // 对端一直不回复close帧时强制关闭
+    forceCloseAfterTimeout(conn);
+}
+
+/**
+ * shutdown只关闭写端，对端一直不关闭连接时fd和TcpConnection会一直留着，
+ * 所以服务端每次shutdown之后都要调用；连接已经关闭时定时器什么也不做
+ */
+void WebSocketServer::forceCloseAfterTimeout(const TcpConnectionPtr &conn) {
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    conn->getLoop()->runAfter(kCloseTimeoutSeconds, [weakConn]() {
+        TcpConnectionPtr conn = weakConn.lock();
+        if (conn) {
+            conn->forceClose();
+        }
+    });
+}
+
+void WebSocketServer::broadcast(const WebSocketFramePtr &frame) {
+    for (const auto &item : shards_) {
+        std::shared_ptr<Shard> shard = item.second;
+        item.first->runInLoop([shard, frame]() { broadcastInLoop(shard, frame); });
+    }
+}
+
+/**
+ * TcpConnection::send在loop线程中直接从frame的字节write，内核接收不完的部分才拷贝进outputBuffer_
+ */
+void WebSocketServer::broadcastInLoop(const std::shared_ptr<Shard> &shard,
+                                      const WebSocketFramePtr &frame) {
+    for (const TcpConnectionPtr &conn : shard->connections) {
+        conn->send(*frame);
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "HttpRequest.h"
+#include "StringPiece.h"
+#include "TcpServer.h"
+#include "WebSocketFrame.h"
+#include "noncopyable.h"
+
+class WebSocketContext;
+
+/**
+ * 基于TcpServer的WebSocket(RFC 6455)服务器
+ *
+ * 握手：解析HTTP/1.1升级请求，检查Upgrade/Connection/Sec-WebSocket-Version，HandshakeCallback同意之后
+ * 回复101和Sec-WebSocket-Accept；不是合法的升级请求回复400(版本不对时是426)，被拒绝的回复403，之后关闭连接
+ * 帧：客户端的帧在inputBuffer_里原地去掩码，分片消息拼完整之后交给MessageCallback；
+ * ping自动回复pong；收到close帧时回复close帧再关闭写端；协议错误时发出带状态码的close帧再关闭
+ * 没有协商扩展(permessage-deflate)和子协议；文本消息是否是合法的UTF-8不检查，交给使用方
+ *
+ * 广播：broadcast把消息编码成一个帧，给每个loop投递一个任务，每个loop在自己的线程中遍历自己的连接列表，
+ * 直接用这个共享的帧write，十几万个连接只有一次编码、每个loop一次跨线程投递，内核一次接收完时没有任何拷贝
+ * 连接列表按loop分开、只在所属loop的线程中访问，所以不能和TcpServer::enableRebalance一起使用
+ * 连接列表在TcpServer的ThreadInitCallback中创建，所以不要通过tcpServer()设置它，用setThreadInitCallback
+ *
+ * 所有回调都在连接所在的loop线程中调用；MessageCallback里的StringPiece只在回调期间有效
+ **/
+class WebSocketServer : noncopyable {
+   public:
+    // 返回false拒绝这个连接(回复403)
+    using HandshakeCallback = std::function<bool(const TcpConnectionPtr &, const HttpRequest &)>;
+    // 握手成功之后conn->connected()为true，连接断开时为false；只有握手成功的连接才会有断开的回调
+    using WebSocketConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
+    using WebSocketMessageCallback = std::function<void(
+        const TcpConnectionPtr &, WebSocketFrame::Opcode, const StringPiece &, Timestamp)>;
+
+    static const size_t kDefaultMaxHandshakeBytes = 8 * 1024;
+    static const size_t kDefaultMaxMessageBytes = 1024 * 1024;
+    static const int kDefaultMaxFramesPerRead = 64;
+    // 服务端发出close帧(或者关闭写端)之后等对端回复、关闭连接的最长时间，超时强制关闭
+    static constexpr double kCloseTimeoutSeconds = 5.0;
+
+    WebSocketServer(EventLoop *loop, const InetAddress &listenAddr,
+                    const std::string &name,
+                    TcpServer::Option option = TcpServer::kNoReusePort);
+    ~WebSocketServer();
+
+    EventLoop *getLoop() const { return loop_; }
+
+    void setHandshakeCallback(const HandshakeCallback &cb) { handshakeCallback_ = cb; }
+    void setConnectionCallback(const WebSocketConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const WebSocketMessageCallback &cb) { messageCallback_ = cb; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    void setThreadInitCallback(const TcpServer::ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    // 一条消息(分片拼起来之后)的最大长度，超过时以1009关闭连接；必须在start之前设置
+    void setMaxMessageBytes(size_t bytes) { maxMessageBytes_ = bytes; }
+    void setMaxFramesPerRead(int n) { maxFramesPerRead_ = n; }
+    TcpServer *tcpServer() { return &server_; }
+
+    void start();
+
+    // 给一个连接发一条消息，可以在任意线程调用
+    static void send(const TcpConnectionPtr &conn, const StringPiece &message,
+                     WebSocketFrame::Opcode opcode = WebSocketFrame::kText) {
+        WebSocketFrame::send(conn, opcode, message);
+    }
+    // 发出close帧，等对端回复之后关闭连接，可以在任意线程调用
+    void close(const TcpConnectionPtr &conn, uint16_t code = 1000,
+               const StringPiece &reason = StringPiece());
+
+    /**
+     * 给所有已经握手成功的连接发同一条消息，可以在任意线程调用，只能在start之后调用
+     * 同一个frame可以反复广播，也可以和WebSocketFrame::make配合提前编码好
+     **/
+    void broadcast(const StringPiece &message, WebSocketFrame::Opcode opcode = WebSocketFrame::kText) {
+        broadcast(WebSocketFrame::make(opcode, message));
+    }
+    void broadcast(const WebSocketFramePtr &frame);
+
+    // 已经握手成功、还没有开始关闭的连接数，只是各个loop连接列表大小的快照
+    size_t numConnections() const;
+
+   private:
+    /**
+     * 一个loop上所有打开的连接，只在这个loop的线程中修改，移除时把最后一个连接挪到空出来的位置
+     * size单独用一个原子变量记下来，给numConnections在其它线程中读
+     **/
+    struct Shard {
+        Shard() : size(0) {}
+        std::vector<TcpConnectionPtr> connections;
+        std::atomic<size_t> size;
+    };
+
+    // 给每个loop创建连接列表，再调用使用方的ThreadInitCallback
+    void onThreadInit(EventLoop *loop);
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    // 处理握手请求，握手完成返回true，数据不够或者拒绝时返回false
+    bool handleHandshake(const TcpConnectionPtr &conn, WebSocketContext *context,
+                         Buffer *buf, Timestamp receiveTime);
+    void handleControl(const TcpConnectionPtr &conn, WebSocketContext *context);
+    void closeInLoop(const TcpConnectionPtr &conn, uint16_t code, const std::string &reason);
+    // 发出close帧并进入kClosing，超时之后强制关闭
+    void sendClose(const TcpConnectionPtr &conn, WebSocketContext *context, uint16_t code,
+                   const StringPiece &reason);
+    // kCloseTimeoutSeconds之后强制关闭连接，服务端shutdown之后调用
+    static void forceCloseAfterTimeout(const TcpConnectionPtr &conn);
+    static void broadcastInLoop(const std::shared_ptr<Shard> &shard, const WebSocketFramePtr &frame);
+
+    Shard *shardOf(EventLoop *loop) const;
+    void addToShard(const TcpConnectionPtr &conn, WebSocketContext *context);
+    void removeFromShard(const TcpConnectionPtr &conn, WebSocketContext *context);
+
+    EventLoop *loop_;
+    /**
+     * 在onThreadInit中逐个添加，start之后就不再变化，可以在任意线程中读
+     * server_放在最后：TcpServer析构时会在各个loop中销毁连接并回调onConnection，这时连接列表和回调都还要在
+     * shared_ptr是因为投递出去的broadcast任务可能在WebSocketServer析构之后才执行
+     **/
+    std::vector<std::pair<EventLoop *, std::shared_ptr<Shard>>> shards_;
+    TcpServer::ThreadInitCallback threadInitCallback_;
+    HandshakeCallback handshakeCallback_;
+    WebSocketConnectionCallback connectionCallback_;
+    WebSocketMessageCallback messageCallback_;
+    size_t maxMessageBytes_;
+    int maxFramesPerRead_;
+    // 最后析构，见shards_
+    TcpServer server_;
+};
@@ -0,0 +1,114 @@
+#include "../TcpServer.h"
+#include "../Logger.h"
+#include "countingalloc.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+
+/**
+ * 统计每个短连接在服务端产生的堆分配次数
+ *
+ * 分配次数由countingalloc.h统计，库里的分配也包括在内
+ * 客户端线程只使用裸的socket系统调用，不做任何堆分配，所以预热之后统计到的分配都来自服务端的
+ * accept => 建立TcpConnection => 回显一个字节 => 拆除连接 这一整条路径
+ *
+ * 用法：allocbench [-t 服务端subLoop线程数] [-n 连接次数] [-p 端口] [-r]
+ */
+
+static bool oneCycle(const sockaddr_in &addr)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    char c = 'x';
+    bool ok = ::connect(fd, (const sockaddr *)&addr, sizeof addr) == 0 &&
+              ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1;
+    ::close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int serverThreads = 1;
+    int count = 20000;
+    int port = 9982;
+    TcpServer::Option option = TcpServer::kNoReusePort;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:p:r")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            serverThreads = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'r':
+            option = TcpServer::kReusePortPerLoop;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t serverThreads] [-n connections] [-p port] [-r]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    TcpServer server(&loop, listenAddr, "allocbench", option);
+    server.setThreadNum(serverThreads);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        // 一个字节的string走的是短字符串优化，不会有堆分配
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+
+    std::thread client([&]() {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        // 预热：让各个loop的vector、对象池等达到稳定状态
+        for (int i = 0; i < 1000; ++i)
+        {
+            oneCycle(addr);
+        }
+        // 等最后一个连接在服务端拆除完
+        usleep(100 * 1000);
+
+        long startAllocs = allocations;
+        long startBytes = allocatedBytes;
+        int ok = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            ok += oneCycle(addr);
+        }
+        usleep(100 * 1000);
+        long allocs = allocations - startAllocs;
+        long bytes = allocatedBytes - startBytes;
+
+        printf("server threads %d, %s\n", serverThreads,
+               option == TcpServer::kReusePortPerLoop ? "reuseport per loop" : "single acceptor");
+        printf("%d connections (%d ok): %.2f allocations, %.0f bytes per connection\n",
+               count, ok, static_cast<double>(allocs) / count, static_cast<double>(bytes) / count);
+        loop.quit();
+    });
+
+    loop.loop();
+    client.join();
+    return 0;
+}
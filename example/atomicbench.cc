@@ -0,0 +1,184 @@
+#include "../TcpServer.h"
+#include "../Logger.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+
+/**
+ * 统计服务端回显一条消息要执行多少条原子指令(只支持x86-64 Linux)
+ *
+ * 子进程里跑一个单loop的回显TcpServer，父进程是客户端，同时用ptrace单步执行子进程的loop线程，
+ * 数一数从发出消息到收到回显期间执行了多少条带lock前缀的指令，以及多少条隐含lock的xchg(操作数在内存中)，
+ * shared_ptr的引用计数、互斥锁、seq_cst的原子写最后都会落到这两类指令上
+ *
+ * glibc的epoll_wait/readv/write都是线程取消点，每次调用都有两条lock cmpxchg，这部分不是网络库自己产生的
+ *
+ * 用法：atomicbench [-n 统计的消息数] [-p 端口]
+ */
+
+static void runServer(int port)
+{
+    // libstdc++在单线程进程中会把shared_ptr的引用计数换成普通的加减，起一个空闲线程让统计反映真实情况
+    std::thread([]() {
+        for (;;)
+        {
+            pause();
+        }
+    }).detach();
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    TcpServer server(&loop, listenAddr, "atomicbench");
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+    loop.loop();
+}
+
+// 返回1表示lock前缀，返回2表示操作数在内存中的xchg
+static int lockedInstruction(const unsigned char *code)
+{
+    int i = 0;
+    bool lock = false;
+    for (;; ++i)
+    {
+        unsigned char c = code[i];
+        if (c == 0xF0)
+        {
+            lock = true;
+        }
+        else if (c != 0xF2 && c != 0xF3 && c != 0x2E && c != 0x36 && c != 0x3E &&
+                 c != 0x26 && c != 0x64 && c != 0x65 && c != 0x66 && c != 0x67)
+        {
+            break;
+        }
+    }
+    if (lock)
+    {
+        return 1;
+    }
+    if (code[i] >= 0x40 && code[i] <= 0x4F) // REX前缀
+    {
+        ++i;
+    }
+    if ((code[i] == 0x86 || code[i] == 0x87) && (code[i + 1] >> 6) != 3)
+    {
+        return 2;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = 100;
+    int port = 9983;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n messages] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        ::ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        runServer(port);
+        _exit(0);
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = -1;
+    for (int retry = 0; retry < 500; ++retry)
+    {
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(fd, (sockaddr *)&addr, sizeof addr) == 0)
+        {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+        usleep(10 * 1000);
+    }
+    if (fd < 0)
+    {
+        fprintf(stderr, "connect failed\n");
+        ::kill(pid, SIGKILL);
+        return 1;
+    }
+
+    // 预热之后再停下loop线程(子进程的主线程)开始单步
+    char c = 'x';
+    for (int i = 0; i < 1000; ++i)
+    {
+        ::write(fd, &c, 1);
+        ::read(fd, &c, 1);
+    }
+    usleep(100 * 1000);
+    ::syscall(SYS_tgkill, pid, pid, SIGSTOP);
+    int status;
+    ::waitpid(pid, &status, 0);
+
+    long instructions = 0;
+    long locks = 0;
+    long xchgs = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        ::write(fd, &c, 1);
+        // 上一条消息回显之后剩下的那段循环也算在下一条消息里，消息数多了以后平均值是准确的
+        while (::recv(fd, &c, 1, MSG_DONTWAIT) != 1)
+        {
+            user_regs_struct regs;
+            ::ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+            unsigned char code[16];
+            for (size_t off = 0; off < sizeof code; off += sizeof(long))
+            {
+                long word = ::ptrace(PTRACE_PEEKTEXT, pid, regs.rip + off, nullptr);
+                memcpy(code + off, &word, sizeof word);
+            }
+            int kind = lockedInstruction(code);
+            locks += kind == 1;
+            xchgs += kind == 2;
+
+            ::ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+            ::waitpid(pid, &status, 0);
+            ++instructions;
+        }
+    }
+
+    printf("%d messages: %.0f instructions, %.2f lock-prefixed, %.2f xchg with memory operand per message\n",
+           count, static_cast<double>(instructions) / count, static_cast<double>(locks) / count,
+           static_cast<double>(xchgs) / count);
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, &status, 0);
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "../TcpServer.h"
+#include "../Logger.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+/**
+ * 流水线请求下，服务端每个响应要用几次write系统调用
+ *
+ * 客户端一次发出depth个请求(每个请求一行)，等depth个响应都回来之后再发下一批；
+ * 服务端每处理一个请求分三次send：头部、正文、结尾，这是一个典型的"一个响应多次send"的处理函数，
+ * 连接设置了TCP_NODELAY，跟一般的RPC服务一样
+ *
+ * 本程序替换了write函数来统计服务端的write次数(动态库中的调用也会走到这里)，客户端只用send/recv
+ *
+ * 用法：batchbench [-n 请求数] [-d 流水线深度] [-p 端口] [-b]
+ * -b 开启TcpServer::setWriteBatching
+ */
+
+static std::atomic<long> writeCalls(0);
+
+extern "C" ssize_t write(int fd, const void *buf, size_t count)
+{
+    ++writeCalls;
+    return ::syscall(SYS_write, fd, buf, count);
+}
+
+static const char kResponseBody[] = "0123456789abcdef0123456789abcdef";
+
+int main(int argc, char *argv[])
+{
+    int count = 100000;
+    int depth = 16;
+    int port = 9987;
+    bool batching = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:p:b")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'b':
+            batching = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-d depth] [-p port] [-b]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    TcpServer server(&loop, listenAddr, "batchbench");
+    server.setWriteBatching(batching);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        // 不开批量写的时候，Nagle算法加上对端的延迟ACK会让第二次send等上几十毫秒
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        const std::string body(kResponseBody);
+        while (true)
+        {
+            const char *begin = buf->peek();
+            const char *eol = static_cast<const char *>(memchr(begin, '\n', buf->readableBytes()));
+            if (eol == nullptr)
+            {
+                break;
+            }
+            buf->retrieve(eol - begin + 1);
+            conn->send("HDR ");
+            conn->send(body);
+            conn->send("\n");
+        }
+    });
+    server.start();
+
+    std::thread client([&]() {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(fd, (sockaddr *)&addr, sizeof addr) != 0)
+        {
+            perror("connect");
+            loop.quit();
+            return;
+        }
+
+        const size_t responseSize = 4 + strlen(kResponseBody) + 1;
+        std::string batch;
+        for (int i = 0; i < depth; ++i)
+        {
+            batch += "GET\n";
+        }
+        char buf[65536];
+
+        long startWrites = writeCalls;
+        auto start = std::chrono::steady_clock::now();
+        int done = 0;
+        while (done < count)
+        {
+            ::send(fd, batch.data(), batch.size(), 0);
+            size_t expected = responseSize * depth;
+            size_t received = 0;
+            while (received < expected)
+            {
+                ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+                if (n <= 0)
+                {
+                    perror("recv");
+                    loop.quit();
+                    return;
+                }
+                received += n;
+            }
+            done += depth;
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long writes = writeCalls - startWrites;
+
+        printf("depth %d, write batching %s\n", depth, batching ? "on" : "off");
+        printf("%d responses in %.2fs, %.0f responses/s, %.3f write calls per response\n",
+               done, elapsed, done / elapsed, static_cast<double>(writes) / done);
+        ::close(fd);
+        loop.quit();
+    });
+
+    loop.loop();
+    client.join();
+    return 0;
+}
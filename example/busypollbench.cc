@@ -0,0 +1,145 @@
+#include "../TcpServer.h"
+#include "../Logger.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/**
+ * 忙轮询对一问一答延迟的影响，以及为此付出的CPU
+ *
+ * 服务端是一个subLoop的回显TcpServer，客户端线程发一个字节、等回显，然后停interval微秒再发下一个，
+ * interval模拟消息之间的间隔：间隔比空转窗口短时忙轮询能省掉subLoop的睡眠/唤醒，
+ * 间隔很长时自适应会停止空转，CPU不会被白白浪费
+ *
+ * 输出往返延迟的分布、整个进程每条消息消耗的CPU时间、subLoop累计空转的时间
+ * 空转的loop线程需要一个独占的核，和客户端挤在同一个核上时结果没有意义
+ *
+ * 用法：busypollbench [-s 最长空转微秒数，0为关闭] [-i 消息间隔微秒] [-n 消息数] [-p 端口]
+ */
+
+static double cpuSeconds()
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    int spinUs = 0;
+    int intervalUs = 0;
+    int count = 20000;
+    int port = 9989;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:n:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            spinUs = atoi(optarg);
+            break;
+        case 'i':
+            intervalUs = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s maxSpinUs] [-i intervalUs] [-n messages] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    TcpServer server(&loop, listenAddr, "busypollbench");
+    server.setThreadNum(1);
+    server.setBusyPoll(spinUs);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+
+    std::thread client([&]() {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(fd, (sockaddr *)&addr, sizeof addr) != 0)
+        {
+            perror("connect");
+            loop.quit();
+            return;
+        }
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+
+        EventLoop *ioLoop = server.threadPool()->getAllLoops()[0];
+        std::vector<int> rtts;
+        rtts.reserve(count);
+        char c = 'x';
+        double startCpu = cpuSeconds();
+        int64_t startSpin = ioLoop->busyPollSpinUs();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i)
+        {
+            auto sent = std::chrono::steady_clock::now();
+            if (::write(fd, &c, 1) != 1 || ::read(fd, &c, 1) != 1)
+            {
+                perror("echo");
+                break;
+            }
+            rtts.push_back(static_cast<int>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                std::chrono::steady_clock::now() - sent)
+                                                .count()));
+            if (intervalUs > 0)
+            {
+                usleep(intervalUs);
+            }
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu = cpuSeconds() - startCpu;
+        int64_t spin = ioLoop->busyPollSpinUs() - startSpin;
+        ::close(fd);
+
+        std::sort(rtts.begin(), rtts.end());
+        printf("busy poll %d us, interval %d us\n", spinUs, intervalUs);
+        if (!rtts.empty())
+        {
+            printf("%zu messages in %.2fs: rtt p50 %.1f us, p99 %.1f us; "
+                   "process cpu %.1f us per message, io loop spun %.1f us per message\n",
+                   rtts.size(), elapsed, rtts[rtts.size() / 2] / 1000.0, rtts[rtts.size() * 99 / 100] / 1000.0,
+                   cpu * 1e6 / rtts.size(), static_cast<double>(spin) / rtts.size());
+        }
+        loop.quit();
+    });
+
+    loop.loop();
+    client.join();
+    return 0;
+}
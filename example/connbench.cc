@@ -0,0 +1,128 @@
+#include "../TcpServer.h"
+#include "../Logger.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 短连接压测：测量每秒能完成多少次 建立连接=>收发一个字节=>关闭连接
+ *
+ * 服务端就是进程内的一个回显TcpServer，客户端线程用阻塞的socket不停地建连、发送、等回显、关闭，
+ * 统计时间包括了服务端accept、建立TcpConnection、处理一次读事件、拆除连接的完整路径
+ *
+ * 用法：connbench [-t 服务端subLoop线程数] [-c 客户端线程数] [-d 秒数] [-p 端口] [-r]
+ * -r 使用TcpServer::kReusePortPerLoop，每个loop各自accept
+ */
+
+static std::atomic_bool running(true);
+static std::atomic<long> cycles(0);
+static std::atomic<long> failures(0);
+
+static void clientThread(int port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    long done = 0;
+    while (running)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        char c = 'x';
+        if (::connect(fd, (sockaddr *)&addr, sizeof addr) == 0 &&
+            ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1)
+        {
+            ++done;
+        }
+        else
+        {
+            ++failures;
+        }
+        ::close(fd);
+    }
+    cycles += done;
+}
+
+int main(int argc, char *argv[])
+{
+    int serverThreads = 3;
+    int clientThreads = 4;
+    int seconds = 5;
+    int port = 9981;
+    TcpServer::Option option = TcpServer::kNoReusePort;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:d:p:r")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            serverThreads = atoi(optarg);
+            break;
+        case 'c':
+            clientThreads = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'r':
+            option = TcpServer::kReusePortPerLoop;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t serverThreads] [-c clientThreads] [-d seconds] [-p port] [-r]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    TcpServer server(&loop, listenAddr, "connbench", option);
+    server.setThreadNum(serverThreads);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+
+    std::thread driver([&]() {
+        std::vector<std::thread> clients;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < clientThreads; ++i)
+        {
+            clients.emplace_back(clientThread, port);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        running = false;
+        for (std::thread &t : clients)
+        {
+            t.join();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("server threads %d, client threads %d, %s\n", serverThreads, clientThreads,
+               option == TcpServer::kReusePortPerLoop ? "reuseport per loop" : "single acceptor");
+        printf("%ld connect/close cycles in %.2fs, %.0f cycles/s, %ld failures\n",
+               cycles.load(), elapsed, cycles.load() / elapsed, failures.load());
+        loop.quit();
+    });
+
+    loop.loop();
+    driver.join();
+    return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+/**
+ * 替换全局的operator new/delete，统计所有线程的堆分配次数和字节数，给各个bench统计每次操作的分配次数
+ *
+ * 库里的所有分配也会走到这里(动态库的符号会被可执行文件中的定义覆盖)
+ * 定义的是全局的替换函数，一个程序只能有一个源文件包含这个头文件
+ * operator delete不能内联：内联之后GCC会把new返回的指针和free配对，报-Wmismatched-new-delete
+ */
+
+static std::atomic<long> allocations(0);
+static std::atomic<long> allocatedBytes(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(static_cast<long>(size), std::memory_order_relaxed);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,218 @@
+#include "../TcpServer.h"
+#include "../Logger.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 一个连接狂发请求时，同一个loop上其它连接的延迟
+ *
+ * 服务端是单loop的TcpServer，请求是一行一行的文本，每处理一行要花workUs微秒的CPU时间；
+ * 以P开头的行是ping，原样回显，其它的行不回复。
+ * 一个flood线程不停地往服务端灌请求，c个ping线程各自一问一答，统计ping的往返延迟分布
+ *
+ * 用法：fairbench [-b 每轮读的字节数] [-m 每次回调处理的行数] [-c ping连接数] [-w 每行的微秒数] [-d 秒数] [-p 端口]
+ * -b 即TcpServer::setReadBudget；-m 处理m行之后还有剩下的完整行就调用TcpConnection::yieldRead
+ */
+
+static std::atomic_bool running(true);
+static std::atomic<long> floodLines(0);
+
+static void spin(int us)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+static int connectTo(int port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) != 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+static void floodThread(int port)
+{
+    int fd = connectTo(port);
+    std::string block;
+    while (block.size() < 65536)
+    {
+        block += "FLOOD-REQUEST..\n"; // 16字节一行
+    }
+    while (running)
+    {
+        if (::send(fd, block.data(), block.size(), 0) <= 0)
+        {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+static void pingThread(int port, std::vector<int> *rtts)
+{
+    int fd = connectTo(port);
+    char buf[64];
+    while (running)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ::send(fd, "PING\n", 5, 0);
+        size_t received = 0;
+        while (received < 5)
+        {
+            ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+            if (n <= 0)
+            {
+                ::close(fd);
+                return;
+            }
+            received += n;
+        }
+        rtts->push_back(static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                             std::chrono::steady_clock::now() - start)
+                                             .count()));
+        usleep(1000);
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t readBudget = 0;
+    int lineBudget = 0;
+    int pingers = 8;
+    int workUs = 2;
+    int seconds = 3;
+    int port = 9988;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:m:c:w:d:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            readBudget = static_cast<size_t>(atol(optarg));
+            break;
+        case 'm':
+            lineBudget = atoi(optarg);
+            break;
+        case 'c':
+            pingers = atoi(optarg);
+            break;
+        case 'w':
+            workUs = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b readBudget] [-m linesPerCallback] [-c pingers] [-w workUs] [-d seconds] [-p port]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    TcpServer server(&loop, listenAddr, "fairbench");
+    server.setReadBudget(readBudget);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        int lines = 0;
+        while (true)
+        {
+            const char *begin = buf->peek();
+            const char *eol = static_cast<const char *>(memchr(begin, '\n', buf->readableBytes()));
+            if (eol == nullptr)
+            {
+                break;
+            }
+            if (lineBudget > 0 && lines == lineBudget)
+            {
+                conn->yieldRead();
+                break;
+            }
+            spin(workUs);
+            if (*begin == 'P')
+            {
+                conn->send(std::string(begin, eol + 1));
+            }
+            else
+            {
+                ++floodLines;
+            }
+            buf->retrieve(eol - begin + 1);
+            ++lines;
+        }
+    });
+    server.start();
+
+    std::thread driver([&]() {
+        std::thread flood(floodThread, port);
+        std::vector<std::vector<int>> rtts(pingers);
+        std::vector<std::thread> pings;
+        for (int i = 0; i < pingers; ++i)
+        {
+            pings.emplace_back(pingThread, port, &rtts[i]);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        running = false;
+        for (std::thread &t : pings)
+        {
+            t.join();
+        }
+        flood.join();
+
+        std::vector<int> all;
+        for (const std::vector<int> &v : rtts)
+        {
+            all.insert(all.end(), v.begin(), v.end());
+        }
+        std::sort(all.begin(), all.end());
+        printf("read budget %zu bytes, %d lines per callback, %d pingers, %d us per line\n",
+               readBudget, lineBudget, pingers, workUs);
+        if (!all.empty())
+        {
+            printf("%zu pings: p50 %d us, p99 %d us, max %d us; %.0f flood lines/s\n", all.size(),
+                   all[all.size() / 2], all[all.size() * 99 / 100], all.back(),
+                   floodLines.load() / static_cast<double>(seconds));
+        }
+        loop.quit();
+    });
+
+    loop.loop();
+    driver.join();
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "../HttpServer.h"
+#include "../EventLoopThread.h"
+#include "../TcpClient.h"
+#include "../Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * HttpServer的压测，类似wrk：c条长连接，每条连接上保持P个请求同时在途(P>1就是流水线)，
+ * 收到一个响应就再发一个请求，持续d秒，输出每秒请求数和平均延迟
+ *
+ * HttpServer跑在EventLoopThread里(-t大于0时再加subLoop)，客户端是另一个线程中的一个loop，
+ * 请求是一个最小的GET，响应是14字节的文本，测的主要是请求解析、响应序列化和系统调用的开销
+ *
+ * 用法：httpbench [-c 连接数] [-d 秒数] [-P 流水线深度] [-t 服务端subLoop数] [-p 端口]
+ */
+
+static const char kRequest[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nUser-Agent: httpbench\r\n\r\n";
+
+// 每条客户端连接的状态，挂在TcpConnection的context上
+struct ClientState
+{
+    std::deque<int64_t> starts; // 在途请求的发送时刻
+};
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = 32;
+    double seconds = 5;
+    int pipeline = 1;
+    int threads = 0;
+    int port = 9994;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:P:t:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            connections = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 'P':
+            pipeline = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c connections] [-d seconds] [-P pipeline] [-t threads] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    InetAddress addr(static_cast<uint16_t>(port));
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<HttpServer> server;
+    std::promise<void> listening;
+    serverLoop->runInLoop([&]() {
+        server.reset(new HttpServer(serverLoop, addr, "httpbench"));
+        server->setThreadNum(threads);
+        server->setHttpCallback([](const HttpRequest &, HttpResponse *response) {
+            response->setContentType("text/plain");
+            response->setBody("hello, world!\n");
+        });
+        server->start();
+        listening.set_value();
+    });
+    listening.get_future().wait();
+
+    EventLoop loop;
+    bool measuring = false;
+    int64_t completed = 0;
+    int64_t totalLatencyUs = 0;
+    int64_t errors = 0;
+
+    auto sendRequests = [](const TcpConnectionPtr &conn, int n) {
+        ClientState *state = static_cast<ClientState *>(conn->getContext().get());
+        Buffer *output = conn->outputBuffer();
+        int64_t now = nowUs();
+        for (int i = 0; i < n; ++i)
+        {
+            output->append(kRequest, sizeof kRequest - 1);
+            state->starts.push_back(now);
+        }
+        conn->sendOutputBuffer();
+    };
+
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < connections; ++i)
+    {
+        TcpClient *client = new TcpClient(&loop, addr, "httpbench-client");
+        clients.push_back(std::unique_ptr<TcpClient>(client));
+        client->setConnectionCallback([&, sendRequests](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn->setContext(std::make_shared<ClientState>());
+                sendRequests(conn, pipeline);
+            }
+        });
+        client->setMessageCallback([&, sendRequests](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            ClientState *state = static_cast<ClientState *>(conn->getContext().get());
+            int done = 0;
+            int64_t now = nowUs();
+            while (true)
+            {
+                // 响应都是Content-Length格式的
+                const char *begin = buf->peek();
+                const void *headEnd = memmem(begin, buf->readableBytes(), "\r\n\r\n", 4);
+                if (headEnd == nullptr)
+                {
+                    break;
+                }
+                size_t headLen = static_cast<const char *>(headEnd) - begin + 4;
+                const void *field = memmem(begin, headLen, "Content-Length: ", 16);
+                size_t bodyLen = field ? strtoul(static_cast<const char *>(field) + 16, nullptr, 10) : 0;
+                if (buf->readableBytes() < headLen + bodyLen)
+                {
+                    break;
+                }
+                if (strncmp(begin, "HTTP/1.1 200", 12) != 0)
+                {
+                    ++errors;
+                }
+                buf->retrieve(headLen + bodyLen);
+                if (measuring)
+                {
+                    ++completed;
+                    totalLatencyUs += now - state->starts.front();
+                }
+                state->starts.pop_front();
+                ++done;
+            }
+            if (done > 0)
+            {
+                sendRequests(conn, done);
+            }
+        });
+        client->connect();
+    }
+
+    // 连接都建好、跑稳之后开始计数
+    int64_t startUs = 0;
+    loop.runAfter(0.5, [&]() {
+        measuring = true;
+        startUs = nowUs();
+    });
+    loop.runAfter(0.5 + seconds, [&]() {
+        double elapsed = (nowUs() - startUs) / 1e6;
+        measuring = false;
+        printf("%d connections, pipeline depth %d, server subLoops %d\n", connections, pipeline, threads);
+        printf("%lld requests in %.2fs: %.0f requests/s, mean latency %.1f us, %lld errors\n",
+               (long long)completed, elapsed, completed / elapsed,
+               completed ? static_cast<double>(totalLatencyUs) / completed : 0.0, (long long)errors);
+        loop.quit();
+    });
+    loop.loop();
+
+    clients.clear();
+    std::promise<void> destroyed;
+    serverLoop->runInLoop([&]() {
+        server.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().wait();
+    return 0;
+}
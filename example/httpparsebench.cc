@@ -0,0 +1,129 @@
+#include "../HttpContext.h"
+#include "../Buffer.h"
+#include "countingalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+/**
+ * HttpContext::parseRequest的微基准，不经过网络，只测请求解析本身
+ *
+ * 每一轮把pipeline个请求追加进一个Buffer，再像HttpServer::onMessage那样逐个解析、finishRequest；
+ * -s大于0时每次只追加s个字节就调用一次parseRequest，模拟请求被拆成很多个TCP段到达的情况，
+ * 用来确认增量解析不会重复扫描已经找过的数据
+ * 请求是一个浏览器风格的GET，大约520字节、8个头部
+ *
+ * 分配次数由countingalloc.h统计，预热之后统计到的分配都来自解析路径
+ *
+ * 用法：httpparsebench [-n 请求数] [-s 每次追加的字节数] [-P 流水线深度]
+ */
+
+static const char kRequest[] =
+    "GET /api/v1/users/12345/profile?fields=name,email&lang=en HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+int main(int argc, char *argv[])
+{
+    long requests = 1000000;
+    size_t split = 0;
+    int pipeline = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:P:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            requests = atol(optarg);
+            break;
+        case 's':
+            split = atoi(optarg);
+            break;
+        case 'P':
+            pipeline = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-s split] [-P pipeline]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (pipeline < 1)
+    {
+        pipeline = 1;
+    }
+
+    HttpContext context(64 * 1024, 8 * 1024 * 1024);
+    Buffer input;
+    size_t requestLen = sizeof kRequest - 1;
+    long parsed = 0;
+    size_t checksum = 0;
+
+    // 一轮：追加pipeline个请求(按split拆开)，解析出所有完整的请求
+    auto round = [&]() {
+        size_t total = requestLen * pipeline;
+        size_t fed = 0;
+        while (fed < total)
+        {
+            size_t n = split > 0 ? std::min(split, total - fed) : total - fed;
+            for (size_t i = 0; i < n;)
+            {
+                // 跨越请求边界时分两次追加
+                size_t offset = (fed + i) % requestLen;
+                size_t len = std::min(n - i, requestLen - offset);
+                input.append(kRequest + offset, len);
+                i += len;
+            }
+            fed += n;
+
+            HttpContext::ParseResult result;
+            while ((result = context.parseRequest(&input, Timestamp())) == HttpContext::kGotRequest)
+            {
+                checksum += context.request().path().size() + context.request().headerCount();
+                context.finishRequest(&input);
+                ++parsed;
+            }
+            if (result == HttpContext::kError)
+            {
+                fprintf(stderr, "parse error %d\n", context.errorStatus());
+                exit(1);
+            }
+        }
+    };
+
+    // 预热，让Buffer和解码缓冲区的容量稳定下来
+    for (int i = 0; i < 1000; ++i)
+    {
+        round();
+    }
+
+    long rounds = std::max(1L, requests / pipeline);
+    parsed = 0;
+    long allocationsBefore = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        round();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long allocated = allocations - allocationsBefore;
+
+    printf("%zu-byte request, split %zu, pipeline depth %d\n", requestLen, split, pipeline);
+    printf("%ld requests in %.3fs: %.0f ns/request, %.2f M requests/s, %.2f allocations/request (checksum %zu)\n",
+           parsed, seconds, seconds * 1e9 / parsed, parsed / seconds / 1e6,
+           static_cast<double>(allocated) / parsed, checksum);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "../HttpServer.h"
+#include "../Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+/**
+ * HttpServer的示例
+ *
+ * GET  /          回复一段文本
+ * POST /echo      把请求体原样返回
+ * GET  /chunked   用chunked编码分块回复
+ * 其它路径回复404
+ *
+ * 用法：httpserver [-p 端口] [-t 线程数]
+ * 试一下：curl -v http://127.0.0.1:8000/  curl -d hello http://127.0.0.1:8000/echo
+ */
+
+static void onRequest(const HttpRequest &request, HttpResponse *response)
+{
+    if (request.path() == "/")
+    {
+        response->setContentType("text/plain");
+        response->setBody("hello, world!\n");
+    }
+    else if (request.path() == "/echo" && request.method() == HttpRequest::kPost)
+    {
+        StringPiece contentType = request.getHeader("Content-Type");
+        response->setContentType(contentType.empty() ? "application/octet-stream" : contentType);
+        response->setBody(request.body());
+    }
+    else if (request.path() == "/chunked")
+    {
+        response->setContentType("text/plain");
+        response->setChunked(true);
+        for (int i = 0; i < 5; ++i)
+        {
+            std::string line = "chunk " + std::to_string(i) + "\n";
+            response->appendChunk(line.data(), line.size());
+        }
+    }
+    else
+    {
+        response->setStatusCode(404);
+        response->setContentType("text/plain");
+        response->setBody("not found\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int port = 8000;
+    int threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-t threads]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(static_cast<uint16_t>(port), "0.0.0.0"), "httpserver");
+    server.setHttpCallback(onRequest);
+    server.setThreadNum(threads);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "../ConnectionPool.h"
+#include "../EventLoopThread.h"
+#include "../TcpServer.h"
+#include "../Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 调用上游服务：每次临时建连接 和 使用ConnectionPool 的对比
+ *
+ * 上游是另一个线程里的回显TcpServer，请求和响应都是一行文本。
+ * 前端loop保持c个请求同时在进行，一个请求完成就发出下一个，统计吞吐和每个请求的平均延迟
+ * -s 每个请求新建一个TcpClient，连接建立之后发请求，收到响应之后关闭
+ * 默认使用ConnectionPool，前端loop上保持k条常驻连接
+ *
+ * 用法：poolbench [-n 请求数] [-c 并发请求数] [-k 每个loop的连接数] [-p 端口] [-s]
+ */
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+int main(int argc, char *argv[])
+{
+    int count = 20000;
+    int concurrency = 8;
+    int poolSize = 4;
+    int port = 9990;
+    bool connectPerRequest = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:k:p:s")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'c':
+            concurrency = atoi(optarg);
+            break;
+        case 'k':
+            poolSize = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 's':
+            connectPerRequest = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-c concurrency] [-k connectionsPerLoop] [-p port] [-s]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 上游服务
+    EventLoopThread upstreamThread;
+    EventLoop *upstreamLoop = upstreamThread.startLoop();
+    InetAddress upstreamAddr(static_cast<uint16_t>(port));
+    std::unique_ptr<TcpServer> upstream;
+    std::promise<void> listening;
+    upstreamLoop->runInLoop([&]() {
+        upstream.reset(new TcpServer(upstreamLoop, upstreamAddr, "upstream"));
+        upstream->setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+            }
+        });
+        upstream->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf->retrieveAllAsString());
+        });
+        upstream->start();
+        listening.set_value();
+    });
+    listening.get_future().wait();
+
+    EventLoop loop;
+    int issued = 0;
+    int completed = 0;
+    int64_t totalLatencyUs = 0;
+    int64_t startUs = 0;
+
+    auto finish = [&]() {
+        double elapsed = (nowUs() - startUs) / 1e6;
+        printf("%s, concurrency %d\n",
+               connectPerRequest ? "connect per request" : "connection pool", concurrency);
+        printf("%d requests in %.2fs, %.0f requests/s, mean latency %.1f us\n",
+               completed, elapsed, completed / elapsed,
+               static_cast<double>(totalLatencyUs) / completed);
+        loop.quit();
+    };
+
+    // 每次临时建连接
+    std::map<int, std::unique_ptr<TcpClient>> calls;
+    std::function<void()> issueOneCall = [&]() {
+        int id = issued++;
+        int64_t start = nowUs();
+        TcpClient *client = new TcpClient(&loop, upstreamAddr, "call");
+        calls[id].reset(client);
+        client->setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn->send("REQ\n");
+            }
+        });
+        client->setMessageCallback([&, id, start](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+            buf->retrieveAll();
+            totalLatencyUs += nowUs() - start;
+            // 当前正处在这个TcpClient的连接的回调中，放到回调之后再析构
+            loop.queueInLoop([&, id]() { calls.erase(id); });
+            if (++completed == count)
+            {
+                finish();
+            }
+            else if (issued < count)
+            {
+                issueOneCall();
+            }
+        });
+        client->connect();
+    };
+
+    // 连接池
+    std::unique_ptr<ConnectionPool> pool;
+    std::unordered_map<TcpConnection *, std::deque<int64_t>> pending;
+    std::function<void()> issuePooled = [&]() {
+        TcpConnectionPtr conn = pool->acquire(&loop);
+        if (!conn)
+        {
+            fprintf(stderr, "no connection available\n");
+            loop.quit();
+            return;
+        }
+        ++issued;
+        pending[conn.get()].push_back(nowUs());
+        conn->send("REQ\n");
+    };
+
+    if (connectPerRequest)
+    {
+        loop.runAfter(0.1, [&]() {
+            startUs = nowUs();
+            for (int i = 0; i < concurrency && issued < count; ++i)
+            {
+                issueOneCall();
+            }
+        });
+    }
+    else
+    {
+        pool.reset(new ConnectionPool(std::vector<EventLoop *>(1, &loop), upstreamAddr, "pool", poolSize));
+        pool->setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+            }
+        });
+        pool->setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            std::deque<int64_t> &starts = pending[conn.get()];
+            while (true)
+            {
+                const char *eol = static_cast<const char *>(memchr(buf->peek(), '\n', buf->readableBytes()));
+                if (eol == nullptr)
+                {
+                    break;
+                }
+                buf->retrieve(eol - buf->peek() + 1);
+                pool->release(conn);
+                totalLatencyUs += nowUs() - starts.front();
+                starts.pop_front();
+                if (++completed == count)
+                {
+                    finish();
+                    return;
+                }
+                if (issued < count)
+                {
+                    issuePooled();
+                }
+            }
+        });
+        pool->start();
+        // 等连接都建好(预热)之后再开始计时
+        loop.runAfter(0.1, [&]() {
+            if (pool->connectedCount(&loop) < poolSize)
+            {
+                fprintf(stderr, "pool not ready\n");
+                loop.quit();
+                return;
+            }
+            startUs = nowUs();
+            for (int i = 0; i < concurrency && issued < count; ++i)
+            {
+                issuePooled();
+            }
+        });
+    }
+
+    loop.loop();
+
+    pool.reset();
+    calls.clear();
+    // TcpServer要在它的loop线程中析构，等析构完再退出
+    std::promise<void> destroyed;
+    upstreamLoop->runInLoop([&]() {
+        upstream.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().wait();
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "../TcpRelay.h"
+#include "../TcpServer.h"
+#include "../Logger.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+/**
+ * TcpRelay转发大流量时，splice和经过Buffer拷贝的对比
+ *
+ * 客户端线程 => TcpRelay(单loop的TcpServer) => 上游线程，上游只负责把数据读走丢掉。
+ * 客户端和上游都是阻塞socket的普通线程，两种模式下它们的开销是一样的，差别只在中间的relay上
+ * 输出吞吐和整个进程每转发1GB消耗的CPU时间
+ *
+ * 用法：relaybench [-m 转发的MB数] [-p 端口] [-c]
+ * -c 关闭splice，TcpRelay::setSplice(false)，走readFd + send
+ */
+
+static double cpuSeconds()
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static sockaddr_in loopbackAddr(int port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+int main(int argc, char *argv[])
+{
+    long megabytes = 2048;
+    int port = 9991;
+    bool splice = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:p:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            megabytes = atol(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            splice = false;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m megabytes] [-p port] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+    const size_t total = static_cast<size_t>(megabytes) * 1024 * 1024;
+    const int upstreamPort = port + 1;
+
+    // 上游：接受一个连接，把数据全部读走
+    sockaddr_in upstreamSockAddr = loopbackAddr(upstreamPort);
+    int listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int on = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    if (::bind(listenFd, (sockaddr *)&upstreamSockAddr, sizeof upstreamSockAddr) != 0 ||
+        ::listen(listenFd, 16) != 0)
+    {
+        perror("upstream listen");
+        return 1;
+    }
+    std::thread upstream([listenFd, total]() {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        static char buf[256 * 1024];
+        size_t received = 0;
+        while (received < total)
+        {
+            ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            received += n;
+        }
+        ::close(fd);
+    });
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    InetAddress upstreamAddr(static_cast<uint16_t>(upstreamPort));
+    TcpServer server(&loop, listenAddr, "relaybench");
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            TcpRelayPtr relay = std::make_shared<TcpRelay>(conn, upstreamAddr);
+            relay->setSplice(splice);
+            relay->start();
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+    });
+    server.start();
+
+    std::thread client([&]() {
+        sockaddr_in addr = loopbackAddr(port);
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(fd, (sockaddr *)&addr, sizeof addr) != 0)
+        {
+            perror("connect");
+            loop.quit();
+            return;
+        }
+
+        std::string block(256 * 1024, 'x');
+        double startCpu = cpuSeconds();
+        auto start = std::chrono::steady_clock::now();
+        size_t sent = 0;
+        while (sent < total)
+        {
+            ssize_t n = ::send(fd, block.data(), std::min(block.size(), total - sent), 0);
+            if (n <= 0)
+            {
+                perror("send");
+                break;
+            }
+            sent += n;
+        }
+        upstream.join(); // 上游收完才算转发完
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu = cpuSeconds() - startCpu;
+        ::close(fd);
+
+        printf("relay with %s\n", splice ? "splice" : "Buffer copy");
+        printf("%ld MB in %.2fs: %.0f MB/s, process cpu %.2f s per GB\n",
+               megabytes, elapsed, megabytes / elapsed, cpu * 1024 / megabytes);
+        loop.quit();
+    });
+
+    loop.loop();
+    client.join();
+    ::close(listenFd);
+    return 0;
+}
@@ -0,0 +1,363 @@
+#include "../TcpClient.h"
+#include "../EventLoop.h"
+#include "../StringPiece.h"
+#include "../Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * redis-benchmark式的RESP压测客户端，可以压respcache，也可以压真正的Redis
+ *
+ * c个连接都在主线程的loop中，每个连接一次发出P个命令(流水线)，P个回复都收到之后再发下一批；
+ * key是key:后面跟[0, r)中随机的12位数字，和redis-benchmark -r一样。
+ * 每个测试跑d秒，输出每秒请求数，以及一批命令从发出到收齐回复的延迟的p50/p99
+ *
+ * 测试：set、get、mget(一次10个key)、mixed(90% get、10% set)，用逗号分开依次执行
+ *
+ * 用法：respbench [-p 端口] [-c 连接数] [-P 流水线深度] [-d 秒数] [-r key的个数] [-s value字节数] [-t 测试列表]
+ */
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+/**
+ * buf开头一个完整回复的长度，不完整时返回0，格式错误时返回-1
+ */
+static long replyLength(const char *begin, const char *end)
+{
+    const char *cr = static_cast<const char *>(memchr(begin, '\r', end - begin));
+    if (cr == nullptr || cr + 1 >= end)
+    {
+        return 0;
+    }
+    const char *next = cr + 2;
+    switch (*begin)
+    {
+    case '+':
+    case '-':
+    case ':':
+        return next - begin;
+    case '$':
+    {
+        long len = atol(begin + 1);
+        if (len < 0)
+        {
+            return next - begin;
+        }
+        return end - next < len + 2 ? 0 : next + len + 2 - begin;
+    }
+    case '*':
+    {
+        long count = atol(begin + 1);
+        const char *p = next;
+        for (long i = 0; i < count; ++i)
+        {
+            long n = replyLength(p, end);
+            if (n <= 0)
+            {
+                return n;
+            }
+            p += n;
+        }
+        return p - begin;
+    }
+    default:
+        return -1;
+    }
+}
+
+struct BenchClient
+{
+    std::unique_ptr<TcpClient> client;
+    TcpConnectionPtr conn;
+    int outstanding;
+    int64_t batchStartUs;
+    uint64_t rng;
+};
+
+enum Test
+{
+    kSet,
+    kGet,
+    kMget,
+    kMixed,
+};
+
+struct Options
+{
+    int port = 6380;
+    int connections = 50;
+    int pipeline = 1;
+    double seconds = 5;
+    int keyspace = 100000;
+    size_t valueSize = 3;
+    std::string tests = "set,get";
+};
+
+class Bench
+{
+public:
+    Bench(EventLoop *loop, const Options &options)
+        : loop_(loop), options_(options), value_(options.valueSize, 'x'), connected_(0),
+          running_(false), current_(0), requests_(0), errors_(0)
+    {
+        size_t start = 0;
+        while (start <= options.tests.size())
+        {
+            size_t comma = options.tests.find(',', start);
+            std::string name = options.tests.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+            static const char *const kTestNames[] = {"set", "get", "mget", "mixed"};
+            const char *const *found = std::find(kTestNames, kTestNames + 4, name);
+            if (found == kTestNames + 4)
+            {
+                fprintf(stderr, "unknown test '%s'\n", name.c_str());
+            }
+            else
+            {
+                tests_.push_back(static_cast<Test>(found - kTestNames));
+            }
+            if (comma == std::string::npos)
+            {
+                break;
+            }
+            start = comma + 1;
+        }
+
+        InetAddress addr(static_cast<uint16_t>(options.port));
+        clients_.resize(options.connections);
+        for (int i = 0; i < options.connections; ++i)
+        {
+            BenchClient *bc = &clients_[i];
+            bc->client.reset(new TcpClient(loop, addr, "respbench"));
+            bc->outstanding = 0;
+            bc->batchStartUs = 0;
+            bc->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+            bc->client->setConnectionCallback([this, bc](const TcpConnectionPtr &conn) { onConnection(bc, conn); });
+            bc->client->setMessageCallback([this, bc](const TcpConnectionPtr &, Buffer *buf, Timestamp) { onMessage(bc, buf); });
+        }
+    }
+
+    void start()
+    {
+        for (BenchClient &bc : clients_)
+        {
+            bc.client->connect();
+        }
+    }
+
+    int errors() const { return static_cast<int>(errors_); }
+
+private:
+    void onConnection(BenchClient *bc, const TcpConnectionPtr &conn)
+    {
+        if (!conn->connected())
+        {
+            bc->conn.reset();
+            if (running_)
+            {
+                ++errors_;
+            }
+            return;
+        }
+        conn->setTcpNoDelay(true);
+        conn->setWriteBatching(true);
+        bc->conn = conn;
+        if (++connected_ == static_cast<int>(clients_.size()))
+        {
+            runTest();
+        }
+    }
+
+    void runTest()
+    {
+        if (current_ == tests_.size())
+        {
+            loop_->quit();
+            return;
+        }
+        requests_ = 0;
+        latenciesUs_.clear();
+        running_ = true;
+        startUs_ = nowUs();
+        for (BenchClient &bc : clients_)
+        {
+            sendBatch(&bc);
+        }
+        loop_->runAfter(options_.seconds, [this]() {
+            running_ = false;
+            double elapsed = (nowUs() - startUs_) / 1e6;
+            std::sort(latenciesUs_.begin(), latenciesUs_.end());
+            auto percentile = [this](double p) {
+                return latenciesUs_.empty() ? 0.0 : latenciesUs_[static_cast<size_t>(p * (latenciesUs_.size() - 1))] / 1000.0;
+            };
+            static const char *const kNames[] = {"SET", "GET", "MGET (10 keys)", "MIXED (90% GET)"};
+            printf("%s: %.2f requests per second, p50=%.3f msec, p99=%.3f msec\n", kNames[tests_[current_]],
+                   requests_ / elapsed, percentile(0.5), percentile(0.99));
+            ++current_;
+            // 等在途的批次都收齐之后再开始下一个测试
+            loop_->runAfter(0.5, [this]() { runTest(); });
+        });
+    }
+
+    uint64_t nextRandom(BenchClient *bc)
+    {
+        bc->rng ^= bc->rng << 13;
+        bc->rng ^= bc->rng >> 7;
+        bc->rng ^= bc->rng << 17;
+        return bc->rng;
+    }
+
+    void appendKey(BenchClient *bc, Buffer *out)
+    {
+        char key[32];
+        int n = snprintf(key, sizeof key, "$16\r\nkey:%012llu\r\n",
+                         static_cast<unsigned long long>(nextRandom(bc) % options_.keyspace));
+        out->append(key, n);
+    }
+
+    void sendBatch(BenchClient *bc)
+    {
+        if (!bc->conn)
+        {
+            return;
+        }
+        Buffer *out = bc->conn->outputBuffer();
+        Test test = tests_[current_];
+        for (int i = 0; i < options_.pipeline; ++i)
+        {
+            Test command = test;
+            if (test == kMixed)
+            {
+                command = nextRandom(bc) % 10 == 0 ? kSet : kGet;
+            }
+            if (command == kSet)
+            {
+                out->append("*3\r\n$3\r\nSET\r\n", 13);
+                appendKey(bc, out);
+                char header[32];
+                int n = snprintf(header, sizeof header, "$%zu\r\n", value_.size());
+                out->append(header, n);
+                out->append(value_.data(), value_.size());
+                out->append("\r\n", 2);
+            }
+            else if (command == kGet)
+            {
+                out->append("*2\r\n$3\r\nGET\r\n", 13);
+                appendKey(bc, out);
+            }
+            else
+            {
+                out->append("*11\r\n$4\r\nMGET\r\n", 15);
+                for (int k = 0; k < 10; ++k)
+                {
+                    appendKey(bc, out);
+                }
+            }
+        }
+        bc->outstanding = options_.pipeline;
+        bc->batchStartUs = nowUs();
+        bc->conn->sendOutputBuffer();
+    }
+
+    void onMessage(BenchClient *bc, Buffer *buf)
+    {
+        for (;;)
+        {
+            long n = replyLength(buf->peek(), buf->peek() + buf->readableBytes());
+            if (n == 0)
+            {
+                break;
+            }
+            if (n < 0 || buf->peek()[0] == '-')
+            {
+                ++errors_;
+                if (n < 0)
+                {
+                    buf->retrieveAll();
+                    break;
+                }
+            }
+            buf->retrieve(n);
+            if (--bc->outstanding == 0)
+            {
+                if (running_)
+                {
+                    requests_ += options_.pipeline;
+                    latenciesUs_.push_back(nowUs() - bc->batchStartUs);
+                    sendBatch(bc);
+                }
+            }
+        }
+    }
+
+    EventLoop *loop_;
+    const Options options_;
+    const std::string value_;
+    std::vector<Test> tests_;
+    std::vector<BenchClient> clients_;
+    int connected_;
+    bool running_;
+    size_t current_;
+    int64_t startUs_;
+    int64_t requests_;
+    int64_t errors_;
+    std::vector<int64_t> latenciesUs_;
+};
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:P:d:r:s:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            options.port = atoi(optarg);
+            break;
+        case 'c':
+            options.connections = atoi(optarg);
+            break;
+        case 'P':
+            options.pipeline = atoi(optarg);
+            break;
+        case 'd':
+            options.seconds = atof(optarg);
+            break;
+        case 'r':
+            options.keyspace = atoi(optarg);
+            break;
+        case 's':
+            options.valueSize = atoi(optarg);
+            break;
+        case 't':
+            options.tests = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-c connections] [-P pipeline] [-d seconds] [-r keyspace] [-s size] [-t set,get,mget,mixed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.keyspace <= 0 || options.pipeline <= 0 || options.connections <= 0)
+    {
+        fprintf(stderr, "-c, -P and -r must be positive\n");
+        return 1;
+    }
+
+    EventLoop loop;
+    Bench bench(&loop, options);
+    bench.start();
+    loop.loop();
+    printf("%d errors\n", bench.errors());
+    return bench.errors() == 0 ? 0 : 1;
+}
@@ -0,0 +1,940 @@
+#include "../TcpServer.h"
+#include "../EventLoopThreadPool.h"
+#include "../StringPiece.h"
+#include "../Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * 说Redis协议(RESP)的内存KV缓存，用来当作真实一些的负载和压测对象
+ *
+ * 支持的命令：GET、SET key value [EX 秒|PX 毫秒]、DEL key...、EXPIRE key 秒、MGET key...、PING，
+ * 以及redis-benchmark启动时会发的CONFIG GET(回复空数组)；既支持RESP的多条批量格式，也支持telnet式的单行命令
+ * 流水线：一次读到的多个命令逐个执行，回复按命令的顺序追加到outputBuffer_，批量写模式下一次write
+ *
+ * 分片：键空间按key的哈希分成和loop数一样多的分片，每个分片只在自己的loop线程中访问，不需要任何锁
+ * 命令的key属于连接所在loop的分片时直接执行；属于别的分片时，一轮读到的所有这类命令按目标分片打成一批，
+ * 用queueInLoop投递到目标loop执行，执行结果再打成一批queueInLoop投递回连接的loop。
+ * 回复的顺序靠每个连接的回复队列保证：前面还有没回来的回复时，后面本地执行的结果也先在队列里排队
+ * 同一个key总是在同一个分片上按投递的顺序执行，所以同一个连接对同一个key的命令不会乱序
+ * MGET/DEL的key可以分散在多个分片上，各个分片的部分结果都回来之后才拼成一个回复
+ *
+ * 过期：访问时检查(惰性删除)，另外每个分片每100ms扫描一部分哈希桶，删掉已经过期但是没人访问的key
+ * 分片和loop绑定，所以不能和TcpServer::enableRebalance一起使用
+ *
+ * 用法：respcache [-p 端口] [-t subLoop数]
+ * 试一下：redis-cli -p 6380 set foo bar；redis-benchmark -p 6380 -t get,set -P 16；或者example/respbench
+ */
+
+static const size_t kMaxArgs = 1024 * 1024;
+static const size_t kMaxBulkBytes = 64 * 1024 * 1024;
+static const size_t kMaxInlineBytes = 64 * 1024;
+static const int kMaxCommandsPerRead = 128;
+static const double kSweepInterval = 0.1;
+static const size_t kSweepBuckets = 1024;
+// 过期时间的上限，换算成微秒之后不会溢出
+static const int64_t kMaxExpireSeconds = 100LL * 365 * 24 * 3600;
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+// FNV-1a，只用来决定key属于哪个分片，和哈希表自己的哈希函数无关
+static uint64_t shardHash(const StringPiece &key)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static bool parseInt64(const StringPiece &s, int64_t *value)
+{
+    if (s.empty())
+    {
+        return false;
+    }
+    bool negative = s[0] == '-';
+    size_t digits = s.size() - negative;
+    // 最多18位，不会溢出
+    if (digits == 0 || digits > 18)
+    {
+        return false;
+    }
+    int64_t v = 0;
+    for (size_t i = negative ? 1 : 0; i < s.size(); ++i)
+    {
+        if (s[i] < '0' || s[i] > '9')
+        {
+            return false;
+        }
+        v = v * 10 + (s[i] - '0');
+    }
+    *value = negative ? -v : v;
+    return true;
+}
+
+// 回复的编码，Out是Buffer(直接写outputBuffer_)或者std::string(排队、跨线程的回复)
+template <typename Out>
+static void appendInteger(Out *out, char prefix, int64_t v)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "%c%lld\r\n", prefix, static_cast<long long>(v));
+    out->append(buf, n);
+}
+
+template <typename Out>
+static void appendBulk(Out *out, const StringPiece &value)
+{
+    appendInteger(out, '$', static_cast<int64_t>(value.size()));
+    out->append(value.data(), value.size());
+    out->append("\r\n", 2);
+}
+
+template <typename Out>
+static void appendNull(Out *out)
+{
+    out->append("$-1\r\n", 5);
+}
+
+template <typename Out>
+static void appendError(Out *out, const std::string &message)
+{
+    out->append("-ERR ", 5);
+    out->append(message.data(), message.size());
+    out->append("\r\n", 2);
+}
+
+/**
+ * 一个分片：一个loop独占的一部分键空间
+ */
+class Shard
+{
+public:
+    explicit Shard(EventLoop *loop) : loop_(loop), volatileKeys_(0), cursor_(0) {}
+
+    EventLoop *loop() const { return loop_; }
+    size_t size() const { return map_.size(); }
+
+    template <typename Out>
+    void get(const StringPiece &key, int64_t now, Out *out)
+    {
+        Map::iterator it = find(key, now);
+        if (it == map_.end())
+        {
+            appendNull(out);
+        }
+        else
+        {
+            appendBulk(out, it->second.value);
+        }
+    }
+
+    // expireAtUs为0表示不过期
+    void set(const StringPiece &key, const StringPiece &value, int64_t expireAtUs)
+    {
+        scratch_.assign(key.data(), key.size());
+        Entry &entry = map_[scratch_];
+        volatileKeys_ += (expireAtUs != 0) - (entry.expireAtUs != 0);
+        entry.value.assign(value.data(), value.size());
+        entry.expireAtUs = expireAtUs;
+    }
+
+    bool del(const StringPiece &key, int64_t now)
+    {
+        Map::iterator it = find(key, now);
+        if (it == map_.end())
+        {
+            return false;
+        }
+        erase(it);
+        return true;
+    }
+
+    // 不大于now的过期时间直接删除，和Redis一样
+    bool expire(const StringPiece &key, int64_t expireAtUs, int64_t now)
+    {
+        Map::iterator it = find(key, now);
+        if (it == map_.end())
+        {
+            return false;
+        }
+        if (expireAtUs <= now)
+        {
+            erase(it);
+            return true;
+        }
+        volatileKeys_ += it->second.expireAtUs == 0;
+        it->second.expireAtUs = expireAtUs;
+        return true;
+    }
+
+    // 每次从上次停下的位置接着扫描kSweepBuckets个桶
+    void sweep()
+    {
+        if (volatileKeys_ == 0 || map_.bucket_count() == 0)
+        {
+            return;
+        }
+        int64_t now = nowUs();
+        expired_.clear();
+        // 桶比kSweepBuckets少时一轮扫完，不能绕回来重复收集同一个key
+        size_t buckets = std::min(kSweepBuckets, map_.bucket_count());
+        for (size_t i = 0; i < buckets; ++i)
+        {
+            cursor_ = (cursor_ + 1) % map_.bucket_count();
+            for (Map::local_iterator it = map_.begin(cursor_); it != map_.end(cursor_); ++it)
+            {
+                if (it->second.expireAtUs != 0 && it->second.expireAtUs <= now)
+                {
+                    expired_.push_back(it->first);
+                }
+            }
+        }
+        for (const std::string &key : expired_)
+        {
+            erase(map_.find(key));
+        }
+    }
+
+private:
+    struct Entry
+    {
+        Entry() : expireAtUs(0) {}
+        std::string value;
+        int64_t expireAtUs;
+    };
+    using Map = std::unordered_map<std::string, Entry>;
+
+    // C++11的unordered_map不能直接用StringPiece查找，key先拷进一个复用的string，短key和复用的容量都不分配内存
+    Map::iterator find(const StringPiece &key, int64_t now)
+    {
+        scratch_.assign(key.data(), key.size());
+        Map::iterator it = map_.find(scratch_);
+        if (it != map_.end() && it->second.expireAtUs != 0 && it->second.expireAtUs <= now)
+        {
+            erase(it);
+            return map_.end();
+        }
+        return it;
+    }
+
+    void erase(Map::iterator it)
+    {
+        volatileKeys_ -= it->second.expireAtUs != 0;
+        map_.erase(it);
+    }
+
+    EventLoop *loop_;
+    Map map_;
+    size_t volatileKeys_;
+    size_t cursor_;
+    std::string scratch_;
+    std::vector<std::string> expired_;
+};
+
+enum Op
+{
+    kGet,
+    kSet,
+    kDel,
+    kExpire,
+    kMget,
+};
+
+// 投递到别的分片执行的一个命令(或者一个多key命令落在这个分片上的那部分)
+struct ForwardOp
+{
+    Op op;
+    uint64_t seq;                  // 回复在连接的回复队列中的序号
+    int64_t expireAtUs;            // SET/EXPIRE
+    std::vector<std::string> args; // key，SET时后面跟value
+    std::vector<uint32_t> positions; // MGET：每个key在原命令中的位置
+};
+
+// 分片执行的结果
+struct ReplyPart
+{
+    uint64_t seq;
+    std::string data;                // GET/SET/EXPIRE的完整回复
+    std::vector<uint32_t> positions; // MGET：元素在数组中的位置
+    std::vector<std::string> elements;
+    int64_t count;                   // DEL：删除的个数
+};
+
+struct ForwardBatch
+{
+    TcpConnectionPtr conn;
+    std::vector<ForwardOp> ops;
+};
+
+/**
+ * 每个连接的状态
+ * 回复队列中的回复按命令的顺序排列，partsLeft为0并且排到队首时才写进outputBuffer_
+ */
+struct Session
+{
+    enum Kind
+    {
+        kPlain,
+        kArray,
+        kSum,
+    };
+
+    struct PendingReply
+    {
+        Kind kind;
+        int partsLeft;
+        std::string data;
+        std::vector<std::string> elements;
+        int64_t sum;
+    };
+
+    Session(size_t localShard, size_t numShards)
+        : localShard(localShard), firstSeq(0), outgoing(numShards), closing(false) {}
+
+    PendingReply &push(Kind kind, int parts)
+    {
+        pending.emplace_back();
+        PendingReply &reply = pending.back();
+        reply.kind = kind;
+        reply.partsLeft = parts;
+        reply.sum = 0;
+        return reply;
+    }
+    uint64_t lastSeq() const { return firstSeq + pending.size() - 1; }
+    PendingReply &at(uint64_t seq) { return pending[seq - firstSeq]; }
+
+    const size_t localShard;
+    std::vector<StringPiece> args; // 当前命令的参数，指向inputBuffer_，反复使用
+    std::deque<PendingReply> pending;
+    uint64_t firstSeq; // pending.front()的序号
+    // 这一轮要投递给各个分片的命令，onMessage结束时统一投递
+    std::vector<std::shared_ptr<ForwardBatch>> outgoing;
+    bool closing; // 出现协议错误，回复完错误之后关闭，之后收到的数据都丢弃
+};
+
+class CacheServer
+{
+public:
+    CacheServer(EventLoop *loop, const InetAddress &addr, int threads)
+        : server_(loop, addr, "respcache")
+    {
+        server_.setThreadNum(threads);
+        server_.setWriteBatching(true);
+        server_.setConnectionCallback(std::bind(&CacheServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(std::bind(&CacheServer::onMessage, this, std::placeholders::_1,
+                                             std::placeholders::_2, std::placeholders::_3));
+    }
+
+    void start()
+    {
+        server_.start();
+        // 没有subLoop时只有baseLoop一个分片
+        for (EventLoop *loop : server_.threadPool()->getAllLoops())
+        {
+            shards_.emplace_back(new Shard(loop));
+        }
+        for (std::unique_ptr<Shard> &shard : shards_)
+        {
+            Shard *s = shard.get();
+            s->loop()->runInLoop([s]() { s->loop()->runEvery(kSweepInterval, [s]() { s->sweep(); }); });
+        }
+        LOG_INFO("respcache: %zu shards", shards_.size());
+    }
+
+private:
+    size_t shardOf(const StringPiece &key) const { return shardHash(key) % shards_.size(); }
+
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (!conn->connected())
+        {
+            return;
+        }
+        conn->setTcpNoDelay(true);
+        size_t local = 0;
+        while (shards_[local]->loop() != conn->getLoop())
+        {
+            ++local;
+        }
+        conn->setContext(std::make_shared<Session>(local, shards_.size()));
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        Session *session = static_cast<Session *>(conn->getContext().get());
+        if (session->closing)
+        {
+            buf->retrieveAll();
+            return;
+        }
+        for (int handled = 0;; ++handled)
+        {
+            if (handled >= kMaxCommandsPerRead && buf->readableBytes() > 0)
+            {
+                conn->yieldRead();
+                break;
+            }
+            size_t consumed = 0;
+            const char *error = nullptr;
+            int result = parseCommand(buf->peek(), buf->peek() + buf->readableBytes(), &session->args, &consumed, &error);
+            if (result == 0)
+            {
+                break;
+            }
+            if (result < 0)
+            {
+                // 协议错误之后找不到下一个命令的边界，回复错误之后关闭连接
+                replyLocal(conn, session, [error](std::string *out) { appendError(out, error); },
+                           [error](Buffer *out) { appendError(out, error); });
+                buf->retrieveAll();
+                session->closing = true;
+                break;
+            }
+            if (!session->args.empty())
+            {
+                execute(conn, session);
+            }
+            buf->retrieve(consumed);
+        }
+        postOutgoing(session);
+        conn->sendOutputBuffer();
+        if (session->closing && session->pending.empty())
+        {
+            // 批量写模式下shutdown会等outputBuffer_写完再关闭写端
+            conn->shutdown();
+        }
+    }
+
+    /**
+     * 解析buf开头的一个命令，完整时返回1，数据不够返回0，格式错误返回-1
+     * 参数指向buf本身；每次都从命令的开头重新解析，只扫描长度行，不扫描批量数据的内容
+     */
+    static int parseCommand(const char *begin, const char *end, std::vector<StringPiece> *args,
+                            size_t *consumed, const char **error)
+    {
+        args->clear();
+        if (begin == end)
+        {
+            return 0;
+        }
+        if (*begin != '*')
+        {
+            // telnet式的单行命令，参数用空格分开
+            const char *eol = static_cast<const char *>(memchr(begin, '\n', end - begin));
+            if (eol == nullptr)
+            {
+                if (static_cast<size_t>(end - begin) > kMaxInlineBytes)
+                {
+                    *error = "Protocol error: too big inline request";
+                    return -1;
+                }
+                return 0;
+            }
+            const char *lineEnd = eol > begin && eol[-1] == '\r' ? eol - 1 : eol;
+            for (const char *p = begin; p < lineEnd;)
+            {
+                while (p < lineEnd && *p == ' ')
+                {
+                    ++p;
+                }
+                const char *start = p;
+                while (p < lineEnd && *p != ' ')
+                {
+                    ++p;
+                }
+                if (p > start)
+                {
+                    args->push_back(StringPiece(start, p - start));
+                }
+            }
+            *consumed = eol + 1 - begin;
+            return 1;
+        }
+
+        const char *p = begin;
+        int64_t count;
+        int result = parseLength(&p, end, '*', kMaxArgs, &count, error);
+        if (result <= 0)
+        {
+            return result;
+        }
+        for (int64_t i = 0; i < count; ++i)
+        {
+            int64_t len;
+            result = parseLength(&p, end, '$', kMaxBulkBytes, &len, error);
+            if (result <= 0)
+            {
+                return result;
+            }
+            if (end - p < len + 2)
+            {
+                return 0;
+            }
+            if (p[len] != '\r' || p[len + 1] != '\n')
+            {
+                *error = "Protocol error: bad bulk string";
+                return -1;
+            }
+            args->push_back(StringPiece(p, static_cast<size_t>(len)));
+            p += len + 2;
+        }
+        *consumed = p - begin;
+        return 1;
+    }
+
+    // 解析一个"<prefix><数字>\r\n"的长度行
+    static int parseLength(const char **p, const char *end, char prefix, size_t max, int64_t *value,
+                           const char **error)
+    {
+        const char *cr = static_cast<const char *>(memchr(*p, '\r', std::min<size_t>(end - *p, 32)));
+        if (cr == nullptr || cr + 1 == end)
+        {
+            if (end - *p >= 32)
+            {
+                *error = "Protocol error: bad length";
+                return -1;
+            }
+            return 0;
+        }
+        if (**p != prefix || cr[1] != '\n' || !parseInt64(StringPiece(*p + 1, cr - *p - 1), value) ||
+            *value < (prefix == '*' ? -1 : 0) || *value > static_cast<int64_t>(max))
+        {
+            *error = "Protocol error: bad length";
+            return -1;
+        }
+        // "*-1"当作没有参数
+        if (*value < 0)
+        {
+            *value = 0;
+        }
+        *p = cr + 2;
+        return 1;
+    }
+
+    /**
+     * 前面没有排队的回复时本地执行的结果直接写进outputBuffer_，否则排进回复队列
+     * 两种目标的类型不同，所以传两个生成回复的函数
+     */
+    template <typename ToString, typename ToBuffer>
+    void replyLocal(const TcpConnectionPtr &conn, Session *session, const ToString &toString,
+                    const ToBuffer &toBuffer)
+    {
+        if (session->pending.empty())
+        {
+            toBuffer(conn->outputBuffer());
+        }
+        else
+        {
+            toString(&session->push(Session::kPlain, 0).data);
+        }
+    }
+
+    void execute(const TcpConnectionPtr &conn, Session *session)
+    {
+        const std::vector<StringPiece> &args = session->args;
+        const StringPiece &name = args[0];
+        if (name.equalsIgnoreCase("GET"))
+        {
+            if (args.size() != 2)
+            {
+                wrongArity(conn, session, "get");
+                return;
+            }
+            routeSingle(conn, session, kGet, 0);
+        }
+        else if (name.equalsIgnoreCase("SET"))
+        {
+            int64_t expireAtUs = 0;
+            if (args.size() != 3 && args.size() != 5)
+            {
+                wrongArity(conn, session, "set");
+                return;
+            }
+            if (args.size() == 5)
+            {
+                int64_t amount;
+                bool seconds = args[3].equalsIgnoreCase("EX");
+                if ((!seconds && !args[3].equalsIgnoreCase("PX")) || !parseInt64(args[4], &amount) || amount <= 0 ||
+                    amount / (seconds ? 1 : 1000) > kMaxExpireSeconds)
+                {
+                    error(conn, session, "syntax error or invalid expire time");
+                    return;
+                }
+                expireAtUs = nowUs() + amount * (seconds ? 1000000 : 1000);
+            }
+            routeSingle(conn, session, kSet, expireAtUs);
+        }
+        else if (name.equalsIgnoreCase("EXPIRE"))
+        {
+            int64_t seconds;
+            if (args.size() != 3)
+            {
+                wrongArity(conn, session, "expire");
+                return;
+            }
+            if (!parseInt64(args[2], &seconds) || seconds > kMaxExpireSeconds || seconds < -kMaxExpireSeconds)
+            {
+                error(conn, session, "value is not an integer or out of range");
+                return;
+            }
+            routeSingle(conn, session, kExpire, nowUs() + seconds * 1000000);
+        }
+        else if (name.equalsIgnoreCase("DEL") || name.equalsIgnoreCase("MGET"))
+        {
+            if (args.size() < 2)
+            {
+                wrongArity(conn, session, name.equalsIgnoreCase("DEL") ? "del" : "mget");
+                return;
+            }
+            routeMulti(conn, session, name.equalsIgnoreCase("DEL") ? kDel : kMget);
+        }
+        else if (name.equalsIgnoreCase("PING"))
+        {
+            if (args.size() > 2)
+            {
+                wrongArity(conn, session, "ping");
+                return;
+            }
+            StringPiece message = args.size() == 2 ? args[1] : StringPiece();
+            if (args.size() == 2)
+            {
+                replyLocal(conn, session, [&message](std::string *out) { appendBulk(out, message); },
+                           [&message](Buffer *out) { appendBulk(out, message); });
+            }
+            else
+            {
+                replyLocal(conn, session, [](std::string *out) { out->append("+PONG\r\n", 7); },
+                           [](Buffer *out) { out->append("+PONG\r\n", 7); });
+            }
+        }
+        else if (name.equalsIgnoreCase("CONFIG"))
+        {
+            // redis-benchmark启动时会读save和appendonly两个配置，这里没有配置，回复空数组
+            replyLocal(conn, session, [](std::string *out) { out->append("*0\r\n", 4); },
+                       [](Buffer *out) { out->append("*0\r\n", 4); });
+        }
+        else
+        {
+            error(conn, session, "unknown command '" + name.toString() + "'");
+        }
+    }
+
+    void error(const TcpConnectionPtr &conn, Session *session, const std::string &message)
+    {
+        replyLocal(conn, session, [&message](std::string *out) { appendError(out, message); },
+                   [&message](Buffer *out) { appendError(out, message); });
+    }
+
+    void wrongArity(const TcpConnectionPtr &conn, Session *session, const char *command)
+    {
+        error(conn, session, std::string("wrong number of arguments for '") + command + "' command");
+    }
+
+    // 在shard上执行单key命令，回复写进out
+    template <typename Out>
+    static void executeSingle(Shard *shard, Op op, const StringPiece &key, const StringPiece &value,
+                              int64_t expireAtUs, int64_t now, Out *out)
+    {
+        switch (op)
+        {
+        case kGet:
+            shard->get(key, now, out);
+            break;
+        case kSet:
+            shard->set(key, value, expireAtUs);
+            out->append("+OK\r\n", 5);
+            break;
+        case kExpire:
+            appendInteger(out, ':', shard->expire(key, expireAtUs, now) ? 1 : 0);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // GET/SET/EXPIRE：key属于本地分片时直接执行，否则投递给目标分片
+    void routeSingle(const TcpConnectionPtr &conn, Session *session, Op op, int64_t expireAtUs)
+    {
+        const std::vector<StringPiece> &args = session->args;
+        const StringPiece &key = args[1];
+        StringPiece value = op == kSet ? args[2] : StringPiece();
+        size_t target = shardOf(key);
+        if (target == session->localShard)
+        {
+            Shard *shard = shards_[target].get();
+            int64_t now = nowUs();
+            replyLocal(conn, session,
+                       [&](std::string *out) { executeSingle(shard, op, key, value, expireAtUs, now, out); },
+                       [&](Buffer *out) { executeSingle(shard, op, key, value, expireAtUs, now, out); });
+            return;
+        }
+        session->push(Session::kPlain, 1);
+        ForwardOp &forward = outgoingOp(conn, session, target, op);
+        forward.expireAtUs = expireAtUs;
+        forward.args.emplace_back(key.data(), key.size());
+        if (op == kSet)
+        {
+            forward.args.emplace_back(value.data(), value.size());
+        }
+    }
+
+    /**
+     * DEL/MGET：key按分片分组，本地分片的部分立即执行，其它分片的部分各自投递
+     * 回复总是先在队列里占一个位置，所有部分都完成之后再拼起来
+     */
+    void routeMulti(const TcpConnectionPtr &conn, Session *session, Op op)
+    {
+        const std::vector<StringPiece> &args = session->args;
+        size_t numKeys = args.size() - 1;
+        // 所有key都在本地分片时(单个key、或者只有一个loop)不必排队
+        bool allLocal = true;
+        for (size_t i = 1; i < args.size() && allLocal; ++i)
+        {
+            allLocal = shardOf(args[i]) == session->localShard;
+        }
+        Shard *local = shards_[session->localShard].get();
+        int64_t now = nowUs();
+        if (allLocal)
+        {
+            if (op == kDel)
+            {
+                int64_t deleted = 0;
+                for (size_t i = 1; i < args.size(); ++i)
+                {
+                    deleted += local->del(args[i], now);
+                }
+                replyLocal(conn, session, [deleted](std::string *out) { appendInteger(out, ':', deleted); },
+                           [deleted](Buffer *out) { appendInteger(out, ':', deleted); });
+            }
+            else
+            {
+                replyLocal(conn, session,
+                           [&](std::string *out) {
+                               appendInteger(out, '*', static_cast<int64_t>(numKeys));
+                               for (size_t i = 1; i < args.size(); ++i)
+                               {
+                                   local->get(args[i], now, out);
+                               }
+                           },
+                           [&](Buffer *out) {
+                               appendInteger(out, '*', static_cast<int64_t>(numKeys));
+                               for (size_t i = 1; i < args.size(); ++i)
+                               {
+                                   local->get(args[i], now, out);
+                               }
+                           });
+            }
+            return;
+        }
+
+        Session::PendingReply &reply = session->push(op == kDel ? Session::kSum : Session::kArray, 0);
+        if (op == kMget)
+        {
+            reply.elements.resize(numKeys);
+        }
+        // 每个分片在这个命令中最多占一个ForwardOp
+        std::vector<ForwardOp *> parts(shards_.size(), nullptr);
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            size_t target = shardOf(args[i]);
+            if (target == session->localShard)
+            {
+                if (op == kDel)
+                {
+                    reply.sum += local->del(args[i], now);
+                }
+                else
+                {
+                    local->get(args[i], now, &reply.elements[i - 1]);
+                }
+                continue;
+            }
+            if (parts[target] == nullptr)
+            {
+                parts[target] = &outgoingOp(conn, session, target, op);
+                ++reply.partsLeft;
+            }
+            parts[target]->args.emplace_back(args[i].data(), args[i].size());
+            parts[target]->positions.push_back(static_cast<uint32_t>(i - 1));
+        }
+    }
+
+    // 在这一轮投递给target的批次中追加一个命令，回复的序号是回复队列的最后一个
+    ForwardOp &outgoingOp(const TcpConnectionPtr &conn, Session *session, size_t target, Op op)
+    {
+        std::shared_ptr<ForwardBatch> &batch = session->outgoing[target];
+        if (!batch)
+        {
+            batch = std::make_shared<ForwardBatch>();
+            batch->conn = conn;
+        }
+        batch->ops.emplace_back();
+        ForwardOp &forward = batch->ops.back();
+        forward.op = op;
+        forward.seq = session->lastSeq();
+        forward.expireAtUs = 0;
+        return forward;
+    }
+
+    // 每个目标分片一次queueInLoop
+    void postOutgoing(Session *session)
+    {
+        for (size_t i = 0; i < session->outgoing.size(); ++i)
+        {
+            std::shared_ptr<ForwardBatch> batch;
+            batch.swap(session->outgoing[i]);
+            if (batch)
+            {
+                Shard *shard = shards_[i].get();
+                shard->loop()->queueInLoop([shard, batch]() { runBatch(shard, batch); });
+            }
+        }
+    }
+
+    // 在目标分片的loop线程中执行一批命令，结果一次投递回连接的loop
+    static void runBatch(Shard *shard, const std::shared_ptr<ForwardBatch> &batch)
+    {
+        std::shared_ptr<std::vector<ReplyPart>> replies = std::make_shared<std::vector<ReplyPart>>(batch->ops.size());
+        int64_t now = nowUs();
+        for (size_t i = 0; i < batch->ops.size(); ++i)
+        {
+            ForwardOp &op = batch->ops[i];
+            ReplyPart &part = (*replies)[i];
+            part.seq = op.seq;
+            part.count = 0;
+            switch (op.op)
+            {
+            case kDel:
+                for (const std::string &key : op.args)
+                {
+                    part.count += shard->del(key, now);
+                }
+                break;
+            case kMget:
+                part.positions.swap(op.positions);
+                part.elements.resize(op.args.size());
+                for (size_t k = 0; k < op.args.size(); ++k)
+                {
+                    shard->get(op.args[k], now, &part.elements[k]);
+                }
+                break;
+            default:
+                executeSingle(shard, op.op, op.args[0], op.op == kSet ? StringPiece(op.args[1]) : StringPiece(),
+                              op.expireAtUs, now, &part.data);
+                break;
+            }
+        }
+        TcpConnectionPtr conn = batch->conn;
+        conn->getLoop()->queueInLoop([conn, replies]() { deliver(conn, *replies); });
+    }
+
+    // 回到连接的loop线程，把各部分结果填进回复队列，队首已经完成的回复写进outputBuffer_
+    static void deliver(const TcpConnectionPtr &conn, std::vector<ReplyPart> &replies)
+    {
+        Session *session = static_cast<Session *>(conn->getContext().get());
+        if (!conn->connected() || session == nullptr)
+        {
+            return;
+        }
+        for (ReplyPart &part : replies)
+        {
+            Session::PendingReply &reply = session->at(part.seq);
+            switch (reply.kind)
+            {
+            case Session::kPlain:
+                reply.data.swap(part.data);
+                break;
+            case Session::kSum:
+                reply.sum += part.count;
+                break;
+            case Session::kArray:
+                for (size_t k = 0; k < part.positions.size(); ++k)
+                {
+                    reply.elements[part.positions[k]].swap(part.elements[k]);
+                }
+                break;
+            }
+            --reply.partsLeft;
+        }
+
+        Buffer *output = conn->outputBuffer();
+        while (!session->pending.empty() && session->pending.front().partsLeft == 0)
+        {
+            Session::PendingReply &reply = session->pending.front();
+            switch (reply.kind)
+            {
+            case Session::kPlain:
+                output->append(reply.data.data(), reply.data.size());
+                break;
+            case Session::kSum:
+                appendInteger(output, ':', reply.sum);
+                break;
+            case Session::kArray:
+                appendInteger(output, '*', static_cast<int64_t>(reply.elements.size()));
+                for (const std::string &element : reply.elements)
+                {
+                    output->append(element.data(), element.size());
+                }
+                break;
+            }
+            session->pending.pop_front();
+            ++session->firstSeq;
+        }
+        conn->sendOutputBuffer();
+        if (session->closing && session->pending.empty())
+        {
+            conn->shutdown();
+        }
+    }
+
+    // 下标和threadPool()->getAllLoops()一致，start之后不再变化
+    std::vector<std::unique_ptr<Shard>> shards_;
+    TcpServer server_;
+};
+
+int main(int argc, char *argv[])
+{
+    int port = 6380;
+    int threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-t threads]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    CacheServer server(&loop, InetAddress(static_cast<uint16_t>(port), "0.0.0.0"), threads);
+    server.start();
+    loop.loop();
+    return 0;
+}
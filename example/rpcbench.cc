@@ -0,0 +1,283 @@
+#include "../RpcServer.h"
+#include "../RpcClient.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+#include "countingalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * RpcServer/RpcClient的压测和行为检查
+ *
+ * 服务端跑在EventLoopThread里(-t大于0时再加subLoop)，c个RpcClient都在主线程的loop中，
+ * 每个客户端保持n个在途的echo调用(s字节的载荷)，一个响应回来立即发起下一个，
+ * 输出每秒调用数，以及计时期间平均每次调用(客户端加服务端)的内存分配次数
+ *
+ * 压测之前先检查几种行为：
+ * 乱序响应：异步方法按请求里的毫秒数延迟回复，先发的30ms请求应该最后回来
+ * 期限：一个永远不回复的方法，50ms期限的调用应该在期限之后一个tick左右得到kRpcDeadlineExceeded
+ * 类型化的方法、不存在的方法、解码失败的请求、从别的线程发起的调用
+ *
+ * 分配次数由countingalloc.h统计，包括所有线程
+ *
+ * 用法：rpcbench [-c 客户端数] [-n 每个客户端在途的调用数] [-s 载荷字节数] [-d 秒数] [-t 服务端subLoop数] [-p 端口]
+ */
+
+enum Method
+{
+    kEcho = 1,
+    kAdd = 2,
+    kDelayedEcho = 3, // 异步，载荷是延迟的毫秒数
+    kBlackHole = 4,   // 异步，永远不回复
+};
+
+struct AddRequest
+{
+    int64_t a;
+    int64_t b;
+
+    void encode(RpcWriter *writer) const
+    {
+        RpcSerializer<int64_t>::encode(a, writer);
+        RpcSerializer<int64_t>::encode(b, writer);
+    }
+    bool decode(RpcReader *reader)
+    {
+        return RpcSerializer<int64_t>::decode(reader, &a) && RpcSerializer<int64_t>::decode(reader, &b);
+    }
+};
+
+// 每个客户端的压测状态，回调只捕获这一个指针，放得进std::function自己的空间
+struct Caller
+{
+    RpcClient *client;
+    const std::string *payload;
+    bool *running;
+    int64_t *completed;
+    int64_t *errors;
+};
+
+static void issue(Caller *caller);
+
+static void onEchoResponse(Caller *caller, RpcStatus status, const StringPiece &payload)
+{
+    if (status != kRpcOk || payload.size() != caller->payload->size())
+    {
+        ++*caller->errors;
+    }
+    ++*caller->completed;
+    if (*caller->running)
+    {
+        issue(caller);
+    }
+}
+
+static void issue(Caller *caller)
+{
+    caller->client->call(kEcho, *caller->payload, 1.0, [caller](RpcStatus status, const StringPiece &payload) {
+        onEchoResponse(caller, status, payload);
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    int clients = 4;
+    int depth = 16;
+    size_t size = 64;
+    double seconds = 5;
+    int threads = 0;
+    int port = 9994;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:s:d:t:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            clients = atoi(optarg);
+            break;
+        case 'n':
+            depth = atoi(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c clients] [-n depth] [-s size] [-d seconds] [-t threads] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    InetAddress addr(static_cast<uint16_t>(port));
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<RpcServer> server;
+    std::promise<void> listening;
+    serverLoop->runInLoop([&]() {
+        server.reset(new RpcServer(serverLoop, addr, "rpcbench"));
+        server->setThreadNum(threads);
+        server->registerMethod(kEcho, [](const RpcRequest &request, RpcWriter *response) {
+            response->writeRaw(request.payload());
+            return kRpcOk;
+        });
+        server->registerMethod<AddRequest, int64_t>(kAdd, [](const AddRequest &request, int64_t *sum) {
+            *sum = request.a + request.b;
+            return kRpcOk;
+        });
+        // 定时器放在baseLoop上，-t大于0时连接在subLoop上，回复就是跨线程的
+        server->registerAsyncMethod(kDelayedEcho, [serverLoop](const RpcRequest &request, const RpcResponder &responder) {
+            uint32_t delayMs;
+            if (!request.decode(&delayMs))
+            {
+                responder.respond(kRpcBadRequest);
+                return;
+            }
+            serverLoop->runAfter(delayMs / 1000.0, [responder, delayMs]() {
+                responder.respondValue(kRpcOk, delayMs);
+            });
+        });
+        server->registerAsyncMethod(kBlackHole, [](const RpcRequest &, const RpcResponder &) {});
+        server->start();
+        listening.set_value();
+    });
+    listening.get_future().wait();
+
+    EventLoop loop;
+    const std::string payload(size, 'x');
+    bool running = false;
+    int64_t completed = 0;
+    int64_t errors = 0;
+    int connected = 0;
+    int checksFailed = 0;
+    std::vector<std::unique_ptr<RpcClient>> rpcClients;
+    std::vector<Caller> callers(clients);
+
+    auto check = [&](bool ok, const char *what) {
+        printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+        if (!ok)
+        {
+            ++checksFailed;
+        }
+    };
+
+    auto startBench = [&]() {
+        running = true;
+        for (Caller &caller : callers)
+        {
+            for (int i = 0; i < depth; ++i)
+            {
+                issue(&caller);
+            }
+        }
+        // 预热1秒之后开始计时
+        loop.runAfter(1.0, [&]() {
+            int64_t startCompleted = completed;
+            long startAllocations = allocations.load();
+            int64_t startUs = Timestamp::now().microSecondsSinceEpoch();
+            loop.runAfter(seconds, [&, startCompleted, startAllocations, startUs]() {
+                double elapsed = (Timestamp::now().microSecondsSinceEpoch() - startUs) / 1e6;
+                int64_t calls = completed - startCompleted;
+                long allocated = allocations.load() - startAllocations;
+                running = false;
+                printf("%d clients x %d in flight, %zu-byte payload, server subLoops %d\n", clients, depth, size, threads);
+                printf("%lld calls in %.2fs: %.0f calls/s, %.3f allocations/call, %lld errors\n",
+                       (long long)calls, elapsed, calls / elapsed,
+                       calls ? static_cast<double>(allocated) / calls : 0.0, (long long)errors);
+                // 等在途的调用都回来
+                loop.runAfter(0.2, [&]() { loop.quit(); });
+            });
+        });
+    };
+
+    auto runChecks = [&]() {
+        RpcClient *client = rpcClients[0].get();
+        struct Checks
+        {
+            std::vector<uint32_t> order;
+            int64_t deadlineStartUs = 0;
+        };
+        std::shared_ptr<Checks> checks = std::make_shared<Checks>();
+
+        // 乱序响应：30、20、10ms依次发出，应该按10、20、30回来
+        for (uint32_t delayMs : {30u, 20u, 10u})
+        {
+            client->callValue(kDelayedEcho, delayMs, 1.0, [checks](RpcStatus status, const StringPiece &payload) {
+                uint32_t value = 0;
+                if (status == kRpcOk && rpcDecode(payload, &value))
+                {
+                    checks->order.push_back(value);
+                }
+            });
+        }
+        client->callValue(kAdd, AddRequest{40, 2}, 1.0, [&check](RpcStatus status, const StringPiece &payload) {
+            int64_t sum = 0;
+            check(status == kRpcOk && rpcDecode(payload, &sum) && sum == 42, "typed method add(40, 2) == 42");
+        });
+        client->call(kAdd, "\xff", 1.0, [&check](RpcStatus status, const StringPiece &) {
+            check(status == kRpcBadRequest, "undecodable request -> bad request");
+        });
+        client->call(99, "", 1.0, [&check](RpcStatus status, const StringPiece &) {
+            check(status == kRpcNoSuchMethod, "unknown method -> no such method");
+        });
+        checks->deadlineStartUs = Timestamp::now().microSecondsSinceEpoch();
+        client->call(kBlackHole, "", 0.05, [&check, checks](RpcStatus status, const StringPiece &) {
+            int64_t elapsedUs = Timestamp::now().microSecondsSinceEpoch() - checks->deadlineStartUs;
+            char what[128];
+            snprintf(what, sizeof what, "unanswered call -> deadline exceeded after %.1f ms (50 ms)", elapsedUs / 1000.0);
+            check(status == kRpcDeadlineExceeded && elapsedUs >= 50000 && elapsedUs < 50000 + 20000, what);
+        });
+        // 从别的线程发起调用，回调仍然在客户端的loop线程中执行
+        serverLoop->runInLoop([&, client]() {
+            client->call(kEcho, "hello", 1.0, [&](RpcStatus status, const StringPiece &payload) {
+                check(status == kRpcOk && payload == "hello" && loop.isInLoopThread(), "call from another thread");
+            });
+        });
+        loop.runAfter(0.2, [&, checks]() {
+            check(checks->order == std::vector<uint32_t>({10, 20, 30}), "async responses out of order (10, 20, 30 ms)");
+            check(rpcClients[0]->pendingCalls() == 0, "no pending calls left");
+            startBench();
+        });
+    };
+
+    for (int i = 0; i < clients; ++i)
+    {
+        RpcClient *client = new RpcClient(&loop, addr, "rpcbench-client");
+        rpcClients.push_back(std::unique_ptr<RpcClient>(client));
+        callers[i] = Caller{client, &payload, &running, &completed, &errors};
+        client->setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            if (conn->connected() && ++connected == clients)
+            {
+                runChecks();
+            }
+        });
+        client->connect();
+    }
+    loop.loop();
+
+    rpcClients.clear();
+    std::promise<void> destroyed;
+    serverLoop->runInLoop([&]() {
+        server.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().wait();
+    return checksFailed == 0 && errors == 0 ? 0 : 1;
+}
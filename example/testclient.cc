@@ -0,0 +1,78 @@
+#include "../TcpClient.h"
+#include "../Logger.h"
+
+#include <string>
+#include <functional>
+
+/**
+ * testserver的客户端：连接127.0.0.1:8000，每秒发送一行，打印回显
+ * testserver回显之后就会关闭连接，开启了enableRetry的TcpClient会自动重新连接；
+ * 先启动testclient再启动testserver，可以看到Connector按退避时间不断重试
+ */
+class EchoClient
+{
+public:
+    EchoClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &name)
+        : loop_(loop), client_(loop, serverAddr, name)
+    {
+        client_.setConnectionCallback(
+            std::bind(&EchoClient::onConnection, this, std::placeholders::_1));
+
+        client_.setMessageCallback(
+            std::bind(&EchoClient::onMessage, this,
+                      std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+
+        // 连接断开之后自动重连，连接失败时从200毫秒开始退避，最长5秒
+        client_.enableRetry();
+        client_.setRetryDelay(200, 5000);
+    }
+
+    void connect()
+    {
+        client_.connect();
+        // 定时器回调在loop线程中执行
+        loop_->runEvery(1.0, std::bind(&EchoClient::onTimer, this));
+    }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            LOG_INFO("Connection UP : %s", conn->peerAddress().toIpPort().c_str());
+        }
+        else
+        {
+            LOG_INFO("Connection DOWN : %s", conn->peerAddress().toIpPort().c_str());
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time)
+    {
+        std::string msg = buf->retrieveAllAsString();
+        LOG_INFO("echo : %s", msg.c_str());
+    }
+
+    void onTimer()
+    {
+        TcpConnectionPtr conn = client_.connection();
+        if (conn && conn->connected())
+        {
+            conn->send("hello " + Timestamp::now().toString() + "\n");
+        }
+    }
+
+    EventLoop *loop_;
+    TcpClient client_;
+};
+
+int main()
+{
+    EventLoop loop;
+    InetAddress serverAddr(8000);
+    EchoClient client(&loop, serverAddr, "EchoClient-01");
+    client.connect();
+    loop.loop();
+
+    return 0;
+}
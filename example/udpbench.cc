@@ -0,0 +1,142 @@
+#include "../UdpServer.h"
+#include "../Logger.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/**
+ * UdpServer收小数据报：每次recvmmsg收1个 和 一次收一批 的对比
+ *
+ * 发送线程用sendmmsg尽可能快地往UdpServer发固定大小的数据报，持续d秒，
+ * UdpServer只统计收到的数据报个数，输出每秒收到的数据报数和丢包(内核接收队列满了丢掉的)比例
+ * 单核机器上发送线程和loop线程抢同一个CPU，收得越省，留给发送的时间越多，两个数都要看
+ *
+ * 用法：udpbench [-b recvmmsg批大小] [-d 秒数] [-s 数据报字节数] [-t loop线程数] [-p 端口]
+ * -t 大于0时每个loop一个SO_REUSEPORT的socket，同时用t个发送线程(源端口不同，内核按四元组分到不同socket)
+ */
+
+int main(int argc, char *argv[])
+{
+    int batchSize = 64;
+    double seconds = 3;
+    int size = 64;
+    int threads = 0;
+    int port = 9992;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:d:s:t:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            batchSize = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b batch] [-d seconds] [-s size] [-t threads] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    InetAddress listenAddr(static_cast<uint16_t>(port));
+    UdpServer server(&loop, listenAddr, "udpbench",
+                     threads > 0 ? UdpServer::kReusePortPerLoop : UdpServer::kSingleSocket);
+    server.setThreadNum(threads);
+    server.setBatchSize(batchSize);
+    server.setReceiveBufferSize(4 * 1024 * 1024);
+    std::atomic<uint64_t> received(0);
+    server.setDatagramCallback([&](UdpSocket *, const Datagram *, size_t count, Timestamp) {
+        received.fetch_add(count, std::memory_order_relaxed);
+    });
+    server.start();
+
+    const int senders = threads > 0 ? threads : 1;
+    std::atomic<uint64_t> sent(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> senderThreads;
+    for (int i = 0; i < senders; ++i)
+    {
+        senderThreads.emplace_back([&]() {
+            int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof addr);
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(port));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            ::connect(fd, (sockaddr *)&addr, sizeof addr);
+
+            const int kBatch = 64;
+            std::vector<char> payload(size, 'x');
+            iovec iov[kBatch];
+            mmsghdr messages[kBatch];
+            memset(messages, 0, sizeof messages);
+            for (int j = 0; j < kBatch; ++j)
+            {
+                iov[j].iov_base = payload.data();
+                iov[j].iov_len = payload.size();
+                messages[j].msg_hdr.msg_iov = &iov[j];
+                messages[j].msg_hdr.msg_iovlen = 1;
+            }
+            uint64_t count = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                int n = ::sendmmsg(fd, messages, kBatch, 0);
+                if (n > 0)
+                {
+                    count += n;
+                }
+            }
+            sent.fetch_add(count);
+            ::close(fd);
+        });
+    }
+
+    // 等发送线程跑起来之后开始计数
+    uint64_t startReceived = 0;
+    uint64_t startDropped = 0;
+    auto start = std::chrono::steady_clock::now();
+    loop.runAfter(0.2, [&]() {
+        startReceived = received.load();
+        startDropped = server.droppedDatagrams();
+        start = std::chrono::steady_clock::now();
+    });
+    loop.runAfter(0.2 + seconds, [&]() {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t got = received.load() - startReceived;
+        stop = true;
+        for (std::thread &t : senderThreads)
+        {
+            t.join();
+        }
+        printf("recvmmsg batch %d, %d-byte datagrams, %s\n", batchSize, size,
+               threads > 0 ? "SO_REUSEPORT socket per loop" : "single socket");
+        printf("received %.0f datagrams/s, %.1f%% of sent, %llu truncated/dropped by server\n",
+               got / elapsed, sent.load() ? 100.0 * received.load() / sent.load() : 0.0,
+               static_cast<unsigned long long>(server.droppedDatagrams() - startDropped));
+        loop.quit();
+    });
+
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "../TcpServer.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+
+/**
+ * 同一台机器上的进程间通信：TCP回环地址 和 Unix域socket 的对比
+ *
+ * 回显TcpServer跑在一个EventLoopThread中，客户端是一个阻塞socket，一问一答地发n个s字节的消息，
+ * 输出每秒往返次数和平均往返时间。两种模式下服务端代码完全一样，只是监听地址不同
+ *
+ * 用法：unixbench [-n 往返次数] [-s 消息字节数] [-p 端口] [-u]
+ * -u 监听Unix域地址(抽象命名空间"@unixbench")，默认监听127.0.0.1
+ */
+
+int main(int argc, char *argv[])
+{
+    int count = 100000;
+    int size = 64;
+    int port = 9993;
+    bool unixDomain = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:p:u")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'u':
+            unixDomain = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n roundtrips] [-s size] [-p port] [-u]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    InetAddress listenAddr = unixDomain ? InetAddress::unixDomain("@unixbench")
+                                        : InetAddress(static_cast<uint16_t>(port));
+
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<TcpServer> server;
+    std::promise<void> listening;
+    serverLoop->runInLoop([&]() {
+        server.reset(new TcpServer(serverLoop, listenAddr, "unixbench"));
+        server->setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+            }
+        });
+        server->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf->retrieveAllAsString());
+        });
+        server->start();
+        listening.set_value();
+    });
+    listening.get_future().wait();
+
+    int fd = ::socket(listenAddr.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(fd, listenAddr.getSockAddr(), listenAddr.getSockLen()) != 0)
+    {
+        perror("connect");
+        return 1;
+    }
+    if (!unixDomain)
+    {
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    }
+
+    std::string message(size, 'x');
+    std::string reply(size, '\0');
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        if (::send(fd, message.data(), message.size(), 0) != static_cast<ssize_t>(message.size()))
+        {
+            perror("send");
+            return 1;
+        }
+        size_t received = 0;
+        while (received < reply.size())
+        {
+            ssize_t n = ::recv(fd, &reply[received], reply.size() - received, 0);
+            if (n <= 0)
+            {
+                perror("recv");
+                return 1;
+            }
+            received += n;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ::close(fd);
+
+    printf("%s, %d-byte messages\n", unixDomain ? "Unix domain socket" : "TCP loopback", size);
+    printf("%d round trips in %.2fs: %.0f round trips/s, mean %.1f us\n",
+           count, elapsed, count / elapsed, elapsed * 1e6 / count);
+
+    // TcpServer要在它的loop线程中析构，等析构完再退出
+    std::promise<void> destroyed;
+    serverLoop->runInLoop([&]() {
+        server.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().wait();
+    return 0;
+}
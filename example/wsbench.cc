@@ -0,0 +1,325 @@
+#include "../WebSocketServer.h"
+#include "../EventLoopThread.h"
+#include "../TcpClient.h"
+#include "../Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * WebSocketServer的压测
+ *
+ * 广播模式(默认)：c个客户端连接握手之后，服务端反复广播s字节的消息，所有客户端都收到一条之后才广播下一条，
+ * 输出每秒广播次数、每秒投递的消息数，以及一次广播从调用到最后一个客户端收到的平均时间
+ * -u：不用broadcast，而是像没有广播支持时那样对每个连接调用一次WebSocketServer::send，
+ *     每个连接各自编码一份帧、各自跨线程投递一次，用来对比共享帧的效果
+ * 回显模式(-e)：每个客户端发一条带掩码的s字节消息，服务端原地去掩码之后原样发回，收到之后再发下一条，
+ *     测的是帧解析和去掩码的路径
+ *
+ * 服务端跑在EventLoopThread里(-t大于0时再加subLoop)，客户端都在主线程的loop中
+ *
+ * 用法：wsbench [-c 连接数] [-s 消息字节数] [-d 秒数] [-t 服务端subLoop数] [-u] [-e] [-p 端口]
+ */
+
+static const char kHandshake[] =
+    "GET /ws HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+// RFC 6455 1.3中这个key对应的应答
+static const char kExpectedAccept[] = "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+struct ClientState
+{
+    ClientState() : upgraded(false) {}
+    bool upgraded;
+};
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+// 客户端发出的帧必须带掩码
+static void sendMaskedFrame(const TcpConnectionPtr &conn, const std::string &payload)
+{
+    Buffer *output = conn->outputBuffer();
+    char header[14];
+    size_t headerLen = 2;
+    header[0] = static_cast<char>(0x80 | WebSocketFrame::kBinary);
+    if (payload.size() < 126)
+    {
+        header[1] = static_cast<char>(0x80 | payload.size());
+    }
+    else
+    {
+        header[1] = static_cast<char>(0x80 | 126);
+        header[2] = static_cast<char>(payload.size() >> 8);
+        header[3] = static_cast<char>(payload.size());
+        headerLen = 4;
+    }
+    const char key[4] = {0x12, 0x34, 0x56, 0x78};
+    memcpy(header + headerLen, key, 4);
+    headerLen += 4;
+    output->append(header, headerLen);
+    std::string masked(payload);
+    WebSocketFrame::unmask(&masked[0], masked.size(), key);
+    output->append(masked.data(), masked.size());
+    conn->sendOutputBuffer();
+}
+
+// 解析服务端发来的一个帧(不带掩码)，不完整时返回false
+static bool takeFrame(Buffer *buf, size_t *payloadLen)
+{
+    if (buf->readableBytes() < 2)
+    {
+        return false;
+    }
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buf->peek());
+    size_t len = p[1] & 0x7F;
+    size_t headerLen = 2;
+    if (len == 126)
+    {
+        if (buf->readableBytes() < 4)
+        {
+            return false;
+        }
+        len = (p[2] << 8) | p[3];
+        headerLen = 4;
+    }
+    else if (len == 127)
+    {
+        if (buf->readableBytes() < 10)
+        {
+            return false;
+        }
+        len = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            len = (len << 8) | p[2 + i];
+        }
+        headerLen = 10;
+    }
+    if (buf->readableBytes() < headerLen + len)
+    {
+        return false;
+    }
+    buf->retrieve(headerLen + len);
+    *payloadLen = len;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = 1000;
+    size_t size = 64;
+    double seconds = 5;
+    int threads = 0;
+    bool unshared = false;
+    bool echo = false;
+    int port = 9995;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:d:t:uep:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            connections = atoi(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'u':
+            unshared = true;
+            break;
+        case 'e':
+            echo = true;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c connections] [-s size] [-d seconds] [-t threads] [-u] [-e] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    InetAddress addr(static_cast<uint16_t>(port));
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<WebSocketServer> server;
+    // -u模式下自己维护的连接列表，服务端各个loop都会修改
+    std::mutex serverConnsMutex;
+    std::vector<TcpConnectionPtr> serverConns;
+    std::promise<void> listening;
+    serverLoop->runInLoop([&]() {
+        server.reset(new WebSocketServer(serverLoop, addr, "wsbench"));
+        server->setThreadNum(threads);
+        server->setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            std::lock_guard<std::mutex> lock(serverConnsMutex);
+            if (conn->connected())
+            {
+                serverConns.push_back(conn);
+            }
+            else
+            {
+                serverConns.erase(std::find(serverConns.begin(), serverConns.end(), conn));
+            }
+        });
+        server->setMessageCallback([](const TcpConnectionPtr &conn, WebSocketFrame::Opcode opcode,
+                                      const StringPiece &message, Timestamp) {
+            WebSocketServer::send(conn, message, opcode);
+        });
+        server->start();
+        listening.set_value();
+    });
+    listening.get_future().wait();
+
+    EventLoop loop;
+    const std::string message(size, 'x');
+    int upgraded = 0;
+    bool measuring = false;
+    int64_t delivered = 0;      // 本轮广播已经收到的客户端数
+    int64_t totalDelivered = 0; // 计时期间收到的消息数
+    int64_t rounds = 0;
+    int64_t roundStartUs = 0;
+    int64_t totalFanoutUs = 0;
+    int64_t errors = 0;
+
+    auto publish = [&]() {
+        roundStartUs = nowUs();
+        delivered = 0;
+        if (!unshared)
+        {
+            server->broadcast(message, WebSocketFrame::kBinary);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(serverConnsMutex);
+        for (const TcpConnectionPtr &conn : serverConns)
+        {
+            WebSocketServer::send(conn, message, WebSocketFrame::kBinary);
+        }
+    };
+
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < connections; ++i)
+    {
+        TcpClient *client = new TcpClient(&loop, addr, "wsbench-client");
+        clients.push_back(std::unique_ptr<TcpClient>(client));
+        client->setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setContext(std::make_shared<ClientState>());
+                conn->send(kHandshake);
+            }
+        });
+        client->setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            ClientState *state = static_cast<ClientState *>(conn->getContext().get());
+            if (!state->upgraded)
+            {
+                const void *headEnd = memmem(buf->peek(), buf->readableBytes(), "\r\n\r\n", 4);
+                if (headEnd == nullptr)
+                {
+                    return;
+                }
+                size_t headLen = static_cast<const char *>(headEnd) - buf->peek() + 4;
+                if (strncmp(buf->peek(), "HTTP/1.1 101", 12) != 0 ||
+                    memmem(buf->peek(), headLen, kExpectedAccept, sizeof kExpectedAccept - 1) == nullptr)
+                {
+                    ++errors;
+                }
+                buf->retrieve(headLen);
+                state->upgraded = true;
+                if (echo)
+                {
+                    sendMaskedFrame(conn, message);
+                }
+                else if (++upgraded == connections)
+                {
+                    publish();
+                }
+            }
+
+            size_t len;
+            while (takeFrame(buf, &len))
+            {
+                if (len != size)
+                {
+                    ++errors;
+                }
+                if (measuring)
+                {
+                    ++totalDelivered;
+                }
+                if (echo)
+                {
+                    sendMaskedFrame(conn, message);
+                }
+                else if (++delivered == connections)
+                {
+                    // 所有客户端都收到了，开始下一次广播
+                    if (measuring)
+                    {
+                        ++rounds;
+                        totalFanoutUs += nowUs() - roundStartUs;
+                    }
+                    publish();
+                }
+            }
+        });
+        client->connect();
+    }
+
+    int64_t startUs = 0;
+    loop.runAfter(1.0, [&]() {
+        measuring = true;
+        startUs = nowUs();
+    });
+    loop.runAfter(1.0 + seconds, [&]() {
+        double elapsed = (nowUs() - startUs) / 1e6;
+        measuring = false;
+        printf("%d connections, %zu-byte messages, server subLoops %d, %s\n", connections, size, threads,
+               echo ? "echo" : (unshared ? "per-connection send" : "shared broadcast frame"));
+        if (echo)
+        {
+            printf("%lld messages in %.2fs: %.0f messages/s, %lld errors\n",
+                   (long long)totalDelivered, elapsed, totalDelivered / elapsed, (long long)errors);
+        }
+        else
+        {
+            printf("%lld broadcasts in %.2fs: %.0f broadcasts/s, %.0f deliveries/s, mean fan-out %.1f us, %lld errors\n",
+                   (long long)rounds, elapsed, rounds / elapsed, totalDelivered / elapsed,
+                   rounds ? static_cast<double>(totalFanoutUs) / rounds : 0.0, (long long)errors);
+        }
+        loop.quit();
+    });
+    loop.loop();
+
+    clients.clear();
+    std::promise<void> destroyed;
+    serverLoop->runInLoop([&]() {
+        server.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().wait();
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "../WebSocketServer.h"
+#include "../Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+/**
+ * WebSocketServer的示例：聊天室
+ *
+ * 连接到ws://127.0.0.1:8001/chat，每条文本消息都广播给所有在线的连接(包括自己)；
+ * 发送 /quit 时服务端以1000关闭这个连接；其它路径的握手请求回复403
+ *
+ * 用法：wschat [-p 端口] [-t 线程数]
+ */
+
+int main(int argc, char *argv[])
+{
+    int port = 8001;
+    int threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-t threads]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    WebSocketServer server(&loop, InetAddress(static_cast<uint16_t>(port), "0.0.0.0"), "wschat");
+    server.setHandshakeCallback([](const TcpConnectionPtr &, const HttpRequest &request) {
+        return request.path() == "/chat";
+    });
+    server.setConnectionCallback([&server](const TcpConnectionPtr &conn) {
+        LOG_INFO("%s %s, %zu online", conn->peerAddress().toIpPort().c_str(),
+                 conn->connected() ? "joined" : "left", server.numConnections());
+    });
+    server.setMessageCallback([&server](const TcpConnectionPtr &conn, WebSocketFrame::Opcode opcode,
+                                        const StringPiece &message, Timestamp) {
+        if (message == "/quit")
+        {
+            server.close(conn, 1000, "bye");
+        }
+        else if (opcode == WebSocketFrame::kText)
+        {
+            server.broadcast(message);
+        }
+    });
+    server.setThreadNum(threads);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,268 @@
+#include "../Logger.h"
+#include "../Timestamp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 二进制日志的离线解码工具
+ * 用法：./logdecoder events.bin > events.log
+ *
+ * 依次读出格式串注册记录和日志记录，按照格式串里的转换符把参数重新格式化，
+ * 输出的文本与Logger文本模式的输出完全一致：[级别]time : msg
+ */
+
+struct Arg {
+    char tag;
+    int64_t i;
+    uint64_t u;
+    double d;
+    std::string s;
+};
+
+class Reader {
+   public:
+    Reader(const char *data, size_t len) : cur_(data), end_(data + len) {}
+
+    bool readable(size_t n) const { return static_cast<size_t>(end_ - cur_) >= n; }
+
+    template <typename T>
+    bool read(T *v) {
+        if (!readable(sizeof *v)) {
+            return false;
+        }
+        memcpy(v, cur_, sizeof *v);
+        cur_ += sizeof *v;
+        return true;
+    }
+
+    bool readBytes(size_t n, std::string *out) {
+        if (!readable(n)) {
+            return false;
+        }
+        out->assign(cur_, n);
+        cur_ += n;
+        return true;
+    }
+
+   private:
+    const char *cur_;
+    const char *end_;
+};
+
+static const char *levelName(int level) {
+    switch (level) {
+        case INFO:
+            return "[INFO]";
+        case ERROR:
+            return "[ERROR]";
+        case FATAL:
+            return "[FATAL]";
+        case DEBUG:
+            return "[DEBUG]";
+        default:
+            return "";
+    }
+}
+
+// 用一个参数格式化一个转换符，spec为去掉长度修饰符之后的"%-08.3"这一部分
+static void formatOne(std::string *out, std::string spec, char conv,
+                      const Arg &arg) {
+    char buf[1024] = {0};
+    if (arg.tag == BinaryLog::kArgString) {
+        spec += 's';
+        snprintf(buf, sizeof buf, spec.c_str(), arg.s.c_str());
+    } else if (arg.tag == BinaryLog::kArgDouble) {
+        spec += strchr("eEfFgGaA", conv) ? conv : 'g';
+        snprintf(buf, sizeof buf, spec.c_str(), arg.d);
+    } else if (arg.tag == BinaryLog::kArgPointer || conv == 'p') {
+        spec += 'p';
+        uint64_t v = arg.tag == BinaryLog::kArgInt ? arg.i : arg.u;
+        snprintf(buf, sizeof buf, spec.c_str(),
+                 reinterpret_cast<void *>(static_cast<uintptr_t>(v)));
+    } else if (conv == 'c') {
+        spec += 'c';
+        snprintf(buf, sizeof buf, spec.c_str(),
+                 static_cast<int>(arg.tag == BinaryLog::kArgInt ? arg.i : arg.u));
+    } else {
+        // 参数在写入时已经被扩展成8字节，这里统一用ll长度修饰符输出
+        spec += "ll";
+        spec += strchr("diouxX", conv) ? conv : 'd';
+        if (conv == 'd' || conv == 'i') {
+            long long v = arg.tag == BinaryLog::kArgInt
+                              ? arg.i
+                              : static_cast<long long>(arg.u);
+            snprintf(buf, sizeof buf, spec.c_str(), v);
+        } else {
+            unsigned long long v = arg.tag == BinaryLog::kArgInt
+                                       ? static_cast<unsigned long long>(arg.i)
+                                       : arg.u;
+            snprintf(buf, sizeof buf, spec.c_str(), v);
+        }
+    }
+    out->append(buf);
+}
+
+// 按printf的规则遍历格式串，每遇到一个转换符就消耗一个参数
+static std::string formatMessage(const std::string &format,
+                                 const std::vector<Arg> &args) {
+    std::string out;
+    size_t next = 0;
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%') {
+            out += format[i];
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%') {
+            out += '%';
+            ++i;
+            continue;
+        }
+
+        std::string spec = "%";
+        size_t j = i + 1;
+        for (; j < format.size(); ++j) {
+            char c = format[j];
+            if (strchr("-+ #0123456789.", c)) {
+                spec += c;
+            } else if (c == '*') {
+                // 宽度或精度由参数给出，调用点写入时它也是一个普通的整数参数
+                if (next < args.size()) {
+                    spec += std::to_string(args[next++].i);
+                }
+            } else if (strchr("hlLqjzt", c)) {
+                // 长度修饰符丢弃，输出时根据参数类型重新决定
+            } else {
+                break;
+            }
+        }
+        if (j >= format.size()) {
+            out += spec;
+            break;
+        }
+
+        char conv = format[j];
+        i = j;
+        if (conv == 'n') {
+            continue;
+        }
+        if (next < args.size()) {
+            formatOne(&out, spec, conv, args[next++]);
+        } else {
+            out += "<missing>";
+        }
+    }
+    return out;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <binary log file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = ::fopen(argv[1], "rb");
+    if (fp == nullptr) {
+        perror("fopen");
+        return 1;
+    }
+    std::string content;
+    char chunk[65536];
+    size_t n;
+    while ((n = ::fread(chunk, 1, sizeof chunk, fp)) > 0) {
+        content.append(chunk, n);
+    }
+    ::fclose(fp);
+
+    if (content.size() < sizeof BinaryLog::kFileMagic ||
+        memcmp(content.data(), BinaryLog::kFileMagic,
+               sizeof BinaryLog::kFileMagic) != 0) {
+        fprintf(stderr, "%s is not a binary log file\n", argv[1]);
+        return 1;
+    }
+
+    Reader reader(content.data() + sizeof BinaryLog::kFileMagic,
+                  content.size() - sizeof BinaryLog::kFileMagic);
+    std::unordered_map<uint32_t, std::string> formats;
+    char type;
+    while (reader.read(&type)) {
+        if (type == BinaryLog::kFormatRecord) {
+            uint32_t id;
+            uint16_t len;
+            std::string format;
+            if (!reader.read(&id) || !reader.read(&len) ||
+                !reader.readBytes(len, &format)) {
+                break;
+            }
+            formats[id] = format;
+        } else if (type == BinaryLog::kLogRecord) {
+            uint16_t bodyLen;
+            std::string body;
+            if (!reader.read(&bodyLen) || !reader.readBytes(bodyLen, &body)) {
+                break;
+            }
+
+            Reader record(body.data(), body.size());
+            uint8_t level;
+            int64_t micros;
+            uint32_t id;
+            uint8_t argCount;
+            if (!record.read(&level) || !record.read(&micros) ||
+                !record.read(&id) || !record.read(&argCount)) {
+                continue;
+            }
+
+            std::vector<Arg> args;
+            for (int k = 0; k < argCount; ++k) {
+                Arg arg;
+                arg.i = 0;
+                arg.u = 0;
+                arg.d = 0;
+                if (!record.read(&arg.tag)) {
+                    break;
+                }
+                bool ok = true;
+                switch (arg.tag) {
+                    case BinaryLog::kArgInt:
+                        ok = record.read(&arg.i);
+                        break;
+                    case BinaryLog::kArgUint:
+                    case BinaryLog::kArgPointer:
+                        ok = record.read(&arg.u);
+                        break;
+                    case BinaryLog::kArgDouble:
+                        ok = record.read(&arg.d);
+                        break;
+                    case BinaryLog::kArgString: {
+                        uint16_t len;
+                        ok = record.read(&len) && record.readBytes(len, &arg.s);
+                        break;
+                    }
+                    default:
+                        ok = false;
+                        break;
+                }
+                if (!ok) {
+                    break;
+                }
+                args.push_back(arg);
+            }
+
+            auto it = formats.find(id);
+            std::string msg = it != formats.end()
+                                  ? formatMessage(it->second, args)
+                                  : "<unknown format " + std::to_string(id) + ">";
+            std::cout << levelName(level) << Timestamp(micros).toString()
+                      << " : " << msg << std::endl;
+        } else {
+            fprintf(stderr, "corrupted record type %d\n", type);
+            return 1;
+        }
+    }
+    return 0;
+}